@@ -2,28 +2,50 @@
 
 #include <DirectXMath.h>
 #include "Lights.h"
+#include "IBLBaker.h"
 //  DirectX::XMFLOAT4
 
+// --------------------------------------------------------
+// Constant buffers, split by how often they change:
+//  - b0: once per frame (camera, time, light cluster info)
+//  - b1: once per material edit (lives in the material)
+//  - b2: once per object (transforms only)
+// --------------------------------------------------------
 
-struct  VertexShaderData
+struct PerFrameData
 {
-	DirectX::XMFLOAT4X4 world;
 	DirectX::XMFLOAT4X4 view;
 	DirectX::XMFLOAT4X4 projection;
-	DirectX::XMFLOAT4X4 worldInvTranspose;
-
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMFLOAT3 cameraPosition;
+	float time;
+	DirectX::XMFLOAT3 ambientLight;
+	unsigned int directionalLightCount;
+	DirectX::XMFLOAT2 screenSize;
+	float clusterSliceScale; // See LightClusters
+	float clusterSliceBias;
+	DirectX::XMFLOAT4 irradianceSH[IBL_SH_COEFFICIENT_COUNT]; // See IBLBaker
+	float environmentMipCount; // 0 until the bake is ready
+	DirectX::XMFLOAT3 padding;
 };
 
-struct PixelShaderData
+struct PerMaterialData
 {
 	DirectX::XMFLOAT4 colorTint;
 	DirectX::XMFLOAT2 uvOffset;
 	DirectX::XMFLOAT2 uvScale;
-	DirectX::XMFLOAT3 currCamPos;
 	float roughness;
-	DirectX::XMFLOAT3 ambientLight;
-	float time;
-	Light lights[5];
+	unsigned int surfaceSlice; // Texture array slices, see TextureArrays
+	unsigned int normalSlice;
+	float padding;
+	DirectX::XMFLOAT4 surfaceRect; // Each texture's part of its slice (UV offset, scale)
+	DirectX::XMFLOAT4 normalRect;
+};
 
-	
+struct PerObjectData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	unsigned int drawID; // Index into per-object tables, e.g. light lists
+	DirectX::XMFLOAT3 padding;
 };
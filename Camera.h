@@ -33,6 +33,8 @@ public:
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
 	Transform& GetTransform() { return this->transform; };
 	float GetFov() { return this->fovAngle; };
+	float GetNearClip() { return this->nearZ; };
+	float GetFarClip() { return this->farZ; };
 	const char* GetProjectionType();
 
 	void UpdateProjectionMatrix(float aspectRatio);
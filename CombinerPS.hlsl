@@ -6,12 +6,12 @@ Texture2D SurfaceTexture : register(t0); // "t" registers for textures
 Texture2D OverlayTexture : register(t1); // "t" registers for textures
 SamplerState BasicSampler : register(s0); // "s" registers for samplers
 
-cbuffer ExternalData : register(b0)
+cbuffer PerMaterial : register(b1)
 {
     float4 colorTint;
     float2 uvOffset;
     float2 uvScale;
-
+    float roughness;
 }
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
@@ -0,0 +1,224 @@
+#include "CommandBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Every command starts on an 8-byte boundary so the
+	// pointers inside the payloads stay naturally aligned
+	constexpr unsigned int CommandAlignment = 8;
+
+	constexpr unsigned int AlignedSize(unsigned int size)
+	{
+		return (size + CommandAlignment - 1) / CommandAlignment * CommandAlignment;
+	}
+
+	constexpr unsigned int HeaderSize = AlignedSize(sizeof(CommandHeader));
+}
+
+CommandBuffer::CommandBuffer()
+{
+	this->commandCount = 0;
+}
+
+void CommandBuffer::Reset()
+{
+	this->bytes.clear();
+	this->commandCount = 0;
+}
+
+void* CommandBuffer::Push(CommandType type, unsigned int payloadSizeInBytes)
+{
+	unsigned int commandSize = HeaderSize + AlignedSize(payloadSizeInBytes);
+	size_t offset = this->bytes.size();
+	this->bytes.resize(offset + commandSize);
+
+	CommandHeader* header = reinterpret_cast<CommandHeader*>(&this->bytes[offset]);
+	header->type = type;
+	memset(header->padding, 0, sizeof(header->padding));
+	header->sizeInBytes = commandSize;
+
+	this->commandCount++;
+	return &this->bytes[offset + HeaderSize];
+}
+
+void CommandBuffer::SetShaders(const void* vertexShader, const void* pixelShader)
+{
+	SetShadersCommand* command = static_cast<SetShadersCommand*>(Push(CommandType::SetShaders, sizeof(SetShadersCommand)));
+	command->vertexShader = vertexShader;
+	command->pixelShader = pixelShader;
+}
+
+void CommandBuffer::SetMesh(const void* vertexBuffer, const void* indexBuffer, unsigned int vertexStride)
+{
+	SetMeshCommand* command = static_cast<SetMeshCommand*>(Push(CommandType::SetMesh, sizeof(SetMeshCommand)));
+	command->vertexBuffer = vertexBuffer;
+	command->indexBuffer = indexBuffer;
+	command->vertexStride = vertexStride;
+}
+
+void CommandBuffer::BindTextures(ShaderStage stage, unsigned int startSlot, unsigned int count, const void* const* views)
+{
+	count = std::min(count, (unsigned int)MAX_COMMAND_BIND_COUNT);
+	BindRangeCommand* command = static_cast<BindRangeCommand*>(Push(CommandType::BindTextures, sizeof(BindRangeCommand)));
+	command->stage = stage;
+	command->startSlot = (uint8_t)startSlot;
+	command->count = (uint8_t)count;
+	memcpy(command->objects, views, sizeof(void*) * count);
+}
+
+void CommandBuffer::BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const void* const* samplers)
+{
+	count = std::min(count, (unsigned int)MAX_COMMAND_BIND_COUNT);
+	BindRangeCommand* command = static_cast<BindRangeCommand*>(Push(CommandType::BindSamplers, sizeof(BindRangeCommand)));
+	command->stage = stage;
+	command->startSlot = (uint8_t)startSlot;
+	command->count = (uint8_t)count;
+	memcpy(command->objects, samplers, sizeof(void*) * count);
+}
+
+void CommandBuffer::BindConstantRange(ShaderStage stage, unsigned int registerSlot, unsigned int firstConstant, unsigned int numConstants)
+{
+	BindConstantRangeCommand* command = static_cast<BindConstantRangeCommand*>(Push(CommandType::BindConstantRange, sizeof(BindConstantRangeCommand)));
+	command->stage = stage;
+	command->registerSlot = (uint8_t)registerSlot;
+	command->firstConstant = firstConstant;
+	command->numConstants = numConstants;
+}
+
+void CommandBuffer::BindConstantBuffer(ShaderStage stage, unsigned int registerSlot, const void* buffer)
+{
+	BindConstantBufferCommand* command = static_cast<BindConstantBufferCommand*>(Push(CommandType::BindConstantBuffer, sizeof(BindConstantBufferCommand)));
+	command->stage = stage;
+	command->registerSlot = (uint8_t)registerSlot;
+	command->buffer = buffer;
+}
+
+void CommandBuffer::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	DrawIndexedCommand* command = static_cast<DrawIndexedCommand*>(Push(CommandType::DrawIndexed, sizeof(DrawIndexedCommand)));
+	command->indexCount = indexCount;
+	command->startIndex = startIndex;
+	command->baseVertex = baseVertex;
+}
+
+void CommandBuffer::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	DrawIndexedInstancedCommand* command = static_cast<DrawIndexedInstancedCommand*>(Push(CommandType::DrawIndexedInstanced, sizeof(DrawIndexedInstancedCommand)));
+	command->indexCount = indexCount;
+	command->instanceCount = instanceCount;
+	command->startIndex = startIndex;
+	command->baseVertex = baseVertex;
+	command->startInstance = startInstance;
+}
+
+void CommandBuffer::SetRenderTargets(unsigned int count, const void* const* renderTargets, const void* depthStencil)
+{
+	count = std::min(count, (unsigned int)MAX_COMMAND_RENDER_TARGETS);
+	SetRenderTargetsCommand* command = static_cast<SetRenderTargetsCommand*>(Push(CommandType::SetRenderTargets, sizeof(SetRenderTargetsCommand)));
+	command->count = (uint8_t)count;
+	memcpy(command->renderTargets, renderTargets, sizeof(void*) * count);
+	command->depthStencil = depthStencil;
+}
+
+void CommandBuffer::SetRenderState(const void* depthStencilState, const void* blendState, const void* rasterizerState, unsigned int stencilRef)
+{
+	SetRenderStateCommand* command = static_cast<SetRenderStateCommand*>(Push(CommandType::SetRenderState, sizeof(SetRenderStateCommand)));
+	command->depthStencilState = depthStencilState;
+	command->blendState = blendState;
+	command->rasterizerState = rasterizerState;
+	command->stencilRef = stencilRef;
+}
+
+void CommandBuffer::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	DrawCommand* command = static_cast<DrawCommand*>(Push(CommandType::Draw, sizeof(DrawCommand)));
+	command->vertexCount = vertexCount;
+	command->startVertex = startVertex;
+}
+
+unsigned int CommandBuffer::GetCommandCount() const
+{
+	return this->commandCount;
+}
+
+size_t CommandBuffer::GetSizeInBytes() const
+{
+	return this->bytes.size();
+}
+
+// --------------------------------------------------------
+// Single-threaded replay loop.  The switch is the only
+// per-command dispatch cost on top of the backend itself.
+// --------------------------------------------------------
+void CommandBuffer::Replay(CommandBackend& backend) const
+{
+	const uint8_t* current = this->bytes.data();
+	const uint8_t* end = current + this->bytes.size();
+
+	while (current < end)
+	{
+		const CommandHeader* header = reinterpret_cast<const CommandHeader*>(current);
+		const void* payload = current + HeaderSize;
+
+		switch (header->type)
+		{
+		case CommandType::SetShaders:
+			backend.SetShaders(*static_cast<const SetShadersCommand*>(payload));
+			break;
+		case CommandType::SetMesh:
+			backend.SetMesh(*static_cast<const SetMeshCommand*>(payload));
+			break;
+		case CommandType::BindTextures:
+			backend.BindTextures(*static_cast<const BindRangeCommand*>(payload));
+			break;
+		case CommandType::BindSamplers:
+			backend.BindSamplers(*static_cast<const BindRangeCommand*>(payload));
+			break;
+		case CommandType::BindConstantRange:
+			backend.BindConstantRange(*static_cast<const BindConstantRangeCommand*>(payload));
+			break;
+		case CommandType::BindConstantBuffer:
+			backend.BindConstantBuffer(*static_cast<const BindConstantBufferCommand*>(payload));
+			break;
+		case CommandType::DrawIndexed:
+			backend.DrawIndexed(*static_cast<const DrawIndexedCommand*>(payload));
+			break;
+		case CommandType::DrawIndexedInstanced:
+			backend.DrawIndexedInstanced(*static_cast<const DrawIndexedInstancedCommand*>(payload));
+			break;
+		case CommandType::SetRenderTargets:
+			backend.SetRenderTargets(*static_cast<const SetRenderTargetsCommand*>(payload));
+			break;
+		case CommandType::SetRenderState:
+			backend.SetRenderState(*static_cast<const SetRenderStateCommand*>(payload));
+			break;
+		case CommandType::Draw:
+			backend.Draw(*static_cast<const DrawCommand*>(payload));
+			break;
+		}
+
+		current += header->sizeInBytes;
+	}
+}
+
+
+// --- Null backend ---
+
+void NullCommandBackend::Reset()
+{
+	*this = NullCommandBackend();
+}
+
+void NullCommandBackend::SetShaders(const SetShadersCommand&) { shaderChanges++; }
+void NullCommandBackend::SetMesh(const SetMeshCommand&) { meshChanges++; }
+void NullCommandBackend::BindTextures(const BindRangeCommand&) { textureBinds++; }
+void NullCommandBackend::BindSamplers(const BindRangeCommand&) { samplerBinds++; }
+void NullCommandBackend::BindConstantRange(const BindConstantRangeCommand&) { constantBinds++; }
+void NullCommandBackend::BindConstantBuffer(const BindConstantBufferCommand&) { constantBinds++; }
+void NullCommandBackend::DrawIndexed(const DrawIndexedCommand&) { drawCalls++; }
+void NullCommandBackend::DrawIndexedInstanced(const DrawIndexedInstancedCommand&) { drawCalls++; }
+void NullCommandBackend::SetRenderTargets(const SetRenderTargetsCommand&) { renderTargetChanges++; }
+void NullCommandBackend::SetRenderState(const SetRenderStateCommand&) { stateChanges++; }
+void NullCommandBackend::Draw(const DrawCommand&) { drawCalls++; }
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// A compact, API-agnostic list of rendering commands.
+//
+// Commands are packed back to back into a byte array, each
+// one starting with a small header.  API objects (shaders,
+// buffers, views, samplers) are stored as opaque pointers,
+// so recording needs no graphics headers and can happen on
+// any thread.  A CommandBackend turns the list into real
+// API calls when it is replayed.
+// --------------------------------------------------------
+
+// Which shader stage a binding is destined for
+enum class ShaderStage : uint8_t
+{
+	Vertex,
+	Pixel
+};
+
+enum class CommandType : uint8_t
+{
+	SetShaders,
+	SetMesh,
+	BindTextures,
+	BindSamplers,
+	BindConstantRange,
+	BindConstantBuffer,
+	DrawIndexed,
+	DrawIndexedInstanced,
+	SetRenderTargets,
+	SetRenderState,
+	Draw
+};
+
+// Largest number of views or samplers a single bind command can carry
+#define MAX_COMMAND_BIND_COUNT 16
+
+// Largest number of simultaneous render targets
+#define MAX_COMMAND_RENDER_TARGETS 8
+
+struct CommandHeader
+{
+	CommandType type;
+	uint8_t padding[3];
+	uint32_t sizeInBytes; // Header + payload, rounded up to 8 bytes
+};
+
+struct SetShadersCommand
+{
+	const void* vertexShader;
+	const void* pixelShader;
+};
+
+struct SetMeshCommand
+{
+	const void* vertexBuffer;
+	const void* indexBuffer;
+	uint32_t vertexStride;
+};
+
+// Used for both textures and samplers
+struct BindRangeCommand
+{
+	ShaderStage stage;
+	uint8_t startSlot;
+	uint8_t count;
+	const void* objects[MAX_COMMAND_BIND_COUNT];
+};
+
+// Binds constants that were already written to GPU memory,
+// given as an offset and size in 16-byte constants
+struct BindConstantRangeCommand
+{
+	ShaderStage stage;
+	uint8_t registerSlot;
+	uint32_t firstConstant;
+	uint32_t numConstants;
+};
+
+// Binds an entire, separately owned constant buffer
+struct BindConstantBufferCommand
+{
+	ShaderStage stage;
+	uint8_t registerSlot;
+	const void* buffer;
+};
+
+struct DrawIndexedCommand
+{
+	uint32_t indexCount;
+	uint32_t startIndex;
+	int32_t baseVertex;
+};
+
+// The start instance doubles as a draw ID for shaders
+// that fetch their data from a DrawTable
+struct DrawIndexedInstancedCommand
+{
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t startIndex;
+	int32_t baseVertex;
+	uint32_t startInstance;
+};
+
+// Render targets plus an optional depth-stencil view
+struct SetRenderTargetsCommand
+{
+	uint8_t count;
+	const void* renderTargets[MAX_COMMAND_RENDER_TARGETS];
+	const void* depthStencil;
+};
+
+// Fixed-function state; null objects mean the API's defaults
+struct SetRenderStateCommand
+{
+	const void* depthStencilState;
+	const void* blendState;
+	const void* rasterizerState;
+	uint32_t stencilRef;
+};
+
+// Non-indexed draw, e.g. a full screen triangle
+// generated entirely in the vertex shader
+struct DrawCommand
+{
+	uint32_t vertexCount;
+	uint32_t startVertex;
+};
+
+
+// --------------------------------------------------------
+// Receives replayed commands.  One implementation per API,
+// plus a null one that only counts calls.
+//
+// Replay happens on the render thread.  Replaying into D3D11
+// deferred contexts on the workers is out of scope: the D3D11
+// backend binds constants through Graphics' ring on the
+// immediate context, and recording these buffers in parallel
+// already takes the per-draw work off the render thread.
+// --------------------------------------------------------
+class CommandBackend
+{
+public:
+	virtual ~CommandBackend() = default;
+
+	virtual void SetShaders(const SetShadersCommand& command) = 0;
+	virtual void SetMesh(const SetMeshCommand& command) = 0;
+	virtual void BindTextures(const BindRangeCommand& command) = 0;
+	virtual void BindSamplers(const BindRangeCommand& command) = 0;
+	virtual void BindConstantRange(const BindConstantRangeCommand& command) = 0;
+	virtual void BindConstantBuffer(const BindConstantBufferCommand& command) = 0;
+	virtual void DrawIndexed(const DrawIndexedCommand& command) = 0;
+	virtual void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) = 0;
+	virtual void SetRenderTargets(const SetRenderTargetsCommand& command) = 0;
+	virtual void SetRenderState(const SetRenderStateCommand& command) = 0;
+	virtual void Draw(const DrawCommand& command) = 0;
+};
+
+
+class CommandBuffer
+{
+private:
+	std::vector<uint8_t> bytes;
+	unsigned int commandCount;
+
+	// Reserves space for one command and returns its payload
+	void* Push(CommandType type, unsigned int payloadSizeInBytes);
+
+public:
+	CommandBuffer();
+
+	// Empties the buffer but keeps its memory for the next frame
+	void Reset();
+
+	// Recording
+	void SetShaders(const void* vertexShader, const void* pixelShader);
+	void SetMesh(const void* vertexBuffer, const void* indexBuffer, unsigned int vertexStride);
+	void BindTextures(ShaderStage stage, unsigned int startSlot, unsigned int count, const void* const* views);
+	void BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const void* const* samplers);
+	void BindConstantRange(ShaderStage stage, unsigned int registerSlot, unsigned int firstConstant, unsigned int numConstants);
+	void BindConstantBuffer(ShaderStage stage, unsigned int registerSlot, const void* buffer);
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+	void SetRenderTargets(unsigned int count, const void* const* renderTargets, const void* depthStencil);
+	void SetRenderState(const void* depthStencilState, const void* blendState, const void* rasterizerState, unsigned int stencilRef = 0);
+	void Draw(unsigned int vertexCount, unsigned int startVertex);
+
+	// Getters
+	unsigned int GetCommandCount() const;
+	size_t GetSizeInBytes() const;
+
+	// Walks the commands in order and hands each one to the backend
+	void Replay(CommandBackend& backend) const;
+};
+
+
+// --------------------------------------------------------
+// Backend that issues no API calls, only counts them.  Used
+// to measure recording and replay cost without a GPU.
+// --------------------------------------------------------
+class NullCommandBackend : public CommandBackend
+{
+public:
+	unsigned int shaderChanges = 0;
+	unsigned int meshChanges = 0;
+	unsigned int textureBinds = 0;
+	unsigned int samplerBinds = 0;
+	unsigned int constantBinds = 0;
+	unsigned int drawCalls = 0;
+	unsigned int renderTargetChanges = 0;
+	unsigned int stateChanges = 0;
+
+	void Reset();
+
+	void SetShaders(const SetShadersCommand& command) override;
+	void SetMesh(const SetMeshCommand& command) override;
+	void BindTextures(const BindRangeCommand& command) override;
+	void BindSamplers(const BindRangeCommand& command) override;
+	void BindConstantRange(const BindConstantRangeCommand& command) override;
+	void BindConstantBuffer(const BindConstantBufferCommand& command) override;
+	void DrawIndexed(const DrawIndexedCommand& command) override;
+	void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override;
+	void SetRenderTargets(const SetRenderTargetsCommand& command) override;
+	void SetRenderState(const SetRenderStateCommand& command) override;
+	void Draw(const DrawCommand& command) override;
+};
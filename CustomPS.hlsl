@@ -1,13 +1,21 @@
 #include "ShaderInclude.hlsli"
 
 
-cbuffer ExternalData : register(b0)
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+    float3 cameraPosition;
+    float TotalTime; // TIme in seconds
+}
+
+cbuffer PerMaterial : register(b1)
 {
     float4 colorTint;
     float2 uvOffset;
     float2 uvScale;
-    float TotalTime; // TIme in seconds
-
+    float roughness;
 }
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
@@ -0,0 +1,95 @@
+#include "D3D11CommandBackend.h"
+#include "Graphics.h"
+
+D3D11CommandBackend::D3D11CommandBackend(ID3D11DeviceContext* context)
+{
+	this->context = context;
+}
+
+void D3D11CommandBackend::SetShaders(const SetShadersCommand& command)
+{
+	context->VSSetShader((ID3D11VertexShader*)command.vertexShader, 0, 0);
+	context->PSSetShader((ID3D11PixelShader*)command.pixelShader, 0, 0);
+}
+
+void D3D11CommandBackend::SetMesh(const SetMeshCommand& command)
+{
+	ID3D11Buffer* vertexBuffer = (ID3D11Buffer*)command.vertexBuffer;
+	UINT stride = command.vertexStride;
+	UINT offset = 0;
+
+	context->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	context->IASetIndexBuffer((ID3D11Buffer*)command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+}
+
+void D3D11CommandBackend::BindTextures(const BindRangeCommand& command)
+{
+	ID3D11ShaderResourceView* const* views = (ID3D11ShaderResourceView* const*)command.objects;
+
+	switch (command.stage)
+	{
+	case ShaderStage::Vertex: context->VSSetShaderResources(command.startSlot, command.count, views); break;
+	case ShaderStage::Pixel: context->PSSetShaderResources(command.startSlot, command.count, views); break;
+	}
+}
+
+void D3D11CommandBackend::BindSamplers(const BindRangeCommand& command)
+{
+	ID3D11SamplerState* const* samplers = (ID3D11SamplerState* const*)command.objects;
+
+	switch (command.stage)
+	{
+	case ShaderStage::Vertex: context->VSSetSamplers(command.startSlot, command.count, samplers); break;
+	case ShaderStage::Pixel: context->PSSetSamplers(command.startSlot, command.count, samplers); break;
+	}
+}
+
+void D3D11CommandBackend::BindConstantRange(const BindConstantRangeCommand& command)
+{
+	Graphics::BindConstantBufferRange(
+		command.stage == ShaderStage::Vertex ? D3D11_VERTEX_SHADER : D3D11_PIXEL_SHADER,
+		command.registerSlot,
+		command.firstConstant,
+		command.numConstants);
+}
+
+void D3D11CommandBackend::BindConstantBuffer(const BindConstantBufferCommand& command)
+{
+	ID3D11Buffer* buffer = (ID3D11Buffer*)command.buffer;
+
+	switch (command.stage)
+	{
+	case ShaderStage::Vertex: context->VSSetConstantBuffers(command.registerSlot, 1, &buffer); break;
+	case ShaderStage::Pixel: context->PSSetConstantBuffers(command.registerSlot, 1, &buffer); break;
+	}
+}
+
+void D3D11CommandBackend::DrawIndexed(const DrawIndexedCommand& command)
+{
+	context->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+}
+
+void D3D11CommandBackend::DrawIndexedInstanced(const DrawIndexedInstancedCommand& command)
+{
+	context->DrawIndexedInstanced(command.indexCount, command.instanceCount, command.startIndex, command.baseVertex, command.startInstance);
+}
+
+void D3D11CommandBackend::SetRenderTargets(const SetRenderTargetsCommand& command)
+{
+	context->OMSetRenderTargets(
+		command.count,
+		(ID3D11RenderTargetView* const*)command.renderTargets,
+		(ID3D11DepthStencilView*)command.depthStencil);
+}
+
+void D3D11CommandBackend::SetRenderState(const SetRenderStateCommand& command)
+{
+	context->OMSetDepthStencilState((ID3D11DepthStencilState*)command.depthStencilState, command.stencilRef);
+	context->OMSetBlendState((ID3D11BlendState*)command.blendState, 0, 0xFFFFFFFF);
+	context->RSSetState((ID3D11RasterizerState*)command.rasterizerState);
+}
+
+void D3D11CommandBackend::Draw(const DrawCommand& command)
+{
+	context->Draw(command.vertexCount, command.startVertex);
+}
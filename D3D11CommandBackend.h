@@ -0,0 +1,30 @@
+#pragma once
+
+#include <d3d11.h>
+#include "CommandBuffer.h"
+
+// --------------------------------------------------------
+// Translates replayed commands into D3D11 calls on the
+// immediate context.  Constant ranges are bound from the
+// ring constant buffer in Graphics.
+// --------------------------------------------------------
+class D3D11CommandBackend : public CommandBackend
+{
+private:
+	ID3D11DeviceContext* context;
+
+public:
+	D3D11CommandBackend(ID3D11DeviceContext* context);
+
+	void SetShaders(const SetShadersCommand& command) override;
+	void SetMesh(const SetMeshCommand& command) override;
+	void BindTextures(const BindRangeCommand& command) override;
+	void BindSamplers(const BindRangeCommand& command) override;
+	void BindConstantRange(const BindConstantRangeCommand& command) override;
+	void BindConstantBuffer(const BindConstantBufferCommand& command) override;
+	void DrawIndexed(const DrawIndexedCommand& command) override;
+	void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override;
+	void SetRenderTargets(const SetRenderTargetsCommand& command) override;
+	void SetRenderState(const SetRenderStateCommand& command) override;
+	void Draw(const DrawCommand& command) override;
+};
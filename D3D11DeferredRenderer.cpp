@@ -0,0 +1,134 @@
+#include "D3D11DeferredRenderer.h"
+#include "Graphics.h"
+#include "StateCache.h"
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+D3D11DeferredRenderer::D3D11DeferredRenderer(
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> fullscreenVS,
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> ambientPS,
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> volumeVS,
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> volumePS,
+	std::shared_ptr<Mesh> volumeMesh) :
+	fullscreenVS(fullscreenVS),
+	ambientPS(ambientPS),
+	volumeVS(volumeVS),
+	volumePS(volumePS),
+	volumeMesh(volumeMesh),
+	volumes(sizeof(LightVolume))
+{
+	CreateStates();
+}
+
+void D3D11DeferredRenderer::CreateStates()
+{
+	// Marking: no depth writes, and count the volume's back faces
+	// that end up behind the scene minus its front faces that do.
+	// Pixels left non-zero have their surface inside the volume.
+	D3D11_DEPTH_STENCIL_DESC markDesc = {};
+	markDesc.DepthEnable = true;
+	markDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	markDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	markDesc.StencilEnable = true;
+	markDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	markDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+	markDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	markDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	markDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_DECR;
+	markDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	markDesc.BackFace = markDesc.FrontFace;
+	markDesc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_INCR;
+	this->stencilMarkDepthState = StateCache::GetDepthStencilState(markDesc);
+
+	// Lighting: back faces only, no depth test (the stencil already
+	// did it), and zero each pixel's stencil once it's lit
+	D3D11_DEPTH_STENCIL_DESC testDesc = {};
+	testDesc.DepthEnable = false;
+	testDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	testDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	testDesc.StencilEnable = true;
+	testDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	testDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+	testDesc.FrontFace.StencilFunc = D3D11_COMPARISON_NOT_EQUAL;
+	testDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	testDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+	testDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_ZERO;
+	testDesc.BackFace = testDesc.FrontFace;
+	this->stencilTestDepthState = StateCache::GetDepthStencilState(testDesc);
+
+	// Camera inside: back faces behind the scene's surface light it,
+	// with no stencil at all
+	D3D11_DEPTH_STENCIL_DESC insideDesc = {};
+	insideDesc.DepthEnable = true;
+	insideDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	insideDesc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+	insideDesc.StencilEnable = false;
+	this->insideVolumeDepthState = StateCache::GetDepthStencilState(insideDesc);
+
+	D3D11_BLEND_DESC noColorDesc = {};
+	noColorDesc.RenderTarget[0].BlendEnable = false;
+	noColorDesc.RenderTarget[0].RenderTargetWriteMask = 0;
+	this->noColorBlendState = StateCache::GetBlendState(noColorDesc);
+
+	D3D11_BLEND_DESC additiveDesc = {};
+	additiveDesc.RenderTarget[0].BlendEnable = true;
+	additiveDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	additiveDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+	additiveDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	additiveDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	additiveDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+	additiveDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	additiveDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	this->additiveBlendState = StateCache::GetBlendState(additiveDesc);
+
+	D3D11_RASTERIZER_DESC rasterDesc = {};
+	rasterDesc.FillMode = D3D11_FILL_SOLID;
+	rasterDesc.CullMode = D3D11_CULL_NONE;
+	rasterDesc.DepthClipEnable = true;
+	this->cullNoneRasterizerState = StateCache::GetRasterizerState(rasterDesc);
+
+	// Back faces still show when the camera is inside the volume
+	rasterDesc.CullMode = D3D11_CULL_FRONT;
+	this->cullFrontRasterizerState = StateCache::GetRasterizerState(rasterDesc);
+}
+
+void D3D11DeferredRenderer::Upload(const LightVolumes& lightVolumes)
+{
+	this->volumes.Upload(lightVolumes.GetVolumes(), lightVolumes.GetVolumeCount());
+}
+
+void D3D11DeferredRenderer::Bind()
+{
+	Graphics::Context->VSSetShaderResources(LIGHT_VOLUME_SLOT, 1, this->volumes.GetSRV().GetAddressOf());
+}
+
+DeferredPassResources D3D11DeferredRenderer::GetResources()
+{
+	DeferredPassResources resources = {};
+	resources.fullscreenVS = this->fullscreenVS.Get();
+	resources.ambientPS = this->ambientPS.Get();
+
+	resources.volumeVS = this->volumeVS.Get();
+	resources.volumePS = this->volumePS.Get();
+	resources.volumeVertexBuffer = this->volumeMesh->GetPositionBuffer().Get();
+	resources.volumeIndexBuffer = this->volumeMesh->GetIndexBuffer().Get();
+	resources.volumeVertexStride = sizeof(XMFLOAT3);
+	resources.volumeIndexCount = this->volumeMesh->GetIndexCount();
+
+	resources.stencilMarkDepthState = this->stencilMarkDepthState.Get();
+	resources.stencilTestDepthState = this->stencilTestDepthState.Get();
+	resources.insideVolumeDepthState = this->insideVolumeDepthState.Get();
+	resources.noColorBlendState = this->noColorBlendState.Get();
+	resources.additiveBlendState = this->additiveBlendState.Get();
+	resources.cullNoneRasterizerState = this->cullNoneRasterizerState.Get();
+	resources.cullFrontRasterizerState = this->cullFrontRasterizerState.Get();
+	return resources;
+}
+
+float D3D11DeferredRenderer::GetVolumeMeshRadius()
+{
+	// The sphere model is centered on its origin, so this is its radius
+	return this->volumeMesh->GetBoundsRadius();
+}
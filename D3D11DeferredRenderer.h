@@ -0,0 +1,59 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include "DeferredPasses.h"
+#include "LightVolumes.h"
+#include "Mesh.h"
+#include "StructuredBuffer.h"
+
+// --------------------------------------------------------
+// GPU side of the deferred path: the stencil/blend/raster
+// states the lighting pass switches between, its shaders and
+// the buffer of light volumes.  The G-buffer itself is made
+// of transient render graph textures.
+//
+// Recording happens in DeferredPasses; this only owns what
+// those commands point at.
+// --------------------------------------------------------
+class D3D11DeferredRenderer
+{
+private:
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> stencilMarkDepthState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> stencilTestDepthState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> insideVolumeDepthState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> noColorBlendState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> additiveBlendState;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> cullNoneRasterizerState;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> cullFrontRasterizerState;
+
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> fullscreenVS;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> ambientPS;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> volumeVS;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> volumePS;
+	std::shared_ptr<Mesh> volumeMesh;
+
+	StructuredBuffer volumes;
+
+	void CreateStates();
+
+public:
+	D3D11DeferredRenderer(
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> fullscreenVS,
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> ambientPS,
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> volumeVS,
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> volumePS,
+		std::shared_ptr<Mesh> volumeMesh);
+
+	// Copies the volumes to the GPU and binds them to VS t1
+	void Upload(const LightVolumes& lightVolumes);
+	void Bind();
+
+	// Everything the passes point at except the G-buffer and the
+	// render targets, which come from the render graph
+	DeferredPassResources GetResources();
+
+	// Getters
+	float GetVolumeMeshRadius();
+};
@@ -0,0 +1,62 @@
+#include "D3D11DrawTable.h"
+#include "Graphics.h"
+
+#include <vector>
+
+D3D11DrawTable::D3D11DrawTable() :
+	objects(sizeof(DrawTableObject)),
+	materials(sizeof(PerMaterialData))
+{
+	CreateDrawIDBuffer(this->objects.GetCapacity());
+}
+
+void D3D11DrawTable::CreateDrawIDBuffer(unsigned int count)
+{
+	// Never changes after creation - it's just 0 to count-1
+	std::vector<unsigned int> ids(count);
+	for (unsigned int i = 0; i < count; i++)
+		ids[i] = i;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(unsigned int) * count;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = ids.data();
+
+	this->drawIDBuffer.Reset();
+	Graphics::Device->CreateBuffer(&desc, &initialData, this->drawIDBuffer.GetAddressOf());
+	this->drawIDCapacity = count;
+}
+
+void D3D11DrawTable::Upload(const DrawTable& table)
+{
+	this->objects.Upload(table.GetObjects(), table.GetObjectCount());
+	this->materials.Upload(table.GetMaterials(), table.GetMaterialCount());
+
+	// Keep the draw ID stream as long as the object table
+	if (this->objects.GetCapacity() > this->drawIDCapacity)
+		CreateDrawIDBuffer(this->objects.GetCapacity());
+}
+
+void D3D11DrawTable::ReserveDrawIDs(unsigned int count)
+{
+	if (count <= this->drawIDCapacity)
+		return;
+
+	unsigned int capacity = this->drawIDCapacity;
+	while (capacity < count)
+		capacity *= 2;
+	CreateDrawIDBuffer(capacity);
+}
+
+void D3D11DrawTable::Bind()
+{
+	Graphics::Context->VSSetShaderResources(DRAW_TABLE_OBJECT_SLOT, 1, this->objects.GetSRV().GetAddressOf());
+	Graphics::Context->PSSetShaderResources(DRAW_TABLE_MATERIAL_SLOT, 1, this->materials.GetSRV().GetAddressOf());
+
+	UINT stride = sizeof(unsigned int);
+	UINT offset = 0;
+	Graphics::Context->IASetVertexBuffers(DRAW_TABLE_DRAW_ID_STREAM, 1, this->drawIDBuffer.GetAddressOf(), &stride, &offset);
+}
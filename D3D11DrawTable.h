@@ -0,0 +1,45 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "DrawTable.h"
+#include "StructuredBuffer.h"
+
+// Shader registers the tables are bound to
+#define DRAW_TABLE_OBJECT_SLOT 0	// VS t0
+#define DRAW_TABLE_MATERIAL_SLOT 8	// PS t8, after the material textures
+#define DRAW_TABLE_DRAW_ID_STREAM 1	// IA vertex buffer slot
+
+// --------------------------------------------------------
+// GPU side of a DrawTable: two structured buffers, plus a
+// per-instance stream of draw IDs (0, 1, 2, ...).
+//
+// D3D11 doesn't add StartInstanceLocation to SV_InstanceID,
+// but it does apply it when fetching per-instance vertex
+// data.  Drawing one instance starting at instance N then
+// hands the shader N through the DRAWID stream.
+// --------------------------------------------------------
+class D3D11DrawTable
+{
+private:
+	StructuredBuffer objects;
+	StructuredBuffer materials;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> drawIDBuffer;
+	unsigned int drawIDCapacity;
+
+	void CreateDrawIDBuffer(unsigned int count);
+
+public:
+	D3D11DrawTable();
+
+	// Copies both tables to the GPU, growing the buffers if needed
+	void Upload(const DrawTable& table);
+
+	// Grows the draw ID stream for draws that index something
+	// other than the object table (e.g. light volumes)
+	void ReserveDrawIDs(unsigned int count);
+
+	// Binds the tables and the draw ID stream
+	void Bind();
+};
@@ -0,0 +1,62 @@
+#include "D3D11GpuTimerBackend.h"
+#include "Graphics.h"
+
+void D3D11GpuTimerBackend::BeginFrame(unsigned int slot)
+{
+	Slot& queries = this->slots[slot];
+	if (!queries.disjoint)
+	{
+		D3D11_QUERY_DESC desc = {};
+		desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		Graphics::Device->CreateQuery(&desc, queries.disjoint.GetAddressOf());
+	}
+	if (queries.disjoint)
+		Graphics::Context->Begin(queries.disjoint.Get());
+}
+
+void D3D11GpuTimerBackend::Timestamp(unsigned int slot, unsigned int query)
+{
+	Microsoft::WRL::ComPtr<ID3D11Query>& timestamp = this->slots[slot].timestamps[query];
+	if (!timestamp)
+	{
+		D3D11_QUERY_DESC desc = {};
+		desc.Query = D3D11_QUERY_TIMESTAMP;
+		Graphics::Device->CreateQuery(&desc, timestamp.GetAddressOf());
+	}
+	if (timestamp)
+		Graphics::Context->End(timestamp.Get());
+}
+
+void D3D11GpuTimerBackend::EndFrame(unsigned int slot)
+{
+	if (this->slots[slot].disjoint)
+		Graphics::Context->End(this->slots[slot].disjoint.Get());
+}
+
+// --------------------------------------------------------
+// Polls without flushing: the disjoint query finishes last,
+// so once it's in, every timestamp inside it is too
+// --------------------------------------------------------
+bool D3D11GpuTimerBackend::ReadFrame(unsigned int slot, unsigned int queryCount, uint64_t* ticks, uint64_t& frequency, bool& valid)
+{
+	Slot& queries = this->slots[slot];
+	if (!queries.disjoint)
+	{
+		valid = false;
+		return true;
+	}
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (Graphics::Context->GetData(queries.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	frequency = disjoint.Frequency;
+	valid = !disjoint.Disjoint;
+	for (unsigned int i = 0; i < queryCount && valid; i++)
+	{
+		if (!queries.timestamps[i] ||
+			Graphics::Context->GetData(queries.timestamps[i].Get(), &ticks[i], sizeof(uint64_t), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			valid = false;
+	}
+	return true;
+}
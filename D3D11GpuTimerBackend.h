@@ -0,0 +1,29 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "GpuProfiler.h"
+
+// --------------------------------------------------------
+// GPU timestamps from D3D11 queries: a TIMESTAMP_DISJOINT
+// query around each frame slot for the clock's frequency,
+// and TIMESTAMP queries for the times themselves.  Queries
+// are created the first time each is used.
+// --------------------------------------------------------
+class D3D11GpuTimerBackend : public GpuTimerBackend
+{
+private:
+	struct Slot
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+		Microsoft::WRL::ComPtr<ID3D11Query> timestamps[GPU_PROFILER_MAX_QUERIES];
+	};
+
+	Slot slots[GPU_PROFILER_FRAMES];
+
+public:
+	void BeginFrame(unsigned int slot) override;
+	void Timestamp(unsigned int slot, unsigned int query) override;
+	void EndFrame(unsigned int slot) override;
+	bool ReadFrame(unsigned int slot, unsigned int queryCount, uint64_t* ticks, uint64_t& frequency, bool& valid) override;
+};
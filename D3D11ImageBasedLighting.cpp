@@ -0,0 +1,102 @@
+#include "D3D11ImageBasedLighting.h"
+#include "Graphics.h"
+#include "StateCache.h"
+
+#include <DirectXPackedVector.h>
+#include <vector>
+
+D3D11ImageBasedLighting::D3D11ImageBasedLighting()
+{
+	this->specularMipCount = 0;
+
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	this->sampler = StateCache::GetSamplerState(samplerDesc);
+}
+
+// --------------------------------------------------------
+// Converts the baked floats to half floats and creates both
+// textures with all of their data up front
+// --------------------------------------------------------
+void D3D11ImageBasedLighting::Upload(const IBLData& data)
+{
+	// Specular cube: 6 faces x every mip, already in subresource order
+	std::vector<DirectX::PackedVector::XMHALF4> specular(data.specular.size());
+	for (size_t i = 0; i < specular.size(); i++)
+		DirectX::PackedVector::XMStoreHalf4(&specular[i], DirectX::XMLoadFloat4(&data.specular[i]));
+
+	std::vector<D3D11_SUBRESOURCE_DATA> subresources(6 * data.specularMipCount);
+	const DirectX::PackedVector::XMHALF4* texels = specular.data();
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (unsigned int mip = 0; mip < data.specularMipCount; mip++)
+		{
+			unsigned int size = data.specularSize >> mip;
+			D3D11_SUBRESOURCE_DATA& subresource = subresources[D3D11CalcSubresource(mip, face, data.specularMipCount)];
+			subresource.pSysMem = texels;
+			subresource.SysMemPitch = size * sizeof(DirectX::PackedVector::XMHALF4);
+			texels += (size_t)size * size;
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC cubeDesc = {};
+	cubeDesc.Width = data.specularSize;
+	cubeDesc.Height = data.specularSize;
+	cubeDesc.MipLevels = data.specularMipCount;
+	cubeDesc.ArraySize = 6;
+	cubeDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	cubeDesc.SampleDesc.Count = 1;
+	cubeDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> cube;
+	Graphics::Device->CreateTexture2D(&cubeDesc, subresources.data(), cube.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC cubeSRVDesc = {};
+	cubeSRVDesc.Format = cubeDesc.Format;
+	cubeSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	cubeSRVDesc.TextureCube.MipLevels = data.specularMipCount;
+	this->specularSRV.Reset();
+	Graphics::Device->CreateShaderResourceView(cube.Get(), &cubeSRVDesc, this->specularSRV.GetAddressOf());
+
+	// BRDF table
+	std::vector<DirectX::PackedVector::XMHALF2> brdf(data.brdf.size());
+	for (size_t i = 0; i < brdf.size(); i++)
+		DirectX::PackedVector::XMStoreHalf2(&brdf[i], DirectX::XMLoadFloat2(&data.brdf[i]));
+
+	D3D11_TEXTURE2D_DESC brdfDesc = {};
+	brdfDesc.Width = data.brdfSize;
+	brdfDesc.Height = data.brdfSize;
+	brdfDesc.MipLevels = 1;
+	brdfDesc.ArraySize = 1;
+	brdfDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	brdfDesc.SampleDesc.Count = 1;
+	brdfDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	brdfDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA brdfData = {};
+	brdfData.pSysMem = brdf.data();
+	brdfData.SysMemPitch = data.brdfSize * sizeof(DirectX::PackedVector::XMHALF2);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> brdfTexture;
+	Graphics::Device->CreateTexture2D(&brdfDesc, &brdfData, brdfTexture.GetAddressOf());
+	this->brdfSRV.Reset();
+	Graphics::Device->CreateShaderResourceView(brdfTexture.Get(), 0, this->brdfSRV.GetAddressOf());
+
+	this->specularMipCount = this->specularSRV && this->brdfSRV ? data.specularMipCount : 0;
+}
+
+void D3D11ImageBasedLighting::Bind()
+{
+	ID3D11ShaderResourceView* srvs[] = { this->specularSRV.Get(), this->brdfSRV.Get() };
+	Graphics::Context->PSSetShaderResources(ENVIRONMENT_SPECULAR_SLOT, 2, srvs);
+	Graphics::Context->PSSetSamplers(ENVIRONMENT_SAMPLER_SLOT, 1, this->sampler.GetAddressOf());
+}
+
+bool D3D11ImageBasedLighting::IsReady() { return this->specularMipCount > 0; }
+unsigned int D3D11ImageBasedLighting::GetSpecularMipCount() { return this->specularMipCount; }
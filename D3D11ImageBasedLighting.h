@@ -0,0 +1,35 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "IBLBaker.h"
+
+// Pixel shader registers for the baked environment lighting
+#define ENVIRONMENT_SPECULAR_SLOT 2	// PS t2
+#define ENVIRONMENT_BRDF_SLOT 3		// PS t3
+#define ENVIRONMENT_SAMPLER_SLOT 1	// PS s1
+
+// --------------------------------------------------------
+// GPU side of IBLBaker: the prefiltered specular cube and the
+// BRDF table, both half float, plus the clamping sampler they
+// are read with.  The SH coefficients travel in the per-frame
+// constants instead.
+// --------------------------------------------------------
+class D3D11ImageBasedLighting
+{
+private:
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> specularSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> brdfSRV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
+	unsigned int specularMipCount;
+
+public:
+	D3D11ImageBasedLighting();
+
+	void Upload(const IBLData& data);
+	void Bind();
+
+	// Getters
+	bool IsReady();
+	unsigned int GetSpecularMipCount();
+};
@@ -0,0 +1,25 @@
+#include "D3D11LightClusters.h"
+#include "Graphics.h"
+
+D3D11LightClusters::D3D11LightClusters() :
+	lights(sizeof(PackedLight)),
+	ranges(sizeof(LightClusterRange), LIGHT_CLUSTER_COUNT),
+	indices(sizeof(uint32_t), 1024)
+{
+}
+
+void D3D11LightClusters::Upload(const LightPacking& lights, const LightClusters& clusters)
+{
+	this->lights.Upload(lights.GetPackedLights(), lights.GetLightCount());
+	this->ranges.Upload(clusters.GetRanges(), LIGHT_CLUSTER_COUNT);
+	this->indices.Upload(clusters.GetLightIndices(), clusters.GetLightIndexCount());
+}
+
+void D3D11LightClusters::Bind()
+{
+	ID3D11ShaderResourceView* srvs[] = {
+		this->lights.GetSRV().Get(),
+		this->ranges.GetSRV().Get(),
+		this->indices.GetSRV().Get() };
+	Graphics::Context->PSSetShaderResources(LIGHT_BUFFER_SLOT, 3, srvs);
+}
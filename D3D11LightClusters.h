@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include "LightClusters.h"
+#include "LightPacking.h"
+#include "StructuredBuffer.h"
+
+// Pixel shader registers for the clustered light data
+#define LIGHT_BUFFER_SLOT 9			// PS t9
+#define LIGHT_CLUSTER_RANGE_SLOT 10	// PS t10
+#define LIGHT_INDEX_SLOT 11			// PS t11
+#define OBJECT_LIGHT_LIST_SLOT 12	// PS t12, see ObjectLightLists
+
+// --------------------------------------------------------
+// GPU side of LightClusters: every packed light, each
+// cluster's offset and counts, and the flattened index list
+// --------------------------------------------------------
+class D3D11LightClusters
+{
+private:
+	StructuredBuffer lights;
+	StructuredBuffer ranges;
+	StructuredBuffer indices;
+
+public:
+	D3D11LightClusters();
+
+	void Upload(const LightPacking& lights, const LightClusters& clusters);
+	void Bind();
+};
@@ -0,0 +1,85 @@
+#include "D3D11RenderGraphPool.h"
+#include "Graphics.h"
+
+namespace
+{
+	DXGI_FORMAT ToDXGIFormat(RenderGraphFormat format)
+	{
+		switch (format)
+		{
+		case RenderGraphFormat::RGBA8Unorm: return DXGI_FORMAT_R8G8B8A8_UNORM;
+		case RenderGraphFormat::RG16Snorm: return DXGI_FORMAT_R16G16_SNORM;
+		case RenderGraphFormat::R32Float: return DXGI_FORMAT_R32_FLOAT;
+		case RenderGraphFormat::RGBA16Float: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+		}
+		return DXGI_FORMAT_UNKNOWN;
+	}
+}
+
+void D3D11RenderGraphPool::Import(RenderGraphResource resource, ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv, ID3D11DepthStencilView* dsv)
+{
+	if (this->imported.size() <= resource)
+		this->imported.resize(resource + 1);
+	this->imported[resource] = { rtv, srv, dsv };
+}
+
+void D3D11RenderGraphPool::Realize(const RenderGraph& graph)
+{
+	unsigned int count = graph.GetAllocationCount();
+	this->textures.resize(count);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const RenderGraphTextureDesc& desc = graph.GetAllocationDesc(i);
+		Texture& texture = this->textures[i];
+		if (texture.rtv && texture.desc == desc)
+			continue;
+
+		texture.desc = desc;
+		texture.rtv.Reset();
+		texture.srv.Reset();
+
+		D3D11_TEXTURE2D_DESC textureDesc = {};
+		textureDesc.Width = desc.width;
+		textureDesc.Height = desc.height;
+		textureDesc.MipLevels = 1;
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = ToDXGIFormat(desc.format);
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> resource;
+		Graphics::Device->CreateTexture2D(&textureDesc, 0, resource.GetAddressOf());
+		Graphics::Device->CreateRenderTargetView(resource.Get(), 0, texture.rtv.GetAddressOf());
+		Graphics::Device->CreateShaderResourceView(resource.Get(), 0, texture.srv.GetAddressOf());
+	}
+}
+
+ID3D11RenderTargetView* D3D11RenderGraphPool::GetRenderTarget(const RenderGraph& graph, RenderGraphResource resource)
+{
+	if (graph.IsImported(resource))
+		return resource < this->imported.size() ? this->imported[resource].rtv : 0;
+
+	unsigned int allocation = graph.GetAllocation(resource);
+	return allocation < this->textures.size() ? this->textures[allocation].rtv.Get() : 0;
+}
+
+ID3D11ShaderResourceView* D3D11RenderGraphPool::GetShaderResource(const RenderGraph& graph, RenderGraphResource resource)
+{
+	if (graph.IsImported(resource))
+		return resource < this->imported.size() ? this->imported[resource].srv : 0;
+
+	unsigned int allocation = graph.GetAllocation(resource);
+	return allocation < this->textures.size() ? this->textures[allocation].srv.Get() : 0;
+}
+
+// Only imported textures have depth views; transients are all color
+ID3D11DepthStencilView* D3D11RenderGraphPool::GetDepthStencil(const RenderGraph& graph, RenderGraphResource resource)
+{
+	if (graph.IsImported(resource) && resource < this->imported.size())
+		return this->imported[resource].dsv;
+	return 0;
+}
+
+unsigned int D3D11RenderGraphPool::GetTextureCount() { return (unsigned int)this->textures.size(); }
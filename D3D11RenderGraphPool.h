@@ -0,0 +1,51 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+#include "RenderGraph.h"
+
+// --------------------------------------------------------
+// Real textures for a compiled RenderGraph.
+//
+// Each of the graph's allocations becomes one texture with
+// a render target view and a shader resource view.  They're
+// kept from frame to frame and only recreated when the graph
+// asks for something different (after a resize, say).
+// Imported textures are whatever views the caller hands in.
+// --------------------------------------------------------
+class D3D11RenderGraphPool
+{
+private:
+	struct Texture
+	{
+		RenderGraphTextureDesc desc;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	};
+
+	struct ImportedViews
+	{
+		ID3D11RenderTargetView* rtv;
+		ID3D11ShaderResourceView* srv;
+		ID3D11DepthStencilView* dsv;
+	};
+
+	std::vector<Texture> textures;
+	std::vector<ImportedViews> imported;
+
+public:
+	// Views for an imported resource; any of them can be null
+	void Import(RenderGraphResource resource, ID3D11RenderTargetView* rtv, ID3D11ShaderResourceView* srv, ID3D11DepthStencilView* dsv);
+
+	// Makes sure there's a texture for each of the graph's allocations
+	void Realize(const RenderGraph& graph);
+
+	// Views of a resource this frame
+	ID3D11RenderTargetView* GetRenderTarget(const RenderGraph& graph, RenderGraphResource resource);
+	ID3D11ShaderResourceView* GetShaderResource(const RenderGraph& graph, RenderGraphResource resource);
+	ID3D11DepthStencilView* GetDepthStencil(const RenderGraph& graph, RenderGraphResource resource);
+
+	// Getters
+	unsigned int GetTextureCount();
+};
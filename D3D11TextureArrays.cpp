@@ -0,0 +1,163 @@
+#include "D3D11TextureArrays.h"
+#include "Graphics.h"
+
+#include <algorithm>
+
+// Annonymous namespace for format sizes, only used in this file
+namespace
+{
+	// Bits per texel of the formats textures are loaded in
+	unsigned int GetBitsPerTexel(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+			return 4;
+		case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+		case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+		case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return 8;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+			return 64;
+		default:
+			return 32;
+		}
+	}
+
+	size_t CalcSliceBytes(const TextureArrayKey& key)
+	{
+		size_t bits = 0;
+		for (unsigned int mip = 0; mip < key.mipCount; mip++)
+			bits += (size_t)std::max(1u, key.width >> mip) * std::max(1u, key.height >> mip) * GetBitsPerTexel((DXGI_FORMAT)key.format);
+		return bits / 8;
+	}
+}
+
+D3D11TextureArrays::D3D11TextureArrays()
+{
+	this->bytes = 0;
+	this->textureCount = 0;
+}
+
+// --------------------------------------------------------
+// Finds the texture a place and copies it in.  Atlas pages
+// keep fewer mips than most textures have, so only the top
+// ones go in; a texture with fewer mips than the page has
+// its 1x1 level repeated down the rest.
+// --------------------------------------------------------
+bool D3D11TextureArrays::Add(ID3D11ShaderResourceView* srv, TextureArrayLocation& location)
+{
+	if (!srv)
+		return false;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> source;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&source)))
+		return false;
+
+	auto existing = this->locations.find(resource.Get());
+	if (existing != this->locations.end())
+	{
+		location = existing->second;
+		return true;
+	}
+
+	D3D11_TEXTURE2D_DESC desc;
+	source->GetDesc(&desc);
+	if (desc.ArraySize != 1 || desc.SampleDesc.Count != 1 || (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE))
+		return false;
+
+	TextureArrayKey key = { desc.Width, desc.Height, desc.MipLevels, (unsigned int)desc.Format };
+	location = this->layout.Add(key);
+	if (!Reserve(location.array))
+		return false;
+
+	const TextureArrayKey& arrayKey = this->layout.GetKey(location.array);
+	ID3D11Texture2D* destination = this->arrays[location.array].texture.Get();
+	for (unsigned int mip = 0; mip < arrayKey.mipCount; mip++)
+	{
+		unsigned int sourceMip = std::min(mip, desc.MipLevels - 1);
+		unsigned int sourceWidth = std::max(1u, desc.Width >> sourceMip);
+		unsigned int sourceHeight = std::max(1u, desc.Height >> sourceMip);
+		if (sourceMip != mip && (sourceWidth > 1 || sourceHeight > 1))
+			break;
+
+		Graphics::Context->CopySubresourceRegion(
+			destination,
+			D3D11CalcSubresource(mip, location.slice, arrayKey.mipCount),
+			location.x >> mip,
+			location.y >> mip,
+			0,
+			source.Get(),
+			sourceMip,
+			0);
+	}
+
+	// Kept so the pointer can't be reused by another texture
+	this->locations[resource.Get()] = location;
+	this->sources.push_back(resource);
+	this->textureCount++;
+	return true;
+}
+
+// --------------------------------------------------------
+// Makes sure an array's texture has room for every slice
+// handed out so far, doubling it (and copying the slices
+// already there) when it doesn't
+// --------------------------------------------------------
+bool D3D11TextureArrays::Reserve(unsigned int array)
+{
+	if (this->arrays.size() <= array)
+		this->arrays.resize(array + 1);
+
+	GPUArray& gpuArray = this->arrays[array];
+	unsigned int needed = this->layout.GetSliceCount(array);
+	if (gpuArray.capacity >= needed)
+		return true;
+
+	const TextureArrayKey& key = this->layout.GetKey(array);
+	unsigned int capacity = std::min(std::max(needed, gpuArray.capacity * 2), (unsigned int)D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION);
+	if (capacity < needed)
+		return false;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = key.width;
+	desc.Height = key.height;
+	desc.MipLevels = key.mipCount;
+	desc.ArraySize = capacity;
+	desc.Format = (DXGI_FORMAT)key.format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(Graphics::Device->CreateTexture2D(&desc, 0, texture.GetAddressOf())) ||
+		FAILED(Graphics::Device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf())))
+		return false;
+
+	for (unsigned int slice = 0; slice < gpuArray.capacity; slice++)
+	{
+		for (unsigned int mip = 0; mip < key.mipCount; mip++)
+		{
+			Graphics::Context->CopySubresourceRegion(
+				texture.Get(), D3D11CalcSubresource(mip, slice, key.mipCount), 0, 0, 0,
+				gpuArray.texture.Get(), D3D11CalcSubresource(mip, slice, key.mipCount), 0);
+		}
+	}
+
+	this->bytes += CalcSliceBytes(key) * (capacity - gpuArray.capacity);
+	gpuArray.texture = texture;
+	gpuArray.srv = srv;
+	gpuArray.capacity = capacity;
+	return true;
+}
+
+ID3D11ShaderResourceView* D3D11TextureArrays::GetSRV(unsigned int array) { return array < this->arrays.size() ? this->arrays[array].srv.Get() : 0; }
+unsigned int D3D11TextureArrays::GetArrayCount() { return (unsigned int)this->arrays.size(); }
+unsigned int D3D11TextureArrays::GetTextureCount() { return this->textureCount; }
+size_t D3D11TextureArrays::GetBytes() { return this->bytes; }
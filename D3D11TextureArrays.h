@@ -0,0 +1,50 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <unordered_map>
+#include <vector>
+#include "TextureArrays.h"
+
+// --------------------------------------------------------
+// GPU side of TextureArrays: one Texture2DArray per array it
+// hands out, with textures copied into their slices on the
+// GPU.  Arrays start small and double when they fill up, so
+// an array's view changes as it grows - always look it up by
+// index with GetSRV() rather than keeping it.
+// --------------------------------------------------------
+class D3D11TextureArrays
+{
+private:
+	struct GPUArray
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		unsigned int capacity;
+	};
+
+	TextureArrays layout;
+	std::vector<GPUArray> arrays;
+
+	// Each texture is only copied once, however many ask
+	std::unordered_map<ID3D11Resource*, TextureArrayLocation> locations;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Resource>> sources;
+	unsigned int textureCount;
+	size_t bytes;
+
+	bool Reserve(unsigned int array);
+
+public:
+	D3D11TextureArrays();
+
+	// Copies every mip of a single 2D texture into an array (or as
+	// many as an atlas keeps).  False if it isn't one, in which case
+	// it should be bound on its own.
+	bool Add(ID3D11ShaderResourceView* srv, TextureArrayLocation& location);
+
+	// Getters
+	ID3D11ShaderResourceView* GetSRV(unsigned int array);
+	unsigned int GetArrayCount();
+	unsigned int GetTextureCount();
+	size_t GetBytes();
+};
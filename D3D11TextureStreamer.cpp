@@ -0,0 +1,389 @@
+#include "D3D11TextureStreamer.h"
+#include "Graphics.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Annonymous namespace for the DDS layout, only used in this file
+namespace
+{
+	const uint32_t DDS_MAGIC = 0x20534444;		// "DDS "
+	const size_t DDS_HEADER_SIZE = 4 + 124;		// Magic and DDS_HEADER
+	const size_t DDS_DX10_HEADER_SIZE = 20;
+
+	const uint32_t DDS_PIXEL_FORMAT_OFFSET = 4 + 72;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDPF_RGB = 0x40;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	const uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+	uint32_t ReadUInt(const uint8_t* data, size_t offset)
+	{
+		uint32_t value;
+		memcpy(&value, data + offset, sizeof(value));
+		return value;
+	}
+
+	uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+	}
+
+	// Bytes per 4x4 block of the BC formats, 0 for anything else
+	unsigned int GetBlockBytes(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_TYPELESS: case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_TYPELESS: case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+			return 8;
+		case DXGI_FORMAT_BC2_TYPELESS: case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_TYPELESS: case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_TYPELESS: case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+		case DXGI_FORMAT_BC6H_TYPELESS: case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+		case DXGI_FORMAT_BC7_TYPELESS: case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool IsRGBA8(DXGI_FORMAT format)
+	{
+		return
+			format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB ||
+			format == DXGI_FORMAT_B8G8R8A8_UNORM || format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+	}
+
+	// Reads part of a file; false if it's not all there
+	bool ReadRange(const std::wstring& path, uint64_t offset, size_t size, std::vector<uint8_t>& bytes)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		bytes.resize(size);
+		file.seekg((std::streamoff)offset);
+		return (bool)file.read((char*)bytes.data(), size);
+	}
+}
+
+D3D11TextureStreamer::D3D11TextureStreamer(uint64_t budgetBytes) :
+	residency(budgetBytes)
+{
+	this->stopping = false;
+	this->bytesRead = 0;
+	this->loadCount = 0;
+	this->evictCount = 0;
+	this->ioThread = std::thread(&D3D11TextureStreamer::IOLoop, this);
+}
+
+D3D11TextureStreamer::~D3D11TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+		this->reads.clear();
+	}
+	this->wake.notify_all();
+	this->ioThread.join();
+}
+
+// --------------------------------------------------------
+// One thread is plenty: it only ever reads bytes straight
+// into memory, nothing is decoded
+// --------------------------------------------------------
+void D3D11TextureStreamer::IOLoop()
+{
+	Profiler::SetThreadName("Texture streamer");
+	while (true)
+	{
+		ReadJob job;
+		std::wstring path;
+		uint64_t offset;
+		size_t size;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [this] { return this->stopping || !this->reads.empty(); });
+			if (this->stopping)
+				break;
+			job = std::move(this->reads.front());
+			this->reads.pop_front();
+
+			// Textures are only added under the lock
+			const StreamedTexture& texture = this->textures[job.texture];
+			path = texture.path;
+			offset = texture.mipOffsets[job.firstMip];
+			size = (size_t)(texture.mipOffsets[job.lastMip - 1] + texture.info.mipBytes[job.lastMip - 1] - offset);
+		}
+
+		// A texture's missing mips sit next to each other in the file
+		PROFILE_SCOPE("Read mips");
+		job.failed = !ReadRange(path, offset, size, job.bytes);
+		if (job.failed)
+			printf("Texture streamer: couldn't read %ls\n", path.c_str());
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->completed.push_back(std::move(job));
+	}
+}
+
+// --------------------------------------------------------
+// Pulls the size, format and mip layout out of a DDS file's
+// headers.  Only single 2D textures in BC or 8-bit RGBA
+// formats with more than one mip are worth streaming.
+// --------------------------------------------------------
+bool D3D11TextureStreamer::ParseHeader(const uint8_t* data, size_t size, StreamedTexture& texture, size_t& dataOffset)
+{
+	if (size < DDS_HEADER_SIZE || ReadUInt(data, 0) != DDS_MAGIC || ReadUInt(data, 4) != 124)
+		return false;
+
+	uint32_t height = ReadUInt(data, 4 + 8);
+	uint32_t width = ReadUInt(data, 4 + 12);
+	uint32_t mipCount = std::max(1u, ReadUInt(data, 4 + 24));
+	uint32_t formatFlags = ReadUInt(data, DDS_PIXEL_FORMAT_OFFSET + 4);
+	uint32_t fourCC = ReadUInt(data, DDS_PIXEL_FORMAT_OFFSET + 8);
+	uint32_t caps2 = ReadUInt(data, 4 + 108);
+	if (caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))
+		return false;
+
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+	dataOffset = DDS_HEADER_SIZE;
+	if ((formatFlags & DDPF_FOURCC) && fourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (size < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE)
+			return false;
+
+		// 3 = D3D11_RESOURCE_DIMENSION_TEXTURE2D, one array slice, not a cube
+		format = (DXGI_FORMAT)ReadUInt(data, DDS_HEADER_SIZE);
+		if (ReadUInt(data, DDS_HEADER_SIZE + 4) != 3 || ReadUInt(data, DDS_HEADER_SIZE + 12) != 1 || (ReadUInt(data, DDS_HEADER_SIZE + 8) & 0x4))
+			return false;
+		dataOffset += DDS_DX10_HEADER_SIZE;
+	}
+	else if (formatFlags & DDPF_FOURCC)
+	{
+		if (fourCC == MakeFourCC('D', 'X', 'T', '1')) format = DXGI_FORMAT_BC1_UNORM;
+		else if (fourCC == MakeFourCC('D', 'X', 'T', '3')) format = DXGI_FORMAT_BC2_UNORM;
+		else if (fourCC == MakeFourCC('D', 'X', 'T', '5')) format = DXGI_FORMAT_BC3_UNORM;
+		else if (fourCC == MakeFourCC('A', 'T', 'I', '1') || fourCC == MakeFourCC('B', 'C', '4', 'U')) format = DXGI_FORMAT_BC4_UNORM;
+		else if (fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U')) format = DXGI_FORMAT_BC5_UNORM;
+	}
+	else if ((formatFlags & DDPF_RGB) && ReadUInt(data, DDS_PIXEL_FORMAT_OFFSET + 12) == 32)
+	{
+		uint32_t redMask = ReadUInt(data, DDS_PIXEL_FORMAT_OFFSET + 16);
+		format = redMask == 0x000000FF ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_B8G8R8A8_UNORM;
+	}
+
+	texture.format = format;
+	texture.blockBytes = GetBlockBytes(format);
+	texture.pixelBytes = IsRGBA8(format) ? 4 : 0;
+	if ((texture.blockBytes == 0 && texture.pixelBytes == 0) || mipCount < 2 || mipCount > STREAMING_MAX_MIPS)
+		return false;
+
+	texture.info = {};
+	texture.info.width = width;
+	texture.info.height = height;
+	texture.info.mipCount = mipCount;
+
+	uint64_t offset = dataOffset;
+	for (unsigned int mip = 0; mip < mipCount; mip++)
+	{
+		unsigned int mipWidth = std::max(1u, width >> mip);
+		unsigned int mipHeight = std::max(1u, height >> mip);
+		uint64_t bytes = texture.blockBytes ?
+			(uint64_t)((mipWidth + 3) / 4) * ((mipHeight + 3) / 4) * texture.blockBytes :
+			(uint64_t)mipWidth * mipHeight * texture.pixelBytes;
+
+		texture.mipOffsets[mip] = offset;
+		texture.info.mipBytes[mip] = bytes;
+		offset += bytes;
+	}
+	return true;
+}
+
+uint32_t D3D11TextureStreamer::CalcRowPitch(const StreamedTexture& texture, unsigned int mip)
+{
+	unsigned int mipWidth = std::max(1u, texture.info.width >> mip);
+	return texture.blockBytes ? ((mipWidth + 3) / 4) * texture.blockBytes : mipWidth * texture.pixelBytes;
+}
+
+// --------------------------------------------------------
+// Replaces a texture's GPU copy with one whose top level is
+// topMip.  Mips [topMip, newMipEnd) come from newMips, back to
+// back as in the file; the rest are copied from the old
+// texture on the GPU.  The owner gets the new view.
+// --------------------------------------------------------
+bool D3D11TextureStreamer::Recreate(StreamedTexture& texture, unsigned int topMip, const uint8_t* newMips, unsigned int newMipEnd)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = std::max(1u, texture.info.width >> topMip);
+	desc.Height = std::max(1u, texture.info.height >> topMip);
+	desc.MipLevels = texture.info.mipCount - topMip;
+	desc.ArraySize = 1;
+	desc.Format = texture.format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> newTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(Graphics::Device->CreateTexture2D(&desc, 0, newTexture.GetAddressOf())) ||
+		FAILED(Graphics::Device->CreateShaderResourceView(newTexture.Get(), 0, srv.GetAddressOf())))
+		return false;
+
+	const uint8_t* source = newMips;
+	for (unsigned int mip = topMip; mip < texture.info.mipCount; mip++)
+	{
+		if (mip < newMipEnd)
+		{
+			Graphics::Context->UpdateSubresource(newTexture.Get(), mip - topMip, 0, source, CalcRowPitch(texture, mip), 0);
+			source += texture.info.mipBytes[mip];
+		}
+		else
+		{
+			Graphics::Context->CopySubresourceRegion(newTexture.Get(), mip - topMip, 0, 0, 0, texture.texture.Get(), mip - texture.gpuMip, 0);
+		}
+	}
+
+	texture.texture = newTexture;
+	texture.srv = srv;
+	texture.gpuMip = topMip;
+	for (LoadedFunction& onLoaded : texture.onLoaded)
+		onLoaded(srv);
+	return true;
+}
+
+// --------------------------------------------------------
+// Reads just enough of the file for the mip tail and makes
+// the first GPU texture from it.  BC textures need every top
+// level they might have to be whole blocks, so ones that
+// can't start at their tail go to the regular loader.
+// --------------------------------------------------------
+int D3D11TextureStreamer::Add(const std::wstring& path, LoadedFunction onLoaded)
+{
+	size_t dot = path.find_last_of(L'.');
+	if (dot == std::wstring::npos)
+		return -1;
+
+	StreamedTexture texture = {};
+	texture.path = path.substr(0, dot) + L".dds";
+
+	auto existing = this->texturesByPath.find(texture.path);
+	if (existing != this->texturesByPath.end())
+	{
+		StreamedTexture& streamed = this->textures[existing->second];
+		streamed.onLoaded.push_back(onLoaded);
+		onLoaded(streamed.srv);
+		return (int)existing->second;
+	}
+
+	std::vector<uint8_t> header;
+	size_t dataOffset = 0;
+	if (!ReadRange(texture.path, 0, DDS_HEADER_SIZE, header) ||
+		(ReadUInt(header.data(), DDS_PIXEL_FORMAT_OFFSET + 8) == MakeFourCC('D', 'X', '1', '0') && !ReadRange(texture.path, 0, DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE, header)) ||
+		!ParseHeader(header.data(), header.size(), texture, dataOffset))
+		return -1;
+
+	unsigned int alignment = texture.blockBytes ? 4 : 1;
+	unsigned int tail = TextureResidency::CalcTailMip(texture.info.width, texture.info.height, texture.info.mipCount, alignment);
+	if (tail == 0)
+		return -1;
+	for (unsigned int mip = 0; mip <= tail; mip++)
+	{
+		if (std::max(1u, texture.info.width >> mip) % alignment != 0 || std::max(1u, texture.info.height >> mip) % alignment != 0)
+			return -1;
+	}
+	texture.info.tailMip = tail;
+
+	unsigned int last = texture.info.mipCount - 1;
+	std::vector<uint8_t> tailBytes;
+	if (!ReadRange(texture.path, texture.mipOffsets[tail], (size_t)(texture.mipOffsets[last] + texture.info.mipBytes[last] - texture.mipOffsets[tail]), tailBytes))
+		return -1;
+
+	texture.onLoaded.push_back(onLoaded);
+	if (!Recreate(texture, tail, tailBytes.data(), texture.info.mipCount))
+		return -1;
+
+	this->bytesRead += tailBytes.size();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->textures.push_back(texture);
+	}
+	this->texturesByPath[texture.path] = (unsigned int)this->textures.size() - 1;
+	return (int)this->residency.AddTexture(texture.info);
+}
+
+void D3D11TextureStreamer::BeginFrame()
+{
+	this->residency.BeginFrame();
+}
+
+void D3D11TextureStreamer::Request(unsigned int texture, unsigned int mip)
+{
+	// A file that failed to read once isn't retried every frame
+	if (texture < this->textures.size() && !this->textures[texture].failed)
+		this->residency.Request(texture, mip);
+}
+
+// --------------------------------------------------------
+// Swaps in every read that finished since last frame, then
+// carries out this frame's evictions and starts its loads
+// --------------------------------------------------------
+void D3D11TextureStreamer::Update()
+{
+	std::vector<ReadJob> finished;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		finished.swap(this->completed);
+	}
+
+	for (ReadJob& job : finished)
+	{
+		StreamedTexture& texture = this->textures[job.texture];
+		bool succeeded = !job.failed && Recreate(texture, job.firstMip, job.bytes.data(), job.lastMip);
+		this->residency.CompleteLoad(job.texture, succeeded);
+		texture.failed = !succeeded;
+		if (succeeded)
+		{
+			this->bytesRead += job.bytes.size();
+			this->loadCount++;
+		}
+	}
+
+	this->actions.clear();
+	this->residency.Update(this->actions);
+
+	for (const StreamingAction& action : this->actions)
+	{
+		StreamedTexture& texture = this->textures[action.texture];
+		if (action.type == StreamingActionType::Evict)
+		{
+			Recreate(texture, action.mip, 0, action.mip);
+			this->evictCount++;
+			continue;
+		}
+
+		ReadJob job = {};
+		job.texture = action.texture;
+		job.firstMip = action.mip;
+		job.lastMip = texture.gpuMip;
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->reads.push_back(std::move(job));
+		this->wake.notify_one();
+	}
+}
+
+void D3D11TextureStreamer::SetBudget(uint64_t budgetBytes) { this->residency.SetBudget(budgetBytes); }
+
+const StreamingTextureInfo& D3D11TextureStreamer::GetInfo(unsigned int texture) { return this->textures[texture].info; }
+unsigned int D3D11TextureStreamer::GetTextureCount() { return (unsigned int)this->textures.size(); }
+unsigned int D3D11TextureStreamer::GetResidentMip(unsigned int texture) { return this->textures[texture].gpuMip; }
+uint64_t D3D11TextureStreamer::GetResidentBytes() { return this->residency.GetResidentBytes(); }
+uint64_t D3D11TextureStreamer::GetBudget() { return this->residency.GetBudget(); }
+uint64_t D3D11TextureStreamer::GetBytesRead() { return this->bytesRead; }
+unsigned int D3D11TextureStreamer::GetLoadCount() { return this->loadCount; }
+unsigned int D3D11TextureStreamer::GetEvictCount() { return this->evictCount; }
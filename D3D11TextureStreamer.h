@@ -0,0 +1,114 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "TextureResidency.h"
+
+#define STREAMING_DEFAULT_BUDGET (64ull * 1024 * 1024)
+
+// --------------------------------------------------------
+// Streams the mips of baked DDS textures (see Tools/
+// TextureBaker) in and out under a memory budget, following
+// TextureResidency's decisions.
+//
+// Adding a texture reads its header and small mip tail right
+// away, so there's always something to sample.  Everything
+// more detailed is read on the streamer's IO thread when it's
+// asked for, and goes into a new GPU texture on the render
+// thread in Update() - the new mips uploaded, the ones already
+// resident copied across on the GPU.  Evicting works the same
+// way in reverse, without any reads.  Either way the owner's
+// callback gets the new view to swap in.
+// --------------------------------------------------------
+class D3D11TextureStreamer
+{
+public:
+	typedef std::function<void(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>)> LoadedFunction;
+
+private:
+	struct StreamedTexture
+	{
+		std::wstring path;
+		DXGI_FORMAT format;
+		unsigned int blockBytes;	// Per 4x4 block, or 0 if uncompressed
+		unsigned int pixelBytes;	// Uncompressed only
+		uint64_t mipOffsets[STREAMING_MAX_MIPS];	// Into the file
+		StreamingTextureInfo info;
+		unsigned int gpuMip;		// Most detailed mip in the GPU texture
+		bool failed;				// Stays at what it has
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		std::vector<LoadedFunction> onLoaded;
+	};
+
+	struct ReadJob
+	{
+		unsigned int texture;
+		unsigned int firstMip;		// Read [firstMip, lastMip)
+		unsigned int lastMip;
+		std::vector<uint8_t> bytes;
+		bool failed;
+	};
+
+	std::vector<StreamedTexture> textures;
+	std::unordered_map<std::wstring, unsigned int> texturesByPath;
+	TextureResidency residency;
+	std::vector<StreamingAction> actions;
+
+	std::thread ioThread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<ReadJob> reads;
+	std::vector<ReadJob> completed;
+	bool stopping;
+
+	// Stats
+	uint64_t bytesRead;
+	unsigned int loadCount;
+	unsigned int evictCount;
+
+	void IOLoop();
+	bool ParseHeader(const uint8_t* data, size_t size, StreamedTexture& texture, size_t& dataOffset);
+	uint32_t CalcRowPitch(const StreamedTexture& texture, unsigned int mip);
+	bool Recreate(StreamedTexture& texture, unsigned int topMip, const uint8_t* newMips, unsigned int newMipEnd);
+
+public:
+	D3D11TextureStreamer(uint64_t budgetBytes = STREAMING_DEFAULT_BUDGET);
+	~D3D11TextureStreamer();
+	D3D11TextureStreamer(const D3D11TextureStreamer&) = delete;
+	D3D11TextureStreamer& operator=(const D3D11TextureStreamer&) = delete;
+
+	// Streams "name.dds" for "name.png" (or any extension), if the
+	// baker made one in a format this can stream.  onLoaded gets the
+	// tail's view straight away and every view after that.  Returns
+	// the texture's index, or -1 to load it some other way.  The
+	// same file twice is streamed once.
+	int Add(const std::wstring& path, LoadedFunction onLoaded);
+
+	// Once per frame, on the render thread: BeginFrame(), a Request()
+	// for every visible use of each texture, then Update()
+	void BeginFrame();
+	void Request(unsigned int texture, unsigned int mip);
+	void Update();
+
+	void SetBudget(uint64_t budgetBytes);
+
+	// Getters
+	const StreamingTextureInfo& GetInfo(unsigned int texture);
+	unsigned int GetTextureCount();
+	unsigned int GetResidentMip(unsigned int texture);
+	uint64_t GetResidentBytes();
+	uint64_t GetBudget();
+	uint64_t GetBytesRead();
+	unsigned int GetLoadCount();
+	unsigned int GetEvictCount();
+};
@@ -0,0 +1,56 @@
+#include "ShaderInclude.hlsli"
+
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+    float3 cameraPosition;
+    float time;
+    float3 ambientLight;
+    uint directionalLightCount;
+    float2 screenSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    float4 irradianceSH[IBL_SH_COEFFICIENT_COUNT];
+    float environmentMipCount;
+}
+
+// Baked sky lighting, see IBLBaker
+TextureCube EnvironmentSpecular : register(t2);
+Texture2D EnvironmentBRDF : register(t3);
+SamplerState ClampSampler : register(s1);
+
+// Directional lights are the first entries
+StructuredBuffer<PackedLight> Lights : register(t9);
+
+Texture2D AlbedoRoughness : register(t13);
+Texture2D NormalBuffer : register(t14);
+Texture2D ViewDepthBuffer : register(t15);
+
+// --------------------------------------------------------
+// Full screen pass: ambient plus every directional light,
+// matching the start of PixelShader.hlsl
+// --------------------------------------------------------
+float4 main(VertexToPixel_Fullscreen input) : SV_TARGET
+{
+    int3 pixel = int3(input.position.xy, 0);
+    float viewDepth = ViewDepthBuffer.Load(pixel).r;
+
+    // Nothing was drawn here, so leave it for the sky
+    if (viewDepth <= 0.0f)
+        discard;
+
+    float4 albedoRoughness = AlbedoRoughness.Load(pixel);
+    float3 normal = DecodeOctahedralNormal(NormalBuffer.Load(pixel).rg);
+    float3 worldPosition = ReconstructWorldPosition(input.position.xy, viewDepth, screenSize, view, projection, cameraPosition);
+
+    float3 totalColor = ambientLight;
+    if (environmentMipCount > 0)
+        totalColor = CalcImageBasedLight(irradianceSH, EnvironmentSpecular, EnvironmentBRDF, ClampSampler,
+            environmentMipCount, normal, worldPosition, cameraPosition, albedoRoughness.rgb, albedoRoughness.a);
+    for (uint i = 0; i < directionalLightCount; i++)
+        totalColor += CalcDirectionalLight(Lights[i], normal, worldPosition, cameraPosition, albedoRoughness.rgb, albedoRoughness.a);
+
+    return float4(totalColor, 1);
+}
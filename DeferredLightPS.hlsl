@@ -0,0 +1,38 @@
+#include "ShaderInclude.hlsli"
+
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+    float3 cameraPosition;
+    float time;
+    float3 ambientLight;
+    uint directionalLightCount;
+    float2 screenSize;
+}
+
+StructuredBuffer<PackedLight> Lights : register(t9);
+
+Texture2D AlbedoRoughness : register(t13);
+Texture2D NormalBuffer : register(t14);
+Texture2D ViewDepthBuffer : register(t15);
+
+// --------------------------------------------------------
+// One point or spot light, added to the pixels its volume
+// marked in the stencil buffer.  Point lights are packed
+// with a spot term that's always 1, so one function covers
+// both types.
+// --------------------------------------------------------
+float4 main(VertexToPixel_LightVolume input) : SV_TARGET
+{
+    int3 pixel = int3(input.position.xy, 0);
+    float viewDepth = ViewDepthBuffer.Load(pixel).r;
+
+    float4 albedoRoughness = AlbedoRoughness.Load(pixel);
+    float3 normal = DecodeOctahedralNormal(NormalBuffer.Load(pixel).rg);
+    float3 worldPosition = ReconstructWorldPosition(input.position.xy, viewDepth, screenSize, view, projection, cameraPosition);
+
+    float3 color = CalcSpotLight(Lights[input.lightIndex], normal, worldPosition, cameraPosition, albedoRoughness.rgb, albedoRoughness.a);
+    return float4(color, 0);
+}
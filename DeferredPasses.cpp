@@ -0,0 +1,52 @@
+#include "DeferredPasses.h"
+
+void DeferredPasses::RecordGeometryBegin(CommandBuffer& commands, const DeferredPassResources& resources)
+{
+	// The G-buffer can't be read while it's being written
+	const void* nullViews[GBUFFER_TARGET_COUNT] = {};
+	commands.BindTextures(ShaderStage::Pixel, GBUFFER_FIRST_SLOT, GBUFFER_TARGET_COUNT, nullViews);
+	commands.SetRenderTargets(GBUFFER_TARGET_COUNT, resources.gBufferTargets, resources.depthStencil);
+}
+
+void DeferredPasses::RecordLighting(CommandBuffer& commands, const DeferredPassResources& resources, unsigned int outsideCount, unsigned int insideCount)
+{
+	commands.SetRenderTargets(1, &resources.backBuffer, resources.depthStencil);
+	commands.BindTextures(ShaderStage::Pixel, GBUFFER_FIRST_SLOT, GBUFFER_TARGET_COUNT, resources.gBufferViews);
+
+	// Ambient and directional lights reach every pixel
+	commands.SetRenderState(0, 0, 0);
+	commands.SetShaders(resources.fullscreenVS, resources.ambientPS);
+	commands.Draw(3, 0);
+
+	// Each outside volume marks, then lights, its own pixels.
+	// The lighting draw zeroes the stencil it passes, leaving
+	// the buffer clean for the next volume.
+	if (outsideCount + insideCount > 0)
+		commands.SetMesh(resources.volumeVertexBuffer, resources.volumeIndexBuffer, resources.volumeVertexStride);
+
+	for (unsigned int i = 0; i < outsideCount; i++)
+	{
+		commands.SetRenderState(resources.stencilMarkDepthState, resources.noColorBlendState, resources.cullNoneRasterizerState);
+		commands.SetShaders(resources.volumeVS, 0);
+		commands.DrawIndexedInstanced(resources.volumeIndexCount, 1, 0, 0, i);
+
+		commands.SetRenderState(resources.stencilTestDepthState, resources.additiveBlendState, resources.cullFrontRasterizerState);
+		commands.SetShaders(resources.volumeVS, resources.volumePS);
+		commands.DrawIndexedInstanced(resources.volumeIndexCount, 1, 0, 0, i);
+	}
+
+	// Inside volumes need no marking, so they all share one state
+	if (insideCount > 0)
+	{
+		commands.SetRenderState(resources.insideVolumeDepthState, resources.additiveBlendState, resources.cullFrontRasterizerState);
+		commands.SetShaders(resources.volumeVS, resources.volumePS);
+	}
+
+	for (unsigned int i = outsideCount; i < outsideCount + insideCount; i++)
+		commands.DrawIndexedInstanced(resources.volumeIndexCount, 1, 0, 0, i);
+
+	// Forward drawing continues on the lit back buffer
+	const void* nullViews[GBUFFER_TARGET_COUNT] = {};
+	commands.BindTextures(ShaderStage::Pixel, GBUFFER_FIRST_SLOT, GBUFFER_TARGET_COUNT, nullViews);
+	commands.SetRenderState(0, 0, 0);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CommandBuffer.h"
+
+// Albedo + roughness, octahedral normal, linear view depth
+#define GBUFFER_TARGET_COUNT 3
+
+// Shader registers for the deferred path
+#define GBUFFER_FIRST_SLOT 13	// PS t13-t15
+#define LIGHT_VOLUME_SLOT 1		// VS t1
+
+// --------------------------------------------------------
+// Every API object the deferred passes touch, as opaque
+// pointers so the passes can be scheduled without a GPU
+// --------------------------------------------------------
+struct DeferredPassResources
+{
+	// The same G-buffer textures, as targets and as views
+	const void* gBufferTargets[GBUFFER_TARGET_COUNT];
+	const void* gBufferViews[GBUFFER_TARGET_COUNT];
+	const void* backBuffer;
+	const void* depthStencil;
+
+	// Full screen ambient and directional light
+	const void* fullscreenVS;
+	const void* ambientPS;
+
+	// Light volumes: a sphere mesh's positions, drawn once per light
+	const void* volumeVS;
+	const void* volumePS;
+	const void* volumeVertexBuffer;
+	const void* volumeIndexBuffer;
+	unsigned int volumeVertexStride;
+	unsigned int volumeIndexCount;
+
+	// Stencil marking, then lighting the marked pixels
+	const void* stencilMarkDepthState;
+	const void* stencilTestDepthState;
+
+	// Camera inside the volume: light whatever lies in front of its back faces
+	const void* insideVolumeDepthState;
+	const void* noColorBlendState;
+	const void* additiveBlendState;
+	const void* cullNoneRasterizerState;
+	const void* cullFrontRasterizerState;
+};
+
+// --------------------------------------------------------
+// Records the passes of the deferred path.
+//
+// Geometry goes to the G-buffer first (with whatever draws
+// the caller records after RecordGeometryBegin), then the
+// lighting pass adds up every light into the back buffer:
+// one full screen pass for ambient and directional lights,
+// then each local light's volume.  A volume the camera is
+// outside of is drawn twice - once to mark, in the stencil
+// buffer, the pixels whose surface lies inside it, and once
+// to light only those.  One the camera is inside of covers
+// the whole view anyway, so its back faces light every pixel
+// in front of them in a single draw.
+// --------------------------------------------------------
+namespace DeferredPasses
+{
+	// Points output at the G-buffer and the scene's depth
+	void RecordGeometryBegin(CommandBuffer& commands, const DeferredPassResources& resources);
+
+	// Lights the G-buffer into the back buffer, then leaves the
+	// back buffer bound with default states for forward drawing.
+	// Volumes are in LightVolumes order: outside ones, then inside.
+	void RecordLighting(CommandBuffer& commands, const DeferredPassResources& resources, unsigned int outsideCount, unsigned int insideCount);
+}
@@ -0,0 +1,38 @@
+
+// Only the start of the per-frame buffer is needed here
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+}
+
+// Per-object data for the whole frame, indexed by draw ID
+// - Must match DrawTableObject in DrawTable.h
+struct DrawTableObject
+{
+    matrix world;
+    matrix worldInvTranspose;
+    uint materialIndex;
+    uint3 padding;
+};
+
+StructuredBuffer<DrawTableObject> ObjectTable : register(t0);
+
+
+// --------------------------------------------------------
+// Depth pre-pass vertex shader
+// 
+// - Reads only positions (from the mesh's position stream)
+// - No pixel shader runs after this, it only fills depth
+// - The transform must match VertexShader.hlsl exactly, since
+//   the lighting pass then tests depth with EQUAL
+// --------------------------------------------------------
+float4 main(float3 localPosition : POSITION, uint drawID : DRAWID) : SV_POSITION
+{
+    matrix world = ObjectTable[drawID].world;
+
+    precise float4 worldPosition = mul(world, float4(localPosition, 1.0f));
+    precise float4 screenPosition = mul(viewProjection, worldPosition);
+    return screenPosition;
+}
@@ -0,0 +1,44 @@
+#include "DrawTable.h"
+
+void DrawTable::Reset()
+{
+	this->objects.clear();
+	this->materials.clear();
+	this->materialIndices.clear();
+}
+
+unsigned int DrawTable::AddMaterial(const void* key, const PerMaterialData& data)
+{
+	auto it = this->materialIndices.find(key);
+	if (it != this->materialIndices.end())
+		return it->second;
+
+	unsigned int index = (unsigned int)this->materials.size();
+	this->materials.push_back(data);
+	this->materialIndices[key] = index;
+	return index;
+}
+
+unsigned int DrawTable::FindMaterial(const void* key) const
+{
+	auto it = this->materialIndices.find(key);
+	return it == this->materialIndices.end() ? DRAW_TABLE_INVALID_INDEX : it->second;
+}
+
+void DrawTable::ResizeObjects(unsigned int count)
+{
+	this->objects.resize(count);
+}
+
+void DrawTable::SetObject(unsigned int drawID, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& worldInvTranspose, unsigned int materialIndex)
+{
+	DrawTableObject& object = this->objects[drawID];
+	object.world = world;
+	object.worldInvTranspose = worldInvTranspose;
+	object.materialIndex = materialIndex;
+}
+
+const DrawTableObject* DrawTable::GetObjects() const { return this->objects.data(); }
+unsigned int DrawTable::GetObjectCount() const { return (unsigned int)this->objects.size(); }
+const PerMaterialData* DrawTable::GetMaterials() const { return this->materials.data(); }
+unsigned int DrawTable::GetMaterialCount() const { return (unsigned int)this->materials.size(); }
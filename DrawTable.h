@@ -0,0 +1,56 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "BufferStruct.h"
+
+// Returned when a material was never added to the table
+#define DRAW_TABLE_INVALID_INDEX 0xFFFFFFFFu
+
+// One entry per draw - must match DrawTableObject in VertexShader.hlsl
+struct DrawTableObject
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	uint32_t materialIndex;
+	uint32_t padding[3];
+};
+
+// --------------------------------------------------------
+// CPU side of the per-draw data tables.
+//
+// Every object drawn this frame gets a slot in one array,
+// indexed by its draw ID, and every material gets a slot
+// in another.  Shaders fetch from both by index instead of
+// having a constant buffer bound per draw.  Only packing
+// happens here; the D3D11DrawTable uploads the result.
+// --------------------------------------------------------
+class DrawTable
+{
+private:
+	std::vector<DrawTableObject> objects;
+	std::vector<PerMaterialData> materials;
+	std::unordered_map<const void*, unsigned int> materialIndices;
+
+public:
+	// Empties both tables but keeps their memory
+	void Reset();
+
+	// Materials are keyed by any stable pointer; adding
+	// the same key twice returns the original index
+	unsigned int AddMaterial(const void* key, const PerMaterialData& data);
+	unsigned int FindMaterial(const void* key) const;
+
+	// Objects are sized up front so ranges of draw IDs can be
+	// filled from several threads at once without locking
+	void ResizeObjects(unsigned int count);
+	void SetObject(unsigned int drawID, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& worldInvTranspose, unsigned int materialIndex);
+
+	// Getters
+	const DrawTableObject* GetObjects() const;
+	unsigned int GetObjectCount() const;
+	const PerMaterialData* GetMaterials() const;
+	unsigned int GetMaterialCount() const;
+};
@@ -0,0 +1,155 @@
+#include "EntityDraws.h"
+#include "BufferStruct.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+void EntityDraws::RecordDraws(CommandBuffer& commands, CommandBuffer* gBufferCommands, const EntityDrawSettings& settings, const DrawItem* items, unsigned int begin, unsigned int end)
+{
+	// Texture arrays and material bindings recorded so far in each
+	// command buffer, so runs of draws sharing them record them once
+	const void* boundArrays[2] = {};
+	const void* gBufferBoundArrays[2] = {};
+	const MaterialBindGroup* boundGroup = 0;
+	const MaterialBindGroup* gBufferBoundGroup = 0;
+
+	for (unsigned int i = begin; i < end; i++)
+	{
+		const DrawItem& item = items[i];
+		const DrawMesh& mesh = *item.mesh;
+		const DrawMaterial& material = *item.material;
+		XMFLOAT4X4 world = item.transform->GetWorldMatrix();
+		XMFLOAT4X4 worldInvTranspose = item.transform->GetWorldInverseTransposeMatrix();
+
+		// Pick this object's lights from its world space bounding sphere
+		if (settings.objectLightLists)
+		{
+			XMFLOAT3 scale = item.transform->GetScale();
+			float maxScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&mesh.boundsCenter), XMLoadFloat4x4(&world)));
+			settings.objectLightLists->Build(i, center, mesh.boundsRadius * maxScale, *settings.sortedLights);
+		}
+
+		// Every object gets a table slot, since the depth pre-pass
+		// reads its transform from there whichever path draws it
+		settings.drawTable->SetObject(i, world, worldInvTranspose, material.drawTableMaterial);
+
+		// Lit later from the G-buffer, so only its surface is written now
+		if (gBufferCommands && material.gBufferPixelShader)
+		{
+			gBufferCommands->SetShaders(settings.drawTableVS, material.gBufferPixelShader);
+			if (material.usesTextureArrays)
+				RecordTextureArrays(*gBufferCommands, material, gBufferBoundArrays);
+			RecordBindGroup(*gBufferCommands, *material.bindGroup, gBufferBoundGroup);
+			gBufferCommands->SetMesh(mesh.vertexBuffer, mesh.indexBuffer, mesh.vertexStride);
+			gBufferCommands->DrawIndexedInstanced(mesh.indexCount, 1, 0, 0, i);
+			continue;
+		}
+
+		// Table path: everything the shaders need is fetched by draw ID,
+		// so the draw itself is the only per-object command
+		if (settings.useDrawTable && material.drawTablePixelShader)
+		{
+			commands.SetShaders(settings.drawTableVS, material.drawTablePixelShader);
+			if (material.usesTextureArrays)
+				RecordTextureArrays(commands, material, boundArrays);
+			RecordBindGroup(commands, *material.bindGroup, boundGroup);
+			commands.SetMesh(mesh.vertexBuffer, mesh.indexBuffer, mesh.vertexStride);
+			commands.DrawIndexedInstanced(mesh.indexCount, 1, 0, 0, i);
+			continue;
+		}
+
+		commands.SetShaders(material.vertexShader, material.pixelShader);
+
+		// Only the transforms change per object, written straight into the allocation
+		DrawConstants objectAlloc = settings.constants->Allocate(sizeof(PerObjectData));
+		PerObjectData* objectData = static_cast<PerObjectData*>(objectAlloc.data);
+		objectData->world = world;
+		objectData->worldInvTranspose = worldInvTranspose;
+		objectData->drawID = i;
+		commands.BindConstantRange(ShaderStage::Vertex, 2, objectAlloc.firstConstant, objectAlloc.numConstants);
+
+		// Material constants already live on the GPU
+		commands.BindConstantBuffer(ShaderStage::Pixel, 1, material.constantBuffer);
+
+		if (material.usesTextureArrays)
+			RecordTextureArrays(commands, material, boundArrays);
+		RecordBindGroup(commands, *material.bindGroup, boundGroup);
+		commands.SetMesh(mesh.vertexBuffer, mesh.indexBuffer, mesh.vertexStride);
+		commands.DrawIndexed(mesh.indexCount, 0, 0);
+	}
+}
+
+// --------------------------------------------------------
+// Nearest first, so farther surfaces fail the depth test as
+// early as possible.
+// - Nothing is culled, so this draws exactly what the lit
+//   passes draw; anything it skipped would vanish under an
+//   EQUAL depth test
+// - Transforms are read from the draw table on the GPU
+// --------------------------------------------------------
+void EntityDraws::RecordDepthPrepass(CommandBuffer& commands, const void* vertexShader, const DrawItem* items, unsigned int count, const XMFLOAT4X4& view, std::vector<unsigned int>& order, std::vector<float>& depths)
+{
+	order.resize(count);
+	depths.resize(count);
+
+	// Sort by the view space depth of each bounding sphere's center
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 world = items[i].transform->GetWorldMatrix();
+		XMVECTOR viewCenter = XMVector3TransformCoord(XMLoadFloat3(&items[i].mesh->boundsCenter), XMLoadFloat4x4(&world) * viewMatrix);
+
+		depths[i] = XMVectorGetZ(viewCenter);
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(),
+		[&depths](unsigned int a, unsigned int b) { return depths[a] < depths[b]; });
+
+	// No pixel shader, only depth is written
+	commands.Reset();
+	commands.SetShaders(vertexShader, 0);
+	for (unsigned int i : order)
+	{
+		const DrawMesh& mesh = *items[i].mesh;
+		commands.SetMesh(mesh.positionBuffer, mesh.indexBuffer, sizeof(XMFLOAT3));
+		commands.DrawIndexedInstanced(mesh.indexCount, 1, 0, 0, i);
+	}
+}
+
+void EntityDraws::RecordBindGroup(CommandBuffer& commands, const MaterialBindGroup& group, const MaterialBindGroup*& bound)
+{
+	if (bound == &group)
+		return;
+	if (bound &&
+		bound->textureStart == group.textureStart && bound->textureCount == group.textureCount &&
+		bound->samplerStart == group.samplerStart && bound->samplerCount == group.samplerCount &&
+		!memcmp(bound->textures, group.textures, group.textureCount * sizeof(group.textures[0])) &&
+		!memcmp(bound->samplers, group.samplers, group.samplerCount * sizeof(group.samplers[0])))
+		return;
+
+	if (group.textureCount > 0)
+		commands.BindTextures(ShaderStage::Pixel, group.textureStart, group.textureCount, group.textures);
+	if (group.samplerCount > 0)
+		commands.BindSamplers(ShaderStage::Pixel, group.samplerStart, group.samplerCount, group.samplers);
+	bound = &group;
+}
+
+// With few arrays, the same ones are usually still bound
+void EntityDraws::RecordTextureArrays(CommandBuffer& commands, const DrawMaterial& material, const void* bound[2])
+{
+	const void* views[2] = {
+		material.textureArrays[0] ? material.textureArrays[0] : bound[0],
+		material.textureArrays[1] ? material.textureArrays[1] : bound[1] };
+	if (views[0] == bound[0] && views[1] == bound[1])
+		return;
+
+	commands.BindTextures(ShaderStage::Pixel, SURFACE_ARRAY_SLOT, 2, views);
+	bound[0] = views[0];
+	bound[1] = views[1];
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "CommandBuffer.h"
+#include "DrawTable.h"
+#include "Lights.h"
+#include "ObjectLightLists.h"
+#include "TextureArrays.h"
+#include "Transform.h"
+
+// Highest texture or sampler slot a material can fill, plus one
+#define MATERIAL_MAX_SLOTS MAX_COMMAND_BIND_COUNT
+
+// --------------------------------------------------------
+// A material's textures and samplers flattened into the slot
+// ranges they bind to, so each binds with a single call.
+// Empty slots inside a range are bound as null.
+// --------------------------------------------------------
+struct MaterialBindGroup
+{
+	unsigned int textureStart;
+	unsigned int textureCount;
+	const void* textures[MATERIAL_MAX_SLOTS];
+
+	unsigned int samplerStart;
+	unsigned int samplerCount;
+	const void* samplers[MATERIAL_MAX_SLOTS];
+};
+
+// --------------------------------------------------------
+// What a draw needs from a mesh: its buffers, as opaque
+// pointers, and its local space bounding sphere
+// --------------------------------------------------------
+struct DrawMesh
+{
+	const void* vertexBuffer;
+	const void* positionBuffer;
+	const void* indexBuffer;
+	unsigned int vertexStride;
+	unsigned int indexCount;
+	DirectX::XMFLOAT3 boundsCenter;
+	float boundsRadius;
+};
+
+// --------------------------------------------------------
+// What a draw needs from a material this frame.  Shaders a
+// material has no permutation for are null, and so are the
+// arrays of slots not kept in a texture array.
+// --------------------------------------------------------
+struct DrawMaterial
+{
+	const void* vertexShader;
+	const void* pixelShader;
+	const void* drawTablePixelShader;
+	const void* gBufferPixelShader;
+	const void* constantBuffer;
+	const MaterialBindGroup* bindGroup;
+	bool usesTextureArrays;
+	const void* textureArrays[2];	// Surface and normal, bound at SURFACE_ARRAY_SLOT
+	unsigned int drawTableMaterial;
+};
+
+// One entity: its draw ID is its index in the draw list
+struct DrawItem
+{
+	const DrawMesh* mesh;
+	const DrawMaterial* material;
+	Transform* transform;
+};
+
+// --------------------------------------------------------
+// Hands out per-object constants.  Called from several
+// recording threads at once, and must never give two calls
+// overlapping space.
+// --------------------------------------------------------
+struct DrawConstants
+{
+	void* data;					// Where to write
+	unsigned int firstConstant;	// Binding offset, in 16-byte constants
+	unsigned int numConstants;	// Binding size, in 16-byte constants
+};
+
+class DrawConstantAllocator
+{
+public:
+	virtual ~DrawConstantAllocator() = default;
+	virtual DrawConstants Allocate(unsigned int dataSizeInBytes) = 0;
+};
+
+// Everything shared by every range of a frame's draws
+struct EntityDrawSettings
+{
+	const void* drawTableVS;
+	bool useDrawTable;
+	DrawTable* drawTable;
+
+	// Only when lights are picked per object
+	ObjectLightLists* objectLightLists;
+	const std::vector<Light>* sortedLights;
+
+	// Only used by draws without the table
+	DrawConstantAllocator* constants;
+};
+
+// --------------------------------------------------------
+// Records the entity draws of a frame, the same way whether
+// they're replayed onto a GPU or into a null backend.
+//
+// Each draw goes down one of three paths: into the G-buffer
+// when deferred and the material can be, by draw ID from the
+// draw table, or with its own transforms in per-object
+// constants.  Bindings that haven't changed since the last
+// draw in the same command buffer aren't recorded again.
+// --------------------------------------------------------
+namespace EntityDraws
+{
+	// Records items [begin, end) into commands, and fills their
+	// draw table slots and light lists.  Only reads shared state,
+	// so several ranges can be recorded at once on different
+	// threads.  On the deferred path, gBufferCommands gets every
+	// item whose material can be written to the G-buffer.
+	void RecordDraws(CommandBuffer& commands, CommandBuffer* gBufferCommands, const EntityDrawSettings& settings, const DrawItem* items, unsigned int begin, unsigned int end);
+
+	// A depth-only draw of every item, nearest bounding sphere
+	// center first.  order and depths are scratch space kept
+	// between frames.
+	void RecordDepthPrepass(CommandBuffer& commands, const void* vertexShader, const DrawItem* items, unsigned int count, const DirectX::XMFLOAT4X4& view, std::vector<unsigned int>& order, std::vector<float>& depths);
+
+	// Records a group, unless bound already has the same bindings,
+	// then points bound at it
+	void RecordBindGroup(CommandBuffer& commands, const MaterialBindGroup& group, const MaterialBindGroup*& bound);
+
+	// Records a material's texture arrays, unless the same ones are
+	// already bound.  bound is what was last bound at t4 and t5.
+	void RecordTextureArrays(CommandBuffer& commands, const DrawMaterial& material, const void* bound[2]);
+}
@@ -0,0 +1,98 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameStats::FrameStats(float budget, unsigned int window)
+{
+	this->window = std::max(window, 1u);
+	this->times.resize(this->window);
+	this->sorted.resize(this->window);
+	this->budget = budget;
+	Reset();
+}
+
+void FrameStats::AddFrame(float milliseconds)
+{
+	this->times[this->next] = milliseconds;
+	this->next = (this->next + 1) % this->window;
+	this->count = std::min(this->count + 1, this->window);
+
+	this->totalFrames++;
+	if (milliseconds > this->budget)
+		this->totalHitches++;
+}
+
+void FrameStats::Reset()
+{
+	this->next = 0;
+	this->count = 0;
+	this->totalFrames = 0;
+	this->totalHitches = 0;
+}
+
+void FrameStats::SetBudget(float milliseconds)
+{
+	this->budget = milliseconds;
+}
+
+// --------------------------------------------------------
+// Sorts a copy of the window and reads percentiles off it by
+// nearest rank: the smallest time at least that fraction of
+// frames are no slower than
+// --------------------------------------------------------
+FrameStatsSummary FrameStats::Summarize()
+{
+	FrameStatsSummary summary = {};
+	summary.frameCount = this->count;
+	summary.budget = this->budget;
+	if (this->count == 0)
+		return summary;
+
+	float total = 0.0f;
+	for (unsigned int i = 0; i < this->count; i++)
+	{
+		this->sorted[i] = this->times[i];
+		total += this->times[i];
+		if (this->times[i] > this->budget)
+			summary.hitchCount++;
+	}
+	std::sort(this->sorted.begin(), this->sorted.begin() + this->count);
+
+	auto percentile = [this](float fraction) {
+		unsigned int rank = (unsigned int)std::ceil(fraction * this->count);
+		return this->sorted[std::clamp(rank, 1u, this->count) - 1];
+	};
+	summary.average = total / this->count;
+	summary.p50 = percentile(0.5f);
+	summary.p90 = percentile(0.9f);
+	summary.p99 = percentile(0.99f);
+	summary.p999 = percentile(0.999f);
+	summary.max = this->sorted[this->count - 1];
+	return summary;
+}
+
+void FrameStats::BuildHistogram(float* buckets, unsigned int bucketCount, float maxMilliseconds) const
+{
+	std::fill(buckets, buckets + bucketCount, 0.0f);
+	if (bucketCount == 0 || maxMilliseconds <= 0.0f)
+		return;
+
+	for (unsigned int i = 0; i < this->count; i++)
+	{
+		unsigned int bucket = (unsigned int)(this->times[i] / maxMilliseconds * bucketCount);
+		buckets[std::min(bucket, bucketCount - 1)] += 1.0f;
+	}
+}
+
+float FrameStats::GetFrameTime(unsigned int index) const
+{
+	unsigned int oldest = this->count < this->window ? 0 : this->next;
+	return this->times[(oldest + index) % this->window];
+}
+
+unsigned int FrameStats::GetCount() const { return this->count; }
+unsigned int FrameStats::GetWindow() const { return this->window; }
+uint64_t FrameStats::GetTotalFrames() const { return this->totalFrames; }
+uint64_t FrameStats::GetTotalHitches() const { return this->totalHitches; }
+float FrameStats::GetBudget() const { return this->budget; }
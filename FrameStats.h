@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define FRAME_STATS_WINDOW 1024					// Frames the percentiles cover, by default
+#define FRAME_STATS_DEFAULT_BUDGET (1000.0f / 60.0f)	// Milliseconds, past which a frame is a hitch
+
+// Percentiles of the frame times in the window, in milliseconds
+struct FrameStatsSummary
+{
+	unsigned int frameCount;
+	float average;
+	float p50;
+	float p90;
+	float p99;
+	float p999;
+	float max;
+	unsigned int hitchCount;	// Frames over budget in the window
+	float budget;
+};
+
+// --------------------------------------------------------
+// Rolling frame time statistics.  The last window frame
+// times live in a fixed ring, so adding a frame is a single
+// store; percentiles are worked out on request from a scratch
+// copy of the ring.  Nothing allocates after construction.
+// --------------------------------------------------------
+class FrameStats
+{
+private:
+	std::vector<float> times;
+	std::vector<float> sorted;	// Scratch for Summarize()
+	unsigned int window;
+	unsigned int next;
+	unsigned int count;
+	uint64_t totalFrames;
+	uint64_t totalHitches;
+	float budget;
+
+public:
+	FrameStats(float budget = FRAME_STATS_DEFAULT_BUDGET, unsigned int window = FRAME_STATS_WINDOW);
+
+	void AddFrame(float milliseconds);
+	void Reset();
+	void SetBudget(float milliseconds);
+
+	FrameStatsSummary Summarize();
+
+	// Counts the window's frame times into bucketCount equal
+	// buckets from 0 to maxMilliseconds; longer ones go in the last
+	void BuildHistogram(float* buckets, unsigned int bucketCount, float maxMilliseconds) const;
+
+	// Getters
+	float GetFrameTime(unsigned int index) const;	// 0 is the oldest in the window
+	unsigned int GetCount() const;
+	unsigned int GetWindow() const;
+	uint64_t GetTotalFrames() const;
+	uint64_t GetTotalHitches() const;
+	float GetBudget() const;
+};
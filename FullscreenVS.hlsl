@@ -0,0 +1,14 @@
+#include "ShaderInclude.hlsli"
+
+// --------------------------------------------------------
+// One triangle big enough to cover the screen, made from
+// the vertex ID alone - no vertex or index buffer needed
+// --------------------------------------------------------
+VertexToPixel_Fullscreen main(uint vertexID : SV_VertexID)
+{
+    float2 uv = float2((vertexID << 1) & 2, vertexID & 2);
+
+    VertexToPixel_Fullscreen output;
+    output.position = float4(uv.x * 2.0f - 1.0f, 1.0f - uv.y * 2.0f, 0.0f, 1.0f);
+    return output;
+}
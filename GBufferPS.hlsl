@@ -0,0 +1,67 @@
+#include "ShaderInclude.hlsli"
+
+// Built on its own (as GBufferPS.cso) this is the general
+// version with every feature on.  The ShaderLibrary compiles
+// variants with only the USE_* features a material needs.
+#ifndef SHADER_PERMUTATION
+#define USE_TEXTURE
+#define USE_NORMAL_MAP
+#endif
+
+Texture2D SurfaceTexture : register(t0);
+Texture2D NormalMap : register(t1);
+SamplerState BasicSampler : register(s0);
+
+// Shared arrays instead, as in PixelShader.hlsl
+#ifdef USE_TEXTURE_ARRAYS
+Texture2DArray SurfaceArray : register(t4);
+Texture2DArray NormalArray : register(t5);
+#endif
+
+// Only the start of the per-frame buffer is needed here
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+}
+
+// G-buffer draws always go through the draw table
+StructuredBuffer<MaterialData> MaterialTable : register(t8);
+
+// One value per G-buffer target - formats are set in D3D11DeferredRenderer.cpp
+struct GBufferOutput
+{
+    float4 albedoRoughness : SV_TARGET0;
+    float2 normal : SV_TARGET1;
+    float viewDepth : SV_TARGET2;
+};
+
+// --------------------------------------------------------
+// Writes a surface's material inputs instead of lighting it;
+// DeferredAmbientPS and DeferredLightPS do that afterwards
+// --------------------------------------------------------
+GBufferOutput main(VertexToPixel input)
+{
+    MaterialData material = MaterialTable[input.materialIndex];
+    float2 uv = input.uv * material.uvScale + material.uvOffset;
+
+    float3 normal = normalize(input.normal);
+#if defined(USE_NORMAL_MAP) && defined(USE_TEXTURE_ARRAYS)
+    normal = normalize(ApplyNormalMap(SampleTextureSlice(NormalArray, BasicSampler, uv, material.normalRect, material.normalSlice), normal, normalize(input.tangent)));
+#elif defined(USE_NORMAL_MAP)
+    normal = normalize(NormalMapping(NormalMap, BasicSampler, uv, normal, normalize(input.tangent)));
+#endif
+
+#if defined(USE_TEXTURE) && defined(USE_TEXTURE_ARRAYS)
+    float4 surfaceColor = SampleTextureSlice(SurfaceArray, BasicSampler, uv, material.surfaceRect, material.surfaceSlice) * material.colorTint;
+#elif defined(USE_TEXTURE)
+    float4 surfaceColor = SurfaceTexture.Sample(BasicSampler, uv) * material.colorTint;
+#else
+    float4 surfaceColor = material.colorTint;
+#endif
+
+    GBufferOutput output;
+    output.albedoRoughness = float4(surfaceColor.rgb, material.roughness);
+    output.normal = EncodeOctahedralNormal(normal);
+    output.viewDepth = mul(view, float4(input.worldPosition, 1.0f)).z;
+    return output;
+}
@@ -9,14 +9,15 @@
 #include "Entity.h"
 #include "BufferStruct.h"
 #include "Camera.h"
-#include "WICTextureLoader.h"
+#include "JobSystem.h"
+#include "D3D11CommandBackend.h"
+#include "ShaderLibrary.h"
+#include "StateCache.h"
+#include "Profiler.h"
+#include "D3D11GpuTimerBackend.h"
 
 #include <DirectXMath.h>
 
-// Needed for a helper function to load pre-compiled shader files
-#pragma comment(lib, "d3dcompiler.lib")
-#include <d3dcompiler.h>
-
 // This code assumes files are in "ImGui" subfolder!
 // Adjust as necessary for your own folder structure and project setup
 #include "ImGui/imgui.h"
@@ -24,17 +25,52 @@
 #include "ImGui/imgui_impl_win32.h"
 
 #include <string.h>
+#include <algorithm>
 #include <memory>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
 
 // For the DirectX Math library
 using namespace DirectX;
 
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	// Per-object constants for EntityDraws, straight from the
+	// ring mapped by Graphics::BeginConstantUpload()
+	class RingConstantAllocator : public DrawConstantAllocator
+	{
+	public:
+		DrawConstants Allocate(unsigned int dataSizeInBytes) override
+		{
+			Graphics::ConstantAllocation allocation = Graphics::AllocateConstants(dataSizeInBytes);
+			return { allocation.data, allocation.firstConstant, allocation.numConstants };
+		}
+	};
+}
+
 // --------------------------------------------------------
 // The constructor is called after the window and graphics API
 // are initialized but before the game loop begins
 // --------------------------------------------------------
 Game::Game()
 {
+	// The render path can only be picked before anything is loaded
+	if (wcsstr(GetCommandLineW(), L"-deferred"))
+		renderPath = RenderPath::Deferred;
+	if (const wchar_t* threads = wcsstr(GetCommandLineW(), L"-loaderthreads "))
+		textureLoaderThreads = (unsigned int)wcstoul(threads + wcslen(L"-loaderthreads "), 0, 10);
+	if (const wchar_t* budget = wcsstr(GetCommandLineW(), L"-texturebudget "))
+		textureBudgetMB = (int)wcstoul(budget + wcslen(L"-texturebudget "), 0, 10);
+
+	// Traces startup and the first frames, for chrome://tracing
+	if (wcsstr(GetCommandLineW(), L"-profilecapture"))
+		Profiler::StartCapture(PROFILER_HISTORY, FixPath("Profile.json"));
+
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
@@ -142,6 +178,9 @@ Game::Game()
 // --------------------------------------------------------
 Game::~Game()
 {
+	ShaderLibrary::ShutDown();
+	StateCache::ShutDown();
+
 	//ImGui clean up
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -149,56 +188,6 @@ Game::~Game()
 }
 
 
-// Helper methods for vertex and pixel shader loading,
-// Create shader objects
-Microsoft::WRL::ComPtr<ID3D11PixelShader>  Game::LoadPixelShader(const wchar_t* filePath) {
-	// BLOBs (or Binary Large OBjects) for reading raw data from external files
-	// - This is a simplified way of handling big chunks of external data
-	// - Literally just a big array of bytes read from a file
-	ID3DBlob* pixelShaderBlob;
-
-	// Read our compiled shader code files into blobs
-		// - Essentially just "open the file and plop its contents here"
-		// - Uses the custom FixPath() helper from Helpers.h to ensure relative paths
-		// - Note the "L" before the string - this tells the compiler the string uses wide characters
-	D3DReadFileToBlob(FixPath(filePath).c_str(), &pixelShaderBlob);
-
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader;
-
-	// Create the actual Direct3D shaders on the GPU
-	Graphics::Device->CreatePixelShader(
-		pixelShaderBlob->GetBufferPointer(),	// Pointer to blob's contents
-		pixelShaderBlob->GetBufferSize(),		// How big is that data?
-		0,										// No classes in this shader
-		pixelShader.GetAddressOf());			// Address of the ID3D11PixelShader pointer
-
-	return pixelShader;
-}
-
-
-Microsoft::WRL::ComPtr<ID3D11VertexShader>  Game::LoadVertexShader(const wchar_t* filePath) {
-	// BLOBs (or Binary Large OBjects) for reading raw data from external files
-	// - This is a simplified way of handling big chunks of external data
-	// - Literally just a big array of bytes read from a file
-	ID3DBlob* vertexShaderBlob;
-
-	// Read our compiled shader code files into blobs
-		// - Essentially just "open the file and plop its contents here"
-		// - Uses the custom FixPath() helper from Helpers.h to ensure relative paths
-		// - Note the "L" before the string - this tells the compiler the string uses wide characters
-	D3DReadFileToBlob(FixPath(filePath).c_str(), &vertexShaderBlob);
-
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader;
-
-	Graphics::Device->CreateVertexShader(
-		vertexShaderBlob->GetBufferPointer(),	// Get a pointer to the blob's contents
-		vertexShaderBlob->GetBufferSize(),		// How big is that data?
-		0,										// No classes in this shader
-		vertexShader.GetAddressOf());			// The address of the ID3D11VertexShader pointer
-
-	return vertexShader;
-}
-
 // --------------------------------------------------------
 // Loads shaders from compiled shader object (.cso) files
 // and also created the Input Layout that describes our 
@@ -209,6 +198,8 @@ Microsoft::WRL::ComPtr<ID3D11VertexShader>  Game::LoadVertexShader(const wchar_t
 // --------------------------------------------------------
 void Game::GeneratingAssetsAndEntities()
 {
+	PROFILE_SCOPE("Load assets");
+
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 
 	D3D11_SAMPLER_DESC samplerDesc = {};
@@ -218,150 +209,36 @@ void Game::GeneratingAssetsAndEntities()
 	samplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	samplerDesc.MaxAnisotropy = 16;
 	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX; // Maximum mip level
-	Graphics::Device->CreateSamplerState(&samplerDesc, samplerState.GetAddressOf());
-
-	// creating multiple texture SRVs
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
-
-	// creating mipmaps of textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> tatamiSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> tatamiNormalMap;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodFloorSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodFloorNormalMap;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> nightSkySRV;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockColorSRV;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobbleSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobbleNormalMap;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockNormalMap;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockyTerrainSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockyTerrainNormalMap;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> tideLogoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> flatNormalSRV;
-
-
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/flat_normals.png").c_str(),
-		0,
-		flatNormalSRV.GetAddressOf()
-	);
-
-
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/Tatami/tatami_mat_diff_4k.png").c_str(),
-		0,
-		tatamiSRV.GetAddressOf()
-	);
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/Tatami/tatami_mat_nor_dx.png").c_str(),
-		0,
-		tatamiNormalMap.GetAddressOf()
-	);
-
-	// creating mipmaps of textures
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/Wood_Floor/wood_floor_diff_4k.png").c_str(),
-		0,
-		woodFloorSRV.GetAddressOf()
-	);
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/Wood_Floor/wood_floor_nor_dx_4k.png").c_str(),
-		0,
-		woodFloorNormalMap.GetAddressOf()
-	);
-
-
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone.png").c_str(),
-		0,
-		cobbleSRV.GetAddressOf()
-	);
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/cobblestone_normals.png").c_str(),
-		0,
-		cobbleNormalMap.GetAddressOf()
-	);
-
-
-	// creating mipmaps of textures
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/NightSky.jpg").c_str(),
-		0,
-		nightSkySRV.GetAddressOf()
-	);
-
-	// creating mipmaps of textures
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/RockColor.png").c_str(),
-		0,
-		rockColorSRV.GetAddressOf()
-	);
-
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/rock.png").c_str(),
-		0,
-		rockSRV.GetAddressOf()
-	);
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/rock_normals.png").c_str(),
-		0,
-		rockNormalMap.GetAddressOf()
-	);
-
-
-	// creating mipmaps of textures
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/rocky_terrain.png").c_str(),
-		0,
-		rockyTerrainSRV.GetAddressOf()
-	);
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/rocky_terrain_nor_dx.png").c_str(),
-		0,
-		rockyTerrainNormalMap.GetAddressOf()
-	);
-
-	// creating mipmaps of textures
-	DirectX::CreateWICTextureFromFile(
-		Graphics::Device.Get(),
-		Graphics::Context.Get(),
-		FixPath(L"../../Assets/Textures/Tide_Logo_RGB_2014.png").c_str(),
-		0,
-		tideLogoSRV.GetAddressOf()
-	);
+	samplerState = StateCache::GetSamplerState(samplerDesc);
+
+	// Textures decode on the loader's threads while the rest of startup
+	// carries on.  Materials show a flat fallback until theirs arrive,
+	// which fills the same slots so their shader variants don't change.
+	// - Baked textures stream instead: only their smallest mips are read
+	//   now, the rest once something on screen needs them
+	textureLoader = std::make_shared<TextureLoader>(textureLoaderThreads);
+	textureStreamer = std::make_shared<D3D11TextureStreamer>((uint64_t)textureBudgetMB * 1024 * 1024);
+	textureArrays = std::make_shared<D3D11TextureArrays>();
+	gpuProfiler = std::make_shared<GpuProfiler>(std::make_shared<D3D11GpuTimerBackend>());
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> whiteTexture = TextureLoader::CreateSolidTexture(0xFFFFFFFF);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> flatNormalTexture = TextureLoader::CreateSolidTexture(0xFFFF8080);
+	auto loadTexture = [&](std::shared_ptr<Material> material, unsigned int slot, const wchar_t* path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> fallback) {
+		material->AddTextureSRV(fallback, slot);
+		auto onStreamed = [material, slot](Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) {
+			material->AddTextureSRV(srv, slot);
+		};
+
+		// Streamed textures keep changing size, so only fully loaded
+		// ones can be copied into the shared texture arrays
+		int streamed = textureStreamer->Add(FixPath(path), onStreamed);
+		if (streamed >= 0)
+			streamedTextures[material.get()].push_back((unsigned int)streamed);
+		else
+			textureLoader->Load(FixPath(path), [this, material, slot](Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) {
+				material->AddTextureSRV(srv, slot);
+				AddToTextureArrays(*material, slot);
+			});
+	};
 
 
 	///https://rgbcolorpicker.com/0-1
@@ -380,18 +257,27 @@ void Game::GeneratingAssetsAndEntities()
 	// Loading shaders
 	//  - Visual Studio will compile our shaders at build time
 	//  - They are saved as .cso (Compiled Shader Object) files
-	//  - We need to load them when the application starts
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> basicVertexShader = LoadVertexShader(L"VertexShader.cso");
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS = LoadVertexShader(L"SkyVS.cso");
+	//  - The library packs those into one archive and maps it, so this
+	//    is a single file open no matter how many shaders there are
+	//  - Sources for specialized variants are in the project folder, next to the Assets,
+	//    which is ../../ from Visual Studio's output folder.  Variants compiled from them
+	//    are cached in the archive, so a build run from elsewhere still gets every
+	//    variant an earlier run compiled, and only falls back for ones it never saw
+	auto shaderLoadStart = std::chrono::high_resolution_clock::now();
+	ShaderLibrary::Initialize(FixPath(L"../../"), FixPath(L""));
+
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> basicVertexShader = ShaderLibrary::LoadVertexShader(L"VertexShader.cso");
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS = ShaderLibrary::LoadVertexShader(L"SkyVS.cso");
+	depthPrepassVS = ShaderLibrary::LoadVertexShader(L"DepthPrepassVS.cso");
 
 	//pixel shaders
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> basicPixelShader = LoadPixelShader(L"PixelShader.cso");
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> debugUVPixelShader = LoadPixelShader(L"DebugUVsPS.cso");
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> debugNormalPixelShader = LoadPixelShader(L"DebugNormalsPS.cso");
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> customPixelShader = LoadPixelShader(L"CustomPS.cso");
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> combinerPixelShader = LoadPixelShader(L"CombinerPS.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> basicPixelShader = ShaderLibrary::LoadPixelShader(L"PixelShader.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> debugUVPixelShader = ShaderLibrary::LoadPixelShader(L"DebugUVsPS.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> debugNormalPixelShader = ShaderLibrary::LoadPixelShader(L"DebugNormalsPS.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> customPixelShader = ShaderLibrary::LoadPixelShader(L"CustomPS.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> combinerPixelShader = ShaderLibrary::LoadPixelShader(L"CombinerPS.cso");
 
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS = LoadPixelShader(L"SkyPS.cso");
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS = ShaderLibrary::LoadPixelShader(L"SkyPS.cso");
 
 
 	// creating materials
@@ -418,31 +304,30 @@ void Game::GeneratingAssetsAndEntities()
 	std::shared_ptr<Material> tideTatamiMat = std::make_shared<Material>("Tide + Tatami", transparent,0.0f, basicVertexShader, combinerPixelShader);
 
 
-	tatamiMatOG->AddTextureSRV(tatamiSRV, 0);
-	tatamiMatOG->AddTextureSRV(tatamiNormalMap, 1);
+	loadTexture(tatamiMatOG, 0, L"../../Assets/Textures/Tatami/tatami_mat_diff_4k.png", whiteTexture);
+	loadTexture(tatamiMatOG, 1, L"../../Assets/Textures/Tatami/tatami_mat_nor_dx.png", flatNormalTexture);
 	tatamiMatOG->AddSamplerState(samplerState, 0);
 
 
-	nightSky->AddTextureSRV(nightSkySRV, 0);
-	nightSky->AddTextureSRV(flatNormalSRV, 1);
+	loadTexture(nightSky, 0, L"../../Assets/Textures/NightSky.jpg", whiteTexture);
 	nightSky->AddSamplerState(samplerState, 0);
 
-	rock->AddTextureSRV(rockSRV, 0);
-	rock->AddTextureSRV(rockNormalMap, 1);
+	loadTexture(rock, 0, L"../../Assets/Textures/rock.png", whiteTexture);
+	loadTexture(rock, 1, L"../../Assets/Textures/rock_normals.png", flatNormalTexture);
 	rock->AddSamplerState(samplerState, 0);
 
-	rockyTerrain->AddTextureSRV(rockyTerrainSRV, 0);
-	rockyTerrain->AddTextureSRV(rockyTerrainNormalMap, 1);
+	loadTexture(rockyTerrain, 0, L"../../Assets/Textures/rocky_terrain.png", whiteTexture);
+	loadTexture(rockyTerrain, 1, L"../../Assets/Textures/rocky_terrain_nor_dx.png", flatNormalTexture);
 	rockyTerrain->AddSamplerState(samplerState, 0);
 
 	//combining
-	tideTatamiMat->AddTextureSRV(tideLogoSRV, 0);
-	tideTatamiMat->AddTextureSRV(tatamiSRV, 1);
+	loadTexture(tideTatamiMat, 0, L"../../Assets/Textures/Tide_Logo_RGB_2014.png", whiteTexture);
+	loadTexture(tideTatamiMat, 1, L"../../Assets/Textures/Tatami/tatami_mat_diff_4k.png", whiteTexture);
 
 	tideTatamiMat->AddSamplerState(samplerState, 0);
 
-	cobbleStoneMat->AddTextureSRV(cobbleSRV, 0);
-	cobbleStoneMat->AddTextureSRV(cobbleNormalMap, 1);
+	loadTexture(cobbleStoneMat, 0, L"../../Assets/Textures/cobblestone.png", whiteTexture);
+	loadTexture(cobbleStoneMat, 1, L"../../Assets/Textures/cobblestone_normals.png", flatNormalTexture);
 	cobbleStoneMat->AddSamplerState(samplerState, 0);
 
 
@@ -462,6 +347,28 @@ void Game::GeneratingAssetsAndEntities()
 	this->materialsList.push_back(tideTatamiMat);
 	this->materialsList.push_back(cobbleStoneMat);
 
+	// Materials using the basic lit shader get variants specialized to their
+	// textures and the scene's lights, including their draw table variant
+	for (std::shared_ptr<Material>& material : this->materialsList) {
+		if (material->GetPixelShader() == basicPixelShader)
+			material->SetShaderSource(L"PixelShader.hlsl");
+	}
+
+	// Those materials' fallbacks go into the shared texture arrays now
+	// (as atlas entries, being tiny) and loaded textures as they arrive
+	for (std::shared_ptr<Material>& material : this->materialsList) {
+		for (auto& [slot, srv] : material->GetTextureMap()) {
+			if (srv == whiteTexture || srv == flatNormalTexture)
+				AddToTextureArrays(*material, slot);
+		}
+	}
+
+	drawTableVS = ShaderLibrary::GetVertexShader(L"VertexShader.hlsl", SHADER_FEATURE_DRAW_TABLE);
+	drawTableBuffers = std::make_shared<D3D11DrawTable>();
+	lightClusterBuffers = std::make_shared<D3D11LightClusters>();
+	objectLightBuffer = std::make_shared<StructuredBuffer>((unsigned int)sizeof(ObjectLightList));
+	renderGraphPool = std::make_shared<D3D11RenderGraphPool>();
+
 
 
 	// creating entities
@@ -489,18 +396,58 @@ void Game::GeneratingAssetsAndEntities()
 
 	skyMesh = std::make_shared<Mesh>(FixPath("../../Assets/Meshes/cube.obj").c_str());
 
+	// The sky starts out the background color until its faces arrive
 	sky = std::make_shared<Sky>(
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/right.png").c_str(),
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/left.png").c_str(),
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/up.png").c_str(),
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/down.png").c_str(),
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/front.png").c_str(),
-		FixPath(L"../../Assets/Skies/CloudsBlueSky/back.png").c_str(),
+		TextureLoader::CreateSolidTexture(0xFFBF9966, true),
 		samplerState,
 		skyVS,
 		skyPS,
 		skyMesh
 	);
+	std::wstring skyFaces[6] = {
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/right.png"),
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/left.png"),
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/up.png"),
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/down.png"),
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/front.png"),
+		FixPath(L"../../Assets/Skies/CloudsBlueSky/back.png") };
+	// Ambient light from the sky comes straight from the cache if the
+	// faces haven't changed, otherwise it's baked once they've decoded
+	environmentBuffers = std::make_shared<D3D11ImageBasedLighting>();
+	std::wstring environmentCachePath = FixPath(L"SkyLighting.ibl");
+	uint64_t skyHash = IBLBaker::HashFiles(skyFaces, 6);
+	environmentFromCache = IBLBaker::LoadCache(environmentCachePath, skyHash, environmentLighting);
+	TextureLoader::DecodedCubeFunction bakeEnvironment = 0;
+	if (environmentFromCache)
+	{
+		environmentBuffers->Upload(environmentLighting);
+		printf("Sky lighting: loaded from cache\n");
+	}
+	else
+	{
+		bakeEnvironment = [this, environmentCachePath, skyHash](const TextureLoader::DecodedCube& cube) {
+			// Lighting is blurry anyway, so bake from a mip of 128 or smaller
+			unsigned int mip = 0;
+			while (mip + 1 < cube.mipLevels && (cube.width >> mip) > 128)
+				mip++;
+			const uint8_t* faces[6];
+			for (unsigned int i = 0; i < 6; i++)
+				faces[i] = cube.GetLevel(i, mip);
+
+			auto bakeStart = std::chrono::high_resolution_clock::now();
+			environmentLighting = IBLBaker::Bake(IBLBaker::CreateSource(faces, std::max(1u, cube.width >> mip), cube.sRGB));
+			environmentBakeMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - bakeStart).count();
+
+			environmentBuffers->Upload(environmentLighting);
+			IBLBaker::SaveCache(environmentCachePath, skyHash, environmentLighting);
+			printf("Sky lighting: baked in %.2f ms on %u threads\n", environmentBakeMilliseconds, JobSystem::WorkerCount() + 1);
+		};
+	}
+
+	std::shared_ptr<Sky> loadingSky = sky;
+	textureLoader->LoadCube(skyFaces, [loadingSky](Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) {
+		loadingSky->SetCubemap(srv);
+	}, bakeEnvironment);
 
 
 
@@ -509,10 +456,14 @@ void Game::GeneratingAssetsAndEntities()
 	//  - In other words, it describes how to interpret data (numbers) in a vertex buffer
 	//  - Doing this NOW because it requires a vertex shader's byte code to verify against!
 	//  - Luckily, we already have that loaded (the vertex shader blob above)
-	ID3DBlob* vertexShaderBlob;
-	D3DReadFileToBlob(FixPath(L"VertexShader.cso").c_str(), &vertexShaderBlob);
+	//  - Verified against the draw table shader, since it uses every element;
+	//    shaders that skip the per-instance draw ID can share the same layout
+	//  - Falls back to the prebuilt basic shader if the variant couldn't be compiled
+	Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob = ShaderLibrary::GetVertexShaderByteCode(L"VertexShader.hlsl", SHADER_FEATURE_DRAW_TABLE);
+	if (!vertexShaderBlob)
+		vertexShaderBlob = ShaderLibrary::GetVertexShaderByteCode(L"VertexShader.cso");
 
-	D3D11_INPUT_ELEMENT_DESC inputElements[4] = {};
+	D3D11_INPUT_ELEMENT_DESC inputElements[5] = {};
 
 	// Set up the first element - a position, which is 3 float values
 	inputElements[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;				// Most formats are described as color channels; really it just means "Three 32-bit floats"
@@ -534,18 +485,65 @@ void Game::GeneratingAssetsAndEntities()
 	inputElements[3].SemanticName = "TANGENT";
 	inputElements[3].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 
+	// Set up the fifth element - a draw ID, read once per instance from its own stream
+	inputElements[4].Format = DXGI_FORMAT_R32_UINT;
+	inputElements[4].SemanticName = "DRAWID";
+	inputElements[4].InputSlot = DRAW_TABLE_DRAW_ID_STREAM;
+	inputElements[4].AlignedByteOffset = 0;
+	inputElements[4].InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+	inputElements[4].InstanceDataStepRate = 1;
+
 	// Create the input layout, verifying our description against actual shader code
-	Graphics::Device->CreateInputLayout(
-		inputElements,							// An array of descriptions
-		4,										// How many elements in that array?
-		vertexShaderBlob->GetBufferPointer(),	// Pointer to the code of a shader that uses this layout
-		vertexShaderBlob->GetBufferSize(),		// Size of the shader code that uses this layout
-		inputLayout.GetAddressOf());			// Address of the resulting ID3D11InputLayout pointer
+	// - The library hands back the same layout to anything else with this format
+	inputLayout = ShaderLibrary::GetInputLayout(inputElements, 5, vertexShaderBlob.Get());
+
+	// The depth pre-pass reads the position-only stream plus the draw ID
+	D3D11_INPUT_ELEMENT_DESC prepassElements[2] = { inputElements[0], inputElements[4] };
+	prepassElements[0].AlignedByteOffset = 0;
+	depthPrepassInputLayout = ShaderLibrary::GetInputLayout(
+		prepassElements,
+		2,
+		ShaderLibrary::GetVertexShaderByteCode(L"DepthPrepassVS.cso").Get());
+
+	// After the pre-pass, only the exact surface it left behind gets shaded
+	D3D11_DEPTH_STENCIL_DESC depthEqualDesc = {};
+	depthEqualDesc.DepthEnable = true;
+	depthEqualDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthEqualDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+	depthEqualState = StateCache::GetDepthStencilState(depthEqualDesc);
+
+	// Deferred path: G-buffer variants of the basic lit shader, plus the
+	// lighting passes.  Light volumes are drawn with the pre-pass layout.
+	if (renderPath == RenderPath::Deferred) {
+		deferredRenderer = std::make_shared<D3D11DeferredRenderer>(
+			ShaderLibrary::LoadVertexShader(L"FullscreenVS.cso"),
+			ShaderLibrary::LoadPixelShader(L"DeferredAmbientPS.cso"),
+			ShaderLibrary::LoadVertexShader(L"LightVolumeVS.cso"),
+			ShaderLibrary::LoadPixelShader(L"DeferredLightPS.cso"),
+			std::make_shared<Mesh>(FixPath("../../Assets/Meshes/sphere.obj").c_str()));
+
+		for (std::shared_ptr<Material>& material : this->materialsList) {
+			if (material->GetShaderSource().empty() || !drawTableVS)
+				continue;
+			material->SetGBufferPixelShader(ShaderLibrary::GetPixelShader(
+				L"GBufferPS.hlsl",
+				material->GetShaderFeatures() | SHADER_FEATURE_DRAW_TABLE));
+		}
+	}
+
+	printf("Shader startup: %.2f ms, %u shaders, %u variants, %u file opens, %llu bytes read\n",
+		std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - shaderLoadStart).count(),
+		ShaderLibrary::ShaderCount(),
+		ShaderLibrary::VariantCount(),
+		ShaderLibrary::FileOpenCount(),
+		ShaderLibrary::BytesRead());
 }
 
 
 
 void Game::ImGuiHelper(float deltaTime, float totalTime) {
+	PROFILE_SCOPE("ImGui");
+
 	// Feed fresh data to ImGui
 	ImGuiIO& io = ImGui::GetIO();
 	io.DeltaTime = deltaTime;
@@ -575,6 +573,56 @@ void Game::ImGuiHelper(float deltaTime, float totalTime) {
 		// Replace each %d with the next parameter, and format as decimal integers
 		// The "x" will be printed as-is between the numbers, like so: 800x600
 		ImGui::Text("Window Resolution: %dx%d", Window::Width(), Window::Height());
+		ImGui::Text("Constant uploads: %u bytes, %u slices, %u maps", lastUploadStats.bytesUploaded, lastUploadStats.allocationCount, lastUploadStats.mapCount);
+		ImGui::Text("Constant ring: %u / %u bytes peak, %u frames in flight", lastUploadStats.highWaterMarkInBytes, lastUploadStats.capacityInBytes, lastUploadStats.framesInFlight);
+		ImGui::Text("Ring grows: %u, discards: %u, overflows: %u", lastUploadStats.growCount, lastUploadStats.discardCount, lastUploadStats.overflowCount);
+		ImGui::Checkbox("Use draw table", &useDrawTable);
+		ImGui::Checkbox("Depth pre-pass", &useDepthPrepass);
+		if (renderPath == RenderPath::Deferred)
+			ImGui::Text("Render path: deferred, %u light volumes (%u around the camera)", lightVolumes.GetVolumeCount(), lightVolumes.GetInsideCount());
+		else
+			ImGui::Text("Render path: forward (start with -deferred for deferred)");
+		ImGui::Text("Render graph: %u / %u passes live, %u textures, %u pooled",
+			(unsigned int)renderGraph.GetPassOrder().size(),
+			renderGraph.GetPassCount(),
+			renderGraph.GetResourceCount(),
+			renderGraphPool->GetTextureCount());
+		ImGui::Text("Transient memory: %.2f MB peak (%.2f MB without aliasing)",
+			renderGraph.GetPeakTransientBytes() / (1024.0f * 1024.0f),
+			renderGraph.GetUnaliasedTransientBytes() / (1024.0f * 1024.0f));
+		ImGui::Text("Lights: %u, clustered light refs: %u", (unsigned int)frameLights.size(), lightClusters.GetLightIndexCount());
+		if (ImGui::SliderInt("Scattered point lights", &scatteredLightCount, 0, 1000))
+			GenerateScatteredLights();
+		ImGui::Checkbox("Per-object light lists (instead of clusters)", &usePerObjectLights);
+		ImGui::Text("Shader variants: %u (%u compiles, %.1f ms)", ShaderLibrary::VariantCount(), ShaderLibrary::CompileCount(), ShaderLibrary::TotalCompileMilliseconds());
+		ImGui::Text("Textures: %u / %u loaded on %u threads (%.1f ms)",
+			textureLoader->GetLoadedCount(),
+			textureLoader->GetRequestCount(),
+			textureLoader->GetThreadCount(),
+			textureLoader->GetFinishMilliseconds());
+		if (environmentFromCache)
+			ImGui::Text("Sky lighting: from cache");
+		else if (environmentBuffers->IsReady())
+			ImGui::Text("Sky lighting: baked in %.1f ms", environmentBakeMilliseconds);
+		else
+			ImGui::Text("Sky lighting: baking...");
+		ImGui::Text("Sky cube: %.1f ms, peak texture staging: %.1f MB",
+			textureLoader->GetCubeMilliseconds(),
+			textureLoader->GetPeakStagingBytes() / (1024.0f * 1024.0f));
+		ImGui::Text("Streamed textures: %u, %.1f MB resident, %.1f MB read, %u loads, %u evictions",
+			textureStreamer->GetTextureCount(),
+			textureStreamer->GetResidentBytes() / (1024.0f * 1024.0f),
+			textureStreamer->GetBytesRead() / (1024.0f * 1024.0f),
+			textureStreamer->GetLoadCount(),
+			textureStreamer->GetEvictCount());
+		ImGui::Text("Texture arrays: %u textures in %u arrays, %.1f MB",
+			textureArrays->GetTextureCount(),
+			textureArrays->GetArrayCount(),
+			textureArrays->GetBytes() / (1024.0f * 1024.0f));
+		if (ImGui::SliderInt("Texture budget (MB)", &textureBudgetMB, 1, 1024))
+			textureStreamer->SetBudget((uint64_t)textureBudgetMB * 1024 * 1024);
+		ImGui::Text("Shader files: %u opens, %llu bytes read, %u input layouts", ShaderLibrary::FileOpenCount(), ShaderLibrary::BytesRead(), ShaderLibrary::InputLayoutCount());
+		ImGui::Text("Pipeline states: %u created for %u requests (%.0f%% shared)", StateCache::CreateCount(), StateCache::RequestCount(), StateCache::HitRate() * 100.0f);
 
 		///Color picker for window background
 		//XMFLOAT4 color(1.0f, 0.0f, 0.5f, 1.0f);
@@ -770,6 +818,139 @@ void Game::ImGuiHelper(float deltaTime, float totalTime) {
 		ImGui::TreePop();
 	}
 
+	// CPU timings of the last frame's profile scopes
+	if (ImGui::TreeNode("CPU Profiler")) {
+		bool profilerEnabled = Profiler::IsEnabled();
+		if (ImGui::Checkbox("Enabled", &profilerEnabled))
+			Profiler::SetEnabled(profilerEnabled);
+		ImGui::SameLine();
+		if (Profiler::IsCapturing())
+			ImGui::Text("Capturing...");
+		else if (ImGui::Button("Capture trace"))
+			Profiler::StartCapture(PROFILER_HISTORY, FixPath("Profile.json"));
+		if (!Profiler::GetLastCapturePath().empty())
+			ImGui::Text("Last trace: %s", Profiler::GetLastCapturePath().c_str());
+
+		const float* frameHistory = Profiler::GetFrameHistory();
+		ImGui::PlotLines("Frame (ms)", frameHistory, PROFILER_HISTORY, 0, 0, 0.0f, FLT_MAX, ImVec2(0, 40));
+		ImGui::Text("Lost events: %llu", Profiler::GetLostCount());
+		ImGui::Text("GPU frame: %.3f ms, read %u frames late, %u skipped, %u disjoint",
+			gpuProfiler->GetFrameMilliseconds(),
+			gpuProfiler->GetLatency(),
+			gpuProfiler->GetSkippedFrames(),
+			gpuProfiler->GetInvalidFrames());
+
+		// One row per scope name, indented by how deep it runs
+		if (ImGui::BeginTable("Scopes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Calls");
+			ImGui::TableSetupColumn("ms");
+			ImGui::TableSetupColumn("Avg / max");
+			ImGui::TableSetupColumn("History");
+			ImGui::TableHeadersRow();
+			for (const ProfileScopeStats& stats : Profiler::GetScopeStats()) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%*s%s", stats.depth * 2, "", stats.name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%u", stats.calls);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stats.milliseconds);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f / %.3f", stats.averageMilliseconds, stats.maxMilliseconds);
+				ImGui::TableNextColumn();
+				ImGui::PushID(stats.name);
+				ImGui::PlotLines("##history", stats.history, PROFILER_HISTORY, 0, 0, 0.0f, FLT_MAX, ImVec2(-1, 16));
+				ImGui::PopID();
+			}
+			ImGui::EndTable();
+		}
+
+		// Flame graph of the last frame: a band per thread, a row per
+		// nesting level, and time running left to right.  Timelines
+		// that arrive late (the GPU's) are shifted to start with it.
+		const std::vector<ProfileEvent>& events = Profiler::GetFrameEvents();
+		std::vector<std::string> threadNames = Profiler::GetThreadNames();
+		int64_t frameStart = Profiler::GetFrameStart();
+		float frameLength = (float)std::max<int64_t>(1, Profiler::GetFrameEnd() - frameStart);
+		const float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+		std::vector<unsigned int> threadDepths(threadNames.size(), 0);
+		std::vector<int64_t> threadFirsts(threadNames.size(), INT64_MAX);
+		std::vector<int64_t> threadLasts(threadNames.size(), INT64_MIN);
+		for (const ProfileEvent& event : events) {
+			threadDepths[event.thread] = std::max(threadDepths[event.thread], event.depth + 1);
+			threadFirsts[event.thread] = std::min(threadFirsts[event.thread], event.start);
+			threadLasts[event.thread] = std::max(threadLasts[event.thread], event.end);
+		}
+		std::vector<int64_t> threadShifts(threadNames.size(), 0);
+		for (unsigned int t = 0; t < threadNames.size(); t++) {
+			if (threadDepths[t] > 0 && threadLasts[t] < frameStart)
+				threadShifts[t] = frameStart - threadFirsts[t];
+		}
+		std::vector<float> threadTops(threadNames.size(), 0.0f);
+		float graphHeight = 0.0f;
+		for (unsigned int t = 0; t < threadNames.size(); t++) {
+			threadTops[t] = graphHeight + rowHeight;
+			if (threadDepths[t] > 0)
+				graphHeight = threadTops[t] + threadDepths[t] * rowHeight;
+		}
+
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		float width = ImGui::GetContentRegionAvail().x;
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		for (unsigned int t = 0; t < threadNames.size(); t++) {
+			if (threadDepths[t] > 0)
+				drawList->AddText(ImVec2(origin.x, origin.y + threadTops[t] - rowHeight), IM_COL32(200, 200, 200, 255), threadNames[t].c_str());
+		}
+		for (const ProfileEvent& event : events) {
+			int64_t start = event.start + threadShifts[event.thread] - frameStart;
+			int64_t end = event.end + threadShifts[event.thread] - frameStart;
+			float x0 = origin.x + width * std::clamp(start / frameLength, 0.0f, 1.0f);
+			float x1 = origin.x + width * std::clamp(end / frameLength, 0.0f, 1.0f);
+			float y0 = origin.y + threadTops[event.thread] + event.depth * rowHeight;
+			ImVec2 min(x0, y0);
+			ImVec2 max(std::max(x1, x0 + 1.0f), y0 + rowHeight - 1.0f);
+			ImU32 color = ImGui::GetColorU32(ImVec4(0.3f + 0.15f * (event.depth % 4), 0.5f, 0.8f - 0.1f * (event.depth % 4), 1.0f));
+			drawList->AddRectFilled(min, max, color);
+			if (max.x - min.x > ImGui::CalcTextSize(event.name).x + 4.0f)
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_BLACK, event.name);
+			if (ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s: %.3f ms", event.name, (event.end - event.start) / 1000000.0f);
+		}
+		ImGui::Dummy(ImVec2(width, graphHeight));
+
+		ImGui::TreePop();
+	}
+
+	// Frame time percentiles over the rolling window
+	if (ImGui::TreeNode("Frame Statistics")) {
+		FrameStatsSummary summary = frameStats.Summarize();
+		ImGui::Text("Last %u frames: average %.2f ms", summary.frameCount, summary.average);
+		ImGui::Text("p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f ms",
+			summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+		ImGui::Text("Hitches: %u in window, %llu of %llu overall",
+			summary.hitchCount, frameStats.GetTotalHitches(), frameStats.GetTotalFrames());
+
+		float budget = frameStats.GetBudget();
+		if (ImGui::SliderFloat("Budget (ms)", &budget, 1.0f, 100.0f, "%.2f"))
+			frameStats.SetBudget(budget);
+		if (ImGui::Button("Reset")) {
+			frameStats.Reset();
+			frameHistogramMax = 0.0f;
+		}
+
+		// The range only grows while the window is open, so the
+		// buckets don't jump around every frame
+		frameHistogramMax = std::max({ frameHistogramMax, budget * 2.0f, summary.max });
+		float buckets[64];
+		frameStats.BuildHistogram(buckets, 64, frameHistogramMax);
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "0 - %.1f ms", frameHistogramMax);
+		ImGui::PlotHistogram("Frame times", buckets, 64, 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+		ImGui::TreePop();
+	}
+
 	ImGui::NewLine();
 
 	
@@ -812,6 +993,9 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	PROFILE_SCOPE("Update");
+	frameStats.AddFrame(deltaTime * 1000.0f);
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::KeyDown(VK_ESCAPE)){
 		Window::Quit();
@@ -835,19 +1019,242 @@ void Game::Update(float deltaTime, float totalTime)
 }
 
 
+// --------------------------------------------------------
+// Lays out scatteredLightCount small point lights on a grid
+// around the scene, cycling through a few colors
+// --------------------------------------------------------
+void Game::GenerateScatteredLights()
+{
+	const XMFLOAT3 colors[] = {
+		XMFLOAT3(1.0f, 0.3f, 0.3f),
+		XMFLOAT3(0.3f, 1.0f, 0.3f),
+		XMFLOAT3(0.3f, 0.3f, 1.0f),
+		XMFLOAT3(1.0f, 0.9f, 0.4f) };
+
+	scatteredLights.clear();
+	int gridSize = (int)ceilf(sqrtf((float)scatteredLightCount));
+	for (int i = 0; i < scatteredLightCount; i++) {
+		Light light = {};
+		light.type = LIGHT_TYPE_POINT;
+		light.position = XMFLOAT3(
+			-10.0f + 30.0f * (i % gridSize) / gridSize,
+			1.0f + (i % 3),
+			-10.0f + 30.0f * (i / gridSize) / gridSize);
+		light.range = 3.0f;
+		light.color = colors[i % 4];
+		light.intensity = 1.0f;
+		scatteredLights.push_back(light);
+	}
+}
+
+
+// --------------------------------------------------------
+// Fills in the constants shared by every draw this frame:
+// camera, time and how to find the light clusters
+// --------------------------------------------------------
+void Game::WritePerFrameData(PerFrameData* data, float totalTime)
+{
+	XMFLOAT4X4 view = currentCamera->GetViewMatrix();
+	XMFLOAT4X4 projection = currentCamera->GetProjectionMatrix();
+
+	data->view = view;
+	data->projection = projection;
+	XMStoreFloat4x4(&data->viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+	data->cameraPosition = currentCamera->GetTransform().GetPosition();
+	data->time = totalTime;
+	data->ambientLight = ambientColor;
+	data->directionalLightCount = lightClusters.GetDirectionalLightCount();
+	data->screenSize = XMFLOAT2((float)Window::Width(), (float)Window::Height());
+	data->clusterSliceScale = lightClusters.GetSliceScale();
+	data->clusterSliceBias = lightClusters.GetSliceBias();
+	memcpy(data->irradianceSH, environmentLighting.irradianceSH, sizeof(data->irradianceSH));
+	data->environmentMipCount = (float)environmentBuffers->GetSpecularMipCount();
+}
+
+
+// --------------------------------------------------------
+// Points each permutable material at the pixel shader variant
+// for its own features plus the lights in this frame.  Only
+// does any work when the scene's side of the key changes;
+// new variants are compiled once and cached by the library.
+// --------------------------------------------------------
+void Game::UpdateShaderPermutations()
+{
+	unsigned int sceneFeatures = 0;
+	if (lightPacking.GetPointCount() > 0)
+		sceneFeatures |= SHADER_FEATURE_POINT_LIGHTS;
+	if (lightPacking.GetSpotCount() > 0)
+		sceneFeatures |= SHADER_FEATURE_SPOT_LIGHTS;
+	if (usePerObjectLights)
+		sceneFeatures |= SHADER_FEATURE_OBJECT_LIGHT_LISTS;
+	unsigned int directionalCount = lightPacking.GetDirectionalCount();
+
+	if (sceneFeatures == shaderSceneFeatures && directionalCount == shaderDirectionalCount)
+		return;
+	shaderSceneFeatures = sceneFeatures;
+	shaderDirectionalCount = directionalCount;
+
+	for (std::shared_ptr<Material>& material : materialsList) {
+		const std::wstring& source = material->GetShaderSource();
+		if (source.empty())
+			continue;
+
+		// Keep the current shader if a variant fails to compile
+		unsigned int features = material->GetShaderFeatures() | sceneFeatures;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader = ShaderLibrary::GetPixelShader(source, features, directionalCount);
+		if (pixelShader)
+			material->SetPixelShader(pixelShader);
+
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> drawTablePixelShader = ShaderLibrary::GetPixelShader(source, features | SHADER_FEATURE_DRAW_TABLE, directionalCount);
+		if (drawTablePixelShader && drawTableVS)
+			material->SetDrawTablePixelShader(drawTablePixelShader);
+
+		// G-buffer variants only depend on the material's own features
+		if (deferredRenderer && drawTableVS) {
+			Microsoft::WRL::ComPtr<ID3D11PixelShader> gBufferPixelShader = ShaderLibrary::GetPixelShader(
+				L"GBufferPS.hlsl", material->GetShaderFeatures() | SHADER_FEATURE_DRAW_TABLE);
+			if (gBufferPixelShader)
+				material->SetGBufferPixelShader(gBufferPixelShader);
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Copies one of a material's textures into the shared arrays,
+// if the material has variants that can sample it from there.
+// Its features change once all of its textures are in, so the
+// next frame picks its variants again.
+// --------------------------------------------------------
+void Game::AddToTextureArrays(Material& material, unsigned int slot)
+{
+	auto found = material.GetTextureMap().find(slot);
+	if (material.GetShaderSource().empty() || found == material.GetTextureMap().end())
+		return;
+
+	// Even if it can't go in, its features may have changed
+	TextureArrayLocation location;
+	if (textureArrays->Add(found->second.Get(), location))
+		material.SetTextureLocation(slot, location);
+	shaderSceneFeatures = ~0u;
+}
+
+
+// --------------------------------------------------------
+// Describes this frame's materials and entities the way
+// EntityDraws takes them.  Runs after the shader variants are
+// picked and before any draws are recorded.
+// - Materials are indexed the same as in the draw table
+// --------------------------------------------------------
+void Game::PrepareDrawItems()
+{
+	drawMaterials.resize(drawTable.GetMaterialCount());
+	for (std::shared_ptr<Material>& material : materialsList) {
+		unsigned int index = drawTable.FindMaterial(material.get());
+		drawMaterials[index] = material->GetDrawMaterial();
+		drawMaterials[index].drawTableMaterial = index;
+		for (unsigned int slot = 0; slot < 2; slot++) {
+			const TextureArrayLocation* location = material->GetTextureLocation(slot);
+			drawMaterials[index].textureArrays[slot] = location ? textureArrays->GetSRV(location->array) : 0;
+		}
+	}
+
+	drawItems.resize(entityList.size());
+	for (size_t i = 0; i < entityList.size(); i++) {
+		Entity& entity = entityList[i];
+		drawItems[i].mesh = &entity.GetMesh()->GetDrawMesh();
+		drawItems[i].material = &drawMaterials[drawTable.FindMaterial(entity.GetMaterial().get())];
+		drawItems[i].transform = &entity.GetTransform();
+	}
+}
+
+
+// --------------------------------------------------------
+// Requests a mip of every streamed texture on a visible entity,
+// sized from how close its bounding sphere gets to the camera
+// and how densely its mesh's UVs (and the material's UV scale)
+// spread texels over its surface.
+// - Scale is taken as the smallest axis, so stretched objects
+//   err towards too much detail rather than too little
+// --------------------------------------------------------
+void Game::RequestStreamedMips()
+{
+	textureStreamer->BeginFrame();
+
+	XMFLOAT4X4 viewMatrix = currentCamera->GetViewMatrix();
+	XMFLOAT4X4 projection = currentCamera->GetProjectionMatrix();
+	XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
+	float nearZ = currentCamera->GetNearClip();
+	float farZ = currentCamera->GetFarClip();
+	float pixelsPerUnit = projection._22 * Window::Height() * 0.5f;
+
+	for (Entity& entity : entityList) {
+		auto found = streamedTextures.find(entity.GetMaterial().get());
+		if (found == streamedTextures.end())
+			continue;
+
+		std::shared_ptr<Mesh> mesh = entity.GetMesh();
+		XMFLOAT3 localCenter = mesh->GetBoundsCenter();
+		XMFLOAT4X4 world = entity.GetTransform().GetWorldMatrix();
+		XMFLOAT3 scale = entity.GetTransform().GetScale();
+		float maxScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+		float minScale = fminf(fabsf(scale.x), fminf(fabsf(scale.y), fabsf(scale.z)));
+
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&localCenter), XMLoadFloat4x4(&world) * view));
+		float radius = mesh->GetBoundsRadius() * maxScale;
+		if (!TextureResidency::IsSphereVisible(center.x, center.y, center.z, radius, projection._11, projection._22, nearZ, farZ))
+			continue;
+
+		float nearestDepth = fmaxf(center.z - radius, nearZ);
+		XMFLOAT2 uvScale = entity.GetMaterial()->GetUVScale();
+		float maxUVScale = fmaxf(fabsf(uvScale.x), fabsf(uvScale.y));
+		for (unsigned int texture : found->second) {
+			const StreamingTextureInfo& info = textureStreamer->GetInfo(texture);
+			textureStreamer->Request(texture, TextureResidency::CalcRequiredMip(
+				info.width, info.height, info.mipCount,
+				mesh->GetUVDensity(), maxUVScale, minScale,
+				nearestDepth, pixelsPerUnit));
+		}
+	}
+
+	textureStreamer->Update();
+}
+
+
 // --------------------------------------------------------
 // Clear the screen, redraw everything, present to the user
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	PROFILE_SCOPE("Draw");
+
 	// Frame START
 	// - These things should happen ONCE PER FRAME
 	// - At the beginning of Game::Draw() before drawing *anything*
 	{
+		PROFILE_SCOPE("Begin frame");
+		Graphics::BeginFrame();
+		gpuProfiler->BeginFrame();
+
+		// Swap in any textures that finished decoding since last frame
+		if (textureLoader->Update() > 0 && textureLoader->IsFinished())
+			printf("Textures: %u loaded on %u threads in %.2f ms (%.2f ms creating them on the render thread), sky cube %.2f ms, peak staging %.1f MB\n",
+				textureLoader->GetLoadedCount(),
+				textureLoader->GetThreadCount(),
+				textureLoader->GetFinishMilliseconds(),
+				textureLoader->GetUploadMilliseconds(),
+				textureLoader->GetCubeMilliseconds(),
+				textureLoader->GetPeakStagingBytes() / (1024.0f * 1024.0f));
+
+		// Ask for the mips this frame's view needs, swap in any that
+		// arrived and start reading the next ones
+		RequestStreamedMips();
+
 		// Clear the back buffer (erase what's on screen) and depth buffer
 		
 		Graphics::Context->ClearRenderTargetView(Graphics::BackBufferRTV.Get(),	color);
-		Graphics::Context->ClearDepthStencilView(Graphics::DepthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		Graphics::Context->ClearDepthStencilView(Graphics::DepthBufferDSV.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 	}
 
 	// DRAW geometry
@@ -856,69 +1263,246 @@ void Game::Draw(float deltaTime, float totalTime)
 	{
 		
 		
-		for (Entity& entity : this->entityList) {
-
-			std::shared_ptr<Material> material = entity.GetMaterial();
-			// Set the active vertex and pixel shaders
-			//  - Once you start applying different shaders to different objects,
-			//    these calls will need to happen multiple times per frame
-			Graphics::Context->VSSetShader(material->GetVertexShader().Get(), 0, 0);
-			Graphics::Context->PSSetShader(material->GetPixelShader().Get(), 0, 0);
-
-
-			VertexShaderData vsData{};
-			/*this->tempWorldMatrix = entity.GetTransform().GetWorldMatrix();
-			DirectX::XMMATRIX transposeMatrix = DirectX::XMLoadFloat4x4(&tempWorldMatrix);
-			transposeMatrix = DirectX::XMMatrixTranspose(transposeMatrix);
-			DirectX::XMStoreFloat4x4(&vsData.world, transposeMatrix);*/
-			vsData.world = entity.GetTransform().GetWorldMatrix();
-			vsData.view = currentCamera->GetViewMatrix();
-			vsData.projection = currentCamera->GetProjectionMatrix();
-			vsData.worldInvTranspose = entity.GetTransform().GetWorldInverseTransposeMatrix();
-			
-			Graphics::FillAndBindNextConstantBuffer(&vsData, sizeof(VertexShaderData), D3D11_VERTEX_SHADER, 0);
-
-			
+		// Record the entity draws in parallel, one command buffer per
+		// contiguous range of the draw list, then replay them in order
+		// on this thread.  Small lists aren't worth the hand-off.
+		unsigned int entityCount = (unsigned int)entityList.size();
+		unsigned int rangeCount = (entityCount + 63) / 64;
+		if (rangeCount > JobSystem::WorkerCount() + 1)
+			rangeCount = JobSystem::WorkerCount() + 1;
+		if (rangeCount == 0)
+			rangeCount = 1;
+		if (commandBuffers.size() < rangeCount)
+			commandBuffers.resize(rangeCount);
+		if (deferredRenderer && gBufferCommandBuffers.size() < rangeCount)
+			gBufferCommandBuffers.resize(rangeCount);
+
+		// Push any material edits to their constant buffers
+		// before the recorded commands reference them
+		for (std::shared_ptr<Material>& material : materialsList)
+			material->UpdateConstantBuffer();
+
+		// Draw IDs are entity indices, so each range fills its own
+		// slice of the object table while recording
+		drawTable.Reset();
+		drawTable.ResizeObjects(entityCount);
+		for (std::shared_ptr<Material>& material : materialsList)
+			drawTable.AddMaterial(material.get(), material->GetConstants());
+
+		// Bin this frame's lights into clusters before the per-frame
+		// constants are written, since those describe the clusters
+		frameLights.assign(lights.begin(), lights.end());
+		frameLights.insert(frameLights.end(), scatteredLights.begin(), scatteredLights.end());
+		lightPacking.Pack(frameLights);
+		lightClusters.Build(
+			lightPacking.GetSortedLights(),
+			currentCamera->GetViewMatrix(),
+			currentCamera->GetProjectionMatrix(),
+			currentCamera->GetNearClip(),
+			currentCamera->GetFarClip(),
+			!usePerObjectLights);
+		lightClusterBuffers->Upload(lightPacking, lightClusters);
+		lightClusterBuffers->Bind();
+		environmentBuffers->Bind();
+		if (usePerObjectLights)
+			objectLightLists.Resize(entityCount);
+
+		// Light counts are known now, so pick matching shader variants
+		UpdateShaderPermutations();
+		PrepareDrawItems();
+
+		// The per-frame constants and all per-object constants go into a
+		// single mapping of the ring, which is sized up front so it never
+		// wraps onto itself mid-frame
+		unsigned int bytesPerEntity = Graphics::CalcConstantBufferSize(sizeof(PerObjectData));
+		Graphics::BeginConstantUpload(
+			Graphics::CalcConstantBufferSize(sizeof(PerFrameData)) +
+			entityCount * bytesPerEntity);
+
+		Graphics::ConstantAllocation frameAlloc = Graphics::AllocateConstants(sizeof(PerFrameData));
+		WritePerFrameData(static_cast<PerFrameData*>(frameAlloc.data), totalTime);
+
+		RingConstantAllocator ringConstants;
+		EntityDrawSettings drawSettings = {};
+		drawSettings.drawTableVS = drawTableVS.Get();
+		drawSettings.useDrawTable = useDrawTable;
+		drawSettings.drawTable = &drawTable;
+		drawSettings.objectLightLists = usePerObjectLights ? &objectLightLists : 0;
+		drawSettings.sortedLights = &lightPacking.GetSortedLights();
+		drawSettings.constants = &ringConstants;
+
+		JobSystem::ParallelFor(entityCount, rangeCount,
+			[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+			{
+				PROFILE_SCOPE("Record draws");
+				CommandBuffer& commands = commandBuffers[rangeIndex];
+				commands.Reset();
+				CommandBuffer* gBufferCommands = 0;
+				if (deferredRenderer) {
+					gBufferCommands = &gBufferCommandBuffers[rangeIndex];
+					gBufferCommands->Reset();
+				}
+				EntityDraws::RecordDraws(commands, gBufferCommands, drawSettings, drawItems.data(), begin, end);
+			});
+		Graphics::EndConstantUpload();
+
+		drawTableBuffers->Upload(drawTable);
+
+		// One volume per local light, each drawn with its own draw ID
+		if (deferredRenderer) {
+			lightVolumes.Build(
+				lightPacking.GetSortedLights(),
+				deferredRenderer->GetVolumeMeshRadius(),
+				currentCamera->GetTransform().GetPosition(),
+				currentCamera->GetNearClip());
+			deferredRenderer->Upload(lightVolumes);
+			deferredRenderer->Bind();
+			drawTableBuffers->ReserveDrawIDs(lightVolumes.GetVolumeCount());
+		}
+		drawTableBuffers->Bind();
 
-			
+		if (usePerObjectLights) {
+			objectLightBuffer->Upload(objectLightLists.GetLists(), objectLightLists.GetCount());
+			Graphics::Context->PSSetShaderResources(OBJECT_LIGHT_LIST_SLOT, 1, objectLightBuffer->GetSRV().GetAddressOf());
+		}
 
-			// second constant buffer for pixel shader
-			PixelShaderData psData{};
-			psData.colorTint = material->GetColorTint();
-			psData.uvOffset = material->GetUVOffset();
-			psData.uvScale = material->GetUVScale();
-			psData.roughness = material->GetRoughnessValue();
-			psData.currCamPos = currentCamera->GetTransform().GetPosition();
-			psData.ambientLight = ambientColor;
-			psData.time = totalTime;
-			
-			memcpy(&psData.lights, &lights[0], sizeof(Light) * (int)lights.size());
+		// Per-frame constants are bound once for both stages
+		Graphics::BindConstantBufferRange(D3D11_VERTEX_SHADER, 0, frameAlloc.firstConstant, frameAlloc.numConstants);
+		Graphics::BindConstantBufferRange(D3D11_PIXEL_SHADER, 0, frameAlloc.firstConstant, frameAlloc.numConstants);
+
+		D3D11CommandBackend backend(Graphics::Context.Get());
+
+		// Describe the rest of the frame as a render graph, which drops
+		// unused passes and hands out the transient render targets
+		PROFILE_SCOPE("Render graph");
+		renderGraph.Reset();
+		RenderGraphResource backBuffer = renderGraph.ImportTexture("Back buffer");
+		RenderGraphResource depthBuffer = renderGraph.ImportTexture("Depth buffer");
+		renderGraphPool->Import(backBuffer, Graphics::BackBufferRTV.Get(), 0, 0);
+		renderGraphPool->Import(depthBuffer, 0, 0, Graphics::DepthBufferDSV.Get());
+
+		// Lay down depth first, then shade only what survived it
+		if (useDepthPrepass) {
+			unsigned int pass = renderGraph.AddPass("Depth pre-pass", [&](const RenderGraph&) {
+				PROFILE_GPU_SCOPE(*gpuProfiler, "GPU depth pre-pass");
+				EntityDraws::RecordDepthPrepass(
+					depthPrepassCommands,
+					depthPrepassVS.Get(),
+					drawItems.data(),
+					(unsigned int)drawItems.size(),
+					currentCamera->GetViewMatrix(),
+					depthPrepassOrder,
+					depthPrepassDepths);
+				Graphics::Context->IASetInputLayout(depthPrepassInputLayout.Get());
+				depthPrepassCommands.Replay(backend);
+				Graphics::Context->IASetInputLayout(inputLayout.Get());
+				Graphics::Context->OMSetDepthStencilState(depthEqualState.Get(), 0);
+			});
+			renderGraph.Write(pass, depthBuffer);
+		}
 
-			Graphics::FillAndBindNextConstantBuffer(&psData, sizeof(PixelShaderData), D3D11_PIXEL_SHADER, 0);
+		// Deferred: fill the G-buffer, light it into the back buffer,
+		// then let the forward draws below finish the rest on top
+		DeferredPassResources deferredResources = {};
+		if (deferredRenderer) {
+			unsigned int width = Window::Width();
+			unsigned int height = Window::Height();
+			RenderGraphResource gBuffer[GBUFFER_TARGET_COUNT] = {
+				renderGraph.CreateTexture("G-buffer albedo", { width, height, RenderGraphFormat::RGBA8Unorm }),
+				renderGraph.CreateTexture("G-buffer normal", { width, height, RenderGraphFormat::RG16Snorm }),
+				renderGraph.CreateTexture("G-buffer depth", { width, height, RenderGraphFormat::R32Float }) };
+
+			unsigned int geometryPass = renderGraph.AddPass("G-buffer", [&, gBuffer](const RenderGraph& graph) {
+				PROFILE_GPU_SCOPE(*gpuProfiler, "GPU G-buffer");
+				deferredResources = deferredRenderer->GetResources();
+				deferredResources.backBuffer = renderGraphPool->GetRenderTarget(graph, backBuffer);
+				deferredResources.depthStencil = renderGraphPool->GetDepthStencil(graph, depthBuffer);
+
+				// View depth is cleared to 0, which marks pixels nothing covers
+				const float black[4] = { 0, 0, 0, 0 };
+				for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++) {
+					ID3D11RenderTargetView* target = renderGraphPool->GetRenderTarget(graph, gBuffer[i]);
+					Graphics::Context->ClearRenderTargetView(target, black);
+					deferredResources.gBufferTargets[i] = target;
+					deferredResources.gBufferViews[i] = renderGraphPool->GetShaderResource(graph, gBuffer[i]);
+				}
 
+				deferredCommands.Reset();
+				DeferredPasses::RecordGeometryBegin(deferredCommands, deferredResources);
+				deferredCommands.Replay(backend);
+				for (unsigned int i = 0; i < rangeCount; i++)
+					gBufferCommandBuffers[i].Replay(backend);
+			});
+			for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++)
+				renderGraph.Write(geometryPass, gBuffer[i]);
+			renderGraph.Write(geometryPass, depthBuffer);
+
+			unsigned int lightingPass = renderGraph.AddPass("Deferred lighting", [&](const RenderGraph&) {
+				PROFILE_GPU_SCOPE(*gpuProfiler, "GPU deferred lighting");
+				deferredCommands.Reset();
+				DeferredPasses::RecordLighting(deferredCommands, deferredResources, lightVolumes.GetOutsideCount(), lightVolumes.GetInsideCount());
+				Graphics::Context->IASetInputLayout(depthPrepassInputLayout.Get());
+				deferredCommands.Replay(backend);
+				Graphics::Context->IASetInputLayout(inputLayout.Get());
+				if (useDepthPrepass)
+					Graphics::Context->OMSetDepthStencilState(depthEqualState.Get(), 0);
+			});
+			for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++)
+				renderGraph.Read(lightingPass, gBuffer[i]);
+			renderGraph.Read(lightingPass, depthBuffer);
+			renderGraph.Write(lightingPass, backBuffer);
+			renderGraph.Write(lightingPass, depthBuffer); // Stencil
+		}
 
-		
-			
-			entity.GetMaterial()->BindTexturesAndSamplers();
-			entity.Draw(deltaTime, totalTime);
+		unsigned int forwardPass = renderGraph.AddPass("Forward", [&](const RenderGraph&) {
+			PROFILE_GPU_SCOPE(*gpuProfiler, "GPU forward");
+			for (unsigned int i = 0; i < rangeCount; i++)
+				commandBuffers[i].Replay(backend);
+			Graphics::Context->OMSetDepthStencilState(0, 0);
+		});
+		renderGraph.Write(forwardPass, backBuffer);
+		renderGraph.Write(forwardPass, depthBuffer);
+
+		unsigned int skyPass = renderGraph.AddPass("Sky", [&](const RenderGraph&) {
+			PROFILE_GPU_SCOPE(*gpuProfiler, "GPU sky");
+			sky->Draw(currentCamera);
+		});
+		renderGraph.Read(skyPass, depthBuffer);
+		renderGraph.Write(skyPass, backBuffer);
+
+		if (renderGraph.Compile()) {
+			renderGraphPool->Realize(renderGraph);
+			renderGraph.Execute();
 		}
-		
-		sky->Draw(currentCamera);
 	}
 
-	ImGui::Render(); // Turns this frames UI into renderable triangles
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData()); // Draws it to the screen
+
+	{
+		PROFILE_SCOPE("ImGui render");
+		PROFILE_GPU_SCOPE(*gpuProfiler, "GPU ImGui");
+		ImGui::Render(); // Turns this frames UI into renderable triangles
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData()); // Draws it to the screen
+	}
 
 	// Frame END
 	// - These should happen exactly ONCE PER FRAME
 	// - At the very end of the frame (after drawing *everything*)
 	{
+		// Everything timed on the GPU has been submitted by now
+		gpuProfiler->EndFrame();
+
 		// Present at the end of the frame
+		PROFILE_SCOPE("Present");
 		bool vsync = Graphics::VsyncState();
 		Graphics::SwapChain->Present(
 			vsync ? 1 : 0,
 			vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 
+		// Fence this frame's constant uploads and keep
+		// the numbers around for the Inspector
+		Graphics::EndFrame();
+		lastUploadStats = Graphics::GetConstantUploadStats();
+
 		// Re-bind back buffer and depth buffer after presenting
 		Graphics::Context->OMSetRenderTargets(
 			1,
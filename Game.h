@@ -6,12 +6,40 @@
 #include "Entity.h"
 #include "Camera.h"
 #include "Material.h"
+#include "BufferStruct.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "CommandBuffer.h"
+#include "DrawTable.h"
+#include "D3D11DrawTable.h"
+#include "EntityDraws.h"
+#include "LightClusters.h"
+#include "LightPacking.h"
+#include "D3D11LightClusters.h"
+#include "ObjectLightLists.h"
+#include "LightVolumes.h"
+#include "D3D11DeferredRenderer.h"
+#include "RenderGraph.h"
+#include "D3D11RenderGraphPool.h"
+#include "TextureLoader.h"
+#include "D3D11ImageBasedLighting.h"
+#include "D3D11TextureStreamer.h"
+#include "D3D11TextureArrays.h"
+#include "GpuProfiler.h"
+#include "FrameStats.h"
+#include "Graphics.h"
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 
+// How the scene is lit, picked once at startup
+enum class RenderPath
+{
+	Forward,	// Every light evaluated while drawing each object
+	Deferred	// Surfaces to a G-buffer first, then lit once per light volume
+};
+
 class Game
 {
 public:
@@ -34,6 +62,20 @@ private:
 	DirectX::XMFLOAT3 ambientColor;
 
 	std::vector<Light> lights;
+
+	// Extra point lights spread over the scene to stress the
+	// clustered lighting, plus every light used this frame
+	int scatteredLightCount = 0;
+	std::vector<Light> scatteredLights;
+	std::vector<Light> frameLights;
+	LightPacking lightPacking;
+	LightClusters lightClusters;
+	std::shared_ptr<D3D11LightClusters> lightClusterBuffers;
+
+	// Lighter alternative to clustering: each object's top few lights
+	bool usePerObjectLights = false;
+	ObjectLightLists objectLightLists;
+	std::shared_ptr<StructuredBuffer> objectLightBuffer;
 	std::shared_ptr<Sky> sky;
 	std::shared_ptr<Mesh> skyMesh;
 
@@ -49,12 +91,93 @@ private:
 
 	std::vector<std::shared_ptr<Material>> materialsList;
 
+	// One command buffer per recording range, reused every frame
+	std::vector<CommandBuffer> commandBuffers;
+
+	// The materials and entities as EntityDraws takes them,
+	// rebuilt every frame (see PrepareDrawItems)
+	std::vector<DrawMaterial> drawMaterials;
+	std::vector<DrawItem> drawItems;
+
+	// Per-draw data fetched by draw ID instead of per-draw
+	// constant buffers, for materials that support it
+	bool useDrawTable = true;
+	DrawTable drawTable;
+	std::shared_ptr<D3D11DrawTable> drawTableBuffers;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> drawTableVS;
+
+	// Optional depth-only pass, drawn front to back before the lit
+	// pass so the lighting shader only runs on the closest surface
+	bool useDepthPrepass = false;
+	CommandBuffer depthPrepassCommands;
+	std::vector<unsigned int> depthPrepassOrder;
+	std::vector<float> depthPrepassDepths;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> depthPrepassVS;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> depthPrepassInputLayout;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthEqualState;
+
+	// Deferred path, chosen with -deferred on the command line.  Materials
+	// without a G-buffer shader are still drawn forward, after lighting.
+	RenderPath renderPath = RenderPath::Forward;
+	std::shared_ptr<D3D11DeferredRenderer> deferredRenderer;
+	std::vector<CommandBuffer> gBufferCommandBuffers;
+	CommandBuffer deferredCommands;
+	LightVolumes lightVolumes;
+
+	// Background texture decoding; -loaderthreads N on the command
+	// line sets the thread count (0 means one per hardware thread)
+	std::shared_ptr<TextureLoader> textureLoader;
+	unsigned int textureLoaderThreads = 0;
+
+	// Mip streaming for textures with a baked .dds, within a budget
+	// set by -texturebudget MB on the command line or in the UI.
+	// Each material's streamed textures are requested every frame
+	// at the detail its visible entities need.
+	std::shared_ptr<D3D11TextureStreamer> textureStreamer;
+	std::unordered_map<Material*, std::vector<unsigned int>> streamedTextures;
+	int textureBudgetMB = (int)(STREAMING_DEFAULT_BUDGET / (1024 * 1024));
+
+	// Shared texture arrays and atlases for the basic lit shader's
+	// materials, so they bind textures per array instead of each
+	// binding their own
+	std::shared_ptr<D3D11TextureArrays> textureArrays;
+
+	// GPU time of the frame's passes, shown with the CPU profiler
+	std::shared_ptr<GpuProfiler> gpuProfiler;
+
+	// Percentiles of recent frame times, with frames over the
+	// budget counted as hitches
+	FrameStats frameStats;
+	float frameHistogramMax = 0.0f;
+
+	// Ambient light baked from the sky (see IBLBaker), read from
+	// the cache when the sky's faces haven't changed
+	IBLData environmentLighting = {};
+	std::shared_ptr<D3D11ImageBasedLighting> environmentBuffers;
+	bool environmentFromCache = false;
+	float environmentBakeMilliseconds = 0.0f;
+
+	// The frame's passes, rebuilt every frame, and the textures
+	// backing their transient render targets
+	RenderGraph renderGraph;
+	std::shared_ptr<D3D11RenderGraphPool> renderGraphPool;
+
+	// Scene side of the current shader variants (see UpdateShaderPermutations)
+	unsigned int shaderSceneFeatures = ~0u;
+	unsigned int shaderDirectionalCount = 0;
+
+	// Ring constant buffer usage from the last frame
+	Graphics::ConstantUploadStats lastUploadStats{};
+
 	// Initialization helper methods - feel free to customize, combine, remove, etc.
 	void GeneratingAssetsAndEntities();
 	void ImGuiHelper(float deltaTime, float totalTime);
-
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> LoadPixelShader(const wchar_t* filePath);
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> LoadVertexShader(const wchar_t* filePath);
+	void GenerateScatteredLights();
+	void WritePerFrameData(PerFrameData* data, float totalTime);
+	void UpdateShaderPermutations();
+	void PrepareDrawItems();
+	void RequestStreamedMips();
+	void AddToTextureArrays(Material& material, unsigned int slot);
 
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
@@ -0,0 +1,183 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+
+// --- Fake backend ---
+
+void FakeGpuTimerBackend::BeginFrame(unsigned int slot)
+{
+	this->slots[slot].ticks.assign(GPU_PROFILER_MAX_QUERIES, 0);
+	this->slots[slot].ended = false;
+}
+
+void FakeGpuTimerBackend::Timestamp(unsigned int slot, unsigned int query)
+{
+	this->clock += this->ticksPerQuery;
+	this->slots[slot].ticks[query] = this->clock;
+}
+
+void FakeGpuTimerBackend::EndFrame(unsigned int slot)
+{
+	this->slots[slot].ended = true;
+	this->slots[slot].endedFrame = this->frame++;
+}
+
+bool FakeGpuTimerBackend::ReadFrame(unsigned int slot, unsigned int queryCount, uint64_t* ticks, uint64_t& frequency, bool& valid)
+{
+	const Slot& fake = this->slots[slot];
+	if (!fake.ended || this->frame - fake.endedFrame <= this->latency)
+		return false;
+
+	std::copy(fake.ticks.begin(), fake.ticks.begin() + queryCount, ticks);
+	frequency = this->frequency;
+	valid = this->valid;
+	return true;
+}
+
+
+// --- Profiler ---
+
+GpuProfiler::GpuProfiler(std::shared_ptr<GpuTimerBackend> backend)
+{
+	this->backend = backend;
+	this->writeFrame = 0;
+	this->readFrame = 0;
+	this->recording = false;
+	this->depth = 0;
+	this->timeline = Profiler::AddTimeline("GPU");
+
+	this->completedFrames = 0;
+	this->skippedFrames = 0;
+	this->invalidFrames = 0;
+	this->latency = 0;
+	this->frameMilliseconds = 0.0f;
+
+	for (FrameSlot& slot : this->slots)
+	{
+		slot.frame = 0;
+		slot.cpuStart = 0;
+		slot.pending = false;
+		slot.scopes.reserve(GPU_PROFILER_MAX_SCOPES);
+	}
+}
+
+// --------------------------------------------------------
+// Starts timing a frame in the next slot, unless that slot
+// is still waiting on the GPU - then this frame is skipped
+// rather than waited for
+// --------------------------------------------------------
+void GpuProfiler::BeginFrame()
+{
+	ReadFinishedFrames();
+
+	FrameSlot& slot = this->slots[this->writeFrame % GPU_PROFILER_FRAMES];
+	this->writeFrame++;
+
+	// Frames in flight - and any skipped between them - are read in order
+	if (slot.pending)
+	{
+		this->skippedFrames++;
+		this->recording = false;
+		return;
+	}
+
+	this->recording = true;
+	this->depth = 0;
+	slot.frame = this->writeFrame - 1;
+	slot.cpuStart = Profiler::Now();
+	slot.scopes.clear();
+
+	unsigned int index = (this->writeFrame - 1) % GPU_PROFILER_FRAMES;
+	this->backend->BeginFrame(index);
+	this->backend->Timestamp(index, 0);
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!this->recording)
+		return;
+
+	unsigned int index = (this->writeFrame - 1) % GPU_PROFILER_FRAMES;
+	this->backend->Timestamp(index, 1);
+	this->backend->EndFrame(index);
+	this->slots[index].pending = true;
+	this->recording = false;
+
+	ReadFinishedFrames();
+}
+
+unsigned int GpuProfiler::BeginScope(const char* name)
+{
+	FrameSlot& slot = this->slots[(this->writeFrame - 1) % GPU_PROFILER_FRAMES];
+	if (!this->recording || slot.scopes.size() >= GPU_PROFILER_MAX_SCOPES)
+		return GPU_PROFILER_MAX_SCOPES;
+
+	unsigned int scope = (unsigned int)slot.scopes.size();
+	slot.scopes.push_back({ name, this->depth++, false });
+	this->backend->Timestamp((this->writeFrame - 1) % GPU_PROFILER_FRAMES, 2 + 2 * scope);
+	return scope;
+}
+
+void GpuProfiler::EndScope(unsigned int scope)
+{
+	FrameSlot& slot = this->slots[(this->writeFrame - 1) % GPU_PROFILER_FRAMES];
+	if (!this->recording || scope >= slot.scopes.size())
+		return;
+
+	slot.scopes[scope].ended = true;
+	this->depth--;
+	this->backend->Timestamp((this->writeFrame - 1) % GPU_PROFILER_FRAMES, 3 + 2 * scope);
+}
+
+// --------------------------------------------------------
+// Reads back finished frames, oldest first, stopping at the
+// first one that isn't finished since the GPU finishes them
+// in order.  Each becomes a "GPU frame" event with its
+// scopes nested inside.
+// --------------------------------------------------------
+void GpuProfiler::ReadFinishedFrames()
+{
+	uint64_t ticks[GPU_PROFILER_MAX_QUERIES];
+	for (; this->readFrame < this->writeFrame; this->readFrame++)
+	{
+		unsigned int index = this->readFrame % GPU_PROFILER_FRAMES;
+		FrameSlot& slot = this->slots[index];
+		if (!slot.pending || slot.frame != this->readFrame)
+			continue;
+
+		uint64_t frequency = 0;
+		bool valid = false;
+		unsigned int queryCount = 2 + 2 * (unsigned int)slot.scopes.size();
+		if (!this->backend->ReadFrame(index, queryCount, ticks, frequency, valid))
+			break;
+
+		slot.pending = false;
+		this->latency = this->writeFrame - this->readFrame - 1;
+		if (!valid || frequency == 0)
+		{
+			this->invalidFrames++;
+			continue;
+		}
+
+		// GPU ticks to CPU nanoseconds, counted from the frame's start
+		auto toCPU = [&](uint64_t tick) {
+			return slot.cpuStart + (int64_t)((double)(tick - ticks[0]) * 1000000000.0 / frequency);
+		};
+
+		this->completedFrames++;
+		this->frameMilliseconds = (float)((double)(ticks[1] - ticks[0]) * 1000.0 / frequency);
+		Profiler::RecordEvent(this->timeline, "GPU frame", toCPU(ticks[0]), toCPU(ticks[1]), 0);
+		for (unsigned int i = 0; i < slot.scopes.size(); i++)
+		{
+			const Scope& scope = slot.scopes[i];
+			if (scope.ended)
+				Profiler::RecordEvent(this->timeline, scope.name, toCPU(ticks[2 + 2 * i]), toCPU(ticks[3 + 2 * i]), scope.depth + 1);
+		}
+	}
+}
+
+unsigned int GpuProfiler::GetCompletedFrames() { return this->completedFrames; }
+unsigned int GpuProfiler::GetSkippedFrames() { return this->skippedFrames; }
+unsigned int GpuProfiler::GetInvalidFrames() { return this->invalidFrames; }
+unsigned int GpuProfiler::GetLatency() { return this->latency; }
+float GpuProfiler::GetFrameMilliseconds() { return this->frameMilliseconds; }
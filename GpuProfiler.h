@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Profiler.h"
+
+#define GPU_PROFILER_FRAMES 4			// Frames that can be waiting on results at once
+#define GPU_PROFILER_MAX_SCOPES 32		// Scopes per frame, past which they're ignored
+
+// Each frame's timestamps: its start and end, then a pair per scope
+#define GPU_PROFILER_MAX_QUERIES (2 + 2 * GPU_PROFILER_MAX_SCOPES)
+
+// Times the rest of the enclosing block on the GPU, e.g.
+// PROFILE_GPU_SCOPE(*gpuProfiler, "GPU sky"), which needs a
+// different name than any CPU scope to get its own stats
+#define PROFILE_GPU_SCOPE(profiler, name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, name)
+
+
+// --------------------------------------------------------
+// Issues and reads back GPU timestamps.  Queries are grouped
+// by frame slot; each slot is only reused once its results
+// have been read.  One implementation per API, plus a fake
+// one that makes up timings.
+// --------------------------------------------------------
+class GpuTimerBackend
+{
+public:
+	virtual ~GpuTimerBackend() = default;
+
+	virtual void BeginFrame(unsigned int slot) = 0;
+	virtual void Timestamp(unsigned int slot, unsigned int query) = 0;
+	virtual void EndFrame(unsigned int slot) = 0;
+
+	// Without waiting: false if the slot's results aren't in yet.
+	// Otherwise fills one tick count per query, the ticks per
+	// second, and whether the timings can be trusted (the clock
+	// can change mid-frame, e.g. with power saving).
+	virtual bool ReadFrame(unsigned int slot, unsigned int queryCount, uint64_t* ticks, uint64_t& frequency, bool& valid) = 0;
+};
+
+
+// --------------------------------------------------------
+// Makes up timestamps without a GPU: each one is ticksPerQuery
+// after the last, and a frame's results only come back after
+// latency more frames have ended.  For testing the profiler's
+// bookkeeping and for running headless.
+// --------------------------------------------------------
+class FakeGpuTimerBackend : public GpuTimerBackend
+{
+private:
+	struct Slot
+	{
+		std::vector<uint64_t> ticks;
+		unsigned int endedFrame;
+		bool ended;
+	};
+
+	Slot slots[GPU_PROFILER_FRAMES] = {};
+	uint64_t clock = 0;
+	unsigned int frame = 0;
+
+public:
+	unsigned int latency = 2;
+	uint64_t ticksPerQuery = 1000;
+	uint64_t frequency = 1000000000;
+	bool valid = true;
+
+	void BeginFrame(unsigned int slot) override;
+	void Timestamp(unsigned int slot, unsigned int query) override;
+	void EndFrame(unsigned int slot) override;
+	bool ReadFrame(unsigned int slot, unsigned int queryCount, uint64_t* ticks, uint64_t& frequency, bool& valid) override;
+};
+
+
+// --------------------------------------------------------
+// Times scopes on the GPU with a ring of frame slots, so a
+// frame's timestamps are read a few frames later without
+// ever stalling on them.  If every slot is still waiting when
+// a frame begins, that frame isn't timed.
+//
+// Finished frames go to the CPU Profiler as a "GPU" timeline.
+// The GPU clock can't be read directly, so each GPU frame is
+// placed at the CPU time it began being submitted - it really
+// started somewhat later, but its scopes keep their lengths
+// and order.
+//
+// Single threaded: call everything from the render thread.
+// --------------------------------------------------------
+class GpuProfiler
+{
+private:
+	struct Scope
+	{
+		const char* name;
+		unsigned int depth;
+		bool ended;
+	};
+
+	struct FrameSlot
+	{
+		unsigned int frame;		// Which of writeFrame's frames it holds
+		int64_t cpuStart;
+		std::vector<Scope> scopes;
+		bool pending;
+	};
+
+	std::shared_ptr<GpuTimerBackend> backend;
+	FrameSlot slots[GPU_PROFILER_FRAMES];
+	unsigned int writeFrame;	// Frames begun, including skipped ones
+	unsigned int readFrame;		// Oldest frame that might be pending
+	bool recording;
+	unsigned int depth;
+	unsigned int timeline;
+
+	// Stats
+	unsigned int completedFrames;
+	unsigned int skippedFrames;
+	unsigned int invalidFrames;
+	unsigned int latency;
+	float frameMilliseconds;
+
+	void ReadFinishedFrames();
+
+public:
+	GpuProfiler(std::shared_ptr<GpuTimerBackend> backend);
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Returns the scope's index for EndScope(), which must be
+	// called in reverse order of BeginScope()
+	unsigned int BeginScope(const char* name);
+	void EndScope(unsigned int scope);
+
+	// Getters
+	unsigned int GetCompletedFrames();
+	unsigned int GetSkippedFrames();
+	unsigned int GetInvalidFrames();
+	unsigned int GetLatency();
+	float GetFrameMilliseconds();
+};
+
+
+// --------------------------------------------------------
+// Times its own lifetime on the GPU, see PROFILE_GPU_SCOPE
+// --------------------------------------------------------
+class GpuProfileScope
+{
+private:
+	GpuProfiler& profiler;
+	unsigned int scope;
+
+public:
+	GpuProfileScope(GpuProfiler& profiler, const char* name) : profiler(profiler)
+	{
+		this->scope = profiler.BeginScope(name);
+	}
+
+	~GpuProfileScope()
+	{
+		this->profiler.EndScope(this->scope);
+	}
+
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
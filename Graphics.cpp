@@ -1,5 +1,8 @@
 #include "Graphics.h"
 #include <dxgi1_6.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 // Tell the drivers to use high-performance GPU in multi-GPU systems (like laptops)
 extern "C"
@@ -21,6 +24,107 @@ namespace Graphics
 
 		D3D_FEATURE_LEVEL featureLevel{};
 
+		// --- Ring constant buffer bookkeeping ---
+
+		// A finished frame's slice of the ring, [begin, end) possibly
+		// wrapping around, plus the query that tells us when the GPU
+		// is done reading it
+		struct FrameSegment
+		{
+			unsigned int begin;
+			unsigned int end;
+			Microsoft::WRL::ComPtr<ID3D11Query> query;
+		};
+
+		// How many finished frames we track before falling back to a DISCARD
+		const unsigned int MaxFramesInFlight = 8;
+		FrameSegment frameSegments[MaxFramesInFlight];
+		unsigned int oldestSegment = 0;
+		unsigned int segmentCount = 0;
+
+		// Where the current frame's uploads started
+		unsigned int frameStartOffset = 0;
+
+		// The reserved range of the current upload batch
+		void* mappedHeap = 0;
+		unsigned int uploadLimit = 0;
+		unsigned int uploadBegin = 0;
+
+		// Telemetry
+		unsigned int mapCount = 0;
+		unsigned int highWaterMark = 0;
+		unsigned int growCount = 0;
+		unsigned int discardCount = 0;
+		std::atomic<unsigned int> allocationCount = 0;
+		std::atomic<unsigned int> bytesUploaded = 0;
+		std::atomic<unsigned int> overflowCount = 0;
+
+		// Forgets every finished frame whose GPU work has completed,
+		// without waiting on anything
+		void RetireCompletedFrames()
+		{
+			while (segmentCount > 0)
+			{
+				FrameSegment& segment = frameSegments[oldestSegment];
+				if (Context->GetData(segment.query.Get(), 0, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+					break;
+
+				oldestSegment = (oldestSegment + 1) % MaxFramesInFlight;
+				segmentCount--;
+			}
+		}
+
+		// Finds a contiguous, GPU-idle range of the ring for the given
+		// number of bytes.  Returns false if there isn't one.
+		bool FindRingSpace(unsigned int size, unsigned int& offset)
+		{
+			unsigned int head = cbHeapOffsetInBytes;
+
+			// The oldest data the GPU might still read
+			bool anyInFlight = segmentCount > 0 || head != frameStartOffset;
+			if (!anyInFlight)
+			{
+				offset = head + size <= cbHeapSizeInBytes ? head : 0;
+				return size <= cbHeapSizeInBytes;
+			}
+			unsigned int tail = segmentCount > 0 ? frameSegments[oldestSegment].begin : frameStartOffset;
+
+			// Strict comparisons keep head from ever landing on tail,
+			// so head == tail always means "nothing in flight"
+			if (head >= tail)
+			{
+				if (head + size <= cbHeapSizeInBytes) { offset = head; return true; }
+				if (size < tail) { offset = 0; return true; }
+				return false;
+			}
+			if (head + size < tail) { offset = head; return true; }
+			return false;
+		}
+
+		// Replaces the ring with a larger buffer.  Work already submitted
+		// keeps the old buffer alive, so nothing needs to wait.
+		// Returns false, keeping the old buffer, if it can't be made.
+		bool GrowRing(unsigned int minimumSize)
+		{
+			unsigned int newSize = cbHeapSizeInBytes;
+			while (newSize < minimumSize * 2)
+				newSize *= 2;
+
+			D3D11_BUFFER_DESC cbDesc = {};
+			cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			cbDesc.ByteWidth = newSize;
+			cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			cbDesc.Usage = D3D11_USAGE_DYNAMIC;
+
+			Microsoft::WRL::ComPtr<ID3D11Buffer> newHeap;
+			if (FAILED(Device->CreateBuffer(&cbDesc, 0, newHeap.GetAddressOf())))
+				return false;
+
+			ConstantBufferHeap = newHeap;
+			cbHeapSizeInBytes = newSize;
+			growCount++;
+			return true;
+		}
 	}
 }
 
@@ -168,7 +272,7 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 	// buffer has not been used yet at this stage
 	cbHeapOffsetInBytes = 0;
 
-	cbHeapSizeInBytes = 1000 * 256; // More than enough for now
+	cbHeapSizeInBytes = 1000 * 256; // Starting size - grows on demand
 	// Ensure 256-byte alignment in the event the above calculation changes!
 	cbHeapSizeInBytes = (cbHeapSizeInBytes + 255) / 256 * 256;
 
@@ -180,6 +284,13 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 	cbDesc.Usage = D3D11_USAGE_DYNAMIC;
 	Device->CreateBuffer(&cbDesc, 0, ConstantBufferHeap.GetAddressOf());
 
+	// One event query per tracked frame, to know when the
+	// GPU has finished with that frame's part of the ring
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (FrameSegment& segment : frameSegments)
+		Device->CreateQuery(&queryDesc, segment.query.GetAddressOf());
+
 #if defined(DEBUG) || defined(_DEBUG)
 	// If we're in debug mode, set up the info queue to
 	// get debug messages we can print to our console
@@ -291,6 +402,58 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 	SwapChain->GetFullscreenState(&isFullscreen, 0);
 }
 
+// --------------------------------------------------------
+// Marks the start of a frame's constant uploads, and lets go
+// of ring space from earlier frames the GPU has finished with
+// --------------------------------------------------------
+void Graphics::BeginFrame()
+{
+	RetireCompletedFrames();
+	frameStartOffset = cbHeapOffsetInBytes;
+
+	mapCount = 0;
+	allocationCount = 0;
+	bytesUploaded = 0;
+	overflowCount = 0;
+}
+
+// --------------------------------------------------------
+// Closes the frame's slice of the ring and fences it with an
+// event query, so later frames won't overwrite it too early
+// --------------------------------------------------------
+void Graphics::EndFrame()
+{
+	unsigned int frameBytes = bytesUploaded;
+	if (frameBytes > highWaterMark)
+		highWaterMark = frameBytes;
+
+	// Nothing uploaded, nothing to protect
+	unsigned int head = cbHeapOffsetInBytes;
+	if (head == frameStartOffset)
+		return;
+
+	// Out of tracking slots - wait for the oldest frame instead of guessing.
+	// That only happens with the GPU MaxFramesInFlight frames behind,
+	// where Present would soon block the CPU anyway, so a hard stall
+	// costs little.  Polling flushes, so the query is sure to finish;
+	// the thread yields between polls rather than spinning a core.
+	if (segmentCount == MaxFramesInFlight)
+	{
+		while (Context->GetData(frameSegments[oldestSegment].query.Get(), 0, 0, 0) == S_FALSE)
+			std::this_thread::yield();
+		oldestSegment = (oldestSegment + 1) % MaxFramesInFlight;
+		segmentCount--;
+	}
+
+	FrameSegment& segment = frameSegments[(oldestSegment + segmentCount) % MaxFramesInFlight];
+	segment.begin = frameStartOffset;
+	segment.end = head;
+	Context->End(segment.query.Get());
+	segmentCount++;
+
+	frameStartOffset = head;
+}
+
 /// <summary>
 ///  fill a portion of the constant buffer with data and then immediately bind 
 /// that portion to pipeline for an upcoming draw
@@ -301,35 +464,162 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 /// <param name="registerSlot">binding slot (register) index since multiple buffer can be bound to a singel shader stage</param>
 void Graphics::FillAndBindNextConstantBuffer(void* data, unsigned int dataSizeInBytes, D3D11_SHADER_TYPE shaderType, unsigned int registerSlot)
 {
-	// How much space will we actually need? Each chunk must be
-	// a multiple of 256 bytes.
-	unsigned int reservationSize = (dataSizeInBytes + 255) / 256 * 256;
+	// A batch of exactly one upload
+	BeginConstantUpload(CalcConstantBufferSize(dataSizeInBytes));
+	ConstantAllocation allocation = AllocateConstants(dataSizeInBytes);
+	memcpy(allocation.data, data, dataSizeInBytes);
+	EndConstantUpload();
+
+	// Bind the buffer to the proper pipeline stage
+	BindConstantBufferRange(shaderType, registerSlot, allocation.firstConstant, allocation.numConstants);
+}
 
-	// Does this fit in the remaining space? If not, loop back to
-	// the beginning of the ring buffer
-	if (cbHeapOffsetInBytes + reservationSize >= cbHeapSizeInBytes)
-		cbHeapOffsetInBytes = 0;
 
-	// This lets us write into the unused areas without the need for separate physical buffers
+// --------------------------------------------------------
+// Maps the ring once for a batch of uploads.  Every slice
+// handed out by AllocateConstants() until EndConstantUpload()
+// points straight into this mapping.
+//
+// bytesNeeded - Total size of the batch, with each upload
+//               rounded up by CalcConstantBufferSize()
+//
+// The space is guaranteed not to be in use by the GPU:
+//  - If the ring is too small for the batch, it grows
+//  - If the free part of the ring is too small, the whole
+//    ring is renamed with a DISCARD instead of overwritten
+// --------------------------------------------------------
+void Graphics::BeginConstantUpload(unsigned int bytesNeeded)
+{
+	if (mappedHeap)
+		return;
+
+	RetireCompletedFrames();
+
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	unsigned int offset = 0;
+
+	if (bytesNeeded > cbHeapSizeInBytes / 2)
+	{
+		// Too big to keep more than one frame's worth around - grow.
+		// The new buffer holds nothing the GPU is using.  If it can't
+		// be made, the batch gets what the old one holds and the rest
+		// overflows (see the limit below).
+		if (!GrowRing(bytesNeeded))
+			printf("Constant ring couldn't grow to fit a %u byte batch\n", bytesNeeded);
+		mapType = D3D11_MAP_WRITE_DISCARD;
+	}
+	else if (!FindRingSpace(bytesNeeded, offset))
+	{
+		// Everything free is still in flight, so let the driver
+		// hand us fresh memory rather than stalling
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		discardCount++;
+	}
+
+	if (mapType == D3D11_MAP_WRITE_DISCARD)
+	{
+		// Old frames live on in the renamed memory, so stop tracking them
+		segmentCount = 0;
+		frameStartOffset = 0;
+		offset = 0;
+	}
+
 	D3D11_MAPPED_SUBRESOURCE map{};
-	Context->Map(
-		ConstantBufferHeap.Get(),
-		0,
-		D3D11_MAP_WRITE_NO_OVERWRITE, //promising not to overwrite any data the GPU might still be using
-		0,
-		&map);
+	if (FAILED(Context->Map(ConstantBufferHeap.Get(), 0, mapType, 0, &map)))
+		return;
+
+	mappedHeap = map.pData;
+	mapCount++;
+
+	// Never past the end of the buffer, whatever was asked for
+	uploadBegin = offset;
+	uploadLimit = std::min(offset + bytesNeeded, cbHeapSizeInBytes);
+	cbHeapOffsetInBytes = offset;
+}
+
+// --------------------------------------------------------
+// Bump-allocates a 256-byte aligned slice of the mapped ring.
+// Callers write their constants directly into the returned
+// memory (write only - it's write-combined GPU memory) and
+// bind the returned range once the upload has ended.
+//
+// dataSizeInBytes - How many bytes the caller will write
+//
+// Running past the size given to BeginConstantUpload() is
+// an overflow, which is a bug in the caller's reservation.
+// The ring can't grow or be renamed here, since this may be
+// running on a worker while the render thread holds the map,
+// so the caller gets scratch memory (nothing the GPU reads is
+// ever overwritten) and an invalid range, which binds no
+// buffer.  Overflows are reported on the console and counted
+// in the upload stats.
+// --------------------------------------------------------
+Graphics::ConstantAllocation Graphics::AllocateConstants(unsigned int dataSizeInBytes)
+{
+	unsigned int reservationSize = CalcConstantBufferSize(dataSizeInBytes);
+	unsigned int offset = cbHeapOffsetInBytes.fetch_add(reservationSize);
+
+	ConstantAllocation allocation{};
+	allocation.numConstants = reservationSize / 16;
+
+	if (!mappedHeap || offset + reservationSize > uploadLimit)
+	{
+		thread_local std::vector<unsigned char> overflowScratch;
+		if (overflowScratch.size() < reservationSize)
+			overflowScratch.resize(reservationSize);
+
+		if (overflowCount++ == 0)
+			printf("Constant ring overflow: allocations past the %u bytes reserved this batch get no constants\n",
+				mappedHeap ? uploadLimit - uploadBegin : 0);
+		allocation.data = overflowScratch.data();
+		allocation.firstConstant = CONSTANT_ALLOCATION_INVALID;
+		allocation.numConstants = 0;
+		return allocation;
+	}
+
+	allocationCount++;
+	bytesUploaded += reservationSize;
+
+	allocation.data = reinterpret_cast<void*>((UINT64)mappedHeap + offset);
+	allocation.firstConstant = offset / 16;
+	return allocation;
+}
+
+// --------------------------------------------------------
+// Unmaps the ring after a batch of uploads
+// --------------------------------------------------------
+void Graphics::EndConstantUpload()
+{
+	if (!mappedHeap)
+		return;
 
-	// Write into the proper portion of the buffer
-	void* uploadAddress = reinterpret_cast<void*>((UINT64)map.pData + cbHeapOffsetInBytes);
-	memcpy(uploadAddress, data, dataSizeInBytes);
 	Context->Unmap(ConstantBufferHeap.Get(), 0);
+	mappedHeap = 0;
 
+	// Overflowed allocations bumped the head past the reservation
+	if (cbHeapOffsetInBytes > uploadLimit)
+		cbHeapOffsetInBytes = uploadLimit;
+}
 
-	// Calculate the binding offset and size as measured in 16-byte constants
-	unsigned int firstConstant = cbHeapOffsetInBytes / 16;
-	unsigned int numConstants = reservationSize / 16;
+// --------------------------------------------------------
+// Binds a range of the ring to a shader stage
+// 
+// firstConstant - Offset into the ring, in 16-byte constants
+// numConstants  - Size of the range, in 16-byte constants
+// --------------------------------------------------------
+void Graphics::BindConstantBufferRange(D3D11_SHADER_TYPE shaderType, unsigned int registerSlot, unsigned int firstConstant, unsigned int numConstants)
+{
+	// An overflowed allocation holds nothing in the ring
+	if (firstConstant == CONSTANT_ALLOCATION_INVALID)
+	{
+		ID3D11Buffer* noBuffer = 0;
+		if (shaderType == D3D11_VERTEX_SHADER)
+			Context->VSSetConstantBuffers(registerSlot, 1, &noBuffer);
+		else if (shaderType == D3D11_PIXEL_SHADER)
+			Context->PSSetConstantBuffers(registerSlot, 1, &noBuffer);
+		return;
+	}
 
-	// Bind the buffer to the proper pipeline stage
 	switch (shaderType)
 	{
 	case D3D11_VERTEX_SHADER:
@@ -349,9 +639,21 @@ void Graphics::FillAndBindNextConstantBuffer(void* data, unsigned int dataSizeIn
 			&numConstants);
 		break;
 	}
+}
 
-	// Offset for the next call
-	cbHeapOffsetInBytes += reservationSize;
+Graphics::ConstantUploadStats Graphics::GetConstantUploadStats()
+{
+	ConstantUploadStats stats{};
+	stats.mapCount = mapCount;
+	stats.allocationCount = allocationCount;
+	stats.bytesUploaded = bytesUploaded;
+	stats.overflowCount = overflowCount;
+	stats.capacityInBytes = cbHeapSizeInBytes;
+	stats.highWaterMarkInBytes = highWaterMark;
+	stats.framesInFlight = segmentCount;
+	stats.growCount = growCount;
+	stats.discardCount = discardCount;
+	return stats;
 }
 
 
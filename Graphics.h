@@ -4,6 +4,7 @@
 #include <d3d11.h>
 #include <d3d11_1.h>
 #include <string>
+#include <atomic>
 #include <wrl/client.h>
 #include <d3d11shadertracing.h>
 
@@ -35,7 +36,41 @@ namespace Graphics
 	// Size of the constant buffer heap (measured in bytes)
 	inline unsigned int cbHeapSizeInBytes;
 	// Position of the next unused portion of the heap
-	inline unsigned int cbHeapOffsetInBytes;
+	// (atomic so several threads can allocate while it's mapped)
+	inline std::atomic<unsigned int> cbHeapOffsetInBytes;
+
+	// firstConstant of an allocation that didn't fit in the batch.
+	// Binding it binds no buffer at all, rather than a range
+	// holding some other upload's constants.
+	#define CONSTANT_ALLOCATION_INVALID 0xFFFFFFFFu
+
+	// A slice of the ring handed out during a frame upload
+	struct ConstantAllocation
+	{
+		void* data;					// Where to write (mapped GPU memory)
+		unsigned int firstConstant;	// Binding offset, in 16-byte constants
+		unsigned int numConstants;	// Binding size, in 16-byte constants
+	};
+
+	// Ring usage telemetry
+	struct ConstantUploadStats
+	{
+		// This frame
+		unsigned int mapCount;
+		unsigned int allocationCount;
+		unsigned int bytesUploaded;
+		unsigned int overflowCount;
+
+		// Since startup
+		unsigned int capacityInBytes;
+		unsigned int highWaterMarkInBytes;
+		unsigned int framesInFlight;
+		unsigned int growCount;
+		unsigned int discardCount;
+	};
+
+	// Every upload takes a multiple of 256 bytes in the ring
+	inline unsigned int CalcConstantBufferSize(unsigned int dataSizeInBytes) { return (dataSizeInBytes + 255) / 256 * 256; }
 
 
 	// --- FUNCTIONS ---
@@ -56,6 +91,23 @@ namespace Graphics
 		D3D11_SHADER_TYPE shaderType,
 		unsigned int registerSlot);
 
+	// Per-frame fencing of the ring
+	void BeginFrame();
+	void EndFrame();
+
+	// Frame-scoped uploads: map the ring once, hand out slices
+	// (from any thread), then unmap once before binding them
+	void BeginConstantUpload(unsigned int bytesNeeded);
+	ConstantAllocation AllocateConstants(unsigned int dataSizeInBytes);
+	void EndConstantUpload();
+	void BindConstantBufferRange(
+		D3D11_SHADER_TYPE shaderType,
+		unsigned int registerSlot,
+		unsigned int firstConstant,
+		unsigned int numConstants);
+
+	ConstantUploadStats GetConstantUploadStats();
+
 
 	// Debug Layer
 	void PrintDebugMessages();
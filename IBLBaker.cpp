@@ -0,0 +1,514 @@
+#include "IBLBaker.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using namespace DirectX;
+
+// Annonymous namespace for sampling helpers and the cache
+// layout, only used in this file
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	struct IBLCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t specularSize;
+		uint32_t specularMipCount;
+		uint32_t brdfSize;
+		uint32_t padding;
+	};
+
+	// Area of the part of a face between the center and (x, y),
+	// projected onto the unit sphere
+	float AreaElement(float x, float y)
+	{
+		return atan2f(x * y, sqrtf(x * x + y * y + 1.0f));
+	}
+
+	float TexelSolidAngle(unsigned int x, unsigned int y, unsigned int size)
+	{
+		float x0 = 2.0f * x / size - 1.0f;
+		float y0 = 2.0f * y / size - 1.0f;
+		float x1 = 2.0f * (x + 1) / size - 1.0f;
+		float y1 = 2.0f * (y + 1) / size - 1.0f;
+		return AreaElement(x0, y0) - AreaElement(x0, y1) - AreaElement(x1, y0) + AreaElement(x1, y1);
+	}
+
+	// Real spherical harmonics, bands 0-2
+	void EvaluateSHBasis(FXMVECTOR direction, float basis[IBL_SH_COEFFICIENT_COUNT])
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, direction);
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * d.y;
+		basis[2] = 0.488603f * d.z;
+		basis[3] = 0.488603f * d.x;
+		basis[4] = 1.092548f * d.x * d.y;
+		basis[5] = 1.092548f * d.y * d.z;
+		basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+		basis[7] = 1.092548f * d.x * d.z;
+		basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+	}
+
+	// Inverse of TexelDirection: which face, and where on it (0-1)
+	void DirectionToFace(FXMVECTOR direction, unsigned int& face, float& u, float& v)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, direction);
+		float ax = fabsf(d.x), ay = fabsf(d.y), az = fabsf(d.z);
+
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az)
+		{
+			face = d.x > 0 ? 0 : 1;
+			sc = d.x > 0 ? -d.z : d.z;
+			tc = -d.y;
+			ma = ax;
+		}
+		else if (ay >= az)
+		{
+			face = d.y > 0 ? 2 : 3;
+			sc = d.x;
+			tc = d.y > 0 ? d.z : -d.z;
+			ma = ay;
+		}
+		else
+		{
+			face = d.z > 0 ? 4 : 5;
+			sc = d.z > 0 ? d.x : -d.x;
+			tc = -d.y;
+			ma = az;
+		}
+
+		u = (sc / ma) * 0.5f + 0.5f;
+		v = (tc / ma) * 0.5f + 0.5f;
+	}
+
+	// Bilinear within a face (edges clamp rather than crossing to
+	// the neighboring face, which is fine for filtered lighting)
+	XMVECTOR SampleLevel(const IBLSource& level, FXMVECTOR direction)
+	{
+		unsigned int face;
+		float u, v;
+		DirectionToFace(direction, face, u, v);
+
+		float x = std::clamp(u * level.size - 0.5f, 0.0f, (float)(level.size - 1));
+		float y = std::clamp(v * level.size - 0.5f, 0.0f, (float)(level.size - 1));
+		unsigned int x0 = (unsigned int)x, y0 = (unsigned int)y;
+		unsigned int x1 = std::min(x0 + 1, level.size - 1), y1 = std::min(y0 + 1, level.size - 1);
+		float fx = x - x0, fy = y - y0;
+
+		const std::vector<XMFLOAT4>& texels = level.faces[face];
+		XMVECTOR top = XMVectorLerp(XMLoadFloat4(&texels[y0 * level.size + x0]), XMLoadFloat4(&texels[y0 * level.size + x1]), fx);
+		XMVECTOR bottom = XMVectorLerp(XMLoadFloat4(&texels[y1 * level.size + x0]), XMLoadFloat4(&texels[y1 * level.size + x1]), fx);
+		return XMVectorLerp(top, bottom, fy);
+	}
+
+	// Trilinear, between two box filtered levels of the source
+	XMVECTOR SampleChain(const std::vector<IBLSource>& chain, FXMVECTOR direction, float lod)
+	{
+		lod = std::clamp(lod, 0.0f, (float)(chain.size() - 1));
+		unsigned int level0 = (unsigned int)lod;
+		unsigned int level1 = std::min(level0 + 1, (unsigned int)chain.size() - 1);
+		return XMVectorLerp(SampleLevel(chain[level0], direction), SampleLevel(chain[level1], direction), lod - level0);
+	}
+
+	// Box filtered mips of the source, so wide GGX lobes can read
+	// pre-averaged texels instead of taking thousands of samples
+	std::vector<IBLSource> BuildSourceChain(const IBLSource& source)
+	{
+		std::vector<IBLSource> chain;
+		chain.push_back(source);
+		while (chain.back().size > 1)
+		{
+			const IBLSource& above = chain.back();
+			IBLSource level;
+			level.size = above.size / 2;
+			for (unsigned int face = 0; face < 6; face++)
+			{
+				level.faces[face].resize((size_t)level.size * level.size);
+				for (unsigned int y = 0; y < level.size; y++)
+				{
+					for (unsigned int x = 0; x < level.size; x++)
+					{
+						const XMFLOAT4* row0 = &above.faces[face][(size_t)(y * 2) * above.size];
+						const XMFLOAT4* row1 = &above.faces[face][(size_t)std::min(y * 2 + 1, above.size - 1) * above.size];
+						unsigned int x0 = x * 2;
+						unsigned int x1 = std::min(x * 2 + 1, above.size - 1);
+						XMVECTOR sum = XMVectorAdd(
+							XMVectorAdd(XMLoadFloat4(&row0[x0]), XMLoadFloat4(&row0[x1])),
+							XMVectorAdd(XMLoadFloat4(&row1[x0]), XMLoadFloat4(&row1[x1])));
+						XMStoreFloat4(&level.faces[face][y * level.size + x], XMVectorScale(sum, 0.25f));
+					}
+				}
+			}
+			chain.push_back(std::move(level));
+		}
+		return chain;
+	}
+
+	XMFLOAT2 Hammersley(unsigned int i, unsigned int count)
+	{
+		uint32_t bits = i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		return XMFLOAT2((float)i / count, bits * 2.3283064365386963e-10f);
+	}
+
+	// A GGX distributed half vector around +Z
+	XMVECTOR ImportanceSampleGGX(XMFLOAT2 xi, float alpha)
+	{
+		float phi = 2.0f * PI * xi.x;
+		float cosTheta = sqrtf((1.0f - xi.y) / (1.0f + (alpha * alpha - 1.0f) * xi.y));
+		float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+		return XMVectorSet(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta, 0.0f);
+	}
+
+	// Rows handed to each job; more ranges than threads evens out the work
+	unsigned int RangeCount()
+	{
+		return (JobSystem::WorkerCount() + 1) * 4;
+	}
+}
+
+// --------------------------------------------------------
+// D3D cube face conventions: u and v go from -1 to 1 across
+// the face, v pointing down the image
+// --------------------------------------------------------
+XMVECTOR IBLBaker::TexelDirection(unsigned int face, float u, float v)
+{
+	XMVECTOR direction;
+	switch (face)
+	{
+	case 0: direction = XMVectorSet(1.0f, -v, -u, 0.0f); break;
+	case 1: direction = XMVectorSet(-1.0f, -v, u, 0.0f); break;
+	case 2: direction = XMVectorSet(u, 1.0f, v, 0.0f); break;
+	case 3: direction = XMVectorSet(u, -1.0f, -v, 0.0f); break;
+	case 4: direction = XMVectorSet(u, -v, 1.0f, 0.0f); break;
+	default: direction = XMVectorSet(-u, -v, -1.0f, 0.0f); break;
+	}
+	return XMVector3Normalize(direction);
+}
+
+IBLSource IBLBaker::CreateSource(const uint8_t* const faces[6], unsigned int size, bool sRGB)
+{
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+	{
+		float c = i / 255.0f;
+		toLinear[i] = !sRGB ? c : (c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f));
+	}
+
+	IBLSource source;
+	source.size = size;
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		source.faces[face].resize((size_t)size * size);
+		for (size_t i = 0; i < source.faces[face].size(); i++)
+		{
+			const uint8_t* texel = faces[face] + i * 4;
+			source.faces[face][i] = XMFLOAT4(toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]], 1.0f);
+		}
+	}
+	return source;
+}
+
+// --------------------------------------------------------
+// Projects every texel onto the first 9 SH functions, weighted
+// by its solid angle.  Each job sums its own rows; the partial
+// sums are added up at the end.
+// --------------------------------------------------------
+void IBLBaker::ProjectIrradianceSH(const IBLSource& source, XMFLOAT4 sh[IBL_SH_COEFFICIENT_COUNT])
+{
+	unsigned int rowCount = source.size * 6;
+	unsigned int rangeCount = std::min(RangeCount(), rowCount);
+	std::vector<XMVECTOR> partials((size_t)rangeCount * IBL_SH_COEFFICIENT_COUNT, XMVectorZero());
+
+	JobSystem::ParallelFor(rowCount, rangeCount,
+		[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+		{
+			XMVECTOR* sums = &partials[(size_t)rangeIndex * IBL_SH_COEFFICIENT_COUNT];
+			for (unsigned int row = begin; row < end; row++)
+			{
+				unsigned int face = row / source.size;
+				unsigned int y = row % source.size;
+				for (unsigned int x = 0; x < source.size; x++)
+				{
+					float u = 2.0f * (x + 0.5f) / source.size - 1.0f;
+					float v = 2.0f * (y + 0.5f) / source.size - 1.0f;
+
+					float basis[IBL_SH_COEFFICIENT_COUNT];
+					EvaluateSHBasis(TexelDirection(face, u, v), basis);
+
+					XMVECTOR radiance = XMVectorScale(
+						XMLoadFloat4(&source.faces[face][y * source.size + x]),
+						TexelSolidAngle(x, y, source.size));
+					for (int i = 0; i < IBL_SH_COEFFICIENT_COUNT; i++)
+						sums[i] = XMVectorMultiplyAdd(radiance, XMVectorReplicate(basis[i]), sums[i]);
+				}
+			}
+		});
+
+	// Convolve with the cosine lobe (pi, 2pi/3, pi/4 per band),
+	// then divide by pi so the shader skips the Lambert term
+	const float bandScale[IBL_SH_COEFFICIENT_COUNT] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (int i = 0; i < IBL_SH_COEFFICIENT_COUNT; i++)
+	{
+		XMVECTOR total = XMVectorZero();
+		for (unsigned int r = 0; r < rangeCount; r++)
+			total = XMVectorAdd(total, partials[(size_t)r * IBL_SH_COEFFICIENT_COUNT + i]);
+		XMStoreFloat4(&sh[i], XMVectorScale(total, bandScale[i]));
+		sh[i].w = 0.0f;
+	}
+}
+
+// --------------------------------------------------------
+// Split sum prefiltering (N = V = R) with GGX importance
+// sampling.  Since N = V, every texel of a mip uses the same
+// samples around its own normal, so they're set up once per
+// mip, each with the source lod its pdf calls for.
+// --------------------------------------------------------
+void IBLBaker::PrefilterSpecular(const IBLSource& source, unsigned int size, IBLData& data)
+{
+	std::vector<IBLSource> chain = BuildSourceChain(source);
+
+	data.specularSize = size;
+	data.specularMipCount = 1;
+	while ((size >> data.specularMipCount) > 0)
+		data.specularMipCount++;
+
+	size_t faceTexels = 0;
+	for (unsigned int mip = 0; mip < data.specularMipCount; mip++)
+		faceTexels += (size_t)(size >> mip) * (size >> mip);
+	data.specular.assign(faceTexels * 6, XMFLOAT4(0, 0, 0, 0));
+
+	float sourceTexelSolidAngle = 4.0f * PI / (6.0f * source.size * source.size);
+
+	size_t mipOffset = 0;
+	for (unsigned int mip = 0; mip < data.specularMipCount; mip++)
+	{
+		unsigned int mipSize = size >> mip;
+		float roughness = data.specularMipCount > 1 ? (float)mip / (data.specularMipCount - 1) : 0.0f;
+		float alpha = roughness * roughness;
+
+		// Tangent space samples: direction to light, N.L weight and source lod
+		struct Sample { XMFLOAT3 light; float weight; float lod; };
+		std::vector<Sample> samples;
+		if (mip == 0)
+		{
+			// Mirror reflection: just resample at this mip's resolution
+			samples.push_back({ XMFLOAT3(0, 0, 1), 1.0f, log2f((float)source.size / mipSize) });
+		}
+		else
+		{
+			for (unsigned int i = 0; i < IBL_SPECULAR_SAMPLES; i++)
+			{
+				XMVECTOR half = ImportanceSampleGGX(Hammersley(i, IBL_SPECULAR_SAMPLES), alpha);
+				XMVECTOR view = XMVectorSet(0, 0, 1, 0);
+				XMVECTOR light = XMVectorSubtract(XMVectorScale(half, 2.0f * XMVectorGetX(XMVector3Dot(view, half))), view);
+				float nDotL = XMVectorGetZ(light);
+				if (nDotL <= 0.0f)
+					continue;
+
+				float nDotH = XMVectorGetZ(half);
+				float denominator = nDotH * nDotH * (alpha * alpha - 1.0f) + 1.0f;
+				float distribution = alpha * alpha / (PI * denominator * denominator);
+				float pdf = distribution * 0.25f;	// D * N.H / (4 V.H), with N = V
+				float sampleSolidAngle = 1.0f / (IBL_SPECULAR_SAMPLES * pdf + 0.0001f);
+
+				Sample sample;
+				XMStoreFloat3(&sample.light, light);
+				sample.weight = nDotL;
+				sample.lod = 0.5f * log2f(sampleSolidAngle / sourceTexelSolidAngle) + 1.0f;
+				samples.push_back(sample);
+			}
+		}
+
+		JobSystem::ParallelFor(mipSize * 6, RangeCount(),
+			[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+			{
+				for (unsigned int row = begin; row < end; row++)
+				{
+					unsigned int face = row / mipSize;
+					unsigned int y = row % mipSize;
+					for (unsigned int x = 0; x < mipSize; x++)
+					{
+						float u = 2.0f * (x + 0.5f) / mipSize - 1.0f;
+						float v = 2.0f * (y + 0.5f) / mipSize - 1.0f;
+						XMVECTOR normal = TexelDirection(face, u, v);
+
+						// Basis around the normal
+						XMVECTOR up = fabsf(XMVectorGetZ(normal)) < 0.999f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(1, 0, 0, 0);
+						XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(up, normal));
+						XMVECTOR bitangent = XMVector3Cross(normal, tangent);
+
+						XMVECTOR color = XMVectorZero();
+						float totalWeight = 0.0f;
+						for (const Sample& sample : samples)
+						{
+							XMVECTOR light = XMVectorMultiplyAdd(tangent, XMVectorReplicate(sample.light.x),
+								XMVectorMultiplyAdd(bitangent, XMVectorReplicate(sample.light.y),
+									XMVectorScale(normal, sample.light.z)));
+							color = XMVectorMultiplyAdd(SampleChain(chain, light, sample.lod), XMVectorReplicate(sample.weight), color);
+							totalWeight += sample.weight;
+						}
+
+						size_t index = faceTexels * face + mipOffset + (size_t)y * mipSize + x;
+						XMStoreFloat4(&data.specular[index], XMVectorScale(color, 1.0f / totalWeight));
+						data.specular[index].w = 1.0f;
+					}
+				}
+			});
+
+		mipOffset += (size_t)mipSize * mipSize;
+	}
+}
+
+// --------------------------------------------------------
+// The environment BRDF half of the split sum: for each N.V
+// and roughness, the scale and bias applied to F0
+// --------------------------------------------------------
+void IBLBaker::IntegrateBRDF(unsigned int size, IBLData& data)
+{
+	data.brdfSize = size;
+	data.brdf.assign((size_t)size * size, XMFLOAT2(0, 0));
+
+	JobSystem::ParallelFor(size, RangeCount(),
+		[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+		{
+			for (unsigned int y = begin; y < end; y++)
+			{
+				float roughness = (y + 0.5f) / size;
+				float alpha = roughness * roughness;
+				float k = alpha * 0.5f;
+
+				for (unsigned int x = 0; x < size; x++)
+				{
+					float nDotV = (x + 0.5f) / size;
+					XMVECTOR view = XMVectorSet(sqrtf(1.0f - nDotV * nDotV), 0.0f, nDotV, 0.0f);
+
+					float scale = 0.0f, bias = 0.0f;
+					for (unsigned int i = 0; i < IBL_BRDF_SAMPLES; i++)
+					{
+						XMVECTOR half = ImportanceSampleGGX(Hammersley(i, IBL_BRDF_SAMPLES), alpha);
+						float vDotH = XMVectorGetX(XMVector3Dot(view, half));
+						XMVECTOR light = XMVectorSubtract(XMVectorScale(half, 2.0f * vDotH), view);
+
+						float nDotL = XMVectorGetZ(light);
+						float nDotH = XMVectorGetZ(half);
+						if (nDotL <= 0.0f)
+							continue;
+
+						float geometry = (nDotV / (nDotV * (1.0f - k) + k)) * (nDotL / (nDotL * (1.0f - k) + k));
+						float visibility = geometry * std::max(vDotH, 0.0f) / (nDotH * nDotV);
+						float fresnel = powf(1.0f - std::max(vDotH, 0.0f), 5.0f);
+						scale += (1.0f - fresnel) * visibility;
+						bias += fresnel * visibility;
+					}
+
+					data.brdf[(size_t)y * size + x] = XMFLOAT2(scale / IBL_BRDF_SAMPLES, bias / IBL_BRDF_SAMPLES);
+				}
+			}
+		});
+}
+
+IBLData IBLBaker::Bake(const IBLSource& source)
+{
+	PROFILE_SCOPE("Bake sky lighting");
+	IBLData data = {};
+	ProjectIrradianceSH(source, data.irradianceSH);
+	PrefilterSpecular(source, std::min((unsigned int)IBL_SPECULAR_SIZE, source.size), data);
+	IntegrateBRDF(IBL_BRDF_SIZE, data);
+	return data;
+}
+
+uint64_t IBLBaker::HashFiles(const std::wstring* paths, unsigned int count)
+{
+	uint64_t hash = 14695981039346656037ull;
+	std::vector<char> buffer(1 << 16);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		std::ifstream file(std::filesystem::path(paths[i]), std::ios::binary);
+		while (file)
+		{
+			file.read(buffer.data(), buffer.size());
+			std::streamsize read = file.gcount();
+			for (std::streamsize b = 0; b < read; b++)
+			{
+				hash ^= (uint8_t)buffer[b];
+				hash *= 1099511628211ull;
+			}
+		}
+	}
+	return hash;
+}
+
+bool IBLBaker::SaveCache(const std::wstring& path, uint64_t key, const IBLData& data)
+{
+	std::ofstream file(std::filesystem::path(path), std::ios::binary);
+	if (!file)
+		return false;
+
+	IBLCacheHeader header = {};
+	header.magic = IBL_CACHE_MAGIC;
+	header.version = IBL_CACHE_VERSION;
+	header.key = key;
+	header.specularSize = data.specularSize;
+	header.specularMipCount = data.specularMipCount;
+	header.brdfSize = data.brdfSize;
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)data.irradianceSH, sizeof(data.irradianceSH));
+	file.write((const char*)data.specular.data(), data.specular.size() * sizeof(XMFLOAT4));
+	file.write((const char*)data.brdf.data(), data.brdf.size() * sizeof(XMFLOAT2));
+	return (bool)file;
+}
+
+bool IBLBaker::LoadCache(const std::wstring& path, uint64_t key, IBLData& data)
+{
+	std::ifstream file(std::filesystem::path(path), std::ios::binary);
+	if (!file)
+		return false;
+
+	IBLCacheHeader header = {};
+	file.read((char*)&header, sizeof(header));
+
+	unsigned int expectedMipCount = 1;
+	while ((header.specularSize >> expectedMipCount) > 0)
+		expectedMipCount++;
+
+	if (!file ||
+		header.magic != IBL_CACHE_MAGIC ||
+		header.version != IBL_CACHE_VERSION ||
+		header.key != key ||
+		header.specularSize > IBL_SPECULAR_SIZE ||
+		header.specularMipCount != expectedMipCount ||
+		header.brdfSize != IBL_BRDF_SIZE)
+		return false;
+
+	size_t faceTexels = 0;
+	for (unsigned int mip = 0; mip < header.specularMipCount; mip++)
+		faceTexels += (size_t)(header.specularSize >> mip) * (header.specularSize >> mip);
+
+	data.specularSize = header.specularSize;
+	data.specularMipCount = header.specularMipCount;
+	data.brdfSize = header.brdfSize;
+	data.specular.resize(faceTexels * 6);
+	data.brdf.resize((size_t)header.brdfSize * header.brdfSize);
+
+	file.read((char*)data.irradianceSH, sizeof(data.irradianceSH));
+	file.read((char*)data.specular.data(), data.specular.size() * sizeof(XMFLOAT4));
+	file.read((char*)data.brdf.data(), data.brdf.size() * sizeof(XMFLOAT2));
+	return (bool)file;
+}
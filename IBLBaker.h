@@ -0,0 +1,75 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define IBL_SH_COEFFICIENT_COUNT 9
+#define IBL_SPECULAR_SIZE 64		// Top mip of the prefiltered cube
+#define IBL_BRDF_SIZE 64
+#define IBL_SPECULAR_SAMPLES 64
+#define IBL_BRDF_SAMPLES 256
+
+#define IBL_CACHE_MAGIC 0x434C4249	// "IBLC"
+#define IBL_CACHE_VERSION 1
+
+// A cube map in linear light, square faces in D3D order
+// (+X, -X, +Y, -Y, +Z, -Z), row by row
+struct IBLSource
+{
+	unsigned int size;
+	std::vector<DirectX::XMFLOAT4> faces[6];
+};
+
+// Everything the shaders need for image based ambient light
+struct IBLData
+{
+	// Irradiance as 9 SH coefficients (rgb), already convolved
+	// with the cosine lobe and divided by pi, so diffuse light is
+	// just albedo * the SH evaluated at the normal
+	DirectX::XMFLOAT4 irradianceSH[IBL_SH_COEFFICIENT_COUNT];
+
+	// GGX prefiltered radiance, roughness = mip / (mipCount - 1).
+	// Laid out face by face, each face's mips top level first.
+	unsigned int specularSize;
+	unsigned int specularMipCount;
+	std::vector<DirectX::XMFLOAT4> specular;
+
+	// Split sum BRDF scale and bias, x = N.V, y = roughness
+	unsigned int brdfSize;
+	std::vector<DirectX::XMFLOAT2> brdf;
+};
+
+// --------------------------------------------------------
+// Bakes image based lighting from the sky on the CPU, spread
+// over the JobSystem's workers.
+//
+// Results are cached on disk, keyed by a hash of the sky's
+// face images, so a sky that hasn't changed is never baked
+// again - startup just reads the cache.
+// --------------------------------------------------------
+namespace IBLBaker
+{
+	// The full bake: SH irradiance, prefiltered specular and the BRDF table
+	IBLData Bake(const IBLSource& source);
+
+	// Each part on its own
+	void ProjectIrradianceSH(const IBLSource& source, DirectX::XMFLOAT4 sh[IBL_SH_COEFFICIENT_COUNT]);
+	void PrefilterSpecular(const IBLSource& source, unsigned int size, IBLData& data);
+	void IntegrateBRDF(unsigned int size, IBLData& data);
+
+	// 8-bit RGBA faces (one mip of each) to linear floats.  Data
+	// that isn't sRGB is treated as linear, as the sampler would.
+	IBLSource CreateSource(const uint8_t* const faces[6], unsigned int size, bool sRGB);
+
+	// Cache key: 64-bit FNV-1a over the bytes of every file, in order
+	uint64_t HashFiles(const std::wstring* paths, unsigned int count);
+
+	// The cache only loads if its key and bake settings match
+	bool SaveCache(const std::wstring& path, uint64_t key, const IBLData& data);
+	bool LoadCache(const std::wstring& path, uint64_t key, IBLData& data);
+
+	// Direction through the center of a face texel
+	DirectX::XMVECTOR TexelDirection(unsigned int face, float u, float v);
+}
@@ -0,0 +1,152 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace JobSystem
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> queue;
+		std::mutex queueMutex;
+		std::condition_variable queueSignal;
+		bool shuttingDown = false;
+
+		// Pops and runs a single queued job, if there is one
+		bool RunOneJob()
+		{
+			std::function<void()> job;
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				if (queue.empty())
+					return false;
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job();
+			return true;
+		}
+
+		void WorkerLoop(unsigned int index)
+		{
+			Profiler::SetThreadName("Worker " + std::to_string(index));
+			while (true)
+			{
+				std::function<void()> job;
+				{
+					std::unique_lock<std::mutex> lock(queueMutex);
+					queueSignal.wait(lock, [] { return shuttingDown || !queue.empty(); });
+					if (shuttingDown && queue.empty())
+						return;
+					job = std::move(queue.front());
+					queue.pop_front();
+				}
+				job();
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Starts the worker threads.
+//
+// threadCount - Number of workers, or 0 to use one less than
+//               the hardware thread count (the calling thread
+//               also takes part in ParallelFor)
+// --------------------------------------------------------
+void JobSystem::Initialize(unsigned int threadCount)
+{
+	// Only initialize once
+	if (!workers.empty())
+		return;
+
+	if (threadCount == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	shuttingDown = false;
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(WorkerLoop, i);
+}
+
+// --------------------------------------------------------
+// Lets the workers finish anything queued, then joins them
+// --------------------------------------------------------
+void JobSystem::ShutDown()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		shuttingDown = true;
+	}
+	queueSignal.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+unsigned int JobSystem::WorkerCount() { return (unsigned int)workers.size(); }
+
+// --------------------------------------------------------
+// Runs func over [0, count) split into rangeCount pieces.
+// The first range always runs on the calling thread, and the
+// caller helps drain the queue while it waits for the rest.
+// --------------------------------------------------------
+void JobSystem::ParallelFor(
+	unsigned int count,
+	unsigned int rangeCount,
+	const std::function<void(unsigned int rangeIndex, unsigned int begin, unsigned int end)>& func)
+{
+	if (count == 0)
+		return;
+
+	rangeCount = std::clamp(rangeCount, 1u, count);
+
+	// Nothing to share (or nobody to share it with), so just run inline
+	if (rangeCount == 1 || workers.empty())
+	{
+		unsigned int rangeSize = (count + rangeCount - 1) / rangeCount;
+		for (unsigned int r = 0; r < rangeCount; r++)
+			func(r, std::min(r * rangeSize, count), std::min((r + 1) * rangeSize, count));
+		return;
+	}
+
+	unsigned int rangeSize = (count + rangeCount - 1) / rangeCount;
+	std::atomic<unsigned int> remaining = rangeCount - 1;
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		for (unsigned int r = 1; r < rangeCount; r++)
+		{
+			unsigned int begin = std::min(r * rangeSize, count);
+			unsigned int end = std::min((r + 1) * rangeSize, count);
+			queue.push_back([&func, &remaining, r, begin, end]()
+				{
+					func(r, begin, end);
+					remaining.fetch_sub(1, std::memory_order_release);
+				});
+		}
+	}
+	queueSignal.notify_all();
+
+	// Our own share of the work
+	func(0, 0, std::min(rangeSize, count));
+
+	// Help out until every range has reported back
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		if (!RunOneJob())
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+
+// --------------------------------------------------------
+// A small fixed-size pool of worker threads.
+//
+// Work is handed out as contiguous index ranges so each
+// range can write into its own output (command buffer,
+// light list, etc.) without any locking.
+// --------------------------------------------------------
+namespace JobSystem
+{
+	// General functions
+	void Initialize(unsigned int threadCount = 0);
+	void ShutDown();
+
+	// Getters
+	unsigned int WorkerCount();
+
+	// Splits [0, count) into rangeCount contiguous ranges and runs them
+	// on the workers and the calling thread, returning once all are done
+	void ParallelFor(
+		unsigned int count,
+		unsigned int rangeCount,
+		const std::function<void(unsigned int rangeIndex, unsigned int begin, unsigned int end)>& func);
+}
@@ -0,0 +1,308 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Builds the plane through three view-space points, flipped
+	// if needed so that the given point is on its positive side
+	XMFLOAT4 BoundaryPlane(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c, GXMVECTOR positiveSide)
+	{
+		XMVECTOR plane = XMPlaneNormalize(XMPlaneFromPoints(a, b, c));
+		if (XMVectorGetX(XMPlaneDotCoord(plane, positiveSide)) < 0.0f)
+			plane = XMVectorNegate(plane);
+
+		XMFLOAT4 result;
+		XMStoreFloat4(&result, plane);
+		return result;
+	}
+
+	// Takes a point from normalized device coordinates back into view space
+	XMVECTOR Unproject(float x, float y, float z, FXMMATRIX invProjection)
+	{
+		return XMVector3TransformCoord(XMVectorSet(x, y, z, 1.0f), invProjection);
+	}
+}
+
+LightClusters::LightClusters()
+{
+	this->nearZ = 0.1f;
+	this->farZ = 100.0f;
+	this->sliceScale = 0.0f;
+	this->sliceBias = 0.0f;
+	this->directionalLightCount = 0;
+	this->clusterLights.resize(LIGHT_CLUSTER_COUNT);
+	this->ranges.resize(LIGHT_CLUSTER_COUNT);
+}
+
+// --------------------------------------------------------
+// Finds the planes between neighbouring tile columns and
+// rows by unprojecting points along each tile edge
+// --------------------------------------------------------
+void LightClusters::BuildPlanes(const XMFLOAT4X4& projection)
+{
+	XMMATRIX invProjection = XMMatrixInverse(0, XMLoadFloat4x4(&projection));
+
+	for (unsigned int i = 0; i <= LIGHT_CLUSTER_COUNT_X; i++)
+	{
+		float x = -1.0f + 2.0f * i / LIGHT_CLUSTER_COUNT_X;
+		this->columnPlanes[i] = BoundaryPlane(
+			Unproject(x, -1.0f, 0.0f, invProjection),
+			Unproject(x, 1.0f, 0.0f, invProjection),
+			Unproject(x, -1.0f, 1.0f, invProjection),
+			Unproject(x + 0.5f, 0.0f, 0.5f, invProjection));
+	}
+
+	// Rows count down from the top of the screen, like pixels do
+	for (unsigned int i = 0; i <= LIGHT_CLUSTER_COUNT_Y; i++)
+	{
+		float y = 1.0f - 2.0f * i / LIGHT_CLUSTER_COUNT_Y;
+		this->rowPlanes[i] = BoundaryPlane(
+			Unproject(-1.0f, y, 0.0f, invProjection),
+			Unproject(1.0f, y, 0.0f, invProjection),
+			Unproject(-1.0f, y, 1.0f, invProjection),
+			Unproject(0.0f, y - 0.5f, 0.5f, invProjection));
+	}
+}
+
+unsigned int LightClusters::DepthToSlice(float viewDepth) const
+{
+	if (viewDepth <= this->nearZ)
+		return 0;
+
+	float slice = logf(viewDepth) * this->sliceScale + this->sliceBias;
+	if (slice >= LIGHT_CLUSTER_COUNT_Z - 1)
+		return LIGHT_CLUSTER_COUNT_Z - 1;
+	return slice > 0.0f ? (unsigned int)slice : 0;
+}
+
+// --------------------------------------------------------
+// Finds the block of clusters each light's bounding sphere
+// touches, four lights at a time.  The spheres are transposed
+// into one vector per component, so each boundary plane is
+// tested against all four at once.  Walking in from each
+// side, a lane keeps counting boundaries until one cuts its
+// sphere.  Conservative: a sphere near a tile corner may
+// land in a cluster it doesn't quite reach.
+// --------------------------------------------------------
+void LightClusters::BoundLights(const Light* lights, unsigned int count, FXMMATRIX view, LightBounds* results) const
+{
+	// World space spheres, one lane per light (unused lanes stay empty)
+	XMFLOAT4 centerX(0, 0, 0, 0);
+	XMFLOAT4 centerY(0, 0, 0, 0);
+	XMFLOAT4 centerZ(0, 0, 0, 0);
+	XMFLOAT4 radii(0, 0, 0, 0);
+	float* lanes[] = { &centerX.x, &centerY.x, &centerZ.x, &radii.x };
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Light& light = lights[i];
+		XMFLOAT3 center = light.position;
+		float radius = light.range;
+
+		// Tightest sphere around a cone: for wide cones it sits on the
+		// cap, for narrow ones it passes through the apex and the cap rim
+		if (light.type == LIGHT_TYPE_SPOT)
+		{
+			XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&light.direction));
+			float cosAngle = cosf(light.spotOuterAngle);
+			float distance;
+			if (light.spotOuterAngle > XM_PIDIV4)
+			{
+				distance = light.range * cosAngle;
+				radius = light.range * sinf(light.spotOuterAngle);
+			}
+			else
+			{
+				radius = light.range / (2.0f * cosAngle);
+				distance = radius;
+			}
+			XMStoreFloat3(&center, XMVectorMultiplyAdd(direction, XMVectorReplicate(distance), XMLoadFloat3(&light.position)));
+		}
+
+		lanes[0][i] = center.x;
+		lanes[1][i] = center.y;
+		lanes[2][i] = center.z;
+		lanes[3][i] = radius;
+	}
+
+	// Into view space.  The view matrix is affine, so no divide.
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, view);
+	XMVECTOR worldX = XMLoadFloat4(&centerX);
+	XMVECTOR worldY = XMLoadFloat4(&centerY);
+	XMVECTOR worldZ = XMLoadFloat4(&centerZ);
+	XMVECTOR x = XMVectorMultiplyAdd(worldX, XMVectorReplicate(m.m[0][0]), XMVectorMultiplyAdd(worldY, XMVectorReplicate(m.m[1][0]), XMVectorMultiplyAdd(worldZ, XMVectorReplicate(m.m[2][0]), XMVectorReplicate(m.m[3][0]))));
+	XMVECTOR y = XMVectorMultiplyAdd(worldX, XMVectorReplicate(m.m[0][1]), XMVectorMultiplyAdd(worldY, XMVectorReplicate(m.m[1][1]), XMVectorMultiplyAdd(worldZ, XMVectorReplicate(m.m[2][1]), XMVectorReplicate(m.m[3][1]))));
+	XMVECTOR z = XMVectorMultiplyAdd(worldX, XMVectorReplicate(m.m[0][2]), XMVectorMultiplyAdd(worldY, XMVectorReplicate(m.m[1][2]), XMVectorMultiplyAdd(worldZ, XMVectorReplicate(m.m[2][2]), XMVectorReplicate(m.m[3][2]))));
+	XMVECTOR radius = XMLoadFloat4(&radii);
+	XMVECTOR negRadius = XMVectorNegate(radius);
+
+	auto distance = [&](const XMFLOAT4& plane) {
+		return XMVectorMultiplyAdd(x, XMVectorReplicate(plane.x),
+			XMVectorMultiplyAdd(y, XMVectorReplicate(plane.y),
+			XMVectorMultiplyAdd(z, XMVectorReplicate(plane.z), XMVectorReplicate(plane.w))));
+	};
+
+	// Count the inner boundaries each sphere lies entirely past
+	// (from the left or top) or short of (from the right or bottom)
+	XMVECTOR one = XMVectorReplicate(1.0f);
+	XMVECTOR zero = XMVectorZero();
+	auto walk = [&](const XMFLOAT4* planes, unsigned int count, XMVECTOR& past, XMVECTOR& shortOf) {
+		XMVECTOR walkingIn = XMVectorTrueInt();
+		XMVECTOR walkingBack = XMVectorTrueInt();
+		past = zero;
+		shortOf = zero;
+		for (unsigned int i = 1; i < count; i++)
+		{
+			walkingIn = XMVectorAndInt(walkingIn, XMVectorGreater(distance(planes[i]), radius));
+			walkingBack = XMVectorAndInt(walkingBack, XMVectorLess(distance(planes[count - i]), negRadius));
+			past = XMVectorAdd(past, XMVectorSelect(zero, one, walkingIn));
+			shortOf = XMVectorAdd(shortOf, XMVectorSelect(zero, one, walkingBack));
+		}
+	};
+
+	XMVECTOR pastColumns, shortOfColumns, pastRows, shortOfRows;
+	walk(this->columnPlanes, LIGHT_CLUSTER_COUNT_X, pastColumns, shortOfColumns);
+	walk(this->rowPlanes, LIGHT_CLUSTER_COUNT_Y, pastRows, shortOfRows);
+
+	// Entirely off to one side of the screen, or outside the depth range
+	XMVECTOR outside = XMVectorOrInt(
+		XMVectorOrInt(
+			XMVectorLess(distance(this->columnPlanes[0]), negRadius),
+			XMVectorGreater(distance(this->columnPlanes[LIGHT_CLUSTER_COUNT_X]), radius)),
+		XMVectorOrInt(
+			XMVectorLess(distance(this->rowPlanes[0]), negRadius),
+			XMVectorGreater(distance(this->rowPlanes[LIGHT_CLUSTER_COUNT_Y]), radius)));
+	outside = XMVectorOrInt(outside, XMVectorOrInt(
+		XMVectorLess(XMVectorAdd(z, radius), XMVectorReplicate(this->nearZ)),
+		XMVectorGreater(XMVectorSubtract(z, radius), XMVectorReplicate(this->farZ))));
+
+	XMFLOAT4 minX, cutX, minY, cutY, depth, isOutside;
+	XMStoreFloat4(&minX, pastColumns);
+	XMStoreFloat4(&cutX, shortOfColumns);
+	XMStoreFloat4(&minY, pastRows);
+	XMStoreFloat4(&cutY, shortOfRows);
+	XMStoreFloat4(&depth, z);
+	XMStoreFloat4(&isOutside, XMVectorSelect(zero, one, outside));
+
+	const float* laneMinX = &minX.x;
+	const float* laneCutX = &cutX.x;
+	const float* laneMinY = &minY.x;
+	const float* laneCutY = &cutY.x;
+	const float* laneDepth = &depth.x;
+	const float* laneOutside = &isOutside.x;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		LightBounds& result = results[i];
+		result = {};
+		if (lights[i].type == LIGHT_TYPE_DIRECTIONAL || laneOutside[i] != 0.0f)
+			continue;
+
+		unsigned int firstX = (unsigned int)laneMinX[i];
+		unsigned int firstY = (unsigned int)laneMinY[i];
+		result.minX = (uint16_t)firstX;
+		result.maxX = (uint16_t)std::max(firstX, LIGHT_CLUSTER_COUNT_X - 1 - (unsigned int)laneCutX[i]);
+		result.minY = (uint16_t)firstY;
+		result.maxY = (uint16_t)std::max(firstY, LIGHT_CLUSTER_COUNT_Y - 1 - (unsigned int)laneCutY[i]);
+		result.minZ = (uint16_t)DepthToSlice(laneDepth[i] - lanes[3][i]);
+		result.maxZ = (uint16_t)DepthToSlice(laneDepth[i] + lanes[3][i]);
+		result.binned = true;
+	}
+}
+
+void LightClusters::Build(
+	const std::vector<Light>& lights,
+	const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection,
+	float nearZ,
+	float farZ,
+	bool binLocalLights)
+{
+	this->nearZ = nearZ;
+	this->farZ = farZ;
+	float logDepthRange = logf(farZ / nearZ);
+	this->sliceScale = LIGHT_CLUSTER_COUNT_Z / logDepthRange;
+	this->sliceBias = -LIGHT_CLUSTER_COUNT_Z * logf(nearZ) / logDepthRange;
+	BuildPlanes(projection);
+
+	unsigned int lightCount = (unsigned int)lights.size();
+	this->bounds.resize(binLocalLights ? lightCount : 0);
+	unsigned int rangeCount = JobSystem::WorkerCount() + 1;
+
+	// Pass 1: bound every light, four at a time.  Ranges are
+	// handed out in groups of four so only the last is partial.
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	unsigned int groupCount = (lightCount + 3) / 4;
+	JobSystem::ParallelFor(binLocalLights ? groupCount : 0, rangeCount,
+		[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+		{
+			for (unsigned int group = begin; group < end; group++)
+			{
+				unsigned int first = group * 4;
+				BoundLights(&lights[first], std::min(4u, lightCount - first), viewMatrix, &this->bounds[first]);
+			}
+		});
+
+	// Pass 2: each range owns whole depth slices, so no two
+	// threads ever write to the same cluster
+	JobSystem::ParallelFor(binLocalLights ? LIGHT_CLUSTER_COUNT_Z : 0, rangeCount,
+		[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+		{
+			for (unsigned int c = begin * LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y; c < end * LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y; c++)
+				this->clusterLights[c].clear();
+
+			for (unsigned int i = 0; i < lightCount; i++)
+			{
+				const LightBounds& b = this->bounds[i];
+				if (!b.binned || b.maxZ < begin || b.minZ >= end)
+					continue;
+
+				unsigned int minZ = b.minZ > begin ? b.minZ : begin;
+				unsigned int maxZ = b.maxZ < end - 1 ? b.maxZ : end - 1;
+				for (unsigned int z = minZ; z <= maxZ; z++)
+					for (unsigned int y = b.minY; y <= b.maxY; y++)
+						for (unsigned int x = b.minX; x <= b.maxX; x++)
+							this->clusterLights[(z * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X + x].push_back(i);
+			}
+		});
+
+	// Pass 3: flatten into one index list, directional lights first
+	this->lightIndices.clear();
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		if (lights[i].type == LIGHT_TYPE_DIRECTIONAL)
+			this->lightIndices.push_back(i);
+	}
+	this->directionalLightCount = (unsigned int)this->lightIndices.size();
+
+	if (!binLocalLights)
+	{
+		for (LightClusterRange& range : this->ranges)
+			range = { this->directionalLightCount, 0, 0 };
+		return;
+	}
+
+	for (unsigned int c = 0; c < LIGHT_CLUSTER_COUNT; c++)
+	{
+		const std::vector<uint32_t>& list = this->clusterLights[c];
+		uint32_t pointCount = 0;
+		for (uint32_t index : list)
+			pointCount += lights[index].type == LIGHT_TYPE_POINT ? 1 : 0;
+
+		this->ranges[c].offset = (uint32_t)this->lightIndices.size();
+		this->ranges[c].pointCount = pointCount;
+		this->ranges[c].spotCount = (uint32_t)list.size() - pointCount;
+		this->lightIndices.insert(this->lightIndices.end(), list.begin(), list.end());
+	}
+}
+
+const LightClusterRange* LightClusters::GetRanges() const { return this->ranges.data(); }
+const uint32_t* LightClusters::GetLightIndices() const { return this->lightIndices.data(); }
+unsigned int LightClusters::GetLightIndexCount() const { return (unsigned int)this->lightIndices.size(); }
+unsigned int LightClusters::GetDirectionalLightCount() const { return this->directionalLightCount; }
+float LightClusters::GetSliceScale() const { return this->sliceScale; }
+float LightClusters::GetSliceBias() const { return this->sliceBias; }
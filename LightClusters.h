@@ -0,0 +1,92 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Lights.h"
+
+// Froxel grid dimensions - must match ShaderInclude.hlsli
+#define LIGHT_CLUSTER_COUNT_X 16
+#define LIGHT_CLUSTER_COUNT_Y 9
+#define LIGHT_CLUSTER_COUNT_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y * LIGHT_CLUSTER_COUNT_Z)
+
+// Where one cluster's lights live in the light index list.
+// With lights sorted by type, the point lights come first.
+struct LightClusterRange
+{
+	uint32_t offset;
+	uint32_t pointCount;
+	uint32_t spotCount;
+};
+
+// --------------------------------------------------------
+// Clustered light assignment.
+//
+// The view frustum is split into a grid of froxels: screen
+// tiles in X and Y, exponentially spaced depth slices in Z.
+// Point light spheres and spot light cones are binned into
+// every froxel they touch, so a pixel only evaluates the
+// lights in its own cluster.  Directional lights reach
+// everything and are listed once, at the very start of the
+// index list.
+//
+// Building is split across the job system: lights are
+// bounded in parallel, four per step as vectors, then each
+// worker fills the clusters of its own depth slices.
+// --------------------------------------------------------
+class LightClusters
+{
+private:
+	// Inclusive cluster coordinates covered by one light
+	struct LightBounds
+	{
+		uint16_t minX, maxX;
+		uint16_t minY, maxY;
+		uint16_t minZ, maxZ;
+		bool binned;
+	};
+
+	// Tile boundary planes in view space, facing +X and -Y (down the screen)
+	DirectX::XMFLOAT4 columnPlanes[LIGHT_CLUSTER_COUNT_X + 1];
+	DirectX::XMFLOAT4 rowPlanes[LIGHT_CLUSTER_COUNT_Y + 1];
+
+	float nearZ;
+	float farZ;
+	float sliceScale;
+	float sliceBias;
+
+	std::vector<LightBounds> bounds;
+	std::vector<std::vector<uint32_t>> clusterLights;
+	std::vector<LightClusterRange> ranges;
+	std::vector<uint32_t> lightIndices;
+	unsigned int directionalLightCount;
+
+	void BuildPlanes(const DirectX::XMFLOAT4X4& projection);
+	void BoundLights(const Light* lights, unsigned int count, DirectX::FXMMATRIX view, LightBounds* results) const;
+	unsigned int DepthToSlice(float viewDepth) const;
+
+public:
+	LightClusters();
+
+	// Rebuilds every cluster's light list for this view.  Without
+	// binLocalLights only the directional lights are listed and
+	// every cluster is left empty.
+	void Build(
+		const std::vector<Light>& lights,
+		const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& projection,
+		float nearZ,
+		float farZ,
+		bool binLocalLights = true);
+
+	// Getters
+	const LightClusterRange* GetRanges() const;
+	const uint32_t* GetLightIndices() const;
+	unsigned int GetLightIndexCount() const;
+	unsigned int GetDirectionalLightCount() const;
+
+	// Slice = log(viewDepth) * scale + bias
+	float GetSliceScale() const;
+	float GetSliceBias() const;
+};
@@ -0,0 +1,140 @@
+#include "LightPacking.h"
+
+using namespace DirectX;
+
+namespace
+{
+	XMVECTOR Load4(const std::vector<float>& stream, size_t i)
+	{
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&stream[i]));
+	}
+
+	void Store4(std::vector<float>& stream, size_t i, FXMVECTOR value)
+	{
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&stream[i]), value);
+	}
+}
+
+LightPacking::LightPacking()
+{
+	this->directionalCount = 0;
+	this->pointCount = 0;
+	this->spotCount = 0;
+}
+
+void LightPacking::Pack(const std::vector<Light>& lights)
+{
+	// Sort by type - a stable three-way split, so lights keep
+	// their relative order within each type
+	this->sortedLights.clear();
+	for (int type : { LIGHT_TYPE_DIRECTIONAL, LIGHT_TYPE_POINT, LIGHT_TYPE_SPOT })
+	{
+		for (const Light& light : lights)
+		{
+			if (light.type == type)
+				this->sortedLights.push_back(light);
+		}
+	}
+
+	this->directionalCount = 0;
+	this->pointCount = 0;
+	this->spotCount = 0;
+	for (const Light& light : this->sortedLights)
+	{
+		if (light.type == LIGHT_TYPE_DIRECTIONAL) this->directionalCount++;
+		else if (light.type == LIGHT_TYPE_POINT) this->pointCount++;
+		else if (light.type == LIGHT_TYPE_SPOT) this->spotCount++;
+	}
+
+	// Transpose into component streams
+	size_t count = this->sortedLights.size();
+	size_t paddedCount = (count + 3) & ~(size_t)3;
+	std::vector<float>* allStreams[] = {
+		&streams.dirX, &streams.dirY, &streams.dirZ,
+		&streams.colorR, &streams.colorG, &streams.colorB,
+		&streams.intensity, &streams.range,
+		&streams.cosInner, &streams.cosOuter };
+	for (std::vector<float>* stream : allStreams)
+		stream->assign(paddedCount, 0.0f);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Light& light = this->sortedLights[i];
+		streams.dirX[i] = light.direction.x;
+		streams.dirY[i] = light.direction.y;
+		streams.dirZ[i] = light.direction.z;
+		streams.colorR[i] = light.color.x;
+		streams.colorG[i] = light.color.y;
+		streams.colorB[i] = light.color.z;
+		streams.intensity[i] = light.intensity;
+		streams.range[i] = light.range;
+		streams.cosInner[i] = light.spotInnerAngle;
+		streams.cosOuter[i] = light.spotOuterAngle;
+	}
+
+	// Four lights per step.  Zero-length directions (point lights)
+	// and zero ranges (directional lights) are left as zero.
+	XMVECTOR epsilon = XMVectorReplicate(1e-8f);
+	XMVECTOR minFalloff = XMVectorReplicate(1e-4f);
+	for (size_t i = 0; i < paddedCount; i += 4)
+	{
+		XMVECTOR x = Load4(streams.dirX, i);
+		XMVECTOR y = Load4(streams.dirY, i);
+		XMVECTOR z = Load4(streams.dirZ, i);
+		XMVECTOR lengthSq = XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(y, y, XMVectorMultiply(z, z)));
+		XMVECTOR hasLength = XMVectorGreater(lengthSq, epsilon);
+		XMVECTOR invLength = XMVectorSelect(XMVectorZero(), XMVectorReciprocalSqrt(lengthSq), hasLength);
+		Store4(streams.dirX, i, XMVectorMultiply(x, invLength));
+		Store4(streams.dirY, i, XMVectorMultiply(y, invLength));
+		Store4(streams.dirZ, i, XMVectorMultiply(z, invLength));
+
+		XMVECTOR intensity = Load4(streams.intensity, i);
+		Store4(streams.colorR, i, XMVectorMultiply(Load4(streams.colorR, i), intensity));
+		Store4(streams.colorG, i, XMVectorMultiply(Load4(streams.colorG, i), intensity));
+		Store4(streams.colorB, i, XMVectorMultiply(Load4(streams.colorB, i), intensity));
+
+		// Range becomes 1 / range^2
+		XMVECTOR range = Load4(streams.range, i);
+		XMVECTOR rangeSq = XMVectorMultiply(range, range);
+		XMVECTOR hasRange = XMVectorGreater(rangeSq, epsilon);
+		Store4(streams.range, i, XMVectorSelect(XMVectorZero(), XMVectorReciprocal(rangeSq), hasRange));
+
+		// Angles become the spot scale (in cosInner) and offset (in cosOuter)
+		XMVECTOR cosInner = XMVectorCos(Load4(streams.cosInner, i));
+		XMVECTOR cosOuter = XMVectorCos(Load4(streams.cosOuter, i));
+		XMVECTOR spotScale = XMVectorReciprocal(XMVectorMax(XMVectorSubtract(cosInner, cosOuter), minFalloff));
+		Store4(streams.cosInner, i, spotScale);
+		Store4(streams.cosOuter, i, XMVectorNegate(XMVectorMultiply(cosOuter, spotScale)));
+	}
+
+	// Back to the interleaved layout the shaders read
+	this->packedLights.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Light& light = this->sortedLights[i];
+		PackedLight& packed = this->packedLights[i];
+		packed.position = light.position;
+		packed.invRangeSq = streams.range[i];
+		packed.direction = XMFLOAT3(streams.dirX[i], streams.dirY[i], streams.dirZ[i]);
+		packed.color = XMFLOAT3(streams.colorR[i], streams.colorG[i], streams.colorB[i]);
+
+		// Anything that isn't a spot light gets a spot term of exactly 1
+		if (light.type == LIGHT_TYPE_SPOT)
+		{
+			packed.spotScale = streams.cosInner[i];
+			packed.spotOffset = streams.cosOuter[i];
+		}
+		else
+		{
+			packed.spotScale = 0.0f;
+			packed.spotOffset = 1.0f;
+		}
+	}
+}
+
+const std::vector<Light>& LightPacking::GetSortedLights() const { return this->sortedLights; }
+const PackedLight* LightPacking::GetPackedLights() const { return this->packedLights.data(); }
+unsigned int LightPacking::GetLightCount() const { return (unsigned int)this->packedLights.size(); }
+unsigned int LightPacking::GetDirectionalCount() const { return this->directionalCount; }
+unsigned int LightPacking::GetPointCount() const { return this->pointCount; }
+unsigned int LightPacking::GetSpotCount() const { return this->spotCount; }
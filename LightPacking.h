@@ -0,0 +1,62 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+
+// GPU light format - must match PackedLight in ShaderInclude.hlsli
+struct PackedLight
+{
+	DirectX::XMFLOAT3 position;
+	float invRangeSq;			// 1 / (range * range)
+	DirectX::XMFLOAT3 direction;	// Normalized
+	float spotScale;			// Spot term = saturate(cosAngle * scale + offset)
+	DirectX::XMFLOAT3 color;		// Premultiplied by intensity
+	float spotOffset;
+};
+
+// --------------------------------------------------------
+// Converts the scene's lights into the packed GPU format
+// once per frame, so pixels don't have to redo the same
+// normalizes, cosines and divides for every light.
+//
+// Lights come out sorted by type (directional, point, then
+// spot), letting shaders walk each type as its own range
+// instead of branching per light.  The math runs four lights
+// at a time over structure-of-arrays copies of the inputs.
+// --------------------------------------------------------
+class LightPacking
+{
+private:
+	// Inputs, split into one array per component and
+	// padded to a multiple of four
+	struct Streams
+	{
+		std::vector<float> dirX, dirY, dirZ;
+		std::vector<float> colorR, colorG, colorB;
+		std::vector<float> intensity;
+		std::vector<float> range;
+		std::vector<float> cosInner, cosOuter;
+	} streams;
+
+	std::vector<Light> sortedLights;
+	std::vector<PackedLight> packedLights;
+	unsigned int directionalCount;
+	unsigned int pointCount;
+	unsigned int spotCount;
+
+public:
+	LightPacking();
+
+	void Pack(const std::vector<Light>& lights);
+
+	// Same order as the packed lights, for CPU-side culling
+	const std::vector<Light>& GetSortedLights() const;
+
+	// Getters
+	const PackedLight* GetPackedLights() const;
+	unsigned int GetLightCount() const;
+	unsigned int GetDirectionalCount() const;
+	unsigned int GetPointCount() const;
+	unsigned int GetSpotCount() const;
+};
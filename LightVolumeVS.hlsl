@@ -0,0 +1,34 @@
+#include "ShaderInclude.hlsli"
+
+// Only the start of the per-frame buffer is needed here
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+}
+
+// One volume per local light, indexed by draw ID
+// - Must match LightVolume in LightVolumes.h
+struct LightVolume
+{
+    matrix world;
+    uint lightIndex;
+    uint3 padding;
+};
+
+StructuredBuffer<LightVolume> Volumes : register(t1);
+
+// --------------------------------------------------------
+// Places the sphere mesh around one light, reading only
+// positions (the same stream as the depth pre-pass)
+// --------------------------------------------------------
+VertexToPixel_LightVolume main(float3 localPosition : POSITION, uint drawID : DRAWID)
+{
+    LightVolume volume = Volumes[drawID];
+
+    VertexToPixel_LightVolume output;
+    output.position = mul(viewProjection, mul(volume.world, float4(localPosition, 1.0f)));
+    output.lightIndex = volume.lightIndex;
+    return output;
+}
@@ -0,0 +1,99 @@
+#include "LightVolumes.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+LightVolumes::LightVolumes() :
+	outsideCount(0)
+{
+}
+
+void LightVolumes::Build(
+	const std::vector<Light>& sortedLights,
+	float meshRadius,
+	const XMFLOAT3& cameraPosition,
+	float nearClip)
+{
+	this->volumes.clear();
+	this->outsideCount = 0;
+	if (meshRadius <= 0.0f)
+		return;
+
+	std::vector<LightVolume> insideVolumes;
+	for (unsigned int i = 0; i < (unsigned int)sortedLights.size(); i++)
+	{
+		const Light& light = sortedLights[i];
+		if (light.type == LIGHT_TYPE_DIRECTIONAL || light.range <= 0.0f)
+			continue;
+
+		XMFLOAT3 center;
+		float radius;
+		BoundLight(light, center, radius);
+
+		// Scale the unit-ish mesh up to the light, then move it there
+		float scale = radius / meshRadius * LIGHT_VOLUME_MARGIN;
+		XMMATRIX world = XMMatrixScaling(scale, scale, scale) * XMMatrixTranslation(center.x, center.y, center.z);
+
+		LightVolume volume = {};
+		XMStoreFloat4x4(&volume.world, world);
+		volume.lightIndex = i;
+		if (ContainsCamera(center, radius * LIGHT_VOLUME_MARGIN, cameraPosition, nearClip))
+			insideVolumes.push_back(volume);
+		else
+			this->volumes.push_back(volume);
+	}
+
+	this->outsideCount = (unsigned int)this->volumes.size();
+	this->volumes.insert(this->volumes.end(), insideVolumes.begin(), insideVolumes.end());
+}
+
+// --------------------------------------------------------
+// Same sphere the light clusters bin with: for wide cones it
+// sits on the cap, for narrow ones it passes through the apex
+// and the rim of the cap
+// --------------------------------------------------------
+void LightVolumes::BoundLight(const Light& light, XMFLOAT3& center, float& radius)
+{
+	center = light.position;
+	radius = light.range;
+	if (light.type != LIGHT_TYPE_SPOT)
+		return;
+
+	XMVECTOR position = XMLoadFloat3(&light.position);
+	XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&light.direction));
+	float cosAngle = cosf(light.spotOuterAngle);
+	float distance;
+	if (light.spotOuterAngle > XM_PIDIV4)
+	{
+		distance = light.range * cosAngle;
+		radius = light.range * sinf(light.spotOuterAngle);
+	}
+	else
+	{
+		radius = light.range / (2.0f * cosAngle);
+		distance = radius;
+	}
+	XMStoreFloat3(&center, XMVectorMultiplyAdd(direction, XMVectorReplicate(distance), position));
+}
+
+// --------------------------------------------------------
+// Conservative: the near plane's corners lie further than
+// nearClip from the camera (twice as far at a 120 degree
+// diagonal field of view), so the check reaches that far.
+// Calling an outside volume inside costs fill rate, never
+// correctness.
+// --------------------------------------------------------
+bool LightVolumes::ContainsCamera(const XMFLOAT3& center, float radius, const XMFLOAT3& cameraPosition, float nearClip)
+{
+	float reach = radius + nearClip * 2.0f;
+	float x = center.x - cameraPosition.x;
+	float y = center.y - cameraPosition.y;
+	float z = center.z - cameraPosition.z;
+	return x * x + y * y + z * z < reach * reach;
+}
+
+const LightVolume* LightVolumes::GetVolumes() const { return this->volumes.data(); }
+unsigned int LightVolumes::GetVolumeCount() const { return (unsigned int)this->volumes.size(); }
+unsigned int LightVolumes::GetOutsideCount() const { return this->outsideCount; }
+unsigned int LightVolumes::GetInsideCount() const { return (unsigned int)this->volumes.size() - this->outsideCount; }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Lights.h"
+
+// How much bigger than the light a volume is drawn, so the
+// flat faces of a low-poly sphere still cover the whole light
+#define LIGHT_VOLUME_MARGIN 1.1f
+
+// One light volume - must match LightVolume in LightVolumeVS.hlsl
+struct LightVolume
+{
+	DirectX::XMFLOAT4X4 world;
+	uint32_t lightIndex;	// Into the packed light buffer
+	uint32_t padding[3];
+};
+
+// --------------------------------------------------------
+// Bounding volumes for the deferred path's local lights.
+//
+// Each point or spot light gets a sphere mesh transform that
+// encloses everything it can reach, so the lighting pass only
+// shades the pixels the light could touch.  Directional
+// lights reach everything and get no volume.  Only the math
+// lives here; the D3D11DeferredRenderer uploads the result.
+//
+// Volumes the camera is outside of come first and are
+// stencil marked before lighting.  Those the camera is
+// inside of (or close enough that the near plane cuts them)
+// come last and light their back faces in one pass, since
+// every visible pixel could be inside the light anyway.
+// --------------------------------------------------------
+class LightVolumes
+{
+private:
+	std::vector<LightVolume> volumes;
+	unsigned int outsideCount;
+
+public:
+	LightVolumes();
+
+	// Takes lights in packed order (see LightPacking), and each
+	// volume remembers its light's index in that order.
+	// meshRadius is the bounding radius of the sphere mesh being
+	// drawn; the camera decides which volumes it's inside of.
+	void Build(
+		const std::vector<Light>& sortedLights,
+		float meshRadius,
+		const DirectX::XMFLOAT3& cameraPosition,
+		float nearClip);
+
+	// Smallest sphere around a point light or spot light cone
+	static void BoundLight(const Light& light, DirectX::XMFLOAT3& center, float& radius);
+
+	// Whether a volume of this drawn radius could hold the camera
+	// or be clipped by its near plane
+	static bool ContainsCamera(const DirectX::XMFLOAT3& center, float radius, const DirectX::XMFLOAT3& cameraPosition, float nearClip);
+
+	// Getters
+	const LightVolume* GetVolumes() const;
+	unsigned int GetVolumeCount() const;
+	unsigned int GetOutsideCount() const;
+	unsigned int GetInsideCount() const;
+};
@@ -6,6 +6,8 @@
 #include "Graphics.h"
 #include "Game.h"
 #include "Input.h"
+#include "JobSystem.h"
+#include "Profiler.h"
 
 // Annonymous namespace to hold variables
 // only accessible in this file
@@ -78,6 +80,10 @@ int WINAPI WinMain(
 	// Initalize the input system, which requires the window handle
 	Input::Initialize(Window::Handle());
 
+	// Start the worker threads used for parallel recording
+	Profiler::SetThreadName("Main");
+	JobSystem::Initialize();
+
 	// Now the main application object itself can be initialzied
 	game = new Game();
 
@@ -130,6 +136,9 @@ int WINAPI WinMain(
 			// Notify Input system about end of frame
 			Input::EndOfFrame();
 
+			// Collect this frame's profile scopes from every thread
+			Profiler::EndFrame();
+
 #if defined(DEBUG) || defined(_DEBUG)
 			// Print any graphics debug messages that occurred this frame
 			Graphics::PrintDebugMessages();
@@ -139,6 +148,7 @@ int WINAPI WinMain(
 
 	// Clean up
 	delete game;
+	JobSystem::ShutDown();
 	Input::ShutDown();
 	Graphics::ShutDown();
 	return (HRESULT)msg.wParam;
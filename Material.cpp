@@ -1,10 +1,9 @@
 #include "Material.h"
-#include "PathHelpers.h"
 #include "Graphics.h"
+#include "ShaderLibrary.h"
 
-// Needed for a helper function to load pre-compiled shader files
-#pragma comment(lib, "d3dcompiler.lib")
-#include <d3dcompiler.h>
+#include <algorithm>
+#include <cstring>
 
 
 
@@ -17,6 +16,17 @@ Material::Material(const char* name, DirectX::XMFLOAT4 colorTint, float roughnes
 	this->uvOffset = DirectX::XMFLOAT2(0.0f, 0.0f);
 	this->uvScale = DirectX::XMFLOAT2(1.0f, 1.0f);
 	this->roughness = roughness;
+
+	// Create the buffer that holds this material's constants
+	// - DEFAULT usage, since it's only updated when edited
+	D3D11_BUFFER_DESC cbDesc = {};
+	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cbDesc.ByteWidth = (sizeof(PerMaterialData) + 15) / 16 * 16; // Must be a multiple of 16
+	cbDesc.Usage = D3D11_USAGE_DEFAULT;
+	Graphics::Device->CreateBuffer(&cbDesc, 0, this->constantBuffer.GetAddressOf());
+	this->constantsDirty = true;
+
+	RebuildBindGroup();
 }
 
 DirectX::XMFLOAT4& Material::GetColorTint()
@@ -27,6 +37,7 @@ DirectX::XMFLOAT4& Material::GetColorTint()
 void Material::SetColorTint(const DirectX::XMFLOAT4& tint)
 {
 	this->colorTint = tint;
+	this->constantsDirty = true;
 }
 
 float Material::GetRoughnessValue()
@@ -62,6 +73,7 @@ DirectX::XMFLOAT2& Material::GetUVOffset()
 void Material::SetUVOffset(const DirectX::XMFLOAT2& offset)
 {
 	this->uvOffset = offset;
+	this->constantsDirty = true;
 }
 
 DirectX::XMFLOAT2& Material::GetUVScale()
@@ -72,6 +84,7 @@ DirectX::XMFLOAT2& Material::GetUVScale()
 void Material::SetUVScale(const DirectX::XMFLOAT2& scale)
 {
 	this->uvScale = scale;
+	this->constantsDirty = true;
 }
 
 const char* Material::GetName()
@@ -96,72 +109,213 @@ void Material::SetInputLayout(Microsoft::WRL::ComPtr<ID3D11InputLayout> layout)
 	this->inputLayout = layout;
 }
 
+// Both come from the ShaderLibrary, so every material
+// using the basic shaders shares the same shader objects
 void Material::LoadVertexShader()
 {
-	// BLOBs (or Binary Large OBjects) for reading raw data from external files
-	// - This is a simplified way of handling big chunks of external data
-	// - Literally just a big array of bytes read from a file
-	ID3DBlob* vertexShaderBlob;
+	this->vertexShader = ShaderLibrary::LoadVertexShader(L"VertexShader.cso");
+}
 
-	// Loading shaders
-	//  - Visual Studio will compile our shaders at build time
-	//  - They are saved as .cso (Compiled Shader Object) files
-	//  - We need to load them when the application starts
+void Material::LoadPixelShader()
+{
+	this->pixelShader = ShaderLibrary::LoadPixelShader(L"PixelShader.cso");
+}
 
-	// Read our compiled shader code files into blobs
-		// - Essentially just "open the file and plop its contents here"
-		// - Uses the custom FixPath() helper from Helpers.h to ensure relative paths
-		// - Note the "L" before the string - this tells the compiler the string uses wide characters
+void Material::AddTextureSRV(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv, unsigned int slot)
+{
+	// Replaces whatever was in the slot, e.g. a loader's fallback,
+	// and any array copy of what was there before
+	this->textureSRVs[slot] = srv;
+	if (this->textureLocations.erase(slot))
+		this->constantsDirty = true;
+	RebuildBindGroup();
+}
 
-	// Create the actual Direct3D shaders on the GPU
-	D3DReadFileToBlob(FixPath(L"VertexShader.cso").c_str(), &vertexShaderBlob);
-	Graphics::Device->CreateVertexShader(
-		vertexShaderBlob->GetBufferPointer(),	// Get a pointer to the blob's contents
-		vertexShaderBlob->GetBufferSize(),		// How big is that data?
-		0,										// No classes in this shader
-		this->vertexShader.GetAddressOf());			// The address of the ID3D11VertexShader pointer
+void Material::AddSamplerState(Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler, unsigned int slot)
+{
+	this->samplers.insert({ slot,sampler });
+	RebuildBindGroup();
+}
 
+void Material::SetTextureLocation(unsigned int slot, const TextureArrayLocation& location)
+{
+	this->textureLocations[slot] = location;
+	this->constantsDirty = true;
+	RebuildBindGroup();
+}
 
-	
+const TextureArrayLocation* Material::GetTextureLocation(unsigned int slot)
+{
+	auto found = this->textureLocations.find(slot);
+	return found == this->textureLocations.end() ? 0 : &found->second;
 }
 
-void Material::LoadPixelShader()
+// Only the surface texture and normal map can live in arrays
+bool Material::UsesTextureArrays()
 {
-	ID3DBlob* pixelShaderBlob;
-	D3DReadFileToBlob(FixPath(L"PixelShader.cso").c_str(), &pixelShaderBlob);
-	// Create the actual Direct3D shaders on the GPU
-	Graphics::Device->CreatePixelShader(
-		pixelShaderBlob->GetBufferPointer(),	// Pointer to blob's contents
-		pixelShaderBlob->GetBufferSize(),		// How big is that data?
-		0,										// No classes in this shader
-		this->pixelShader.GetAddressOf());			// Address of the ID3D11PixelShader pointer
+	if (this->textureLocations.empty())
+		return false;
+
+	for (auto& [slot, srv] : this->textureSRVs) {
+		if ((slot != 0 && slot != 1) || !this->textureLocations.count(slot))
+			return false;
+	}
+	return true;
 }
 
-void Material::AddTextureSRV(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv, unsigned int slot)
+PerMaterialData Material::GetConstants()
 {
-	this->textureSRVs.insert({ slot,srv });
+	PerMaterialData data{};
+	data.colorTint = this->colorTint;
+	data.uvOffset = this->uvOffset;
+	data.uvScale = this->uvScale;
+	data.roughness = this->roughness;
+	data.surfaceRect = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+	data.normalRect = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+	if (const TextureArrayLocation* surface = GetTextureLocation(0)) {
+		data.surfaceSlice = surface->slice;
+		data.surfaceRect = surface->rect;
+	}
+	if (const TextureArrayLocation* normal = GetTextureLocation(1)) {
+		data.normalSlice = normal->slice;
+		data.normalRect = normal->rect;
+	}
+	return data;
 }
 
-void Material::AddSamplerState(Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler, unsigned int slot)
+// --------------------------------------------------------
+// Re-uploads this material's constants if anything changed
+// since the last upload.  Must run on the render thread.
+// --------------------------------------------------------
+void Material::UpdateConstantBuffer()
 {
-	this->samplers.insert({ slot,sampler });
+	if (!this->constantsDirty)
+		return;
+
+	PerMaterialData data = GetConstants();
+	Graphics::Context->UpdateSubresource(this->constantBuffer.Get(), 0, 0, &data, 0, 0);
 
+	this->constantsDirty = false;
 }
 
-void Material::BindTexturesAndSamplers()
+Microsoft::WRL::ComPtr<ID3D11Buffer> Material::GetConstantBuffer()
 {
+	return this->constantBuffer;
+}
+
+void Material::SetDrawTablePixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader)
+{
+	this->drawTablePixelShader = pixelShader;
+}
 
-	for (auto& [id, pair] : this->textureSRVs) {
-		// Binding SRVs and Samplers in C++ (the first param is the index from the shader)
-		Graphics::Context->PSSetShaderResources(id, 1, pair.GetAddressOf()); // Bind srv to texture slot 0
+Microsoft::WRL::ComPtr<ID3D11PixelShader> Material::GetDrawTablePixelShader()
+{
+	return this->drawTablePixelShader;
+}
+
+void Material::SetGBufferPixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader)
+{
+	this->gBufferPixelShader = pixelShader;
+}
+
+Microsoft::WRL::ComPtr<ID3D11PixelShader> Material::GetGBufferPixelShader()
+{
+	return this->gBufferPixelShader;
+}
+
+void Material::SetShaderSource(const std::wstring& fileName)
+{
+	this->shaderSource = fileName;
+}
+
+const std::wstring& Material::GetShaderSource()
+{
+	return this->shaderSource;
+}
+
+// --------------------------------------------------------
+// Shader features this material actually needs, based on
+// which texture slots it fills: t0 is the surface texture
+// and t1 is the normal map
+// --------------------------------------------------------
+unsigned int Material::GetShaderFeatures()
+{
+	unsigned int features = 0;
+	if (this->textureSRVs.count(0))
+		features |= SHADER_FEATURE_TEXTURE;
+	if (this->textureSRVs.count(1))
+		features |= SHADER_FEATURE_NORMAL_MAP;
+	if (UsesTextureArrays())
+		features |= SHADER_FEATURE_TEXTURE_ARRAYS;
+	return features;
+}
+
+// --------------------------------------------------------
+// Flattens the texture and sampler maps into one slot range
+// each.  Runs on the render thread whenever they change,
+// never while draws are being recorded.
+// - Textures in the shared arrays are bound once for every
+//   material sharing them, so aren't part of the group
+// - Slots past MATERIAL_MAX_SLOTS are never bound
+// --------------------------------------------------------
+void Material::RebuildBindGroup()
+{
+	MaterialBindGroup group = {};
+
+	unsigned int first = MATERIAL_MAX_SLOTS;
+	unsigned int end = 0;
+	if (!UsesTextureArrays()) {
+		for (auto& [slot, srv] : this->textureSRVs) {
+			if (slot >= MATERIAL_MAX_SLOTS)
+				continue;
+			group.textures[slot] = srv.Get();
+			first = std::min(first, slot);
+			end = std::max(end, slot + 1);
+		}
+	}
+	if (first < end) {
+		group.textureStart = first;
+		group.textureCount = end - first;
+		memmove(group.textures, group.textures + first, group.textureCount * sizeof(group.textures[0]));
 	}
 
-	for (auto& [id, pair] : this->samplers) {
-		// Binding SRVs and Samplers in C++ (the first param is the index from the shader)
-		Graphics::Context->PSSetSamplers(id, 1, pair.GetAddressOf()); // Bind srv to texture slot 0
+	first = MATERIAL_MAX_SLOTS;
+	end = 0;
+	for (auto& [slot, sampler] : this->samplers) {
+		if (slot >= MATERIAL_MAX_SLOTS)
+			continue;
+		group.samplers[slot] = sampler.Get();
+		first = std::min(first, slot);
+		end = std::max(end, slot + 1);
+	}
+	if (first < end) {
+		group.samplerStart = first;
+		group.samplerCount = end - first;
+		memmove(group.samplers, group.samplers + first, group.samplerCount * sizeof(group.samplers[0]));
 	}
-	
-	
 
-	
+	this->bindGroup = group;
+}
+
+void Material::BindTexturesAndSamplers()
+{
+	if (this->bindGroup.textureCount > 0)
+		Graphics::Context->PSSetShaderResources(this->bindGroup.textureStart, this->bindGroup.textureCount, (ID3D11ShaderResourceView* const*)this->bindGroup.textures);
+	if (this->bindGroup.samplerCount > 0)
+		Graphics::Context->PSSetSamplers(this->bindGroup.samplerStart, this->bindGroup.samplerCount, (ID3D11SamplerState* const*)this->bindGroup.samplers);
 }
+
+DrawMaterial Material::GetDrawMaterial()
+{
+	DrawMaterial material = {};
+	material.vertexShader = this->vertexShader.Get();
+	material.pixelShader = this->pixelShader.Get();
+	material.drawTablePixelShader = this->drawTablePixelShader.Get();
+	material.gBufferPixelShader = this->gBufferPixelShader.Get();
+	material.constantBuffer = this->constantBuffer.Get();
+	material.bindGroup = &this->bindGroup;
+	material.usesTextureArrays = UsesTextureArrays();
+	return material;
+}
+
+const MaterialBindGroup& Material::GetBindGroup() { return this->bindGroup; }
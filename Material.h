@@ -3,6 +3,10 @@
 #include <d3d11.h>
 #include <wrl/client.h>
 #include <unordered_map>
+#include <string>
+#include "BufferStruct.h"
+#include "EntityDraws.h"
+#include "TextureArrays.h"
 
 class Material
 {
@@ -21,6 +25,15 @@ private:
 	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
 
+	// Where the surface (t0) and normal (t1) textures were copied
+	// to in the shared texture arrays, if they were
+	std::unordered_map<unsigned int, TextureArrayLocation> textureLocations;
+
+	// Rebuilt from the maps above whenever they change, so drawing
+	// never touches the maps.  The maps keep the objects alive.
+	MaterialBindGroup bindGroup;
+	void RebuildBindGroup();
+
 	DirectX::XMFLOAT2 uvOffset;
 	DirectX::XMFLOAT2 uvScale;
 
@@ -29,6 +42,24 @@ private:
 	/// </summary>
 	float roughness;
 
+	// Persistent per-material constant buffer, only
+	// re-uploaded after one of the values above changes
+	Microsoft::WRL::ComPtr<ID3D11Buffer> constantBuffer;
+	bool constantsDirty;
+
+	// Variant of the pixel shader that reads its material
+	// constants from a DrawTable, if this material has one
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> drawTablePixelShader;
+
+	// Writes this material to the G-buffer on the deferred path,
+	// if it can be lit there
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> gBufferPixelShader;
+
+	// Source file this material's pixel shader variants are
+	// compiled from by the ShaderLibrary, or empty if it always
+	// uses the shader it was created with
+	std::wstring shaderSource;
+
 public:
 	Material(const char* name, DirectX::XMFLOAT4 colorTint, float roughness, Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader,
 		Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader);
@@ -75,6 +106,33 @@ public:
 	void AddTextureSRV(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv, unsigned int slot);
 	void AddSamplerState(Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler, unsigned int slot);
 
+	// Texture arrays: once every texture a material has is in one,
+	// it samples them from there and binds none of its own
+	void SetTextureLocation(unsigned int slot, const TextureArrayLocation& location);
+	const TextureArrayLocation* GetTextureLocation(unsigned int slot);
+	bool UsesTextureArrays();
+
+	// Per-material constants
+	PerMaterialData GetConstants();
+	void UpdateConstantBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetConstantBuffer();
+
+	void SetDrawTablePixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader);
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDrawTablePixelShader();
+	void SetGBufferPixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader);
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetGBufferPixelShader();
+
+	// Shader permutations
+	void SetShaderSource(const std::wstring& fileName);
+	const std::wstring& GetShaderSource();
+	unsigned int GetShaderFeatures();
+
+	// Textures and samplers, one range call each
+	const MaterialBindGroup& GetBindGroup();
 	void BindTexturesAndSamplers();
+
+	// Shaders, constants and bindings as EntityDraws takes them.
+	// Texture arrays and the draw table index are up to the caller.
+	DrawMaterial GetDrawMaterial();
 };
 
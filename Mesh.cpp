@@ -1,9 +1,12 @@
 #include "Mesh.h"
 #include "Vertex.h"
 #include "Graphics.h"
+#include "Profiler.h"
 #include <fstream>
 #include <stdexcept>
 #include <vector>
+#include <cfloat>
+#include <cmath>
 #include <DirectXMath.h>
 
 using namespace DirectX;
@@ -14,6 +17,43 @@ void Mesh::CreateDirect3DBuffer(Vertex* vertexArr, unsigned int* indexArr, int n
 	this->numIndex = numIndex;
 	this->numVert = numVert;
 
+	// Bounding sphere around the center of the vertices' box
+	XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < numVert; i++) {
+		XMVECTOR position = XMLoadFloat3(&vertexArr[i].Position);
+		boxMin = XMVectorMin(boxMin, position);
+		boxMax = XMVectorMax(boxMax, position);
+	}
+	XMVECTOR center = XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f);
+	float radiusSq = 0.0f;
+	for (int i = 0; i < numVert; i++) {
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&vertexArr[i].Position), center);
+		float distSq = XMVectorGetX(XMVector3LengthSq(offset));
+		if (distSq > radiusSq)
+			radiusSq = distSq;
+	}
+	XMStoreFloat3(&this->boundsCenter, center);
+	this->boundsRadius = sqrtf(radiusSq);
+
+	// How stretched the UVs are: the square root of total UV area
+	// over total surface area, for texture streaming to size mips by
+	float surfaceArea = 0.0f;
+	float uvArea = 0.0f;
+	for (int i = 0; i + 2 < numIndex; i += 3) {
+		const Vertex& v0 = vertexArr[indexArr[i]];
+		const Vertex& v1 = vertexArr[indexArr[i + 1]];
+		const Vertex& v2 = vertexArr[indexArr[i + 2]];
+
+		XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+		XMVECTOR edges = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&v1.Position), p0), XMVectorSubtract(XMLoadFloat3(&v2.Position), p0));
+		surfaceArea += 0.5f * XMVectorGetX(XMVector3Length(edges));
+		uvArea += 0.5f * fabsf(
+			(v1.UV.x - v0.UV.x) * (v2.UV.y - v0.UV.y) -
+			(v2.UV.x - v0.UV.x) * (v1.UV.y - v0.UV.y));
+	}
+	this->uvDensity = surfaceArea > 0.0f ? sqrtf(uvArea / surfaceArea) : 0.0f;
+
 	// Create a VERTEX BUFFER
 	// - This holds the vertex data of triangles for a single object
 	// - This buffer is created on the GPU, which is where the data needs to
@@ -40,6 +80,16 @@ void Mesh::CreateDirect3DBuffer(Vertex* vertexArr, unsigned int* indexArr, int n
 	// - Once we do this, we'll NEVER CHANGE DATA IN THE BUFFER AGAIN
 	Graphics::Device->CreateBuffer(&vbd, &initialVertexData, this->vertexBuffer.GetAddressOf());
 
+	// A second, position-only copy so depth-only passes fetch
+	// 12 bytes per vertex instead of the whole Vertex
+	std::vector<XMFLOAT3> positions(numVert);
+	for (int i = 0; i < numVert; i++)
+		positions[i] = vertexArr[i].Position;
+
+	vbd.ByteWidth = sizeof(XMFLOAT3) * numVert;
+	initialVertexData.pSysMem = positions.data();
+	Graphics::Device->CreateBuffer(&vbd, &initialVertexData, this->positionBuffer.GetAddressOf());
+
 	//=================================================================================================
 
 	// Create an INDEX BUFFER
@@ -66,6 +116,15 @@ void Mesh::CreateDirect3DBuffer(Vertex* vertexArr, unsigned int* indexArr, int n
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
 	Graphics::Device->CreateBuffer(&ibd, &initialIndexData, this->indexBuffer.GetAddressOf());
+
+	// Everything recorded draws need, with the buffers as handles
+	this->drawMesh.vertexBuffer = this->vertexBuffer.Get();
+	this->drawMesh.positionBuffer = this->positionBuffer.Get();
+	this->drawMesh.indexBuffer = this->indexBuffer.Get();
+	this->drawMesh.vertexStride = sizeof(Vertex);
+	this->drawMesh.indexCount = numIndex;
+	this->drawMesh.boundsCenter = this->boundsCenter;
+	this->drawMesh.boundsRadius = this->boundsRadius;
 }
 
 Mesh::Mesh(Vertex vertices[], unsigned int indices[], int numVert, int numIndex)
@@ -76,6 +135,8 @@ Mesh::Mesh(Vertex vertices[], unsigned int indices[], int numVert, int numIndex)
 
 Mesh::Mesh(const char* objFilePath)
 {
+	PROFILE_SCOPE("Load mesh");
+
 	// Author: Chris Cascioli
 	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
 	// 
@@ -351,6 +412,11 @@ Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
 	return this->indexBuffer;
 }
 
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetPositionBuffer()
+{
+	return this->positionBuffer;
+}
+
 int Mesh::GetIndexCount()
 {
 	return this->numIndex;
@@ -361,6 +427,26 @@ int Mesh::GetVertexCount()
 	return this->numVert;
 }
 
+DirectX::XMFLOAT3 Mesh::GetBoundsCenter()
+{
+	return this->boundsCenter;
+}
+
+float Mesh::GetBoundsRadius()
+{
+	return this->boundsRadius;
+}
+
+float Mesh::GetUVDensity()
+{
+	return this->uvDensity;
+}
+
+const DrawMesh& Mesh::GetDrawMesh()
+{
+	return this->drawMesh;
+}
+
 void Mesh::Draw()
 {
 	// Set buffers in the input assembler (IA) stage
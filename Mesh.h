@@ -3,6 +3,7 @@
 #include <d3d11.h>
 #include <wrl/client.h>
 #include "Vertex.h"
+#include "EntityDraws.h"
 #include <vector>
 
 
@@ -15,6 +16,19 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer; 
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer; 
 
+	// Positions only, for passes that need nothing else (depth pre-pass)
+	Microsoft::WRL::ComPtr<ID3D11Buffer> positionBuffer;
+
+	// Local space bounding sphere
+	DirectX::XMFLOAT3 boundsCenter;
+	float boundsRadius;
+
+	// UV units per local space unit, averaged over the surface
+	float uvDensity;
+
+	// The above as EntityDraws takes it
+	DrawMesh drawMesh;
+
 	void CreateDirect3DBuffer(Vertex* vertexArr, unsigned int* indexArr, int numVert, int numIndex);
 
 public:
@@ -24,9 +38,14 @@ public:
 
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetPositionBuffer();
 
 	int GetIndexCount();
 	int GetVertexCount();
+	DirectX::XMFLOAT3 GetBoundsCenter();
+	float GetBoundsRadius();
+	float GetUVDensity();
+	const DrawMesh& GetDrawMesh();
 	void Draw();
 
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
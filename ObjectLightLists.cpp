@@ -0,0 +1,130 @@
+#include "ObjectLightLists.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Average of saturate(N dot L) over every direction, used to
+	// turn a folded light into a direction-less ambient term
+	constexpr float FoldedLightScale = 0.25f;
+
+	// Same falloff as CalcAttenuate(), taken at the nearest point of
+	// the bounding sphere.  Returns 0 if the light can't reach it at all.
+	float EstimateAttenuation(const Light& light, FXMVECTOR center, float radius)
+	{
+		XMVECTOR lightPosition = XMLoadFloat3(&light.position);
+		XMVECTOR toObject = XMVectorSubtract(center, lightPosition);
+		float distance = XMVectorGetX(XMVector3Length(toObject));
+		if (distance > light.range + radius)
+			return 0.0f;
+
+		// Sphere vs. cone, measured from the cone's axis
+		if (light.type == LIGHT_TYPE_SPOT)
+		{
+			XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&light.direction));
+			float alongAxis = XMVectorGetX(XMVector3Dot(toObject, direction));
+			float fromAxis = sqrtf(fmaxf(distance * distance - alongAxis * alongAxis, 0.0f));
+			float coneDistance = cosf(light.spotOuterAngle) * fromAxis - sinf(light.spotOuterAngle) * alongAxis;
+			if (coneDistance > radius || alongAxis < -radius)
+				return 0.0f;
+		}
+
+		float nearest = fmaxf(distance - radius, 0.0f);
+		float attenuation = 1.0f - (nearest * nearest) / (light.range * light.range);
+		return attenuation > 0.0f ? attenuation * attenuation : 0.0f;
+	}
+
+	float Brightness(const Light& light)
+	{
+		return light.intensity * (0.299f * light.color.x + 0.587f * light.color.y + 0.114f * light.color.z);
+	}
+
+	struct RankedLight
+	{
+		uint32_t index;
+		float attenuation;
+		float score;
+	};
+}
+
+void ObjectLightLists::Resize(unsigned int objectCount)
+{
+	this->lists.resize(objectCount);
+}
+
+void ObjectLightLists::Build(unsigned int objectIndex, XMFLOAT3 center, float radius, const std::vector<Light>& lights)
+{
+	XMVECTOR centerVec = XMLoadFloat3(&center);
+
+	// Best lights so far, sorted by score, highest first
+	RankedLight best[MAX_OBJECT_LIGHTS];
+	unsigned int bestCount = 0;
+	XMVECTOR folded = XMVectorZero();
+
+	auto fold = [&](const RankedLight& ranked)
+		{
+			const Light& light = lights[ranked.index];
+			folded = XMVectorMultiplyAdd(
+				XMLoadFloat3(&light.color),
+				XMVectorReplicate(light.intensity * ranked.attenuation * FoldedLightScale),
+				folded);
+		};
+
+	for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+	{
+		const Light& light = lights[i];
+		if (light.type == LIGHT_TYPE_DIRECTIONAL)
+			continue;
+
+		RankedLight candidate;
+		candidate.index = i;
+		candidate.attenuation = EstimateAttenuation(light, centerVec, radius);
+		if (candidate.attenuation <= 0.0f)
+			continue;
+		candidate.score = candidate.attenuation * Brightness(light);
+
+		// Full list: either the candidate or the current last place gets folded
+		unsigned int slot = bestCount;
+		if (bestCount == MAX_OBJECT_LIGHTS)
+		{
+			if (candidate.score <= best[MAX_OBJECT_LIGHTS - 1].score)
+			{
+				fold(candidate);
+				continue;
+			}
+			fold(best[MAX_OBJECT_LIGHTS - 1]);
+			slot = MAX_OBJECT_LIGHTS - 1;
+		}
+		else
+		{
+			bestCount++;
+		}
+
+		// Insertion sort - N is tiny
+		while (slot > 0 && best[slot - 1].score < candidate.score)
+		{
+			best[slot] = best[slot - 1];
+			slot--;
+		}
+		best[slot] = candidate;
+	}
+
+	// Point lights first, then spot lights, for the shader's two loops
+	ObjectLightList& list = this->lists[objectIndex];
+	list.pointCount = 0;
+	for (unsigned int i = 0; i < bestCount; i++)
+	{
+		list.indices[i] = best[i].index;
+		list.pointCount += lights[best[i].index].type == LIGHT_TYPE_POINT ? 1 : 0;
+	}
+	std::stable_partition(list.indices, list.indices + bestCount,
+		[&](uint32_t index) { return lights[index].type == LIGHT_TYPE_POINT; });
+	list.spotCount = bestCount - list.pointCount;
+	XMStoreFloat3(&list.foldedLight, folded);
+}
+
+const ObjectLightList* ObjectLightLists::GetLists() const { return this->lists.data(); }
+unsigned int ObjectLightLists::GetCount() const { return (unsigned int)this->lists.size(); }
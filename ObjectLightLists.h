@@ -0,0 +1,48 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Lights.h"
+
+// Most point/spot lights one object evaluates per pixel - must match ShaderInclude.hlsli
+#define MAX_OBJECT_LIGHTS 8
+
+// Must match ObjectLightList in ShaderInclude.hlsli
+struct ObjectLightList
+{
+	uint32_t pointCount;
+	DirectX::XMFLOAT3 foldedLight; // Everything past the top N, as flat extra ambient
+	uint32_t spotCount; // Spot indices follow the point ones
+	uint32_t padding[3];
+	uint32_t indices[MAX_OBJECT_LIGHTS];
+};
+
+// --------------------------------------------------------
+// Per-object light lists, a lighter alternative to full
+// light clustering.
+//
+// Each object's bounding sphere is tested against every
+// point and spot light.  The ones that reach it are ranked
+// by a rough estimate of their contribution, the best few
+// are kept for the pixel shader to evaluate properly, and
+// the rest are folded into a single ambient term.
+// Directional lights are handled elsewhere.
+// --------------------------------------------------------
+class ObjectLightLists
+{
+private:
+	std::vector<ObjectLightList> lists;
+
+public:
+	// Sizes the table up front so objects can be
+	// built from several threads at once
+	void Resize(unsigned int objectCount);
+
+	// Fills in one object's list from its world space bounds
+	void Build(unsigned int objectIndex, DirectX::XMFLOAT3 center, float radius, const std::vector<Light>& lights);
+
+	// Getters
+	const ObjectLightList* GetLists() const;
+	unsigned int GetCount() const;
+};
@@ -1,22 +1,78 @@
 
 #include "ShaderInclude.hlsli"
 
+// Built on its own (as PixelShader.cso) this is the general
+// version with every feature on.  The ShaderLibrary compiles
+// specialized variants with SHADER_PERMUTATION defined, and
+// only the USE_* features the material and scene need.
+#ifndef SHADER_PERMUTATION
+#define USE_TEXTURE
+#define USE_NORMAL_MAP
+#define USE_POINT_LIGHTS
+#define USE_SPOT_LIGHTS
+#endif
+
 Texture2D SurfaceTexture : register(t0); // "t" registers for textures
 Texture2D NormalMap : register(t1);
 SamplerState BasicSampler : register(s0); // "s" registers for samplers
 
-cbuffer ExternalData : register(b0)
+// Or both textures from shared arrays, at the material's slices
+// (see D3D11TextureArrays), so materials don't bind their own
+#ifdef USE_TEXTURE_ARRAYS
+Texture2DArray SurfaceArray : register(t4);
+Texture2DArray NormalArray : register(t5);
+#endif
+
+// Baked sky lighting, see IBLBaker
+TextureCube EnvironmentSpecular : register(t2);
+Texture2D EnvironmentBRDF : register(t3);
+SamplerState ClampSampler : register(s1);
+
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+    matrix viewProjection;
+    float3 cameraPosition;
+    float time;
+    float3 ambientLight;
+    uint directionalLightCount;
+    float2 screenSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    float4 irradianceSH[IBL_SH_COEFFICIENT_COUNT];
+    float environmentMipCount; // 0 until the bake is ready
+}
+
+// Clustered lights, sorted by type
+// - Directional lights are the first entries in LightIndices
+// - Every other light is found through its cluster's range,
+//   with all of the point lights before the spot lights
+StructuredBuffer<PackedLight> Lights : register(t9);
+StructuredBuffer<uint3> ClusterRanges : register(t10); // Offset, point count, spot count
+StructuredBuffer<uint> LightIndices : register(t11);
+
+// Per-object light lists, indexed by draw ID
+StructuredBuffer<ObjectLightList> ObjectLights : register(t12);
+
+#ifdef USE_DRAW_TABLE
+// Every material's constants, indexed by the material index
+// passed down from the vertex shader
+StructuredBuffer<MaterialData> MaterialTable : register(t8);
+#else
+cbuffer PerMaterial : register(b1)
 {
     float4 colorTint;
     float2 uvOffset;
     float2 uvScale;
-    float3 cameraPosition;
     float roughness;
-    float3 ambientLight;
-    float time;
-    Light lights[5]; // array of extaclty 5 lights
-
+    uint surfaceSlice;
+    uint normalSlice;
+    float padding;
+    float4 surfaceRect;
+    float4 normalRect;
 }
+#endif
 
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
@@ -29,46 +85,87 @@ cbuffer ExternalData : register(b0)
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
+#ifdef USE_DRAW_TABLE
+    MaterialData material = MaterialTable[input.materialIndex];
+    float4 colorTint = material.colorTint;
+    float2 uvOffset = material.uvOffset;
+    float2 uvScale = material.uvScale;
+    float roughness = material.roughness;
+    uint surfaceSlice = material.surfaceSlice;
+    uint normalSlice = material.normalSlice;
+    float4 surfaceRect = material.surfaceRect;
+    float4 normalRect = material.normalRect;
+#endif
+
     input.normal = normalize(input.normal);
     input.tangent = normalize(input.tangent);
     input.uv = input.uv * uvScale + uvOffset;
     
+#if defined(USE_NORMAL_MAP) && defined(USE_TEXTURE_ARRAYS)
+    input.normal = ApplyNormalMap(SampleTextureSlice(NormalArray, BasicSampler, input.uv, normalRect, normalSlice), input.normal, input.tangent);
+#elif defined(USE_NORMAL_MAP)
     input.normal = NormalMapping(NormalMap, BasicSampler, input.uv, input.normal, input.tangent);
+#endif
 	
 	// Adjust the variables below as necessary to work with your own code
+#if defined(USE_TEXTURE) && defined(USE_TEXTURE_ARRAYS)
+    float4 surfaceColor = SampleTextureSlice(SurfaceArray, BasicSampler, input.uv, surfaceRect, surfaceSlice);
+    surfaceColor *= colorTint;
+#elif defined(USE_TEXTURE)
 	float4 surfaceColor = SurfaceTexture.Sample(BasicSampler, input.uv);
-	
     surfaceColor *=colorTint;
+#else
+    float4 surfaceColor = colorTint;
+#endif
     
-    //starting off with ambient light
+    //starting off with ambient light from the sky (or the flat
+    //ambient color while it's still being baked)
     float3 totalColor = ambientLight;
+    if (environmentMipCount > 0)
+        totalColor = CalcImageBasedLight(irradianceSH, EnvironmentSpecular, EnvironmentBRDF, ClampSampler,
+            environmentMipCount, input.normal, input.worldPosition, cameraPosition, surfaceColor.rgb, roughness);
 
     
-    for (int i = 0; i < 5; i++)
+    // Directional lights reach every pixel and are sorted first,
+    // so a known count can be unrolled straight over the light buffer
+#ifdef DIRECTIONAL_LIGHT_COUNT
+    [unroll]
+    for (uint i = 0; i < DIRECTIONAL_LIGHT_COUNT; i++)
+        totalColor += CalcDirectionalLight(Lights[i], input.normal, input.worldPosition, cameraPosition, surfaceColor.xyz, roughness);
+#else
+    for (uint i = 0; i < directionalLightCount; i++)
     {
-        Light light = lights[i];
-        light.direction = normalize(lights[i].direction);
-        
-        if (lights[i].type == LIGHT_TYPE_DIRECTIONAL)
-        {
-            // Process directional light
-            float3 dirLight = CalcDirectionalLight(light, input.normal, input.worldPosition, cameraPosition, surfaceColor.xyz, roughness);
-            
-            totalColor += dirLight;
-        }
-        else if (lights[i].type == LIGHT_TYPE_POINT)
-        {
-            // Process point light
-            float3 pointLight = CalcPointLight(light, input.normal, input.worldPosition, cameraPosition, surfaceColor.xyz, roughness);
-            totalColor += pointLight;
-        }
-        else if (lights[i].type == LIGHT_TYPE_SPOT)
-        {
-            // Process spot light
-            float3 spotLight = CalcSpotLight(light, input.normal, input.worldPosition, cameraPosition, surfaceColor.xyz, roughness);
-            totalColor += spotLight;
-        }
+        PackedLight light = Lights[LightIndices[i]];
+        totalColor += CalcDirectionalLight(light, input.normal, input.worldPosition, cameraPosition, surfaceColor.xyz, roughness);
     }
+#endif
+
+#ifdef USE_OBJECT_LIGHT_LISTS
+    // This object's top few lights, plus the rest folded into ambient
+    ObjectLightList list = ObjectLights[input.drawID];
+    totalColor += list.foldedLight * surfaceColor.rgb;
+    uint pointCount = list.pointCount;
+    uint spotCount = list.spotCount;
+    #define LIGHT_INDEX(j) list.indices[j]
+#else
+    // Point and spot lights only from this pixel's cluster
+    float viewDepth = mul(view, float4(input.worldPosition, 1.0f)).z;
+    uint clusterIndex = GetClusterIndex(input.screenPosition.xy, viewDepth, screenSize, clusterSliceScale, clusterSliceBias);
+    uint3 cluster = ClusterRanges[clusterIndex];
+    uint pointCount = cluster.y;
+    uint spotCount = cluster.z;
+    #define LIGHT_INDEX(j) LightIndices[cluster.x + j]
+#endif
+
+    // Point lights come before spot lights in either list
+#ifdef USE_POINT_LIGHTS
+    for (uint p = 0; p < pointCount; p++)
+        totalColor += CalcPointLight(Lights[LIGHT_INDEX(p)], input.normal, input.worldPosition, cameraPosition, surfaceColor.rgb, roughness);
+#endif
+#ifdef USE_SPOT_LIGHTS
+    for (uint s = pointCount; s < pointCount + spotCount; s++)
+        totalColor += CalcSpotLight(Lights[LIGHT_INDEX(s)], input.normal, input.worldPosition, cameraPosition, surfaceColor.rgb, roughness);
+#endif
     
     
     
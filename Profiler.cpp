@@ -0,0 +1,326 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace Profiler
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		// Written only by the thread that owns it, read only by EndFrame()
+		struct ThreadBuffer
+		{
+			ProfileEvent events[PROFILER_RING_SIZE];
+			std::atomic<uint64_t> written = 0;	// Events ever finished
+			uint64_t read = 0;					// Reader's side
+			unsigned int depth = 0;				// Owner's side
+			unsigned int index = 0;
+			std::string name;					// Guarded by threadsMutex
+		};
+
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		std::atomic<bool> enabled = true;
+
+		// Buffers live as long as the program, since their
+		// threads keep pointers to them
+		std::mutex threadsMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> threads;
+		thread_local ThreadBuffer* threadBuffer = 0;
+
+		// Main thread only from here on
+		std::vector<ProfileEvent> frameEvents;
+		std::vector<ProfileScopeStats> scopeStats;
+		std::unordered_map<std::string_view, unsigned int> scopeIndices;
+		float frameHistory[PROFILER_HISTORY] = {};
+		unsigned int frameCount = 0;
+		int64_t frameStart = 0;
+		int64_t frameEnd = 0;
+		uint64_t lostCount = 0;
+
+		std::vector<ProfileEvent> captureEvents;
+		std::string capturePath;
+		std::string lastCapturePath;
+		unsigned int captureFramesLeft = 0;
+
+		ThreadBuffer* AddBuffer(const std::string& name)
+		{
+			std::lock_guard<std::mutex> lock(threadsMutex);
+			threads.push_back(std::make_unique<ThreadBuffer>());
+			ThreadBuffer* buffer = threads.back().get();
+			buffer->index = (unsigned int)threads.size() - 1;
+			buffer->name = name.empty() ? "Thread " + std::to_string(buffer->index) : name;
+			return buffer;
+		}
+
+		ThreadBuffer& GetThreadBuffer()
+		{
+			if (!threadBuffer)
+				threadBuffer = AddBuffer("");
+			return *threadBuffer;
+		}
+
+		// Only the buffer's one writer calls this, so publishing the
+		// event is one release store of the count
+		void WriteEvent(ThreadBuffer& buffer, const char* name, int64_t start, int64_t end, unsigned int depth)
+		{
+			uint64_t written = buffer.written.load(std::memory_order_relaxed);
+			ProfileEvent& event = buffer.events[written % PROFILER_RING_SIZE];
+			event.name = name;
+			event.start = start;
+			event.end = end;
+			event.depth = depth;
+			event.thread = buffer.index;
+			buffer.written.store(written + 1, std::memory_order_release);
+		}
+
+		// --------------------------------------------------------
+		// Copies a thread's events since the last call.  The owner
+		// may lap the reader while it copies, so anything old enough
+		// to have been overwritten by the time it's done is dropped.
+		// --------------------------------------------------------
+		void Drain(ThreadBuffer& buffer)
+		{
+			uint64_t written = buffer.written.load(std::memory_order_acquire);
+			uint64_t first = std::max(buffer.read, written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0);
+			size_t copyStart = frameEvents.size();
+			for (uint64_t i = first; i < written; i++)
+				frameEvents.push_back(buffer.events[i % PROFILER_RING_SIZE]);
+
+			uint64_t after = buffer.written.load(std::memory_order_acquire);
+			uint64_t valid = after > PROFILER_RING_SIZE ? after - PROFILER_RING_SIZE : 0;
+			uint64_t overwritten = valid > first ? std::min(valid, written) - first : 0;
+			frameEvents.erase(frameEvents.begin() + copyStart, frameEvents.begin() + copyStart + overwritten);
+
+			lostCount += (first - buffer.read) + overwritten;
+			buffer.read = written;
+		}
+
+		// Shifts a history left by one and puts value at the end
+		void PushHistory(float* history, float value)
+		{
+			memmove(history, history + 1, (PROFILER_HISTORY - 1) * sizeof(float));
+			history[PROFILER_HISTORY - 1] = value;
+		}
+
+		float ToMilliseconds(int64_t nanoseconds)
+		{
+			return nanoseconds / 1000000.0f;
+		}
+
+		void WriteEscaped(std::ofstream& file, const char* text)
+		{
+			for (; *text; text++)
+			{
+				if (*text == '"' || *text == '\\')
+					file << '\\';
+				if ((unsigned char)*text >= 0x20)
+					file << *text;
+			}
+		}
+	}
+}
+
+void Profiler::SetEnabled(bool value)
+{
+	enabled.store(value, std::memory_order_relaxed);
+}
+
+bool Profiler::IsEnabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	buffer.name = name;
+}
+
+unsigned int Profiler::AddTimeline(const std::string& name)
+{
+	return AddBuffer(name)->index;
+}
+
+void Profiler::RecordEvent(unsigned int timeline, const char* name, int64_t start, int64_t end, unsigned int depth)
+{
+	ThreadBuffer* buffer;
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		if (timeline >= threads.size())
+			return;
+		buffer = threads[timeline].get();
+	}
+	WriteEvent(*buffer, name, start, end, depth);
+}
+
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+unsigned int Profiler::PushScope()
+{
+	return GetThreadBuffer().depth++;
+}
+
+// Finishes a scope on the calling thread
+void Profiler::PopScope(const char* name, int64_t start, int64_t end, unsigned int depth)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	buffer.depth = depth;
+	WriteEvent(buffer, name, start, end, depth);
+}
+
+// --------------------------------------------------------
+// Collects the frame just ended and folds it into each
+// scope's history.  Events are sorted by thread, then
+// start, so parents come before their children.
+// --------------------------------------------------------
+void Profiler::EndFrame()
+{
+	frameStart = frameEnd;
+	frameEnd = Now();
+	frameCount++;
+	PushHistory(frameHistory, ToMilliseconds(frameEnd - frameStart));
+
+	frameEvents.clear();
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		for (std::unique_ptr<ThreadBuffer>& buffer : threads)
+			Drain(*buffer);
+	}
+	std::sort(frameEvents.begin(), frameEvents.end(), [](const ProfileEvent& a, const ProfileEvent& b) {
+		return a.thread != b.thread ? a.thread < b.thread : a.start < b.start;
+	});
+
+	// Per-scope totals, with scopes kept in the order they first ran
+	for (ProfileScopeStats& stats : scopeStats)
+	{
+		stats.calls = 0;
+		stats.milliseconds = 0.0f;
+	}
+	for (const ProfileEvent& event : frameEvents)
+	{
+		auto found = scopeIndices.find(event.name);
+		if (found == scopeIndices.end())
+		{
+			ProfileScopeStats stats = {};
+			stats.name = event.name;
+			stats.depth = event.depth;
+			found = scopeIndices.insert({ event.name, (unsigned int)scopeStats.size() }).first;
+			scopeStats.push_back(stats);
+		}
+
+		ProfileScopeStats& stats = scopeStats[found->second];
+		stats.depth = std::min(stats.depth, event.depth);
+		stats.calls++;
+		stats.milliseconds += ToMilliseconds(event.end - event.start);
+	}
+
+	unsigned int filled = std::min(frameCount, (unsigned int)PROFILER_HISTORY);
+	for (ProfileScopeStats& stats : scopeStats)
+	{
+		PushHistory(stats.history, stats.milliseconds);
+		float total = 0.0f;
+		stats.maxMilliseconds = 0.0f;
+		for (unsigned int i = PROFILER_HISTORY - filled; i < PROFILER_HISTORY; i++)
+		{
+			total += stats.history[i];
+			stats.maxMilliseconds = std::max(stats.maxMilliseconds, stats.history[i]);
+		}
+		stats.averageMilliseconds = total / filled;
+	}
+
+	if (captureFramesLeft > 0)
+	{
+		captureEvents.insert(captureEvents.end(), frameEvents.begin(), frameEvents.end());
+		if (--captureFramesLeft == 0)
+		{
+			if (WriteChromeTrace(capturePath, captureEvents))
+				lastCapturePath = capturePath;
+			captureEvents.clear();
+			captureEvents.shrink_to_fit();
+		}
+	}
+}
+
+// --------------------------------------------------------
+// The capture also gets anything recorded before this call
+// but not collected yet, such as a slow startup
+// --------------------------------------------------------
+void Profiler::StartCapture(unsigned int frames, const std::string& path)
+{
+	captureEvents.clear();
+	capturePath = path;
+	captureFramesLeft = frames;
+}
+
+bool Profiler::IsCapturing()
+{
+	return captureFramesLeft > 0;
+}
+
+// --------------------------------------------------------
+// Writes events in the Trace Event Format: one complete
+// ("X") event per scope with its time and duration in
+// microseconds, plus a metadata event naming each thread
+// --------------------------------------------------------
+bool Profiler::WriteChromeTrace(const std::string& path, const std::vector<ProfileEvent>& events)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	file.setf(std::ios::fixed);
+	file.precision(3);
+
+	// Thread names first.  There may be none (events handed in
+	// before any thread recorded), so separators go before entries.
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	const char* separator = "";
+	std::vector<std::string> names = GetThreadNames();
+	for (unsigned int i = 0; i < names.size(); i++)
+	{
+		file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"";
+		WriteEscaped(file, names[i].c_str());
+		file << "\"}}";
+		separator = ",\n";
+	}
+	for (const ProfileEvent& event : events)
+	{
+		file << separator << "{\"name\":\"";
+		separator = ",\n";
+		WriteEscaped(file, event.name);
+		file << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+			<< ",\"ts\":" << event.start / 1000.0
+			<< ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+std::vector<std::string> Profiler::GetThreadNames()
+{
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	std::vector<std::string> names;
+	for (std::unique_ptr<ThreadBuffer>& buffer : threads)
+		names.push_back(buffer->name);
+	return names;
+}
+
+const std::vector<ProfileEvent>& Profiler::GetFrameEvents() { return frameEvents; }
+const std::vector<ProfileScopeStats>& Profiler::GetScopeStats() { return scopeStats; }
+int64_t Profiler::GetFrameStart() { return frameStart; }
+int64_t Profiler::GetFrameEnd() { return frameEnd; }
+const float* Profiler::GetFrameHistory() { return frameHistory; }
+uint64_t Profiler::GetLostCount() { return lostCount; }
+const std::string& Profiler::GetLastCapturePath() { return lastCapturePath; }
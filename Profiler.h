@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define PROFILER_RING_SIZE 4096		// Events each thread can record between EndFrame()s
+#define PROFILER_HISTORY 120		// Frames of timings kept per scope
+
+// Times the rest of the enclosing block, e.g. PROFILE_SCOPE("Draw").
+// The name must outlive the program - a string literal.
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// One finished scope, in nanoseconds since the profiler started
+struct ProfileEvent
+{
+	const char* name;
+	int64_t start;
+	int64_t end;
+	unsigned int depth;		// How many scopes it's nested in on its thread
+	unsigned int thread;	// Index into GetThreadNames()
+};
+
+// Timings of every scope with the same name, over recent frames
+struct ProfileScopeStats
+{
+	const char* name;
+	unsigned int depth;		// Shallowest it's been seen at, for indenting
+	unsigned int calls;		// Last frame
+	float milliseconds;		// Last frame, all calls added up
+	float history[PROFILER_HISTORY];	// Same, oldest first
+	float averageMilliseconds;
+	float maxMilliseconds;
+};
+
+// --------------------------------------------------------
+// A hierarchical CPU profiler.
+//
+// Scopes record into a ring buffer owned by the thread they
+// run on, so recording takes no locks: the owning thread is
+// the only writer, and EndFrame() (the only reader) collects
+// every thread's new events once per frame.  A thread that
+// records more than PROFILER_RING_SIZE events in one frame
+// loses its oldest ones, which GetLostCount() counts.
+//
+// While disabled, a scope costs one relaxed atomic load.
+// No graphics or OS APIs here, only the standard library.
+// --------------------------------------------------------
+namespace Profiler
+{
+	// General functions
+	void SetEnabled(bool enabled);
+	bool IsEnabled();
+
+	// Names the calling thread in the panel and in traces
+	void SetThreadName(const std::string& name);
+
+	// Timelines that aren't threads, such as the GPU's: events are
+	// recorded for them after the fact, by one thread at a time
+	unsigned int AddTimeline(const std::string& name);
+	void RecordEvent(unsigned int timeline, const char* name, int64_t start, int64_t end, unsigned int depth);
+
+	// Called by ProfileScope
+	int64_t Now();
+	unsigned int PushScope();
+	void PopScope(const char* name, int64_t start, int64_t end, unsigned int depth);
+
+	// Once per frame, on the main thread, after everything it
+	// should include: collects every thread's events into the
+	// frame just ended and updates the per-scope stats
+	void EndFrame();
+
+	// Keeps every event from now through the next frameCount
+	// frames, then writes them to path as Chrome trace JSON
+	// (chrome://tracing or ui.perfetto.dev)
+	void StartCapture(unsigned int frameCount, const std::string& path);
+	bool IsCapturing();
+	bool WriteChromeTrace(const std::string& path, const std::vector<ProfileEvent>& events);
+
+	// Getters
+	const std::vector<ProfileEvent>& GetFrameEvents();
+	const std::vector<ProfileScopeStats>& GetScopeStats();
+	std::vector<std::string> GetThreadNames();
+	int64_t GetFrameStart();
+	int64_t GetFrameEnd();
+	const float* GetFrameHistory();		// Milliseconds, oldest first
+	uint64_t GetLostCount();
+	const std::string& GetLastCapturePath();
+}
+
+// --------------------------------------------------------
+// Times its own lifetime, see PROFILE_SCOPE
+// --------------------------------------------------------
+class ProfileScope
+{
+private:
+	const char* name;
+	int64_t start;
+	unsigned int depth;
+	bool active;
+
+public:
+	ProfileScope(const char* name)
+	{
+		this->active = Profiler::IsEnabled();
+		if (!this->active)
+			return;
+		this->name = name;
+		this->depth = Profiler::PushScope();
+		this->start = Profiler::Now();
+	}
+
+	~ProfileScope()
+	{
+		if (this->active)
+			Profiler::PopScope(this->name, this->start, Profiler::Now(), this->depth);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
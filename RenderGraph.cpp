@@ -0,0 +1,282 @@
+#include "RenderGraph.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace
+{
+	constexpr unsigned int NoPass = 0xFFFFFFFFu;
+
+	void AddUnique(std::vector<unsigned int>& list, unsigned int value)
+	{
+		if (std::find(list.begin(), list.end(), value) == list.end())
+			list.push_back(value);
+	}
+}
+
+bool RenderGraphTextureDesc::operator==(const RenderGraphTextureDesc& other) const
+{
+	return width == other.width && height == other.height && format == other.format;
+}
+
+RenderGraph::RenderGraph()
+{
+	Reset();
+}
+
+void RenderGraph::Reset()
+{
+	this->resources.clear();
+	this->passes.clear();
+	this->allocations.clear();
+	this->order.clear();
+	this->peakTransientBytes = 0;
+	this->unaliasedTransientBytes = 0;
+}
+
+RenderGraphResource RenderGraph::CreateTexture(const char* name, const RenderGraphTextureDesc& desc)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.desc = desc;
+	resource.imported = false;
+	this->resources.push_back(resource);
+	return (RenderGraphResource)this->resources.size() - 1;
+}
+
+RenderGraphResource RenderGraph::ImportTexture(const char* name)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.imported = true;
+	this->resources.push_back(resource);
+	return (RenderGraphResource)this->resources.size() - 1;
+}
+
+unsigned int RenderGraph::AddPass(const char* name, ExecuteFunction execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = std::move(execute);
+	pass.live = false;
+	this->passes.push_back(std::move(pass));
+	return (unsigned int)this->passes.size() - 1;
+}
+
+void RenderGraph::Read(unsigned int pass, RenderGraphResource resource) { this->passes[pass].reads.push_back(resource); }
+void RenderGraph::Write(unsigned int pass, RenderGraphResource resource) { this->passes[pass].writes.push_back(resource); }
+
+// --------------------------------------------------------
+// Declaration order gives every texture a history of writes.
+// A read depends on the latest write before it, and a write
+// depends on the previous write (it may only touch part of
+// the texture) - those are the edges culling follows.  A
+// write also has to wait for earlier reads of the old
+// contents, which only matters for ordering.
+// --------------------------------------------------------
+bool RenderGraph::Compile()
+{
+	unsigned int passCount = (unsigned int)this->passes.size();
+	unsigned int resourceCount = (unsigned int)this->resources.size();
+
+	this->dependencies.assign(passCount, std::vector<unsigned int>());
+	this->successors.assign(passCount, std::vector<unsigned int>());
+	this->lastWriters.assign(resourceCount, NoPass);
+	this->readersSinceWrite.assign(resourceCount, std::vector<unsigned int>());
+	this->allocations.clear();
+	this->order.clear();
+	this->peakTransientBytes = 0;
+	this->unaliasedTransientBytes = 0;
+
+	for (unsigned int p = 0; p < passCount; p++)
+	{
+		for (RenderGraphResource r : this->passes[p].reads)
+		{
+			unsigned int writer = this->lastWriters[r];
+			if (writer != NoPass && writer != p)
+			{
+				AddUnique(this->dependencies[p], writer);
+				AddUnique(this->successors[writer], p);
+			}
+			this->readersSinceWrite[r].push_back(p);
+		}
+
+		for (RenderGraphResource r : this->passes[p].writes)
+		{
+			unsigned int writer = this->lastWriters[r];
+			if (writer != NoPass && writer != p)
+			{
+				AddUnique(this->dependencies[p], writer);
+				AddUnique(this->successors[writer], p);
+			}
+			for (unsigned int reader : this->readersSinceWrite[r])
+			{
+				if (reader != p)
+					AddUnique(this->successors[reader], p);
+			}
+			this->readersSinceWrite[r].clear();
+			this->lastWriters[r] = p;
+		}
+	}
+
+	// Anything that writes an imported texture is visible outside the
+	// graph; everything else survives only if one of those needs it
+	std::vector<unsigned int> stack;
+	for (unsigned int p = 0; p < passCount; p++)
+	{
+		this->passes[p].live = false;
+		for (RenderGraphResource r : this->passes[p].writes)
+		{
+			if (this->resources[r].imported)
+				this->passes[p].live = true;
+		}
+		if (this->passes[p].live)
+			stack.push_back(p);
+	}
+	while (!stack.empty())
+	{
+		unsigned int p = stack.back();
+		stack.pop_back();
+		for (unsigned int dependency : this->dependencies[p])
+		{
+			if (this->passes[dependency].live)
+				continue;
+			this->passes[dependency].live = true;
+			stack.push_back(dependency);
+		}
+	}
+
+	// Topological sort of the live passes, always taking the earliest
+	// declared pass that's ready so independent passes keep their order
+	std::vector<unsigned int> waitingOn(passCount, 0);
+	unsigned int liveCount = 0;
+	for (unsigned int p = 0; p < passCount; p++)
+	{
+		if (!this->passes[p].live)
+			continue;
+		liveCount++;
+		for (unsigned int next : this->successors[p])
+		{
+			if (this->passes[next].live)
+				waitingOn[next]++;
+		}
+	}
+
+	std::priority_queue<unsigned int, std::vector<unsigned int>, std::greater<unsigned int>> ready;
+	for (unsigned int p = 0; p < passCount; p++)
+	{
+		if (this->passes[p].live && waitingOn[p] == 0)
+			ready.push(p);
+	}
+	while (!ready.empty())
+	{
+		unsigned int p = ready.top();
+		ready.pop();
+		this->order.push_back(p);
+		for (unsigned int next : this->successors[p])
+		{
+			if (this->passes[next].live && --waitingOn[next] == 0)
+				ready.push(next);
+		}
+	}
+	if (this->order.size() != liveCount)
+	{
+		this->order.clear();
+		return false;
+	}
+
+	// Lifetimes, as positions in the compiled order
+	for (Resource& resource : this->resources)
+	{
+		resource.firstUse = NoPass;
+		resource.lastUse = 0;
+		resource.allocation = RENDER_GRAPH_NO_ALLOCATION;
+	}
+	for (unsigned int i = 0; i < (unsigned int)this->order.size(); i++)
+	{
+		const Pass& pass = this->passes[this->order[i]];
+		for (const std::vector<RenderGraphResource>* list : { &pass.reads, &pass.writes })
+		{
+			for (RenderGraphResource r : *list)
+			{
+				this->resources[r].firstUse = std::min(this->resources[r].firstUse, i);
+				this->resources[r].lastUse = std::max(this->resources[r].lastUse, i);
+			}
+		}
+	}
+
+	// Hand out allocations in order of first use, reusing any matching
+	// allocation whose last user has already run
+	std::vector<RenderGraphResource> transients;
+	for (RenderGraphResource r = 0; r < resourceCount; r++)
+	{
+		if (!this->resources[r].imported && this->resources[r].firstUse != NoPass)
+			transients.push_back(r);
+	}
+	std::stable_sort(transients.begin(), transients.end(),
+		[this](RenderGraphResource a, RenderGraphResource b) { return this->resources[a].firstUse < this->resources[b].firstUse; });
+
+	for (RenderGraphResource r : transients)
+	{
+		Resource& resource = this->resources[r];
+		this->unaliasedTransientBytes += CalcTextureBytes(resource.desc);
+
+		for (unsigned int a = 0; a < (unsigned int)this->allocations.size(); a++)
+		{
+			if (this->allocations[a].desc == resource.desc && this->allocations[a].lastUse < resource.firstUse)
+			{
+				resource.allocation = a;
+				break;
+			}
+		}
+		if (resource.allocation == RENDER_GRAPH_NO_ALLOCATION)
+		{
+			resource.allocation = (unsigned int)this->allocations.size();
+			this->allocations.push_back({ resource.desc, 0 });
+			this->peakTransientBytes += CalcTextureBytes(resource.desc);
+		}
+		this->allocations[resource.allocation].lastUse = resource.lastUse;
+	}
+	return true;
+}
+
+void RenderGraph::Execute() const
+{
+	for (unsigned int p : this->order)
+	{
+		PROFILE_SCOPE(this->passes[p].name);
+		if (this->passes[p].execute)
+			this->passes[p].execute(*this);
+	}
+}
+
+const std::vector<unsigned int>& RenderGraph::GetPassOrder() const { return this->order; }
+unsigned int RenderGraph::GetPassCount() const { return (unsigned int)this->passes.size(); }
+const char* RenderGraph::GetPassName(unsigned int pass) const { return this->passes[pass].name; }
+bool RenderGraph::IsPassLive(unsigned int pass) const { return this->passes[pass].live; }
+
+unsigned int RenderGraph::GetResourceCount() const { return (unsigned int)this->resources.size(); }
+bool RenderGraph::IsImported(RenderGraphResource resource) const { return this->resources[resource].imported; }
+unsigned int RenderGraph::GetFirstUse(RenderGraphResource resource) const { return this->resources[resource].firstUse; }
+unsigned int RenderGraph::GetLastUse(RenderGraphResource resource) const { return this->resources[resource].lastUse; }
+unsigned int RenderGraph::GetAllocation(RenderGraphResource resource) const { return this->resources[resource].allocation; }
+unsigned int RenderGraph::GetAllocationCount() const { return (unsigned int)this->allocations.size(); }
+const RenderGraphTextureDesc& RenderGraph::GetAllocationDesc(unsigned int allocation) const { return this->allocations[allocation].desc; }
+
+size_t RenderGraph::GetPeakTransientBytes() const { return this->peakTransientBytes; }
+size_t RenderGraph::GetUnaliasedTransientBytes() const { return this->unaliasedTransientBytes; }
+
+size_t RenderGraph::CalcTextureBytes(const RenderGraphTextureDesc& desc)
+{
+	size_t bytesPerPixel = 4;
+	switch (desc.format)
+	{
+	case RenderGraphFormat::RGBA8Unorm: bytesPerPixel = 4; break;
+	case RenderGraphFormat::RG16Snorm: bytesPerPixel = 4; break;
+	case RenderGraphFormat::R32Float: bytesPerPixel = 4; break;
+	case RenderGraphFormat::RGBA16Float: bytesPerPixel = 8; break;
+	}
+	return (size_t)desc.width * desc.height * bytesPerPixel;
+}
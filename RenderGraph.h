@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Handle to a texture declared in a RenderGraph
+typedef uint32_t RenderGraphResource;
+
+// Returned when a resource has no pooled texture (imported or unused)
+#define RENDER_GRAPH_NO_ALLOCATION 0xFFFFFFFFu
+
+enum class RenderGraphFormat : uint8_t
+{
+	RGBA8Unorm,
+	RG16Snorm,
+	R32Float,
+	RGBA16Float
+};
+
+struct RenderGraphTextureDesc
+{
+	uint32_t width;
+	uint32_t height;
+	RenderGraphFormat format;
+
+	bool operator==(const RenderGraphTextureDesc& other) const;
+};
+
+// --------------------------------------------------------
+// A frame described as passes and the textures they read
+// and write, rebuilt every frame.
+//
+// Compiling the graph:
+//  - culls every pass whose output never reaches an imported
+//    texture (the back buffer, say)
+//  - orders the rest so each one runs after the writes it
+//    depends on, keeping declaration order otherwise
+//  - finds each transient texture's first and last use and
+//    lets textures with the same description and lifetimes
+//    that don't overlap share one pooled allocation
+//
+// Only bookkeeping happens here.  A pool (see
+// D3D11RenderGraphPool) turns allocations into real textures.
+// --------------------------------------------------------
+class RenderGraph
+{
+public:
+	typedef std::function<void(const RenderGraph&)> ExecuteFunction;
+
+private:
+	struct Resource
+	{
+		const char* name;
+		RenderGraphTextureDesc desc;
+		bool imported;
+		unsigned int firstUse;	// Positions in the compiled order
+		unsigned int lastUse;
+		unsigned int allocation;
+	};
+
+	struct Pass
+	{
+		const char* name;
+		std::vector<RenderGraphResource> reads;
+		std::vector<RenderGraphResource> writes;
+		ExecuteFunction execute;
+		bool live;
+	};
+
+	struct Allocation
+	{
+		RenderGraphTextureDesc desc;
+		unsigned int lastUse;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<Allocation> allocations;
+	std::vector<unsigned int> order;
+
+	// Scratch space kept between compiles
+	std::vector<std::vector<unsigned int>> dependencies;	// Passes each pass needs the output of
+	std::vector<std::vector<unsigned int>> successors;		// Passes that must run after each pass
+	std::vector<unsigned int> lastWriters;
+	std::vector<std::vector<unsigned int>> readersSinceWrite;
+
+	size_t peakTransientBytes;
+	size_t unaliasedTransientBytes;
+
+public:
+	RenderGraph();
+
+	// Forgets every pass and resource but keeps their memory
+	void Reset();
+
+	// Declaring the frame
+	RenderGraphResource CreateTexture(const char* name, const RenderGraphTextureDesc& desc);
+	RenderGraphResource ImportTexture(const char* name);
+	unsigned int AddPass(const char* name, ExecuteFunction execute);
+	void Read(unsigned int pass, RenderGraphResource resource);
+	void Write(unsigned int pass, RenderGraphResource resource);
+
+	// Culls, orders and allocates.  Returns false if the passes
+	// can't be ordered, which leaves nothing to execute.
+	bool Compile();
+
+	// Runs the live passes in compiled order
+	void Execute() const;
+
+	// Getters for the compiled result
+	const std::vector<unsigned int>& GetPassOrder() const;
+	unsigned int GetPassCount() const;
+	const char* GetPassName(unsigned int pass) const;
+	bool IsPassLive(unsigned int pass) const;
+
+	unsigned int GetResourceCount() const;
+	bool IsImported(RenderGraphResource resource) const;
+	unsigned int GetFirstUse(RenderGraphResource resource) const;	// Positions in GetPassOrder()
+	unsigned int GetLastUse(RenderGraphResource resource) const;
+	unsigned int GetAllocation(RenderGraphResource resource) const;
+	unsigned int GetAllocationCount() const;
+	const RenderGraphTextureDesc& GetAllocationDesc(unsigned int allocation) const;
+
+	// Memory the pooled allocations need (they're all held for the
+	// whole frame), and what every transient would need unshared
+	size_t GetPeakTransientBytes() const;
+	size_t GetUnaliasedTransientBytes() const;
+
+	static size_t CalcTextureBytes(const RenderGraphTextureDesc& desc);
+};
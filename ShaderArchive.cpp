@@ -0,0 +1,138 @@
+#include "ShaderArchive.h"
+
+#include <cstring>
+
+ShaderArchive::ShaderArchive()
+{
+	Close();
+}
+
+// --------------------------------------------------------
+// Lays out the header, the index and then each unique piece
+// of byte code, 16-byte aligned.  Duplicates (same hash and
+// same bytes) point at the copy that was written first.
+// --------------------------------------------------------
+std::vector<uint8_t> ShaderArchive::Pack(const std::vector<std::pair<std::string, std::vector<uint8_t>>>& shaders)
+{
+	unsigned int count = (unsigned int)shaders.size();
+	size_t indexEnd = sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * count;
+
+	std::vector<uint8_t> bytes(indexEnd);
+
+	ShaderArchiveHeader header = {};
+	header.magic = SHADER_ARCHIVE_MAGIC;
+	header.version = SHADER_ARCHIVE_VERSION;
+	header.entryCount = count;
+	memcpy(bytes.data(), &header, sizeof(header));
+
+	std::vector<ShaderArchiveEntry> entries(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const std::string& name = shaders[i].first;
+		const std::vector<uint8_t>& code = shaders[i].second;
+
+		ShaderArchiveEntry& entry = entries[i];
+		size_t nameLength = name.size() < SHADER_ARCHIVE_NAME_LENGTH - 1 ? name.size() : SHADER_ARCHIVE_NAME_LENGTH - 1;
+		memcpy(entry.name, name.c_str(), nameLength);
+		entry.size = (uint32_t)code.size();
+		entry.hash = Hash(code.data(), code.size());
+
+		// Reuse an earlier copy of the same byte code if there is one
+		bool found = false;
+		for (unsigned int j = 0; j < i && !found; j++)
+		{
+			if (entries[j].hash == entry.hash &&
+				entries[j].size == entry.size &&
+				memcmp(&bytes[(size_t)entries[j].offset], code.data(), code.size()) == 0)
+			{
+				entry.offset = entries[j].offset;
+				found = true;
+			}
+		}
+		if (found)
+			continue;
+
+		size_t offset = (bytes.size() + 15) / 16 * 16;
+		bytes.resize(offset + code.size());
+		memcpy(&bytes[offset], code.data(), code.size());
+		entry.offset = offset;
+	}
+
+	if (count > 0)
+		memcpy(&bytes[sizeof(ShaderArchiveHeader)], entries.data(), sizeof(ShaderArchiveEntry) * count);
+	return bytes;
+}
+
+bool ShaderArchive::Open(const void* archiveData, size_t archiveSizeInBytes)
+{
+	Close();
+
+	if (!archiveData || archiveSizeInBytes < sizeof(ShaderArchiveHeader))
+		return false;
+
+	const ShaderArchiveHeader* header = static_cast<const ShaderArchiveHeader*>(archiveData);
+	if (header->magic != SHADER_ARCHIVE_MAGIC || header->version != SHADER_ARCHIVE_VERSION)
+		return false;
+	if (sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * (size_t)header->entryCount > archiveSizeInBytes)
+		return false;
+
+	// Make sure every entry stays inside the archive before trusting any of them
+	const ShaderArchiveEntry* index = reinterpret_cast<const ShaderArchiveEntry*>(header + 1);
+	for (unsigned int i = 0; i < header->entryCount; i++)
+	{
+		if (index[i].offset > archiveSizeInBytes || index[i].size > archiveSizeInBytes - index[i].offset)
+			return false;
+	}
+
+	this->data = static_cast<const uint8_t*>(archiveData);
+	this->sizeInBytes = archiveSizeInBytes;
+	this->entries = index;
+	this->entryCount = header->entryCount;
+	return true;
+}
+
+void ShaderArchive::Close()
+{
+	this->data = 0;
+	this->sizeInBytes = 0;
+	this->entries = 0;
+	this->entryCount = 0;
+}
+
+// A handful of shaders, so a linear search over the index is plenty
+bool ShaderArchive::Find(const char* name, const void** byteCode, size_t* byteCodeSize) const
+{
+	for (unsigned int i = 0; i < this->entryCount; i++)
+	{
+		if (strncmp(this->entries[i].name, name, SHADER_ARCHIVE_NAME_LENGTH) != 0)
+			continue;
+
+		*byteCode = this->data + this->entries[i].offset;
+		*byteCodeSize = this->entries[i].size;
+		return true;
+	}
+	return false;
+}
+
+void ShaderArchive::GetEntry(unsigned int index, const char** name, const void** byteCode, size_t* byteCodeSize) const
+{
+	*name = this->entries[index].name;
+	*byteCode = this->data + this->entries[index].offset;
+	*byteCodeSize = this->entries[index].size;
+}
+
+bool ShaderArchive::IsOpen() const { return this->data != 0; }
+unsigned int ShaderArchive::GetEntryCount() const { return this->entryCount; }
+size_t ShaderArchive::GetIndexSizeInBytes() const { return sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * this->entryCount; }
+
+uint32_t ShaderArchive::Hash(const void* data, size_t sizeInBytes)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeInBytes; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
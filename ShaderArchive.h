@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SHADER_ARCHIVE_MAGIC 0x4B415053u // "SPAK"
+#define SHADER_ARCHIVE_VERSION 1
+#define SHADER_ARCHIVE_NAME_LENGTH 48
+
+// File layout: header, entryCount entries, then the byte code
+struct ShaderArchiveHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t padding;
+};
+
+struct ShaderArchiveEntry
+{
+	char name[SHADER_ARCHIVE_NAME_LENGTH]; // e.g. "VertexShader.cso", null terminated
+	uint64_t offset;	// From the start of the archive
+	uint32_t size;
+	uint32_t hash;		// Of the byte code
+};
+
+// --------------------------------------------------------
+// Every compiled shader in one indexed blob, so startup
+// needs a single file instead of one per shader.
+//
+// Identical byte code is only stored once; entries with
+// the same contents share an offset.  Only the format lives
+// here - the ShaderLibrary decides where the bytes come
+// from (usually a memory-mapped file).
+// --------------------------------------------------------
+class ShaderArchive
+{
+private:
+	const uint8_t* data;
+	size_t sizeInBytes;
+	const ShaderArchiveEntry* entries;
+	unsigned int entryCount;
+
+public:
+	ShaderArchive();
+
+	// Builds a complete archive from named byte code
+	static std::vector<uint8_t> Pack(const std::vector<std::pair<std::string, std::vector<uint8_t>>>& shaders);
+
+	// Reads the index of an archive already in memory.  The
+	// memory must outlive this object.  Returns false if the
+	// data isn't a valid archive.
+	bool Open(const void* archiveData, size_t archiveSizeInBytes);
+	void Close();
+
+	// Finds a shader by name, returning false if it's missing
+	bool Find(const char* name, const void** byteCode, size_t* byteCodeSize) const;
+
+	// Name and byte code of one entry, e.g. to repack the archive
+	// with more shaders.  name is at most SHADER_ARCHIVE_NAME_LENGTH
+	// characters and may not be null terminated.
+	void GetEntry(unsigned int index, const char** name, const void** byteCode, size_t* byteCodeSize) const;
+
+	// Getters
+	bool IsOpen() const;
+	unsigned int GetEntryCount() const;
+	size_t GetIndexSizeInBytes() const;
+
+	// 32-bit FNV-1a, used to spot duplicate byte code
+	static uint32_t Hash(const void* data, size_t sizeInBytes);
+};
@@ -6,6 +6,17 @@
 #define LIGHT_TYPE_POINT 1
 #define LIGHT_TYPE_SPOT 2
 #define MAX_SPECULAR_EXPONENT 256.0f
+
+// Froxel grid dimensions - must match LightClusters.h
+#define LIGHT_CLUSTER_COUNT_X 16
+#define LIGHT_CLUSTER_COUNT_Y 9
+#define LIGHT_CLUSTER_COUNT_Z 24
+
+// Must match ObjectLightLists.h
+#define MAX_OBJECT_LIGHTS 8
+
+// Must match IBLBaker.h
+#define IBL_SH_COEFFICIENT_COUNT 9
 // ALL of your code pieces (structs, functions, etc.) go here!
 
 
@@ -46,6 +57,8 @@ struct VertexToPixel
     float3 normal : NORMAL;
     float3 tangent : TANGENT;
     float3 worldPosition : POSITION;
+    nointerpolation uint materialIndex : MATERIAL_INDEX; // Only used with a draw table
+    nointerpolation uint drawID : DRAW_ID;
 };
 
 
@@ -63,27 +76,65 @@ struct VertexToPixel_Sky
 
 
 
-struct Light
+// Deferred path structs
+struct VertexToPixel_Fullscreen
+{
+    float4 position : SV_Position;
+};
+
+struct VertexToPixel_LightVolume
+{
+    float4 position : SV_Position;
+    nointerpolation uint lightIndex : LIGHT_INDEX;
+};
+
+
+// Every material's constants, as the draw table stores them
+// - Must match PerMaterialData in BufferStruct.h
+struct MaterialData
 {
-    int type; // 0 = directional, 1 = point, 2 = 
-    float3 direction; // For directional and spot lights
-    float range; // Effective range for point and spot lights
-    float3 position; // For point and spot lights
-    float intensity; // Brightness of the light
-    float3 color; // RGBA color
-    float spotInnerAngle; // Inner cone angle (in radians)  Inside this, full light!
-    float spotOuterAngle; // Outer cone angle (in radians)  Between inner and outer, light falls off to zero
-    float2 padding; // Padding to align to 16-byte boundary
-	
+    float4 colorTint;
+    float2 uvOffset;
+    float2 uvScale;
+    float roughness;
+    uint surfaceSlice;
+    uint normalSlice;
+    float padding;
+    float4 surfaceRect;
+    float4 normalRect;
 };
 
 
-float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler,float2 uv, float3 normalFromVS, float3 tangentFromVS )
+// Lights as the CPU packs them each frame (see LightPacking)
+// - Must match PackedLight in LightPacking.h
+struct PackedLight
 {
-    float3 normalFromTexture = normalMap.Sample(basicSampler, uv).xyz;
-    
-    // Unpack normal from texture sample  ensure normalization!
-    float3 unpackedNormal = normalize(normalFromTexture * 2.0f - 1.0f);
+    float3 position;
+    float invRangeSq; // 1 / (range * range)
+    float3 direction; // Already normalized
+    float spotScale; // Spot term = saturate(cosAngle * spotScale + spotOffset)
+    float3 color; // Already multiplied by intensity
+    float spotOffset;
+};
+
+
+// Samples a texture packed into an array slice (see TextureArrays).
+// rect.xy is where it starts in the slice and rect.zw its size, so
+// wrapping happens here, and the gradients are scaled to match so
+// the mip chosen is the one the texture would get on its own.
+float4 SampleTextureSlice(Texture2DArray textures, SamplerState basicSampler, float2 uv, float4 rect, uint slice)
+{
+    float2 sliceUV = rect.xy + frac(uv) * rect.zw;
+    return textures.SampleGrad(basicSampler, float3(sliceUV, slice), ddx(uv) * rect.zw, ddy(uv) * rect.zw);
+}
+
+
+float3 ApplyNormalMap(float4 normalSample, float3 normalFromVS, float3 tangentFromVS)
+{
+    // Only X and Y are read: BC5 normal maps (from the texture baker)
+    // have no Z, so it's rebuilt from the fact the normal is unit length
+    float2 normalXY = normalSample.xy * 2.0f - 1.0f;
+    float3 unpackedNormal = float3(normalXY, sqrt(saturate(1.0f - dot(normalXY, normalXY))));
     // Create TBN matrix
     float3 N = normalize(normalFromVS);
     float3 T = normalize(tangentFromVS - dot(tangentFromVS, N) * N); // Orthonormalize!
@@ -95,10 +146,16 @@ float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler,float2 uv, f
 }
 
 
-float CalcAttenuate(Light light, float3 worldPos)
+float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler,float2 uv, float3 normalFromVS, float3 tangentFromVS )
 {
-    float dist = distance(light.position, worldPos);
-    float att = saturate(1.0f - (dist * dist / (light.range * light.range)));
+    return ApplyNormalMap(normalMap.Sample(basicSampler, uv), normalFromVS, tangentFromVS);
+}
+
+
+float CalcAttenuate(PackedLight light, float3 worldPos)
+{
+    float3 toLight = light.position - worldPos;
+    float att = saturate(1.0f - dot(toLight, toLight) * light.invRangeSq);
     return att * att;
 }
 
@@ -132,71 +189,142 @@ float3 CalcSpecularPhong(float3 camPos, float3 worldPos, float3 lightDir, float3
 }
 
 
-float3 CalcDirectionalLight(Light lights, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
+float3 CalcDirectionalLight(PackedLight light, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
 {
     
-    float3 direToLight = normalize(-lights.direction); // Light direction is opposite to light vector
+    float3 direToLight = -light.direction; // Light direction is opposite to light vector
     
     
     float3 diffuse = CalcDiffuse(
         normal,
         direToLight,
-        lights.color,
-        lights.intensity,
+        light.color,
+        1.0f,
         surfaceColor
     );
     
-    float3 specular = CalcSpecularPhong(camPos, worldPos, lights.direction, normal, roughness) * lights.color * lights.intensity * surfaceColor;
+    float3 specular = CalcSpecularPhong(camPos, worldPos, light.direction, normal, roughness) * light.color * surfaceColor;
     
     //float3 result = surfaceColor * (diffuse + specular); // Tint specular?
-    float3 result = surfaceColor * diffuse + specular; // Dont tint specular?
+    float3 result = surfaceColor * diffuse + specular; // Don't tint specular?
 
-    //return result * lights.color * lights.intensity; // Lights overall color
     return result;
 }
 
 
-float3 CalcPointLight(Light light, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
+float3 CalcPointLight(PackedLight light, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
 {
     float3 pixelToLight = normalize(light.position - worldPos);
     
-    
-    float3 direToLight = normalize(-light.direction); // Light direction is opposite to light vector
-    
-    float attenuation = CalcAttenuate(light,worldPos); // Linear falloff
+    float attenuation = CalcAttenuate(light,worldPos);
     
     float3 diffuse = CalcDiffuse(
         normal,
-        direToLight,
+        pixelToLight,
         light.color,
-        light.intensity * attenuation,
+        attenuation,
         surfaceColor
     );
     
-    float3 specular = CalcSpecularPhong(camPos, worldPos, light.direction, normal, roughness) * light.color * light.intensity * attenuation * surfaceColor;
+    float3 specular = CalcSpecularPhong(camPos, worldPos, -pixelToLight, normal, roughness) * light.color * attenuation * surfaceColor;
     
-    float3 result = surfaceColor * diffuse + specular; // Dont tint specular?
+    float3 result = surfaceColor * diffuse + specular; // Don't tint specular?
     return result;
 }
 
-float3 CalcSpotLight(Light light, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
+float3 CalcSpotLight(PackedLight light, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
 {
-    float3 lightToPixel = normalize(light.position - worldPos);
-    //float3 lightDir = normalize(light.direction);
-    
+    float3 pixelToLight = normalize(light.position - worldPos);
     
-    // Get cos(angle) between pixel and light direction
-    float pixelAngle = saturate(dot(-lightToPixel, light.direction));
-    // Get cosines of angles and calculate range
-    float cosOuter = cos(light.spotOuterAngle);
-    float cosInner = cos(light.spotInnerAngle);
-    float falloffRange = cosOuter - cosInner;
-    // Linear falloff over the range, clamp 0-1, apply to light calc
-    float spotTerm = saturate((cosOuter - pixelAngle) / falloffRange);
+    // Get cos(angle) between pixel and light direction, then
+    // remap it with the precomputed falloff (linear, clamped 0-1)
+    float pixelAngle = saturate(dot(-pixelToLight, light.direction));
+    float spotTerm = saturate(pixelAngle * light.spotScale + light.spotOffset);
     float3 color = CalcPointLight(light, normal, worldPos, camPos, surfaceColor, roughness) * spotTerm ;
     
     return color;
 
 }
 
-#endif
\ No newline at end of file
+// One object's most important point and spot lights
+// - Must match ObjectLightList in ObjectLightLists.h
+struct ObjectLightList
+{
+    uint pointCount;
+    float3 foldedLight;
+    uint spotCount; // Spot indices follow the point ones
+    uint3 padding;
+    uint indices[MAX_OBJECT_LIGHTS];
+};
+
+// Finds the light cluster a pixel falls in, from its screen position
+// and view space depth.  Must match the layout in LightClusters.cpp
+uint GetClusterIndex(float2 pixelPosition, float viewDepth, float2 screenSize, float sliceScale, float sliceBias)
+{
+    uint x = min((uint)(pixelPosition.x / screenSize.x * LIGHT_CLUSTER_COUNT_X), LIGHT_CLUSTER_COUNT_X - 1);
+    uint y = min((uint)(pixelPosition.y / screenSize.y * LIGHT_CLUSTER_COUNT_Y), LIGHT_CLUSTER_COUNT_Y - 1);
+    uint z = (uint)clamp(log(viewDepth) * sliceScale + sliceBias, 0, LIGHT_CLUSTER_COUNT_Z - 1);
+    return (z * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X + x;
+}
+
+// Unit normal to two [-1, 1] values, by folding an octahedron
+// flat.  Fits an R16G16_SNORM target with very little error.
+float2 EncodeOctahedralNormal(float3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx)) * (n.xy >= 0.0f ? 1.0f : -1.0f);
+    return n.xy;
+}
+
+float3 DecodeOctahedralNormal(float2 e)
+{
+    float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += (n.xy >= 0.0f ? -t : t);
+    return normalize(n);
+}
+
+// World position of a pixel from its linear view depth, undoing the
+// projection's scale and then the view's rotation and translation
+float3 ReconstructWorldPosition(float2 pixelPosition, float viewDepth, float2 screenSize, matrix view, matrix projection, float3 cameraPosition)
+{
+    float2 ndc = float2(pixelPosition.x / screenSize.x * 2.0f - 1.0f, 1.0f - pixelPosition.y / screenSize.y * 2.0f);
+    float3 viewPosition = float3(ndc.x / projection[0][0], ndc.y / projection[1][1], 1.0f) * viewDepth;
+    return cameraPosition + viewPosition.x * view[0].xyz + viewPosition.y * view[1].xyz + viewPosition.z * view[2].xyz;
+}
+
+// Diffuse irradiance from the baked SH (already divided by pi,
+// so this just gets multiplied by the albedo)
+float3 EvaluateIrradianceSH(float4 sh[IBL_SH_COEFFICIENT_COUNT], float3 n)
+{
+    float3 result =
+        sh[0].rgb * 0.282095f +
+        sh[1].rgb * 0.488603f * n.y +
+        sh[2].rgb * 0.488603f * n.z +
+        sh[3].rgb * 0.488603f * n.x +
+        sh[4].rgb * 1.092548f * n.x * n.y +
+        sh[5].rgb * 1.092548f * n.y * n.z +
+        sh[6].rgb * 0.315392f * (3.0f * n.z * n.z - 1.0f) +
+        sh[7].rgb * 1.092548f * n.x * n.z +
+        sh[8].rgb * 0.546274f * (n.x * n.x - n.y * n.y);
+    return max(result, 0.0f);
+}
+
+// Ambient light from the sky, baked by IBLBaker: SH diffuse plus
+// the prefiltered cube and BRDF table for specular (split sum).
+// Materials have no metalness, so F0 is the usual dielectric 0.04.
+float3 CalcImageBasedLight(float4 sh[IBL_SH_COEFFICIENT_COUNT], TextureCube specularMap, Texture2D brdfMap, SamplerState clampSampler,
+    float mipCount, float3 normal, float3 worldPos, float3 camPos, float3 surfaceColor, float roughness)
+{
+    float3 toCamera = normalize(camPos - worldPos);
+    float3 reflected = reflect(-toCamera, normal);
+    float nDotV = saturate(dot(normal, toCamera));
+
+    float3 prefiltered = specularMap.SampleLevel(clampSampler, reflected, roughness * (mipCount - 1.0f)).rgb;
+    float2 brdf = brdfMap.SampleLevel(clampSampler, float2(nDotV, roughness), 0).rg;
+
+    return EvaluateIrradianceSH(sh, normal) * surfaceColor + prefiltered * (0.04f * brdf.x + brdf.y);
+}
+
+#endif
@@ -0,0 +1,534 @@
+#include "ShaderLibrary.h"
+#include "ShaderArchive.h"
+#include "PathHelpers.h"
+#include "Graphics.h"
+#include "Profiler.h"
+
+#include <Windows.h>
+#include <d3dcompiler.h>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#pragma comment(lib, "d3dcompiler.lib")
+
+namespace ShaderLibrary
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		struct Variant
+		{
+			Microsoft::WRL::ComPtr<ID3DBlob> byteCode; // Only kept for vertex shaders
+			Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader;
+			Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader;
+		};
+
+		std::wstring sourceDirectory;
+		std::wstring compiledDirectory;
+
+		// Every shader handed out so far, prebuilt or compiled
+		std::unordered_map<std::wstring, Variant> variants;
+		std::unordered_map<uint64_t, Microsoft::WRL::ComPtr<ID3D11InputLayout>> inputLayouts;
+
+		// The packed prebuilt shaders, either mapped from disk
+		// or (right after a rebuild) held in memory
+		ShaderArchive archive;
+		HANDLE archiveFile = INVALID_HANDLE_VALUE;
+		HANDLE archiveMapping = 0;
+		const void* archiveView = 0;
+		std::vector<uint8_t> archiveBytes;
+
+		// Variants compiled this run, added to the archive at shut down
+		std::vector<std::pair<std::string, std::vector<uint8_t>>> compiledVariants;
+
+		unsigned int shaderCount = 0;
+		unsigned int variantCount = 0;
+		unsigned int compileCount = 0;
+		float compileMilliseconds = 0.0f;
+		unsigned int fileOpenCount = 0;
+		unsigned long long bytesRead = 0;
+
+		const wchar_t* ArchiveFileName = L"Shaders.pack";
+
+		std::wstring WithTrailingSlash(const std::wstring& directory)
+		{
+			if (!directory.empty() && directory.back() != L'/' && directory.back() != L'\\')
+				return directory + L'/';
+			return directory;
+		}
+
+		// Every file the library reads goes through here so it can be counted
+		bool ReadWholeFile(const std::wstring& path, std::vector<uint8_t>& bytes)
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			fileOpenCount++;
+			if (!file)
+				return false;
+
+			bytes.resize((size_t)file.tellg());
+			file.seekg(0);
+			file.read((char*)bytes.data(), bytes.size());
+			bytesRead += bytes.size();
+			return true;
+		}
+
+		// Resolves #includes from the source directory, counting each read
+		class CountingInclude : public ID3DInclude
+		{
+		public:
+			HRESULT __stdcall Open(D3D_INCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* sizeInBytes) override
+			{
+				std::vector<uint8_t> bytes;
+				if (!ReadWholeFile(sourceDirectory + NarrowToWide(fileName), bytes))
+					return E_FAIL;
+
+				uint8_t* copy = new uint8_t[bytes.size()];
+				memcpy(copy, bytes.data(), bytes.size());
+				*data = copy;
+				*sizeInBytes = (UINT)bytes.size();
+				return S_OK;
+			}
+
+			HRESULT __stdcall Close(LPCVOID data) override
+			{
+				delete[] static_cast<const uint8_t*>(data);
+				return S_OK;
+			}
+		};
+
+		// One string per variant, e.g. "PixelShader.hlsl|1b|2".
+		// Prebuilt shaders just use their file name.
+		std::wstring MakeKey(const std::wstring& fileName, unsigned int features, unsigned int directionalLightCount)
+		{
+			wchar_t suffix[32];
+			swprintf_s(suffix, L"|%x|%u", features, directionalLightCount);
+			return fileName + suffix;
+		}
+
+		// --------------------------------------------------------
+		// Packs every .cso next to the executable into one archive
+		// if the archive is missing or older than any of them, then
+		// opens it.  After a rebuild the packed bytes are used as-is
+		// instead of reading the file straight back.
+		//
+		// Edited sources also count as newer, since the variants
+		// cached in the archive were compiled from the old ones.
+		// Rebuilding drops those variants.
+		// --------------------------------------------------------
+		void LoadArchive()
+		{
+			namespace fs = std::filesystem;
+			std::error_code error;
+
+			fs::path archivePath = compiledDirectory + ArchiveFileName;
+			bool stale = !fs::exists(archivePath, error);
+			fs::file_time_type archiveTime = stale ? fs::file_time_type() : fs::last_write_time(archivePath, error);
+
+			std::vector<fs::path> compiledFiles;
+			for (const fs::directory_entry& entry : fs::directory_iterator(compiledDirectory, error))
+			{
+				if (entry.path().extension() != L".cso")
+					continue;
+				compiledFiles.push_back(entry.path());
+				if (!stale && entry.last_write_time(error) > archiveTime)
+					stale = true;
+			}
+			for (const fs::directory_entry& entry : fs::directory_iterator(sourceDirectory, error))
+			{
+				fs::path extension = entry.path().extension();
+				if (!stale && (extension == L".hlsl" || extension == L".hlsli") && entry.last_write_time(error) > archiveTime)
+					stale = true;
+			}
+
+			if (stale && !compiledFiles.empty())
+			{
+				std::vector<std::pair<std::string, std::vector<uint8_t>>> shaders;
+				for (const fs::path& path : compiledFiles)
+				{
+					std::vector<uint8_t> bytes;
+					if (ReadWholeFile(path.wstring(), bytes))
+						shaders.push_back({ WideToNarrow(path.filename().wstring()), std::move(bytes) });
+				}
+
+				archiveBytes = ShaderArchive::Pack(shaders);
+				std::ofstream file(archivePath, std::ios::binary | std::ios::trunc);
+				file.write((const char*)archiveBytes.data(), archiveBytes.size());
+
+				archive.Open(archiveBytes.data(), archiveBytes.size());
+				return;
+			}
+
+			// Up to date, so map it and let the OS page in only what's used
+			archiveFile = CreateFileW(archivePath.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+			fileOpenCount++;
+			if (archiveFile == INVALID_HANDLE_VALUE)
+				return;
+
+			LARGE_INTEGER size = {};
+			GetFileSizeEx(archiveFile, &size);
+			archiveMapping = CreateFileMappingW(archiveFile, 0, PAGE_READONLY, 0, 0, 0);
+			if (archiveMapping)
+				archiveView = MapViewOfFile(archiveMapping, FILE_MAP_READ, 0, 0, 0);
+
+			if (!archive.Open(archiveView, (size_t)size.QuadPart))
+				printf("\x1B[91mShader archive %ls is invalid\x1B[0m\n", archivePath.c_str());
+			else
+				bytesRead += archive.GetIndexSizeInBytes();
+		}
+
+		// --------------------------------------------------------
+		// Creates a prebuilt shader from the archive, or from its
+		// own .cso file if the archive doesn't have it
+		// --------------------------------------------------------
+		Variant& LoadPrebuilt(const std::wstring& fileName, bool vertexShader)
+		{
+			auto it = variants.find(fileName);
+			if (it != variants.end())
+				return it->second;
+
+			Variant& variant = variants[fileName];
+
+			const void* byteCode = 0;
+			size_t byteCodeSize = 0;
+			std::vector<uint8_t> fileBytes;
+			if (archive.Find(WideToNarrow(fileName).c_str(), &byteCode, &byteCodeSize))
+			{
+				bytesRead += byteCodeSize;
+			}
+			else if (ReadWholeFile(compiledDirectory + fileName, fileBytes))
+			{
+				byteCode = fileBytes.data();
+				byteCodeSize = fileBytes.size();
+			}
+			else
+			{
+				printf("\x1B[91mShader %ls not found\x1B[0m\n", fileName.c_str());
+				return variant;
+			}
+
+			if (vertexShader)
+			{
+				D3DCreateBlob(byteCodeSize, variant.byteCode.GetAddressOf());
+				memcpy(variant.byteCode->GetBufferPointer(), byteCode, byteCodeSize);
+				Graphics::Device->CreateVertexShader(byteCode, byteCodeSize, 0, variant.vertexShader.GetAddressOf());
+			}
+			else
+			{
+				Graphics::Device->CreatePixelShader(byteCode, byteCodeSize, 0, variant.pixelShader.GetAddressOf());
+			}
+			shaderCount++;
+			return variant;
+		}
+
+		// Compiles one variant, returning null byte code on failure.
+		// Failures are cached as well so they're only reported once.
+		Microsoft::WRL::ComPtr<ID3DBlob> Compile(
+			const std::wstring& fileName,
+			const char* target,
+			unsigned int features,
+			unsigned int directionalLightCount)
+		{
+			PROFILE_SCOPE("Compile shader");
+
+			// Number strings must outlive the compile call
+			char directionalCountString[16];
+			sprintf_s(directionalCountString, "%u", directionalLightCount);
+
+			std::vector<D3D_SHADER_MACRO> defines;
+			defines.push_back({ "SHADER_PERMUTATION", "1" });
+			if (features & SHADER_FEATURE_TEXTURE)				defines.push_back({ "USE_TEXTURE", "1" });
+			if (features & SHADER_FEATURE_NORMAL_MAP)			defines.push_back({ "USE_NORMAL_MAP", "1" });
+			if (features & SHADER_FEATURE_DRAW_TABLE)			defines.push_back({ "USE_DRAW_TABLE", "1" });
+			if (features & SHADER_FEATURE_POINT_LIGHTS)			defines.push_back({ "USE_POINT_LIGHTS", "1" });
+			if (features & SHADER_FEATURE_SPOT_LIGHTS)			defines.push_back({ "USE_SPOT_LIGHTS", "1" });
+			if (features & SHADER_FEATURE_OBJECT_LIGHT_LISTS)	defines.push_back({ "USE_OBJECT_LIGHT_LISTS", "1" });
+			if (features & SHADER_FEATURE_TEXTURE_ARRAYS)		defines.push_back({ "USE_TEXTURE_ARRAYS", "1" });
+			defines.push_back({ "DIRECTIONAL_LIGHT_COUNT", directionalCountString });
+			defines.push_back({ 0, 0 });
+
+			UINT flags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#if defined(DEBUG) || defined(_DEBUG)
+			flags |= D3DCOMPILE_DEBUG;
+#endif
+
+			auto start = std::chrono::high_resolution_clock::now();
+			compileCount++;
+
+			std::vector<uint8_t> source;
+			if (!ReadWholeFile(sourceDirectory + fileName, source))
+			{
+				printf("\x1B[91mShader source %ls not found\x1B[0m\n", fileName.c_str());
+				return nullptr;
+			}
+
+			CountingInclude includes;
+			std::string sourceName = WideToNarrow(fileName);
+			Microsoft::WRL::ComPtr<ID3DBlob> byteCode;
+			Microsoft::WRL::ComPtr<ID3DBlob> errors;
+			HRESULT hr = D3DCompile(
+				source.data(),
+				source.size(),
+				sourceName.c_str(),		// Used in error messages
+				defines.data(),
+				&includes,
+				"main",
+				target,
+				flags,
+				0,
+				byteCode.GetAddressOf(),
+				errors.GetAddressOf());
+
+			compileMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if (FAILED(hr))
+			{
+				printf("\x1B[91mShader variant %ls (features 0x%x) failed to compile\n", fileName.c_str(), features);
+				if (errors)
+					printf("%s\n", (const char*)errors->GetBufferPointer());
+				printf("\x1B[0m");
+				return nullptr;
+			}
+
+			return byteCode;
+		}
+
+		// --------------------------------------------------------
+		// Byte code for one variant: from the archive if an earlier
+		// run compiled it, otherwise compiled now and queued to go
+		// into the archive
+		// --------------------------------------------------------
+		Microsoft::WRL::ComPtr<ID3DBlob> GetVariantByteCode(
+			const std::wstring& key,
+			const std::wstring& fileName,
+			const char* target,
+			unsigned int features,
+			unsigned int directionalLightCount)
+		{
+			std::string name = WideToNarrow(key);
+			Microsoft::WRL::ComPtr<ID3DBlob> byteCode;
+
+			const void* cached = 0;
+			size_t cachedSize = 0;
+			if (archive.Find(name.c_str(), &cached, &cachedSize))
+			{
+				bytesRead += cachedSize;
+				D3DCreateBlob(cachedSize, byteCode.GetAddressOf());
+				memcpy(byteCode->GetBufferPointer(), cached, cachedSize);
+				return byteCode;
+			}
+
+			// Names the archive would cut short could collide, so those aren't cached
+			byteCode = Compile(fileName, target, features, directionalLightCount);
+			if (byteCode && name.size() < SHADER_ARCHIVE_NAME_LENGTH)
+			{
+				const uint8_t* bytes = static_cast<const uint8_t*>(byteCode->GetBufferPointer());
+				compiledVariants.push_back({ name, std::vector<uint8_t>(bytes, bytes + byteCode->GetBufferSize()) });
+			}
+			return byteCode;
+		}
+
+		// --------------------------------------------------------
+		// Everything in the archive plus this run's variants, copied
+		// out so the archive can be closed before it's overwritten
+		// --------------------------------------------------------
+		std::vector<std::pair<std::string, std::vector<uint8_t>>> GatherArchiveWithVariants()
+		{
+			std::vector<std::pair<std::string, std::vector<uint8_t>>> shaders;
+			for (unsigned int i = 0; i < archive.GetEntryCount(); i++)
+			{
+				const char* name = 0;
+				const void* byteCode = 0;
+				size_t byteCodeSize = 0;
+				archive.GetEntry(i, &name, &byteCode, &byteCodeSize);
+
+				const uint8_t* bytes = static_cast<const uint8_t*>(byteCode);
+				shaders.push_back({ std::string(name, strnlen(name, SHADER_ARCHIVE_NAME_LENGTH)), std::vector<uint8_t>(bytes, bytes + byteCodeSize) });
+			}
+			for (auto& variant : compiledVariants)
+				shaders.push_back(std::move(variant));
+			return shaders;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Sets where shader source files are read from and where the
+// prebuilt .cso files live, then opens (or rebuilds) the
+// packed archive of prebuilt shaders
+// --------------------------------------------------------
+void ShaderLibrary::Initialize(const std::wstring& sources, const std::wstring& compiled)
+{
+	sourceDirectory = WithTrailingSlash(sources);
+	compiledDirectory = WithTrailingSlash(compiled);
+
+	// Not fatal: variants cached in the archive don't need them
+	std::error_code error;
+	if (!std::filesystem::is_directory(sourceDirectory, error))
+		printf("\x1B[93mShader sources not found in %ls, so only variants already in the archive are available\x1B[0m\n", sourceDirectory.c_str());
+
+	fileOpenCount = 0;
+	bytesRead = 0;
+	LoadArchive();
+}
+
+void ShaderLibrary::ShutDown()
+{
+	variants.clear();
+	inputLayouts.clear();
+	shaderCount = 0;
+	variantCount = 0;
+
+	// Only rewritten when this run compiled something new
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> shaders;
+	if (!compiledVariants.empty())
+		shaders = GatherArchiveWithVariants();
+	compiledVariants.clear();
+
+	archive.Close();
+	archiveBytes.clear();
+	if (archiveView)
+		UnmapViewOfFile(archiveView);
+	if (archiveMapping)
+		CloseHandle(archiveMapping);
+	if (archiveFile != INVALID_HANDLE_VALUE)
+		CloseHandle(archiveFile);
+	archiveView = 0;
+	archiveMapping = 0;
+	archiveFile = INVALID_HANDLE_VALUE;
+
+	if (!shaders.empty())
+	{
+		std::vector<uint8_t> bytes = ShaderArchive::Pack(shaders);
+		std::ofstream file(std::filesystem::path(compiledDirectory + ArchiveFileName), std::ios::binary | std::ios::trunc);
+		file.write((const char*)bytes.data(), bytes.size());
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D11VertexShader> ShaderLibrary::LoadVertexShader(const std::wstring& fileName)
+{
+	return LoadPrebuilt(fileName, true).vertexShader;
+}
+
+Microsoft::WRL::ComPtr<ID3D11PixelShader> ShaderLibrary::LoadPixelShader(const std::wstring& fileName)
+{
+	return LoadPrebuilt(fileName, false).pixelShader;
+}
+
+Microsoft::WRL::ComPtr<ID3D11VertexShader> ShaderLibrary::GetVertexShader(const std::wstring& fileName, unsigned int features)
+{
+	std::wstring key = MakeKey(fileName, features, 0);
+	auto it = variants.find(key);
+	if (it != variants.end())
+		return it->second.vertexShader;
+
+	Variant& variant = variants[key];
+	variant.byteCode = GetVariantByteCode(key, fileName, "vs_5_0", features, 0);
+	if (variant.byteCode)
+	{
+		Graphics::Device->CreateVertexShader(
+			variant.byteCode->GetBufferPointer(),
+			variant.byteCode->GetBufferSize(),
+			0,
+			variant.vertexShader.GetAddressOf());
+		variantCount++;
+	}
+	return variant.vertexShader;
+}
+
+Microsoft::WRL::ComPtr<ID3D11PixelShader> ShaderLibrary::GetPixelShader(const std::wstring& fileName, unsigned int features, unsigned int directionalLightCount)
+{
+	std::wstring key = MakeKey(fileName, features, directionalLightCount);
+	auto it = variants.find(key);
+	if (it != variants.end())
+		return it->second.pixelShader;
+
+	Variant& variant = variants[key];
+	Microsoft::WRL::ComPtr<ID3DBlob> byteCode = GetVariantByteCode(key, fileName, "ps_5_0", features, directionalLightCount);
+	if (byteCode)
+	{
+		Graphics::Device->CreatePixelShader(
+			byteCode->GetBufferPointer(),
+			byteCode->GetBufferSize(),
+			0,
+			variant.pixelShader.GetAddressOf());
+		variantCount++;
+	}
+	return variant.pixelShader;
+}
+
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderLibrary::GetVertexShaderByteCode(const std::wstring& fileName)
+{
+	return LoadPrebuilt(fileName, true).byteCode;
+}
+
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderLibrary::GetVertexShaderByteCode(const std::wstring& fileName, unsigned int features)
+{
+	// Makes sure the variant exists first
+	GetVertexShader(fileName, features);
+	return variants[MakeKey(fileName, features, 0)].byteCode;
+}
+
+// --------------------------------------------------------
+// Input layouts are keyed by a hash of the element list and
+// a hash of the shader's input signature, so any number of
+// shaders reading the same vertex format share one layout
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11InputLayout> ShaderLibrary::GetInputLayout(
+	const D3D11_INPUT_ELEMENT_DESC* elements,
+	unsigned int elementCount,
+	ID3DBlob* vertexShaderByteCode)
+{
+	if (!vertexShaderByteCode)
+		return nullptr;
+
+	uint32_t formatHash = 0;
+	for (unsigned int i = 0; i < elementCount; i++)
+	{
+		const D3D11_INPUT_ELEMENT_DESC& element = elements[i];
+		uint32_t fields[] = {
+			ShaderArchive::Hash(element.SemanticName, strlen(element.SemanticName)),
+			element.SemanticIndex,
+			(uint32_t)element.Format,
+			element.InputSlot,
+			element.AlignedByteOffset,
+			(uint32_t)element.InputSlotClass,
+			element.InstanceDataStepRate,
+			formatHash };
+		formatHash = ShaderArchive::Hash(fields, sizeof(fields));
+	}
+
+	Microsoft::WRL::ComPtr<ID3DBlob> signature;
+	if (FAILED(D3DGetInputSignatureBlob(vertexShaderByteCode->GetBufferPointer(), vertexShaderByteCode->GetBufferSize(), signature.GetAddressOf())))
+		return nullptr;
+	uint32_t signatureHash = ShaderArchive::Hash(signature->GetBufferPointer(), signature->GetBufferSize());
+
+	uint64_t key = ((uint64_t)formatHash << 32) | signatureHash;
+	auto it = inputLayouts.find(key);
+	if (it != inputLayouts.end())
+		return it->second;
+
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> layout;
+	Graphics::Device->CreateInputLayout(
+		elements,
+		elementCount,
+		vertexShaderByteCode->GetBufferPointer(),
+		vertexShaderByteCode->GetBufferSize(),
+		layout.GetAddressOf());
+	inputLayouts[key] = layout;
+	return layout;
+}
+
+unsigned int ShaderLibrary::ShaderCount() { return shaderCount; }
+unsigned int ShaderLibrary::VariantCount() { return variantCount; }
+unsigned int ShaderLibrary::CompileCount() { return compileCount; }
+unsigned int ShaderLibrary::InputLayoutCount() { return (unsigned int)inputLayouts.size(); }
+float ShaderLibrary::TotalCompileMilliseconds() { return compileMilliseconds; }
+unsigned int ShaderLibrary::FileOpenCount() { return fileOpenCount; }
+unsigned long long ShaderLibrary::BytesRead() { return bytesRead; }
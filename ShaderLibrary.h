@@ -0,0 +1,79 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <string>
+
+// --------------------------------------------------------
+// Feature bits used to specialize a shader.  Each one turns
+// on a matching #define when a variant is compiled, so code
+// for features a material doesn't use is never generated.
+// --------------------------------------------------------
+enum ShaderFeature : unsigned int
+{
+	SHADER_FEATURE_TEXTURE				= 1 << 0, // USE_TEXTURE
+	SHADER_FEATURE_NORMAL_MAP			= 1 << 1, // USE_NORMAL_MAP
+	SHADER_FEATURE_DRAW_TABLE			= 1 << 2, // USE_DRAW_TABLE
+	SHADER_FEATURE_POINT_LIGHTS			= 1 << 3, // USE_POINT_LIGHTS
+	SHADER_FEATURE_SPOT_LIGHTS			= 1 << 4, // USE_SPOT_LIGHTS
+	SHADER_FEATURE_OBJECT_LIGHT_LISTS	= 1 << 5, // USE_OBJECT_LIGHT_LISTS
+	SHADER_FEATURE_TEXTURE_ARRAYS		= 1 << 6, // USE_TEXTURE_ARRAYS
+};
+
+// --------------------------------------------------------
+// Owns every shader object in the program, each created once.
+//
+// Prebuilt shaders (the .cso files Visual Studio compiles) are
+// read from a single packed archive (see ShaderArchive) that
+// is memory-mapped at startup.  The archive is rebuilt from
+// the .cso files whenever any of them, or any shader source,
+// is newer than it.
+//
+// Specialized variants are compiled from source on first
+// request and kept for the rest of the run.  A variant is
+// keyed by its source file, feature bits and directional
+// light count (which is baked in so that loop can be unrolled).
+// Variants compiled during a run are added to the archive at
+// shut down, so later runs create them straight from it and
+// only need the sources for variants they haven't seen yet.
+//
+// Errors are printed to the console and the request returns
+// null, so callers can keep whatever shader they already had.
+// --------------------------------------------------------
+namespace ShaderLibrary
+{
+	// General functions
+	void Initialize(const std::wstring& sourceDirectory, const std::wstring& compiledDirectory);
+	void ShutDown();
+
+	// Prebuilt shaders by file name, e.g. L"VertexShader.cso"
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> LoadVertexShader(const std::wstring& fileName);
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> LoadPixelShader(const std::wstring& fileName);
+
+	// Variant lookup, compiling on a miss
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> GetVertexShader(const std::wstring& fileName, unsigned int features);
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetPixelShader(const std::wstring& fileName, unsigned int features, unsigned int directionalLightCount = 0);
+
+	// Byte code of a vertex shader, prebuilt or variant, for input layouts
+	Microsoft::WRL::ComPtr<ID3DBlob> GetVertexShaderByteCode(const std::wstring& fileName);
+	Microsoft::WRL::ComPtr<ID3DBlob> GetVertexShaderByteCode(const std::wstring& fileName, unsigned int features);
+
+	// Input layouts, shared by every shader with the same vertex
+	// format and input signature
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout(
+		const D3D11_INPUT_ELEMENT_DESC* elements,
+		unsigned int elementCount,
+		ID3DBlob* vertexShaderByteCode);
+
+	// Getters
+	unsigned int ShaderCount();
+	unsigned int VariantCount();
+	unsigned int CompileCount();
+	unsigned int InputLayoutCount();
+	float TotalCompileMilliseconds();
+
+	// File access since Initialize(), including source files
+	// and includes read for runtime compiles
+	unsigned int FileOpenCount();
+	unsigned long long BytesRead();
+}
@@ -17,6 +17,8 @@ private:
 
 	std::shared_ptr<Mesh> skyMesh;
 
+	void CreateStates();
+
 	// Helper for creating a cubemap from 6 individual textures
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
 		const wchar_t* right,
@@ -42,8 +44,19 @@ public:
 		std::shared_ptr<Mesh> mesh
 		);
 
+	// From a cube map that's already been made (or is still loading)
+	Sky(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS,
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS,
+		std::shared_ptr<Mesh> mesh
+		);
+
 	~Sky();
 
+	void SetCubemap(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap);
+
 	void Draw(std::shared_ptr<Camera> cam);
 };
 
@@ -0,0 +1,145 @@
+#include "StateCache.h"
+#include "ShaderArchive.h"
+#include "Graphics.h"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace StateCache
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		template<typename Desc, typename State>
+		struct Entry
+		{
+			Desc desc;
+			Microsoft::WRL::ComPtr<State> state;
+		};
+
+		// Several entries per hash in the unlikely case of a collision
+		std::unordered_multimap<uint32_t, Entry<D3D11_SAMPLER_DESC, ID3D11SamplerState>> samplerStates;
+		std::unordered_multimap<uint32_t, Entry<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>> rasterizerStates;
+		std::unordered_multimap<uint32_t, Entry<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>> depthStencilStates;
+		std::unordered_multimap<uint32_t, Entry<D3D11_BLEND_DESC, ID3D11BlendState>> blendStates;
+
+		unsigned int createCount = 0;
+		unsigned int requestCount = 0;
+		unsigned int hitCount = 0;
+
+		// --------------------------------------------------------
+		// Finds a description's state, or creates and keeps it.
+		// - desc must have no uninitialized padding, since it's
+		//   hashed and compared as bytes
+		// --------------------------------------------------------
+		template<typename Desc, typename State, typename CreateFunction>
+		Microsoft::WRL::ComPtr<State> Find(
+			std::unordered_multimap<uint32_t, Entry<Desc, State>>& states,
+			const Desc& desc,
+			CreateFunction create)
+		{
+			requestCount++;
+
+			uint32_t hash = ShaderArchive::Hash(&desc, sizeof(Desc));
+			auto range = states.equal_range(hash);
+			for (auto it = range.first; it != range.second; it++)
+			{
+				if (!memcmp(&it->second.desc, &desc, sizeof(Desc)))
+				{
+					hitCount++;
+					return it->second.state;
+				}
+			}
+
+			Microsoft::WRL::ComPtr<State> state;
+			if (FAILED(create(&desc, state.GetAddressOf())))
+				return nullptr;
+
+			createCount++;
+			states.insert({ hash, { desc, state } });
+			return state;
+		}
+
+		// Depth stencil and blend descriptions have padding after their
+		// UINT8 fields, so they're copied field by field into zeroed ones
+		D3D11_DEPTH_STENCIL_DESC Normalize(const D3D11_DEPTH_STENCIL_DESC& desc)
+		{
+			D3D11_DEPTH_STENCIL_DESC normalized;
+			memset(&normalized, 0, sizeof(normalized));
+			normalized.DepthEnable = desc.DepthEnable;
+			normalized.DepthWriteMask = desc.DepthWriteMask;
+			normalized.DepthFunc = desc.DepthFunc;
+			normalized.StencilEnable = desc.StencilEnable;
+			normalized.StencilReadMask = desc.StencilReadMask;
+			normalized.StencilWriteMask = desc.StencilWriteMask;
+			normalized.FrontFace = desc.FrontFace;
+			normalized.BackFace = desc.BackFace;
+			return normalized;
+		}
+
+		D3D11_BLEND_DESC Normalize(const D3D11_BLEND_DESC& desc)
+		{
+			D3D11_BLEND_DESC normalized;
+			memset(&normalized, 0, sizeof(normalized));
+			normalized.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+			normalized.IndependentBlendEnable = desc.IndependentBlendEnable;
+
+			// Only the first target counts unless they blend independently
+			unsigned int targetCount = desc.IndependentBlendEnable ? D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT : 1;
+			for (unsigned int i = 0; i < targetCount; i++)
+			{
+				const D3D11_RENDER_TARGET_BLEND_DESC& target = desc.RenderTarget[i];
+				normalized.RenderTarget[i].BlendEnable = target.BlendEnable;
+				normalized.RenderTarget[i].SrcBlend = target.SrcBlend;
+				normalized.RenderTarget[i].DestBlend = target.DestBlend;
+				normalized.RenderTarget[i].BlendOp = target.BlendOp;
+				normalized.RenderTarget[i].SrcBlendAlpha = target.SrcBlendAlpha;
+				normalized.RenderTarget[i].DestBlendAlpha = target.DestBlendAlpha;
+				normalized.RenderTarget[i].BlendOpAlpha = target.BlendOpAlpha;
+				normalized.RenderTarget[i].RenderTargetWriteMask = target.RenderTargetWriteMask;
+			}
+			return normalized;
+		}
+	}
+}
+
+void StateCache::ShutDown()
+{
+	samplerStates.clear();
+	rasterizerStates.clear();
+	depthStencilStates.clear();
+	blendStates.clear();
+	createCount = 0;
+	requestCount = 0;
+	hitCount = 0;
+}
+
+Microsoft::WRL::ComPtr<ID3D11SamplerState> StateCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	return Find(samplerStates, desc, [](const D3D11_SAMPLER_DESC* d, ID3D11SamplerState** state) {
+		return Graphics::Device->CreateSamplerState(d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11RasterizerState> StateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	return Find(rasterizerStates, desc, [](const D3D11_RASTERIZER_DESC* d, ID3D11RasterizerState** state) {
+		return Graphics::Device->CreateRasterizerState(d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11DepthStencilState> StateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	return Find(depthStencilStates, Normalize(desc), [](const D3D11_DEPTH_STENCIL_DESC* d, ID3D11DepthStencilState** state) {
+		return Graphics::Device->CreateDepthStencilState(d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11BlendState> StateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	return Find(blendStates, Normalize(desc), [](const D3D11_BLEND_DESC* d, ID3D11BlendState** state) {
+		return Graphics::Device->CreateBlendState(d, state); });
+}
+
+unsigned int StateCache::StateCount() { return (unsigned int)(samplerStates.size() + rasterizerStates.size() + depthStencilStates.size() + blendStates.size()); }
+unsigned int StateCache::CreateCount() { return createCount; }
+unsigned int StateCache::RequestCount() { return requestCount; }
+float StateCache::HitRate() { return requestCount ? (float)hitCount / requestCount : 0.0f; }
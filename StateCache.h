@@ -0,0 +1,30 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// Shares immutable pipeline state objects: asking twice for
+// the same description returns the same object, so identical
+// states from different materials or passes compare equal by
+// pointer.  Descriptions are keyed by a hash of their fields
+// and checked in full on a hit.
+//
+// Not thread safe - create states on the render thread (or
+// before any other thread starts).
+// --------------------------------------------------------
+namespace StateCache
+{
+	void ShutDown();
+
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11BlendState> GetBlendState(const D3D11_BLEND_DESC& desc);
+
+	// Getters
+	unsigned int StateCount();
+	unsigned int CreateCount();
+	unsigned int RequestCount();
+	float HitRate();
+}
@@ -0,0 +1,57 @@
+#include "StructuredBuffer.h"
+#include "Graphics.h"
+
+#include <cstring>
+
+StructuredBuffer::StructuredBuffer(unsigned int stride, unsigned int initialCapacity)
+{
+	this->stride = stride;
+	this->capacity = 0;
+	Create(initialCapacity > 0 ? initialCapacity : 1);
+}
+
+void StructuredBuffer::Create(unsigned int elementCount)
+{
+	// Dynamic, since the contents are replaced every upload
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = this->stride * elementCount;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = this->stride;
+	this->buffer.Reset();
+	Graphics::Device->CreateBuffer(&desc, 0, this->buffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = elementCount;
+	this->srv.Reset();
+	Graphics::Device->CreateShaderResourceView(this->buffer.Get(), &srvDesc, this->srv.GetAddressOf());
+
+	this->capacity = elementCount;
+}
+
+void StructuredBuffer::Upload(const void* data, unsigned int count)
+{
+	if (count > this->capacity)
+	{
+		unsigned int newCapacity = this->capacity;
+		while (newCapacity < count)
+			newCapacity *= 2;
+		Create(newCapacity);
+	}
+
+	if (count == 0)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped{};
+	Graphics::Context->Map(this->buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, data, (size_t)this->stride * count);
+	Graphics::Context->Unmap(this->buffer.Get(), 0);
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> StructuredBuffer::GetSRV() { return this->srv; }
+unsigned int StructuredBuffer::GetCapacity() { return this->capacity; }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// A dynamic structured buffer plus its shader resource view,
+// rewritten in full each time it's uploaded.  Grows (in
+// powers of two) when handed more elements than it holds.
+// --------------------------------------------------------
+class StructuredBuffer
+{
+private:
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	unsigned int stride;
+	unsigned int capacity;
+
+	void Create(unsigned int elementCount);
+
+public:
+	StructuredBuffer(unsigned int stride, unsigned int initialCapacity = 64);
+
+	// Copies count elements of stride bytes each to the GPU
+	void Upload(const void* data, unsigned int count);
+
+	// Getters
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+	unsigned int GetCapacity();
+};
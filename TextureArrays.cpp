@@ -0,0 +1,108 @@
+#include "TextureArrays.h"
+
+#include <algorithm>
+
+// ImGui builds its copy of stb_rect_pack as static functions,
+// so this file gets its own
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "ImGui/imstb_rectpack.h"
+
+// Packing works in whole alignment cells, which keeps every
+// entry aligned without stb_rect_pack knowing about it
+#define TEXTURE_ATLAS_CELLS (TEXTURE_ATLAS_SIZE / TEXTURE_ATLAS_ALIGNMENT)
+
+struct TextureArrays::AtlasPage
+{
+	stbrp_context context;
+	stbrp_node nodes[TEXTURE_ATLAS_CELLS];
+};
+
+TextureArrays::TextureArrays()
+{
+}
+
+TextureArrays::~TextureArrays()
+{
+}
+
+// --------------------------------------------------------
+// Small textures go in the first atlas page of their format
+// with room for them, full size ones in the next slice of the
+// array matching them exactly
+// --------------------------------------------------------
+TextureArrayLocation TextureArrays::Add(const TextureArrayKey& key)
+{
+	TextureArrayLocation location = {};
+	location.rect = DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+
+	if (std::max(key.width, key.height) > TEXTURE_ATLAS_MAX_SIZE)
+	{
+		location.array = FindArray(key, false);
+		location.slice = this->arrays[location.array].sliceCount++;
+		return location;
+	}
+
+	TextureArrayKey pageKey = { TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_MIPS, key.format };
+	location.array = FindArray(pageKey, true);
+	Array& atlas = this->arrays[location.array];
+
+	location.slice = 0;
+	while (location.slice < atlas.sliceCount && !PackIntoPage(*atlas.pages[location.slice], key.width, key.height, location.x, location.y))
+		location.slice++;
+
+	// Every page is full, so start another
+	if (location.slice == atlas.sliceCount)
+	{
+		std::unique_ptr<AtlasPage> page = std::make_unique<AtlasPage>();
+		stbrp_init_target(&page->context, TEXTURE_ATLAS_CELLS, TEXTURE_ATLAS_CELLS, page->nodes, TEXTURE_ATLAS_CELLS);
+		PackIntoPage(*page, key.width, key.height, location.x, location.y);
+		atlas.pages.push_back(std::move(page));
+		atlas.sliceCount++;
+	}
+
+	location.rect = DirectX::XMFLOAT4(
+		(location.x + 0.5f) / TEXTURE_ATLAS_SIZE,
+		(location.y + 0.5f) / TEXTURE_ATLAS_SIZE,
+		(key.width - 1.0f) / TEXTURE_ATLAS_SIZE,
+		(key.height - 1.0f) / TEXTURE_ATLAS_SIZE);
+	return location;
+}
+
+unsigned int TextureArrays::FindArray(const TextureArrayKey& key, bool atlas)
+{
+	for (unsigned int i = 0; i < this->arrays.size(); i++)
+	{
+		const Array& existing = this->arrays[i];
+		if (existing.atlas == atlas &&
+			existing.key.width == key.width &&
+			existing.key.height == key.height &&
+			existing.key.mipCount == key.mipCount &&
+			existing.key.format == key.format)
+			return i;
+	}
+
+	Array created = {};
+	created.key = key;
+	created.atlas = atlas;
+	this->arrays.push_back(std::move(created));
+	return (unsigned int)this->arrays.size() - 1;
+}
+
+bool TextureArrays::PackIntoPage(AtlasPage& page, unsigned int width, unsigned int height, unsigned int& x, unsigned int& y)
+{
+	stbrp_rect rect = {};
+	rect.w = (width + TEXTURE_ATLAS_ALIGNMENT - 1) / TEXTURE_ATLAS_ALIGNMENT;
+	rect.h = (height + TEXTURE_ATLAS_ALIGNMENT - 1) / TEXTURE_ATLAS_ALIGNMENT;
+	if (!stbrp_pack_rects(&page.context, &rect, 1))
+		return false;
+
+	x = rect.x * TEXTURE_ATLAS_ALIGNMENT;
+	y = rect.y * TEXTURE_ATLAS_ALIGNMENT;
+	return true;
+}
+
+unsigned int TextureArrays::GetArrayCount() const { return (unsigned int)this->arrays.size(); }
+const TextureArrayKey& TextureArrays::GetKey(unsigned int array) const { return this->arrays[array].key; }
+unsigned int TextureArrays::GetSliceCount(unsigned int array) const { return this->arrays[array].sliceCount; }
+bool TextureArrays::IsAtlas(unsigned int array) const { return this->arrays[array].atlas; }
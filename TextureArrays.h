@@ -0,0 +1,87 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+#define TEXTURE_ATLAS_SIZE 512			// Width and height of an atlas page
+#define TEXTURE_ATLAS_MIPS 4			// Mips kept in atlas pages
+#define TEXTURE_ATLAS_MAX_SIZE 128		// Textures this size or smaller go in an atlas
+
+// Atlas entries start and end on this many texels, so every kept mip
+// of every entry is whole 4x4 blocks (block compressed formats need it)
+#define TEXTURE_ATLAS_ALIGNMENT (4 << (TEXTURE_ATLAS_MIPS - 1))
+
+// Pixel shader registers for materials whose textures live in
+// arrays (see USE_TEXTURE_ARRAYS in PixelShader.hlsl)
+#define SURFACE_ARRAY_SLOT 4	// PS t4
+#define NORMAL_ARRAY_SLOT 5		// PS t5
+
+// Textures can share an array only if all of these match
+struct TextureArrayKey
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipCount;
+	unsigned int format;	// A DXGI_FORMAT, as far as this file cares just a number
+};
+
+// Where a texture ended up
+struct TextureArrayLocation
+{
+	unsigned int array;
+	unsigned int slice;
+	unsigned int x;		// Top left texel in the slice (0, 0 unless in an atlas)
+	unsigned int y;
+
+	// The texture's part of the slice in UVs: offset in xy, scale
+	// in zw.  Atlas entries are inset half a texel so bilinear
+	// filtering doesn't pick up their neighbors.
+	DirectX::XMFLOAT4 rect;
+};
+
+// --------------------------------------------------------
+// Decides which texture array slice each texture goes in, so
+// materials can share bindings instead of each binding their
+// own textures.
+//
+// Textures with the same size, format and mip count share an
+// array, one slice each.  Small ones are packed into atlas
+// pages instead (with stb_rect_pack, bundled with ImGui), and
+// those pages are slices of arrays of their own.  Arrays only
+// ever grow, so a location never changes once handed out.
+//
+// No graphics API here; D3D11TextureArrays does the copying.
+// --------------------------------------------------------
+class TextureArrays
+{
+private:
+	struct AtlasPage;
+
+	struct Array
+	{
+		TextureArrayKey key;
+		unsigned int sliceCount;
+		std::vector<std::unique_ptr<AtlasPage>> pages;	// Atlas arrays only, one per slice
+		bool atlas;
+	};
+
+	std::vector<Array> arrays;
+
+	unsigned int FindArray(const TextureArrayKey& key, bool atlas);
+	bool PackIntoPage(AtlasPage& page, unsigned int width, unsigned int height, unsigned int& x, unsigned int& y);
+
+public:
+	TextureArrays();
+	~TextureArrays();
+
+	// Finds a home for a texture: a slice of its own, or a spot in
+	// an atlas page if it's small enough
+	TextureArrayLocation Add(const TextureArrayKey& key);
+
+	// Getters
+	unsigned int GetArrayCount() const;
+	const TextureArrayKey& GetKey(unsigned int array) const;
+	unsigned int GetSliceCount(unsigned int array) const;
+	bool IsAtlas(unsigned int array) const;
+};
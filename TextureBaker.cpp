@@ -0,0 +1,759 @@
+#include "TextureBaker.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Annonymous namespace for the filter, the block encoders
+// and the DDS layout, only used in this file
+namespace
+{
+	// --------------------------------------------------------
+	// Mip filter: a Kaiser windowed sinc, 3 destination pixels
+	// wide on each side, applied separably with wrapping edges
+	// --------------------------------------------------------
+	const float FILTER_RADIUS = 3.0f;
+	const float KAISER_ALPHA = 4.0f;
+	const float PI = 3.14159265358979f;
+
+	// Zeroth order modified Bessel function (series form)
+	float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			float t = x / (2.0f * k);
+			term *= t * t;
+			sum += term;
+		}
+		return sum;
+	}
+
+	float FilterWeight(float x)
+	{
+		if (fabsf(x) >= FILTER_RADIUS)
+			return 0.0f;
+
+		float sinc = x == 0.0f ? 1.0f : sinf(PI * x) / (PI * x);
+		float r = x / FILTER_RADIUS;
+		float window = BesselI0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / BesselI0(KAISER_ALPHA);
+		return sinc * window;
+	}
+
+	struct FilterTap
+	{
+		unsigned int source;
+		float weight;
+	};
+
+	// Taps for each destination pixel along one axis
+	std::vector<std::vector<FilterTap>> BuildTaps(unsigned int sourceSize, unsigned int destSize)
+	{
+		std::vector<std::vector<FilterTap>> taps(destSize);
+		float scale = (float)sourceSize / destSize;
+		int reach = (int)ceilf(FILTER_RADIUS * scale);
+
+		for (unsigned int i = 0; i < destSize; i++)
+		{
+			float center = (i + 0.5f) * scale;
+			int first = (int)floorf(center) - reach;
+			float total = 0.0f;
+
+			for (int j = first; j <= first + reach * 2; j++)
+			{
+				float weight = FilterWeight((j + 0.5f - center) / scale);
+				if (weight == 0.0f)
+					continue;
+
+				int wrapped = j % (int)sourceSize;
+				if (wrapped < 0) wrapped += sourceSize;
+				taps[i].push_back({ (unsigned int)wrapped, weight });
+				total += weight;
+			}
+
+			for (FilterTap& tap : taps[i])
+				tap.weight /= total;
+		}
+		return taps;
+	}
+
+	float SRGBToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSRGB(float c)
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// --------------------------------------------------------
+	// Bit packing, least significant bit first (the order both
+	// BC7 and BC4/5 use)
+	// --------------------------------------------------------
+	void WriteBits(uint8_t* block, unsigned int& position, uint32_t value, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; i++, position++)
+		{
+			if ((value >> i) & 1)
+				block[position / 8] |= (uint8_t)(1 << (position % 8));
+		}
+	}
+
+	uint32_t ReadBits(const uint8_t* block, unsigned int& position, unsigned int count)
+	{
+		uint32_t value = 0;
+		for (unsigned int i = 0; i < count; i++, position++)
+			value |= (uint32_t)((block[position / 8] >> (position % 8)) & 1) << i;
+		return value;
+	}
+
+	// Pulls a 4x4 block out of a level (0-255 per channel),
+	// repeating the last row/column for partial edge blocks
+	void GatherBlock(const BakeImage& image, unsigned int blockX, unsigned int blockY, float pixels[16][4])
+	{
+		for (unsigned int y = 0; y < 4; y++)
+		{
+			unsigned int sy = std::min(blockY * 4 + y, image.height - 1);
+			for (unsigned int x = 0; x < 4; x++)
+			{
+				unsigned int sx = std::min(blockX * 4 + x, image.width - 1);
+				const float* source = &image.pixels[((size_t)sy * image.width + sx) * 4];
+				for (unsigned int c = 0; c < 4; c++)
+					pixels[y * 4 + x][c] = std::clamp(source[c], 0.0f, 1.0f) * 255.0f;
+			}
+		}
+	}
+
+	// --------------------------------------------------------
+	// BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a
+	// unique p-bit each and 4-bit indices
+	// --------------------------------------------------------
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BC7Endpoints
+	{
+		int quantized[2][4];	// 7-bit values
+		int pBits[2];
+	};
+
+	int Interpolate(int e0, int e1, int weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	void Dequantize(const BC7Endpoints& endpoints, int values[2][4])
+	{
+		for (int e = 0; e < 2; e++)
+			for (int c = 0; c < 4; c++)
+				values[e][c] = (endpoints.quantized[e][c] << 1) | endpoints.pBits[e];
+	}
+
+	BC7Endpoints Quantize(const float endpoints[2][4], int pBit0, int pBit1)
+	{
+		BC7Endpoints result = {};
+		result.pBits[0] = pBit0;
+		result.pBits[1] = pBit1;
+		for (int e = 0; e < 2; e++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int q = (int)floorf((endpoints[e][c] - result.pBits[e]) * 0.5f + 0.5f);
+				result.quantized[e][c] = std::clamp(q, 0, 127);
+			}
+		}
+		return result;
+	}
+
+	// Picks the closest palette entry for every pixel, returning the total error
+	float AssignIndices(const float pixels[16][4], const BC7Endpoints& endpoints, int indices[16])
+	{
+		int values[2][4];
+		Dequantize(endpoints, values);
+
+		float palette[16][4];
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				palette[i][c] = (float)Interpolate(values[0][c], values[1][c], BC7_WEIGHTS[i]);
+
+		float total = 0.0f;
+		for (int p = 0; p < 16; p++)
+		{
+			float best = 1e30f;
+			for (int i = 0; i < 16; i++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					float d = palette[i][c] - pixels[p][c];
+					error += d * d;
+				}
+				if (error < best)
+				{
+					best = error;
+					indices[p] = i;
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	// Least squares endpoints for a fixed set of indices
+	bool FitEndpoints(const float pixels[16][4], const int indices[16], float endpoints[2][4])
+	{
+		float aa = 0, ab = 0, bb = 0;
+		float ax[4] = {}, bx[4] = {};
+		for (int p = 0; p < 16; p++)
+		{
+			float b = BC7_WEIGHTS[indices[p]] / 64.0f;
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 4; c++)
+			{
+				ax[c] += a * pixels[p][c];
+				bx[c] += b * pixels[p][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) < 1e-6f)
+			return false;
+
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+			endpoints[1][c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	// Tries all four p-bit combinations, keeping the best
+	float QuantizeBest(const float pixels[16][4], const float endpoints[2][4], BC7Endpoints& best, int bestIndices[16])
+	{
+		float bestError = 1e30f;
+		for (int pBits = 0; pBits < 4; pBits++)
+		{
+			BC7Endpoints candidate = Quantize(endpoints, pBits & 1, pBits >> 1);
+			int indices[16];
+			float error = AssignIndices(pixels, candidate, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best = candidate;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+		return bestError;
+	}
+
+	void EncodeBC7Block(const float pixels[16][4], uint8_t block[16])
+	{
+		// Principal axis of the block's colors (power iteration on the covariance)
+		float mean[4] = {};
+		for (int p = 0; p < 16; p++)
+			for (int c = 0; c < 4; c++)
+				mean[c] += pixels[p][c] / 16.0f;
+
+		float covariance[4][4] = {};
+		for (int p = 0; p < 16; p++)
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					covariance[i][j] += (pixels[p][i] - mean[i]) * (pixels[p][j] - mean[j]);
+
+		float axis[4] = { 1, 1, 1, 1 };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					next[i] += covariance[i][j] * axis[j];
+
+			float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+			if (length < 1e-6f)
+				break;
+			for (int i = 0; i < 4; i++)
+				axis[i] = next[i] / length;
+		}
+
+		// Extent of the block along that axis gives the starting endpoints
+		float minT = 1e30f, maxT = -1e30f;
+		for (int p = 0; p < 16; p++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 4; c++)
+				t += (pixels[p][c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		float endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			endpoints[1][c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+
+		BC7Endpoints best;
+		int indices[16];
+		float bestError = QuantizeBest(pixels, endpoints, best, indices);
+
+		// Refine: refit the endpoints to the chosen indices and requantize
+		for (int iteration = 0; iteration < 3 && bestError > 0.0f; iteration++)
+		{
+			float refined[2][4];
+			if (!FitEndpoints(pixels, indices, refined))
+				break;
+
+			BC7Endpoints candidate;
+			int candidateIndices[16];
+			float error = QuantizeBest(pixels, refined, candidate, candidateIndices);
+			if (error >= bestError)
+				break;
+
+			bestError = error;
+			best = candidate;
+			memcpy(indices, candidateIndices, sizeof(indices));
+		}
+
+		// The first index's top bit is implied zero, so flip the block if needed
+		if (indices[0] >= 8)
+		{
+			std::swap(best.quantized[0], best.quantized[1]);
+			std::swap(best.pBits[0], best.pBits[1]);
+			for (int p = 0; p < 16; p++)
+				indices[p] = 15 - indices[p];
+		}
+
+		memset(block, 0, 16);
+		unsigned int position = 0;
+		WriteBits(block, position, 1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			WriteBits(block, position, best.quantized[0][c], 7);
+			WriteBits(block, position, best.quantized[1][c], 7);
+		}
+		WriteBits(block, position, best.pBits[0], 1);
+		WriteBits(block, position, best.pBits[1], 1);
+		for (int p = 0; p < 16; p++)
+			WriteBits(block, position, indices[p], p == 0 ? 3 : 4);
+	}
+
+	// --------------------------------------------------------
+	// BC4: one channel, two 8-bit endpoints and 3-bit indices
+	// into an 8 value ramp (BC5 is two of these, for R and G)
+	// --------------------------------------------------------
+	void BC4Palette(int e0, int e1, float palette[8])
+	{
+		palette[0] = (float)e0;
+		palette[1] = (float)e1;
+		if (e0 > e1)
+		{
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * e0 + i * e1) / 7.0f;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * e0 + i * e1) / 5.0f;
+			palette[6] = 0.0f;
+			palette[7] = 255.0f;
+		}
+	}
+
+	float BC4Indices(const float values[16], const float palette[8], int indices[16])
+	{
+		float total = 0.0f;
+		for (int p = 0; p < 16; p++)
+		{
+			float best = 1e30f;
+			for (int i = 0; i < 8; i++)
+			{
+				float d = palette[i] - values[p];
+				if (d * d < best)
+				{
+					best = d * d;
+					indices[p] = i;
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	void EncodeBC4Block(const float values[16], uint8_t block[8])
+	{
+		float low = values[0], high = values[0];
+		for (int p = 1; p < 16; p++)
+		{
+			low = std::min(low, values[p]);
+			high = std::max(high, values[p]);
+		}
+
+		// Min/max endpoints, plus a few inset ones which often
+		// fit the ramp to the values better
+		int bestE0 = 0, bestE1 = 0;
+		int bestIndices[16] = {};
+		float bestError = 1e30f;
+		for (int insetHigh = 0; insetHigh < 4; insetHigh++)
+		{
+			for (int insetLow = 0; insetLow < 4; insetLow++)
+			{
+				int e0 = std::clamp((int)(high + 0.5f) - insetHigh, 0, 255);
+				int e1 = std::clamp((int)(low + 0.5f) + insetLow, 0, 255);
+				if (e0 < e1)
+					continue;
+
+				float palette[8];
+				int indices[16];
+				BC4Palette(e0, e1, palette);
+				float error = BC4Indices(values, palette, indices);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestE0 = e0;
+					bestE1 = e1;
+					memcpy(bestIndices, indices, sizeof(indices));
+				}
+			}
+		}
+
+		memset(block, 0, 8);
+		unsigned int position = 0;
+		WriteBits(block, position, bestE0, 8);
+		WriteBits(block, position, bestE1, 8);
+		for (int p = 0; p < 16; p++)
+			WriteBits(block, position, bestIndices[p], 3);
+	}
+
+	void DecodeBC4Block(const uint8_t block[8], uint8_t values[16])
+	{
+		unsigned int position = 0;
+		int e0 = ReadBits(block, position, 8);
+		int e1 = ReadBits(block, position, 8);
+
+		float palette[8];
+		BC4Palette(e0, e1, palette);
+		for (int p = 0; p < 16; p++)
+			values[p] = (uint8_t)(palette[ReadBits(block, position, 3)] + 0.5f);
+	}
+
+	// Encodes every block of a level, a row of blocks per job
+	template <typename EncodeFunction>
+	std::vector<uint8_t> EncodeBlocks(const BakeImage& image, EncodeFunction encode)
+	{
+		unsigned int blocksWide = (image.width + 3) / 4;
+		unsigned int blocksHigh = (image.height + 3) / 4;
+		std::vector<uint8_t> bytes((size_t)blocksWide * blocksHigh * 16);
+
+		// More ranges than threads so uneven rows even out
+		unsigned int rangeCount = (JobSystem::WorkerCount() + 1) * 4;
+		JobSystem::ParallelFor(blocksHigh, rangeCount,
+			[&](unsigned int, unsigned int begin, unsigned int end)
+			{
+				for (unsigned int by = begin; by < end; by++)
+				{
+					for (unsigned int bx = 0; bx < blocksWide; bx++)
+					{
+						float pixels[16][4];
+						GatherBlock(image, bx, by, pixels);
+						encode(pixels, &bytes[((size_t)by * blocksWide + bx) * 16]);
+					}
+				}
+			});
+
+		return bytes;
+	}
+
+	// --------------------------------------------------------
+	// DDS file layout (DX10 extended header)
+	// --------------------------------------------------------
+	const uint32_t DDS_MAGIC = 0x20534444;	// "DDS "
+	const uint32_t DDS_FOURCC_DX10 = 0x30315844;	// "DX10"
+
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+	const uint32_t DXGI_BC5_UNORM = 83;
+	const uint32_t DXGI_BC7_UNORM = 98;
+	const uint32_t DXGI_BC7_UNORM_SRGB = 99;
+
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
+	static_assert(sizeof(DDSHeaderDX10) == 20, "DX10 header must be 20 bytes");
+}
+
+uint32_t TextureBaker::GetDXGIFormat(BakeKind kind, bool sRGB)
+{
+	if (kind == BakeKind::Normal)
+		return DXGI_BC5_UNORM;
+	return sRGB ? DXGI_BC7_UNORM_SRGB : DXGI_BC7_UNORM;
+}
+
+// --------------------------------------------------------
+// Builds the whole chain by filtering each level from the one
+// above it.  Color is filtered in linear light when the image
+// is sRGB; normals are filtered as vectors and renormalized so
+// distant mips don't flatten out the lighting.
+// --------------------------------------------------------
+std::vector<BakeImage> TextureBaker::GenerateMips(const BakeImage& top, BakeKind kind, bool sRGB)
+{
+	// Move into the space the filter should work in
+	BakeImage working = top;
+	for (size_t i = 0; i < working.pixels.size(); i += 4)
+	{
+		float* p = &working.pixels[i];
+		for (int c = 0; c < 3; c++)
+		{
+			if (kind == BakeKind::Normal)
+				p[c] = p[c] * 2.0f - 1.0f;
+			else if (sRGB)
+				p[c] = SRGBToLinear(p[c]);
+		}
+	}
+
+	std::vector<BakeImage> levels;
+	levels.push_back(top);
+
+	while (working.width > 1 || working.height > 1)
+	{
+		unsigned int width = std::max(1u, working.width / 2);
+		unsigned int height = std::max(1u, working.height / 2);
+		std::vector<std::vector<FilterTap>> tapsX = BuildTaps(working.width, width);
+		std::vector<std::vector<FilterTap>> tapsY = BuildTaps(working.height, height);
+
+		// Horizontal pass
+		std::vector<float> horizontal((size_t)width * working.height * 4, 0.0f);
+		for (unsigned int y = 0; y < working.height; y++)
+			for (unsigned int x = 0; x < width; x++)
+				for (const FilterTap& tap : tapsX[x])
+					for (int c = 0; c < 4; c++)
+						horizontal[((size_t)y * width + x) * 4 + c] += working.pixels[((size_t)y * working.width + tap.source) * 4 + c] * tap.weight;
+
+		// Vertical pass
+		BakeImage next = { width, height, std::vector<float>((size_t)width * height * 4, 0.0f) };
+		for (unsigned int y = 0; y < height; y++)
+			for (const FilterTap& tap : tapsY[y])
+				for (unsigned int x = 0; x < width; x++)
+					for (int c = 0; c < 4; c++)
+						next.pixels[((size_t)y * width + x) * 4 + c] += horizontal[((size_t)tap.source * width + x) * 4 + c] * tap.weight;
+
+		// Sinc lobes can overshoot, and normals need to stay unit length
+		for (size_t i = 0; i < next.pixels.size(); i += 4)
+		{
+			float* p = &next.pixels[i];
+			if (kind == BakeKind::Normal)
+			{
+				float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+				if (length > 1e-6f)
+					for (int c = 0; c < 3; c++)
+						p[c] /= length;
+				else
+				{
+					p[0] = 0.0f; p[1] = 0.0f; p[2] = 1.0f;
+				}
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+					p[c] = std::max(p[c], 0.0f);
+			}
+			p[3] = std::clamp(p[3], 0.0f, 1.0f);
+		}
+
+		// Back to the stored encoding for this level
+		BakeImage level = next;
+		for (size_t i = 0; i < level.pixels.size(); i += 4)
+		{
+			float* p = &level.pixels[i];
+			for (int c = 0; c < 3; c++)
+			{
+				if (kind == BakeKind::Normal)
+					p[c] = p[c] * 0.5f + 0.5f;
+				else if (sRGB)
+					p[c] = LinearToSRGB(std::min(p[c], 1.0f));
+				else
+					p[c] = std::min(p[c], 1.0f);
+			}
+		}
+
+		levels.push_back(level);
+		working = std::move(next);
+	}
+
+	return levels;
+}
+
+// --------------------------------------------------------
+// Mode 6 only: a single RGBA subset fitted along the block's
+// principal axis, then refined by least squares.  That misses
+// the multi-subset modes, but it's the common choice for a
+// fast encoder and handles alpha without a separate path.
+// --------------------------------------------------------
+std::vector<uint8_t> TextureBaker::EncodeBC7(const BakeImage& image)
+{
+	return EncodeBlocks(image, [](const float pixels[16][4], uint8_t* block)
+		{
+			EncodeBC7Block(pixels, block);
+		});
+}
+
+// --------------------------------------------------------
+// Red and green are stored as two BC4 blocks.  Blue (and alpha)
+// are dropped: the shader rebuilds Z from X and Y.
+// --------------------------------------------------------
+std::vector<uint8_t> TextureBaker::EncodeBC5(const BakeImage& image)
+{
+	return EncodeBlocks(image, [](const float pixels[16][4], uint8_t* block)
+		{
+			for (int c = 0; c < 2; c++)
+			{
+				float values[16];
+				for (int p = 0; p < 16; p++)
+					values[p] = pixels[p][c];
+				EncodeBC4Block(values, block + c * 8);
+			}
+		});
+}
+
+// --------------------------------------------------------
+// Only decodes mode 6 (what EncodeBC7 writes); any other mode
+// comes back as opaque black
+// --------------------------------------------------------
+void TextureBaker::DecodeBC7Block(const uint8_t block[16], uint8_t rgba[16][4])
+{
+	unsigned int position = 0;
+	if (ReadBits(block, position, 7) != (1 << 6))
+	{
+		for (int p = 0; p < 16; p++)
+		{
+			rgba[p][0] = rgba[p][1] = rgba[p][2] = 0;
+			rgba[p][3] = 255;
+		}
+		return;
+	}
+
+	BC7Endpoints endpoints;
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints.quantized[0][c] = ReadBits(block, position, 7);
+		endpoints.quantized[1][c] = ReadBits(block, position, 7);
+	}
+	endpoints.pBits[0] = ReadBits(block, position, 1);
+	endpoints.pBits[1] = ReadBits(block, position, 1);
+
+	int values[2][4];
+	Dequantize(endpoints, values);
+	for (int p = 0; p < 16; p++)
+	{
+		int index = ReadBits(block, position, p == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+			rgba[p][c] = (uint8_t)Interpolate(values[0][c], values[1][c], BC7_WEIGHTS[index]);
+	}
+}
+
+void TextureBaker::DecodeBC5Block(const uint8_t block[16], uint8_t rg[16][2])
+{
+	uint8_t red[16], green[16];
+	DecodeBC4Block(block, red);
+	DecodeBC4Block(block + 8, green);
+	for (int p = 0; p < 16; p++)
+	{
+		rg[p][0] = red[p];
+		rg[p][1] = green[p];
+	}
+}
+
+// --------------------------------------------------------
+// Converts the pixels, builds the mip chain, encodes every
+// level and wraps it all in a DDS file with a DX10 header
+// --------------------------------------------------------
+std::vector<uint8_t> TextureBaker::Bake(const uint8_t* rgba8, unsigned int width, unsigned int height, BakeKind kind, bool sRGB)
+{
+	BakeImage top = { width, height, std::vector<float>((size_t)width * height * 4) };
+	for (size_t i = 0; i < top.pixels.size(); i++)
+		top.pixels[i] = rgba8[i] / 255.0f;
+
+	std::vector<BakeImage> levels = GenerateMips(top, kind, sRGB);
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = ((width + 3) / 4) * ((height + 3) / 4) * 16;
+	header.mipMapCount = (uint32_t)levels.size();
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+	DDSHeaderDX10 headerDX10 = {};
+	headerDX10.dxgiFormat = GetDXGIFormat(kind, sRGB);
+	headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	headerDX10.arraySize = 1;
+
+	std::vector<uint8_t> bytes(sizeof(DDS_MAGIC) + sizeof(header) + sizeof(headerDX10));
+	memcpy(bytes.data(), &DDS_MAGIC, sizeof(DDS_MAGIC));
+	memcpy(bytes.data() + sizeof(DDS_MAGIC), &header, sizeof(header));
+	memcpy(bytes.data() + sizeof(DDS_MAGIC) + sizeof(header), &headerDX10, sizeof(headerDX10));
+
+	for (const BakeImage& level : levels)
+	{
+		std::vector<uint8_t> blocks = kind == BakeKind::Normal ? EncodeBC5(level) : EncodeBC7(level);
+		bytes.insert(bytes.end(), blocks.begin(), blocks.end());
+	}
+
+	return bytes;
+}
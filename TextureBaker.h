@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What a texture holds, which decides how it's filtered and encoded
+enum class BakeKind
+{
+	Albedo,	// Color (+ alpha), BC7
+	Normal	// Tangent space normal in RG, BC5; Z is rebuilt in the shader
+};
+
+// One mip level of an image, four floats (RGBA) per pixel in 0-1
+struct BakeImage
+{
+	unsigned int width;
+	unsigned int height;
+	std::vector<float> pixels;
+};
+
+// --------------------------------------------------------
+// Offline texture cooking: mip chains and block compression
+// into DDS files the DDSTextureLoader reads directly.
+//
+// No graphics API is involved, so this runs anywhere (the
+// command line baker in Tools/TextureBaker builds on Linux).
+// Block encoding is split into rows of blocks and spread
+// over the JobSystem's workers.
+// --------------------------------------------------------
+namespace TextureBaker
+{
+	// Whole pipeline: RGBA8 pixels in, a complete DDS file out
+	std::vector<uint8_t> Bake(const uint8_t* rgba8, unsigned int width, unsigned int height, BakeKind kind, bool sRGB);
+
+	// Every level down to 1x1, made with a windowed sinc filter
+	// (in linear light for sRGB color, renormalized for normals)
+	std::vector<BakeImage> GenerateMips(const BakeImage& top, BakeKind kind, bool sRGB);
+
+	// Block compression of one level, 16 bytes per 4x4 block
+	std::vector<uint8_t> EncodeBC7(const BakeImage& image);
+	std::vector<uint8_t> EncodeBC5(const BakeImage& image);
+
+	// Decoders for a single block, to measure the encoders' error
+	// (BC7 only understands mode 6, the one EncodeBC7 writes)
+	void DecodeBC7Block(const uint8_t block[16], uint8_t rgba[16][4]);
+	void DecodeBC5Block(const uint8_t block[16], uint8_t rg[16][2]);
+
+	// DXGI formats written to the DDS header
+	uint32_t GetDXGIFormat(BakeKind kind, bool sRGB);
+}
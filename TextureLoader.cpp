@@ -0,0 +1,570 @@
+#include "TextureLoader.h"
+#include "Graphics.h"
+#include "DDSTextureLoader.h"
+#include "Profiler.h"
+
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+namespace
+{
+	// Same rule the DirectXTK WIC loader uses: PNGs are sRGB if they
+	// carry an sRGB chunk or a 2.2 gamma, other formats if their
+	// color space says so
+	bool IsSRGB(IWICBitmapFrameDecode* frame)
+	{
+		Microsoft::WRL::ComPtr<IWICMetadataQueryReader> reader;
+		if (FAILED(frame->GetMetadataQueryReader(reader.GetAddressOf())))
+			return false;
+
+		GUID container;
+		if (FAILED(reader->GetContainerFormat(&container)))
+			return false;
+
+		bool sRGB = false;
+		PROPVARIANT value;
+		PropVariantInit(&value);
+		if (memcmp(&container, &GUID_ContainerFormatPng, sizeof(GUID)) == 0)
+		{
+			if (SUCCEEDED(reader->GetMetadataByName(L"/sRGB/RenderingIntent", &value)) && value.vt == VT_UI1)
+				sRGB = true;
+			else if (SUCCEEDED(reader->GetMetadataByName(L"/gAMA/ImageGamma", &value)) && value.vt == VT_UI4)
+				sRGB = (value.uintVal == 45455);
+		}
+		else if (SUCCEEDED(reader->GetMetadataByName(L"System.Image.ColorSpace", &value)) && value.vt == VT_UI2)
+		{
+			sRGB = (value.uiVal == 1);
+		}
+		PropVariantClear(&value);
+		return sRGB;
+	}
+
+	// Reads "name.dds" for "name.png" (or any other extension),
+	// if the baker has produced one
+	bool ReadBakedDDS(const std::wstring& path, std::vector<uint8_t>& bytes)
+	{
+		size_t dot = path.find_last_of(L'.');
+		if (dot == std::wstring::npos)
+			return false;
+
+		std::ifstream file(path.substr(0, dot) + L".dds", std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		bytes.resize((size_t)file.tellg());
+		file.seekg(0);
+		return bytes.size() > 0 && (bool)file.read((char*)bytes.data(), bytes.size());
+	}
+
+	unsigned int CalcMipLevels(unsigned int width, unsigned int height)
+	{
+		unsigned int levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(1u, width / 2);
+			height = std::max(1u, height / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	size_t CalcMipChainBytes(unsigned int width, unsigned int height, unsigned int mipLevels)
+	{
+		size_t bytes = 0;
+		for (unsigned int i = 0; i < mipLevels; i++)
+			bytes += (size_t)std::max(1u, width >> i) * std::max(1u, height >> i) * 4;
+		return bytes;
+	}
+
+	// Tables for moving 8-bit sRGB in and out of linear light
+	// without a pow() per channel
+	struct SRGBTables
+	{
+		float toLinear[256];
+		uint8_t fromLinear[4096];
+
+		SRGBTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				float c = i / 4095.0f;
+				float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = (uint8_t)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SRGBTables& GetSRGBTables()
+	{
+		static SRGBTables tables;
+		return tables;
+	}
+
+	DirectX::XMVECTOR LoadTexel(const uint8_t* texel, bool sRGB)
+	{
+		if (!sRGB)
+			return DirectX::PackedVector::XMLoadUByteN4((const DirectX::PackedVector::XMUBYTEN4*)texel);
+
+		const SRGBTables& tables = GetSRGBTables();
+		return DirectX::XMVectorSet(tables.toLinear[texel[0]], tables.toLinear[texel[1]], tables.toLinear[texel[2]], texel[3] / 255.0f);
+	}
+
+	void StoreTexel(uint8_t* texel, DirectX::FXMVECTOR value, bool sRGB)
+	{
+		if (!sRGB)
+		{
+			DirectX::PackedVector::XMStoreUByteN4((DirectX::PackedVector::XMUBYTEN4*)texel, value);
+			return;
+		}
+
+		DirectX::XMFLOAT4 linear;
+		DirectX::XMStoreFloat4(&linear, DirectX::XMVectorSaturate(value));
+		const SRGBTables& tables = GetSRGBTables();
+		texel[0] = tables.fromLinear[(int)(linear.x * 4095.0f + 0.5f)];
+		texel[1] = tables.fromLinear[(int)(linear.y * 4095.0f + 0.5f)];
+		texel[2] = tables.fromLinear[(int)(linear.z * 4095.0f + 0.5f)];
+		texel[3] = (uint8_t)(linear.w * 255.0f + 0.5f);
+	}
+
+	// --------------------------------------------------------
+	// Fills in levels 1+ of a mip chain whose top level is already
+	// in place, each from the one above with a 2x2 box filter (in
+	// linear light for sRGB).  The four texels are summed and
+	// scaled as whole vectors.
+	// --------------------------------------------------------
+	void GenerateMipChain(uint8_t* chain, unsigned int width, unsigned int height, unsigned int mipLevels, bool sRGB)
+	{
+		const uint8_t* source = chain;
+		uint8_t* dest = chain + (size_t)width * height * 4;
+		unsigned int sourceWidth = width;
+		unsigned int sourceHeight = height;
+
+		for (unsigned int level = 1; level < mipLevels; level++)
+		{
+			unsigned int destWidth = std::max(1u, sourceWidth / 2);
+			unsigned int destHeight = std::max(1u, sourceHeight / 2);
+
+			for (unsigned int y = 0; y < destHeight; y++)
+			{
+				const uint8_t* row0 = source + (size_t)std::min(y * 2, sourceHeight - 1) * sourceWidth * 4;
+				const uint8_t* row1 = source + (size_t)std::min(y * 2 + 1, sourceHeight - 1) * sourceWidth * 4;
+				for (unsigned int x = 0; x < destWidth; x++)
+				{
+					unsigned int x0 = std::min(x * 2, sourceWidth - 1) * 4;
+					unsigned int x1 = std::min(x * 2 + 1, sourceWidth - 1) * 4;
+
+					DirectX::XMVECTOR sum = DirectX::XMVectorAdd(
+						DirectX::XMVectorAdd(LoadTexel(row0 + x0, sRGB), LoadTexel(row0 + x1, sRGB)),
+						DirectX::XMVectorAdd(LoadTexel(row1 + x0, sRGB), LoadTexel(row1 + x1, sRGB)));
+					StoreTexel(dest + ((size_t)y * destWidth + x) * 4, DirectX::XMVectorScale(sum, 0.25f), sRGB);
+				}
+			}
+
+			source = dest;
+			dest += (size_t)destWidth * destHeight * 4;
+			sourceWidth = destWidth;
+			sourceHeight = destHeight;
+		}
+	}
+}
+
+TextureLoader::TextureLoader(unsigned int threadCount)
+{
+	this->stopping = false;
+	this->startTime = std::chrono::high_resolution_clock::now();
+	this->requestCount = 0;
+	this->loadedCount = 0;
+	this->finishMilliseconds = 0.0f;
+	this->uploadMilliseconds = 0.0f;
+	this->cubeMilliseconds = 0.0f;
+	this->stagingBytes = 0;
+	this->peakStagingBytes = 0;
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int i = 0; i < threadCount; i++)
+		this->workers.emplace_back(&TextureLoader::WorkerLoop, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+		this->jobs.clear();
+	}
+	this->wake.notify_all();
+	for (std::thread& worker : this->workers)
+		worker.join();
+}
+
+// --------------------------------------------------------
+// Each worker has its own COM apartment and WIC factory, so
+// decodes never wait on one another
+// --------------------------------------------------------
+void TextureLoader::WorkerLoop()
+{
+	HRESULT comResult = CoInitializeEx(0, COINIT_MULTITHREADED);
+	Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+	CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()));
+	Profiler::SetThreadName("Texture loader");
+
+	while (true)
+	{
+		DecodeJob job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+			if (this->stopping)
+				break;
+			job = this->jobs.front();
+			this->jobs.pop_front();
+		}
+
+		PROFILE_SCOPE("Decode texture");
+		Image& image = job.request->faces[job.face];
+		image.failed = true;
+
+		// A baked file needs no decoding at all
+		if (job.request->faceCount == 1 && ReadBakedDDS(job.request->paths[job.face], image.dds))
+		{
+			image.failed = false;
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stagingBytes += image.dds.size();
+			this->peakStagingBytes = std::max(this->peakStagingBytes, this->stagingBytes);
+			if (++job.request->facesDecoded == job.request->faceCount)
+				this->decoded.push_back(job.request);
+			continue;
+		}
+
+		Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+		Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+		Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+		if (factory &&
+			SUCCEEDED(factory->CreateDecoderFromFilename(job.request->paths[job.face].c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())) &&
+			SUCCEEDED(decoder->GetFrame(0, frame.GetAddressOf())) &&
+			SUCCEEDED(factory->CreateFormatConverter(converter.GetAddressOf())) &&
+			SUCCEEDED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom)) &&
+			SUCCEEDED(converter->GetSize(&image.width, &image.height)))
+		{
+			image.sRGB = IsSRGB(frame.Get());
+			if (job.request->faceCount == 6)
+			{
+				DecodeCubeFace(frame.Get(), converter.Get(), *job.request, job.face);
+			}
+			else
+			{
+				image.pixels.resize((size_t)image.width * image.height * 4);
+				image.failed = FAILED(converter->CopyPixels(0, image.width * 4, (UINT)image.pixels.size(), image.pixels.data()));
+			}
+		}
+		if (image.failed)
+			printf("Texture loader: couldn't decode %ls\n", job.request->paths[job.face].c_str());
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stagingBytes += image.pixels.size();
+		this->peakStagingBytes = std::max(this->peakStagingBytes, this->stagingBytes);
+		if (++job.request->facesDecoded == job.request->faceCount)
+			this->decoded.push_back(job.request);
+	}
+
+	factory.Reset();
+	if (SUCCEEDED(comResult))
+		CoUninitialize();
+}
+
+// --------------------------------------------------------
+// Decodes one face of a cube map into its slot of the shared
+// staging block and builds that face's mips right there.  The
+// first face to arrive sizes the block for all six; faces that
+// don't match it fail the whole cube.
+// --------------------------------------------------------
+void TextureLoader::DecodeCubeFace(IWICBitmapFrameDecode* frame, IWICFormatConverter* converter, Request& request, unsigned int face)
+{
+	Image& image = request.faces[face];
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (!request.staging)
+		{
+			request.mipLevels = CalcMipLevels(image.width, image.height);
+			request.stagingFaceBytes = CalcMipChainBytes(image.width, image.height, request.mipLevels);
+			request.staging.reset(new uint8_t[request.stagingFaceBytes * 6]);
+			this->stagingBytes += request.stagingFaceBytes * 6;
+			this->peakStagingBytes = std::max(this->peakStagingBytes, this->stagingBytes);
+		}
+		else if (CalcMipChainBytes(image.width, image.height, request.mipLevels) != request.stagingFaceBytes)
+		{
+			return;
+		}
+	}
+
+	// Each face owns its own slice, so no lock from here on
+	uint8_t* chain = request.staging.get() + request.stagingFaceBytes * face;
+	UINT topBytes = image.width * image.height * 4;
+	if (FAILED(converter->CopyPixels(0, image.width * 4, topBytes, chain)))
+		return;
+
+	GenerateMipChain(chain, image.width, image.height, request.mipLevels, image.sRGB);
+	image.failed = false;
+}
+
+void TextureLoader::Load(const std::wstring& path, LoadedFunction onLoaded)
+{
+	// Callbacks only ever run on this thread, so no lock is needed to
+	// join a request that's still in flight
+	auto existing = this->requestsByPath.find(path);
+	if (existing != this->requestsByPath.end())
+	{
+		Request* request = existing->second;
+		if (!request->uploaded)
+			request->onLoaded.push_back(std::move(onLoaded));
+		else if (request->srv)
+			onLoaded(request->srv);
+		return;
+	}
+
+	std::unique_ptr<Request> request = std::make_unique<Request>();
+	request->paths[0] = path;
+	request->faceCount = 1;
+	request->facesDecoded = 0;
+	request->stagingFaceBytes = 0;
+	request->mipLevels = 0;
+	request->requestTime = std::chrono::high_resolution_clock::now();
+	request->uploaded = false;
+	request->onLoaded.push_back(std::move(onLoaded));
+	this->requestsByPath[path] = request.get();
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push_back({ request.get(), 0 });
+		this->requestCount++;
+	}
+	this->requests.push_back(std::move(request));
+	this->wake.notify_one();
+}
+
+void TextureLoader::LoadCube(const std::wstring facePaths[6], LoadedFunction onLoaded, DecodedCubeFunction onDecoded)
+{
+	std::unique_ptr<Request> request = std::make_unique<Request>();
+	request->faceCount = 6;
+	request->facesDecoded = 0;
+	request->stagingFaceBytes = 0;
+	request->mipLevels = 0;
+	request->requestTime = std::chrono::high_resolution_clock::now();
+	request->uploaded = false;
+	request->onLoaded.push_back(std::move(onLoaded));
+	request->onDecoded = std::move(onDecoded);
+	for (unsigned int i = 0; i < 6; i++)
+		request->paths[i] = facePaths[i];
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (unsigned int i = 0; i < 6; i++)
+			this->jobs.push_back({ request.get(), i });
+		this->requestCount++;
+	}
+	this->requests.push_back(std::move(request));
+	this->wake.notify_all();
+}
+
+unsigned int TextureLoader::Update()
+{
+	PROFILE_SCOPE("Create textures");
+	std::vector<Request*> ready;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->decoded.empty())
+			return 0;
+		ready.swap(this->decoded);
+	}
+
+	auto uploadStart = std::chrono::high_resolution_clock::now();
+	for (Request* request : ready)
+	{
+		request->srv = CreateTexture(*request);
+		request->uploaded = true;
+
+		// Failed loads keep their fallbacks
+		if (request->srv)
+		{
+			for (LoadedFunction& onLoaded : request->onLoaded)
+				onLoaded(request->srv);
+
+			if (request->onDecoded)
+			{
+				DecodedCube cube = {};
+				cube.width = request->faces[0].width;
+				cube.height = request->faces[0].height;
+				cube.mipLevels = request->mipLevels;
+				cube.sRGB = request->faces[0].sRGB;
+				for (unsigned int i = 0; i < 6; i++)
+					cube.faces[i] = request->staging.get() + request->stagingFaceBytes * i;
+				request->onDecoded(cube);
+			}
+		}
+		request->onDecoded = 0;
+
+		if (request->faceCount == 6)
+			this->cubeMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - request->requestTime).count();
+
+		// The pixels live on the GPU now
+		request->onLoaded.clear();
+		size_t released = request->staging ? request->stagingFaceBytes * 6 : 0;
+		request->staging.reset();
+		for (unsigned int i = 0; i < request->faceCount; i++)
+		{
+			released += request->faces[i].pixels.size() + request->faces[i].dds.size();
+			request->faces[i].pixels = std::vector<uint8_t>();
+			request->faces[i].dds = std::vector<uint8_t>();
+		}
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stagingBytes -= released;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	this->uploadMilliseconds += std::chrono::duration<float, std::milli>(now - uploadStart).count();
+	this->loadedCount += (unsigned int)ready.size();
+	if (IsFinished())
+		this->finishMilliseconds = std::chrono::duration<float, std::milli>(now - this->startTime).count();
+	return (unsigned int)ready.size();
+}
+
+// --------------------------------------------------------
+// 2D textures get a full mip chain generated on the GPU, just
+// like CreateWICTextureFromFile with a context.  Cube maps
+// arrive with their mips already built, so the texture is made
+// once with all 6 x mipLevels subresources as initial data.
+// Baked DDS files also carry their mips and go straight in.
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> TextureLoader::CreateTexture(const Request& request)
+{
+	const Image& first = request.faces[0];
+	if (!first.dds.empty())
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		DirectX::CreateDDSTextureFromMemory(Graphics::Device.Get(), first.dds.data(), first.dds.size(), 0, srv.GetAddressOf());
+		return srv;
+	}
+
+	for (unsigned int i = 0; i < request.faceCount; i++)
+	{
+		const Image& face = request.faces[i];
+		if (face.failed || face.width != first.width || face.height != first.height)
+			return 0;
+	}
+
+	bool cube = request.faceCount == 6;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = first.width;
+	desc.Height = first.height;
+	desc.MipLevels = cube ? request.mipLevels : 0;
+	desc.ArraySize = request.faceCount;
+	desc.Format = first.sRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	if (cube)
+		desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	else
+	{
+		desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (cube)
+	{
+		// Subresources go face by face, each face's mips in order,
+		// which is exactly how the staging block is laid out
+		std::vector<D3D11_SUBRESOURCE_DATA> subresources(6 * request.mipLevels);
+		for (unsigned int face = 0; face < 6; face++)
+		{
+			const uint8_t* level = request.staging.get() + request.stagingFaceBytes * face;
+			for (unsigned int mip = 0; mip < request.mipLevels; mip++)
+			{
+				unsigned int width = std::max(1u, first.width >> mip);
+				unsigned int height = std::max(1u, first.height >> mip);
+
+				D3D11_SUBRESOURCE_DATA& data = subresources[D3D11CalcSubresource(mip, face, request.mipLevels)];
+				data.pSysMem = level;
+				data.SysMemPitch = width * 4;
+				level += (size_t)width * height * 4;
+			}
+		}
+		if (FAILED(Graphics::Device->CreateTexture2D(&desc, subresources.data(), texture.GetAddressOf())))
+			return 0;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = desc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = request.mipLevels;
+		Graphics::Device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
+		return srv;
+	}
+
+	// Mipmapped textures can't take initial data, so fill the top level after
+	if (FAILED(Graphics::Device->CreateTexture2D(&desc, 0, texture.GetAddressOf())))
+		return 0;
+	Graphics::Context->UpdateSubresource(texture.Get(), 0, 0, first.pixels.data(), first.width * 4, 0);
+	Graphics::Device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+	Graphics::Context->GenerateMips(srv.Get());
+	return srv;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> TextureLoader::CreateSolidTexture(uint32_t color, bool cube)
+{
+	uint32_t faces[6] = { color, color, color, color, color, color };
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = cube ? 6 : 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+	D3D11_SUBRESOURCE_DATA data[6] = {};
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		data[i].pSysMem = &faces[i];
+		data[i].SysMemPitch = sizeof(uint32_t);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	Graphics::Device->CreateTexture2D(&desc, data, texture.GetAddressOf());
+	Graphics::Device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+	return srv;
+}
+
+const uint8_t* TextureLoader::DecodedCube::GetLevel(unsigned int face, unsigned int mip) const
+{
+	return this->faces[face] + CalcMipChainBytes(this->width, this->height, mip);
+}
+
+unsigned int TextureLoader::GetThreadCount() { return (unsigned int)this->workers.size(); }
+unsigned int TextureLoader::GetRequestCount() { return this->requestCount; }
+unsigned int TextureLoader::GetLoadedCount() { return this->loadedCount; }
+bool TextureLoader::IsFinished() { return this->loadedCount == this->requestCount; }
+float TextureLoader::GetFinishMilliseconds() { return this->finishMilliseconds; }
+float TextureLoader::GetUploadMilliseconds() { return this->uploadMilliseconds; }
+float TextureLoader::GetCubeMilliseconds() { return this->cubeMilliseconds; }
+size_t TextureLoader::GetPeakStagingBytes() { return this->peakStagingBytes; }
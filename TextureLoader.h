@@ -0,0 +1,145 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wincodec.h>
+#include <wrl/client.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// --------------------------------------------------------
+// Loads image files in the background.
+//
+// Decoding (the slow part) runs on the loader's own worker
+// threads into CPU memory.  GPU textures are only created in
+// Update(), on the render thread, for every image finished
+// since the last call, and each request's callbacks get the
+// new view there too.  Until then, callers show whatever
+// fallback they like - see CreateSolidTexture().
+//
+// Cube maps decode their six faces in parallel straight into
+// one staging block, each worker building its face's mip chain
+// in place, so the GPU texture is created once with every
+// subresource as initial data.
+//
+// Requesting the same file twice decodes it once.  A 2D image
+// with a baked .dds beside it (see Tools/TextureBaker) loads the
+// .dds instead, compressed mips and all.
+// --------------------------------------------------------
+class TextureLoader
+{
+public:
+	typedef std::function<void(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>)> LoadedFunction;
+
+	// A cube map's CPU pixels, handed out once just before its
+	// staging memory is released
+	struct DecodedCube
+	{
+		unsigned int width;
+		unsigned int height;
+		unsigned int mipLevels;
+		bool sRGB;
+		const uint8_t* faces[6];	// Each face's RGBA8 mip chain, top level first
+
+		const uint8_t* GetLevel(unsigned int face, unsigned int mip) const;
+	};
+	typedef std::function<void(const DecodedCube&)> DecodedCubeFunction;
+
+private:
+	struct Image
+	{
+		std::vector<uint8_t> pixels;	// RGBA8, tightly packed
+		std::vector<uint8_t> dds;		// Or a whole baked DDS file
+		unsigned int width;
+		unsigned int height;
+		bool sRGB;
+		bool failed;
+	};
+
+	struct Request
+	{
+		std::wstring paths[6];
+		unsigned int faceCount;		// 1, or 6 for a cube map
+		unsigned int facesDecoded;
+		Image faces[6];
+		std::unique_ptr<uint8_t[]> staging;	// Cube maps: every face's mip chain, back to back
+		size_t stagingFaceBytes;
+		unsigned int mipLevels;
+		std::chrono::high_resolution_clock::time_point requestTime;
+		std::vector<LoadedFunction> onLoaded;
+		DecodedCubeFunction onDecoded;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;	// Once uploaded
+		bool uploaded;
+	};
+
+	struct DecodeJob
+	{
+		Request* request;
+		unsigned int face;
+	};
+
+	std::vector<std::unique_ptr<Request>> requests;
+	std::unordered_map<std::wstring, Request*> requestsByPath;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<DecodeJob> jobs;
+	std::vector<Request*> decoded;
+	bool stopping;
+
+	// Timing, from construction to the last upload
+	std::chrono::high_resolution_clock::time_point startTime;
+	unsigned int requestCount;
+	unsigned int loadedCount;
+	float finishMilliseconds;
+	float uploadMilliseconds;
+	float cubeMilliseconds;
+
+	// CPU memory held by decoded images waiting for upload
+	size_t stagingBytes;
+	size_t peakStagingBytes;
+
+	void WorkerLoop();
+	void DecodeCubeFace(IWICBitmapFrameDecode* frame, IWICFormatConverter* converter, Request& request, unsigned int face);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(const Request& request);
+
+public:
+	// 0 threads means one per hardware thread
+	TextureLoader(unsigned int threadCount = 0);
+	~TextureLoader();
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// A mipmapped 2D texture
+	void Load(const std::wstring& path, LoadedFunction onLoaded);
+
+	// A cube map from six faces, in +X, -X, +Y, -Y, +Z, -Z order.
+	// onDecoded (optional) gets the pixels too, e.g. to bake from.
+	void LoadCube(const std::wstring facePaths[6], LoadedFunction onLoaded, DecodedCubeFunction onDecoded = 0);
+
+	// Render thread only: creates textures for every finished
+	// image and runs their callbacks.  Returns how many arrived.
+	unsigned int Update();
+
+	// A 1x1 texture (or cube) of one color, as 0xAABBGGRR
+	static Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateSolidTexture(uint32_t color, bool cube = false);
+
+	// Getters
+	unsigned int GetThreadCount();
+	unsigned int GetRequestCount();
+	unsigned int GetLoadedCount();
+	bool IsFinished();
+	float GetFinishMilliseconds();	// Until the last texture arrived
+	float GetUploadMilliseconds();	// Spent creating textures on the render thread
+	float GetCubeMilliseconds();	// Last cube map, from request to GPU texture
+	size_t GetPeakStagingBytes();
+};
@@ -0,0 +1,246 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <cmath>
+
+TextureResidency::TextureResidency(uint64_t budgetBytes) :
+	budgetBytes(budgetBytes),
+	residentBytes(0),
+	frame(0)
+{
+}
+
+// --------------------------------------------------------
+// Adds a texture with just its tail resident.  The tail
+// counts against the budget like everything else, but since
+// it's never evicted it can push the total over.
+// --------------------------------------------------------
+unsigned int TextureResidency::AddTexture(const StreamingTextureInfo& info)
+{
+	TextureState texture = {};
+	texture.info = info;
+	texture.info.mipCount = std::min(info.mipCount, (unsigned int)STREAMING_MAX_MIPS);
+	texture.info.tailMip = std::min(info.tailMip, texture.info.mipCount - 1);
+	texture.residentMip = texture.info.tailMip;
+	texture.loadedFromMip = texture.info.tailMip;
+	texture.requestedMip = texture.info.tailMip;
+	texture.lastUsedFrame = this->frame;
+	texture.loading = false;
+
+	this->residentBytes += CalcBytesFrom(texture, texture.residentMip);
+	this->textures.push_back(texture);
+	return (unsigned int)this->textures.size() - 1;
+}
+
+void TextureResidency::BeginFrame()
+{
+	this->frame++;
+	for (TextureState& texture : this->textures)
+		texture.requestedMip = texture.info.tailMip;
+}
+
+// --------------------------------------------------------
+// Asks for a texture to have (at least) the given mip this
+// frame.  Several requests keep the most detailed one.
+// --------------------------------------------------------
+void TextureResidency::Request(unsigned int texture, unsigned int mip)
+{
+	if (texture >= this->textures.size())
+		return;
+
+	TextureState& state = this->textures[texture];
+	state.requestedMip = std::min(state.requestedMip, mip);
+	state.lastUsedFrame = this->frame;
+}
+
+// --------------------------------------------------------
+// Turns this frame's requests into actions.  Every decision
+// depends only on the order of calls so far, and ties are
+// always broken by texture index.
+// --------------------------------------------------------
+void TextureResidency::Update(std::vector<StreamingAction>& actions)
+{
+	// A lowered budget is met right away, as far as unused mips allow
+	if (this->residentBytes > this->budgetBytes)
+		EvictFor((unsigned int)-1, this->residentBytes - this->budgetBytes, actions);
+
+	// Textures short of what they asked for, most starved first
+	std::vector<unsigned int> candidates;
+	for (unsigned int i = 0; i < this->textures.size(); i++)
+	{
+		const TextureState& texture = this->textures[i];
+		if (!texture.loading && texture.requestedMip < texture.residentMip)
+			candidates.push_back(i);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [&](unsigned int a, unsigned int b)
+		{
+			unsigned int deficitA = this->textures[a].residentMip - this->textures[a].requestedMip;
+			unsigned int deficitB = this->textures[b].residentMip - this->textures[b].requestedMip;
+			return deficitA != deficitB ? deficitA > deficitB : a < b;
+		});
+
+	unsigned int loads = 0;
+	for (unsigned int index : candidates)
+	{
+		if (loads == STREAMING_MAX_LOADS)
+			break;
+
+		TextureState& texture = this->textures[index];
+
+		// Make room for the full request if older textures can spare it,
+		// then settle for whatever does fit
+		uint64_t needed = CalcBytesFrom(texture, texture.requestedMip) - CalcBytesFrom(texture, texture.residentMip);
+		if (this->residentBytes + needed > this->budgetBytes)
+			EvictFor(index, this->residentBytes + needed - this->budgetBytes, actions);
+
+		unsigned int target = texture.requestedMip;
+		while (target < texture.residentMip &&
+			this->residentBytes + CalcBytesFrom(texture, target) - CalcBytesFrom(texture, texture.residentMip) > this->budgetBytes)
+			target++;
+
+		if (target == texture.residentMip)
+			continue;
+
+		this->residentBytes += CalcBytesFrom(texture, target) - CalcBytesFrom(texture, texture.residentMip);
+		texture.loadedFromMip = texture.residentMip;
+		texture.residentMip = target;
+		texture.loading = true;
+		actions.push_back({ StreamingActionType::Load, index, target });
+		loads++;
+	}
+}
+
+void TextureResidency::CompleteLoad(unsigned int texture, bool succeeded)
+{
+	if (texture >= this->textures.size() || !this->textures[texture].loading)
+		return;
+
+	TextureState& state = this->textures[texture];
+	state.loading = false;
+	if (!succeeded)
+	{
+		this->residentBytes -= CalcBytesFrom(state, state.residentMip) - CalcBytesFrom(state, state.loadedFromMip);
+		state.residentMip = state.loadedFromMip;
+	}
+}
+
+// --------------------------------------------------------
+// Frees at least neededBytes if it can, from the least
+// recently used textures first, never touching mips that
+// were requested this frame, a texture that's loading or
+// the texture being made room for.  Each texture gives up
+// its most detailed mips first, one at a time, so no more
+// is dropped than needed.
+// --------------------------------------------------------
+bool TextureResidency::EvictFor(unsigned int texture, uint64_t neededBytes, std::vector<StreamingAction>& actions)
+{
+	std::vector<unsigned int> victims;
+	for (unsigned int i = 0; i < this->textures.size(); i++)
+	{
+		const TextureState& state = this->textures[i];
+		if (i != texture && !state.loading && state.residentMip < state.requestedMip)
+			victims.push_back(i);
+	}
+
+	std::sort(victims.begin(), victims.end(), [&](unsigned int a, unsigned int b)
+		{
+			uint64_t usedA = this->textures[a].lastUsedFrame;
+			uint64_t usedB = this->textures[b].lastUsedFrame;
+			return usedA != usedB ? usedA < usedB : a < b;
+		});
+
+	uint64_t freed = 0;
+	for (unsigned int index : victims)
+	{
+		if (freed >= neededBytes)
+			break;
+
+		TextureState& state = this->textures[index];
+		uint64_t before = CalcBytesFrom(state, state.residentMip);
+		while (state.residentMip < state.requestedMip && freed + before - CalcBytesFrom(state, state.residentMip) < neededBytes)
+			state.residentMip++;
+
+		uint64_t dropped = before - CalcBytesFrom(state, state.residentMip);
+		freed += dropped;
+		this->residentBytes -= dropped;
+		actions.push_back({ StreamingActionType::Evict, index, state.residentMip });
+	}
+
+	return freed >= neededBytes;
+}
+
+uint64_t TextureResidency::CalcBytesFrom(const TextureState& texture, unsigned int mip) const
+{
+	uint64_t bytes = 0;
+	for (unsigned int i = mip; i < texture.info.mipCount; i++)
+		bytes += texture.info.mipBytes[i];
+	return bytes;
+}
+
+void TextureResidency::SetBudget(uint64_t budgetBytes) { this->budgetBytes = budgetBytes; }
+
+unsigned int TextureResidency::GetTextureCount() const { return (unsigned int)this->textures.size(); }
+unsigned int TextureResidency::GetResidentMip(unsigned int texture) const { return this->textures[texture].residentMip; }
+unsigned int TextureResidency::GetRequestedMip(unsigned int texture) const { return this->textures[texture].requestedMip; }
+bool TextureResidency::IsLoading(unsigned int texture) const { return this->textures[texture].loading; }
+uint64_t TextureResidency::GetResidentBytes() const { return this->residentBytes; }
+uint64_t TextureResidency::GetBudget() const { return this->budgetBytes; }
+uint64_t TextureResidency::GetFrame() const { return this->frame; }
+
+unsigned int TextureResidency::CalcTailMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int blockAlignment)
+{
+	if (mipCount == 0)
+		return 0;
+
+	unsigned int mip = 0;
+	while (mip + 1 < mipCount && std::max(width >> mip, height >> mip) > STREAMING_TAIL_SIZE)
+		mip++;
+
+	while (mip > 0 && (std::max(width >> mip, 1u) % blockAlignment != 0 || std::max(height >> mip, 1u) % blockAlignment != 0))
+		mip--;
+
+	return mip;
+}
+
+// --------------------------------------------------------
+// Texels per screen pixel along the texture's larger axis:
+// texels per world unit over pixels per world unit at that
+// depth.  Each mip halves it, so the log2 is the mip where
+// a texel covers about one pixel.
+// --------------------------------------------------------
+unsigned int TextureResidency::CalcRequiredMip(
+	unsigned int textureWidth,
+	unsigned int textureHeight,
+	unsigned int mipCount,
+	float uvDensity,
+	float uvScale,
+	float worldScale,
+	float viewDepth,
+	float pixelsPerUnit)
+{
+	// Without the numbers to go on, assume the worst
+	if (mipCount == 0 || uvDensity <= 0.0f || worldScale <= 0.0f || pixelsPerUnit <= 0.0f)
+		return 0;
+
+	float texelsPerUnit = std::max(textureWidth, textureHeight) * uvDensity * uvScale / worldScale;
+	float pixelsAtDepth = pixelsPerUnit / std::max(viewDepth, 0.0001f);
+	float texelsPerPixel = texelsPerUnit / pixelsAtDepth;
+	if (texelsPerPixel <= 1.0f)
+		return 0;
+
+	return std::min((unsigned int)floorf(log2f(texelsPerPixel)), mipCount - 1);
+}
+
+bool TextureResidency::IsSphereVisible(float x, float y, float z, float radius, float projectionScaleX, float projectionScaleY, float nearZ, float farZ)
+{
+	if (z + radius < nearZ || z - radius > farZ)
+		return false;
+
+	// Side planes pass through the eye: |x| * scale = z at the edge
+	float lengthX = sqrtf(projectionScaleX * projectionScaleX + 1.0f);
+	float lengthY = sqrtf(projectionScaleY * projectionScaleY + 1.0f);
+	return
+		(fabsf(x) * projectionScaleX - z) / lengthX < radius &&
+		(fabsf(y) * projectionScaleY - z) / lengthY < radius;
+}
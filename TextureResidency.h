@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define STREAMING_MAX_MIPS 16
+#define STREAMING_TAIL_SIZE 64		// Mips this size and smaller are loaded up front and never evicted
+#define STREAMING_MAX_LOADS 4		// Loads started per Update
+
+// What the policy needs to know about one streamed texture
+struct StreamingTextureInfo
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipCount;
+	uint64_t mipBytes[STREAMING_MAX_MIPS];
+	unsigned int tailMip;	// Most detailed mip that's always resident
+};
+
+enum class StreamingActionType
+{
+	Load,	// Bring mips [mip, current) in (asynchronously)
+	Evict	// Drop everything more detailed than mip (right away)
+};
+
+struct StreamingAction
+{
+	StreamingActionType type;
+	unsigned int texture;
+	unsigned int mip;	// The texture's most detailed resident mip afterwards
+};
+
+// --------------------------------------------------------
+// Decides which mips of each streamed texture should be in
+// memory.  No graphics API, no threads and no clocks - just
+// frame numbers - so the same requests always produce the same
+// actions, whatever machine it runs on.
+//
+// Each frame, every visible use of a texture requests the mip
+// it needs (see CalcRequiredMip).  Update() then turns the
+// difference between requested and resident mips into loads,
+// most starved texture first.  Loads count against the budget
+// as soon as they start; when one doesn't fit, the least
+// recently used textures give up mips they aren't asked for,
+// and if that's still not enough the load settles for a less
+// detailed mip.
+// --------------------------------------------------------
+class TextureResidency
+{
+private:
+	struct TextureState
+	{
+		StreamingTextureInfo info;
+		unsigned int residentMip;	// Most detailed mip resident (or being loaded)
+		unsigned int loadedFromMip;	// What was resident before the load
+		unsigned int requestedMip;	// Most detailed mip asked for this frame
+		uint64_t lastUsedFrame;
+		bool loading;
+	};
+
+	std::vector<TextureState> textures;
+	uint64_t budgetBytes;
+	uint64_t residentBytes;
+	uint64_t frame;
+
+	uint64_t CalcBytesFrom(const TextureState& texture, unsigned int mip) const;
+	bool EvictFor(unsigned int texture, uint64_t neededBytes, std::vector<StreamingAction>& actions);
+
+public:
+	TextureResidency(uint64_t budgetBytes);
+
+	// Starts with only the tail resident; returns the texture's index
+	unsigned int AddTexture(const StreamingTextureInfo& info);
+
+	// Requests only count for the frame they're made in
+	void BeginFrame();
+	void Request(unsigned int texture, unsigned int mip);
+
+	// Appends this frame's loads and evictions to actions
+	void Update(std::vector<StreamingAction>& actions);
+
+	// The data for the texture's last Load is in place - or isn't,
+	// in which case it goes back to what it had before
+	void CompleteLoad(unsigned int texture, bool succeeded = true);
+
+	void SetBudget(uint64_t budgetBytes);
+
+	// Getters
+	unsigned int GetTextureCount() const;
+	unsigned int GetResidentMip(unsigned int texture) const;
+	unsigned int GetRequestedMip(unsigned int texture) const;
+	bool IsLoading(unsigned int texture) const;
+	uint64_t GetResidentBytes() const;
+	uint64_t GetBudget() const;
+	uint64_t GetFrame() const;
+
+	// Picks the first mip of at most STREAMING_TAIL_SIZE, moving to
+	// more detailed ones while blockAlignment doesn't divide its size
+	// (block compressed textures can't start at a 2x2 mip)
+	static unsigned int CalcTailMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int blockAlignment);
+
+	// The mip whose texels are about pixel sized on screen for a
+	// surface at viewDepth.  uvDensity is UV units per object space
+	// unit (see Mesh), pixelsPerUnit the screen pixels covered by one
+	// world unit at a depth of 1 (projection[1][1] * height / 2).
+	static unsigned int CalcRequiredMip(
+		unsigned int textureWidth,
+		unsigned int textureHeight,
+		unsigned int mipCount,
+		float uvDensity,
+		float uvScale,
+		float worldScale,
+		float viewDepth,
+		float pixelsPerUnit);
+
+	// Bounding sphere (view space) against the frustum's side, near
+	// and far planes, from a perspective projection's x/y scales
+	static bool IsSphereVisible(float x, float y, float z, float radius, float projectionScaleX, float projectionScaleY, float nearZ, float farZ);
+};
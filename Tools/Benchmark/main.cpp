@@ -0,0 +1,698 @@
+#include "CommandBuffer.h"
+#include "DeferredPasses.h"
+#include "DrawTable.h"
+#include "EntityDraws.h"
+#include "FrameStats.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "LightPacking.h"
+#include "LightVolumes.h"
+#include "ObjectLightLists.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "Transform.h"
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Headless CPU benchmark: runs the game's per-frame update
+// and draw preparation - light packing and clustering, the
+// draw table, parallel command recording, the depth pre-pass
+// sort, the deferred passes and the render graph - over a
+// generated scene, and replays every command into a
+// NullCommandBackend instead of a GPU.
+//
+// Time advances by a fixed step and the camera follows a
+// scripted orbit, so every run does the same work and only
+// the timings change between machines or commits.  Results
+// go out as JSON.
+//
+// Usage: Benchmark [options]
+//   --frames N            Measured frames (default 1000)
+//   --warmup N            Frames run first and not measured (default 30)
+//   --entities N          Entities in the scene (default 2048)
+//   --materials N         Materials they cycle through (default 16)
+//   --lights N            Scattered point lights (default 256)
+//   --threads N           Threads recording draws (default: all cores)
+//   --budget MS           Frame time counted as a hitch (default 16.67)
+//   --deferred            Deferred path, as with -deferred in the game
+//   --perobjectlights     Per-object light lists instead of clusters
+//   --nodrawtable         Per-object constants instead of the draw table
+//   --depthprepass        Draw depth first
+//   --trace path          Chrome trace of the measured frames
+//   -o path               Write the JSON here instead of stdout
+// --------------------------------------------------------
+
+struct BenchmarkOptions
+{
+	unsigned int frames = 1000;
+	unsigned int warmup = 30;
+	unsigned int entities = 2048;
+	unsigned int materials = 16;
+	unsigned int lights = 256;
+	unsigned int threads = 0;
+	float budget = FRAME_STATS_DEFAULT_BUDGET;
+	bool deferred = false;
+	bool perObjectLights = false;
+	bool drawTable = true;
+	bool depthPrepass = false;
+	std::string trace;
+	std::string output;
+};
+
+// A material as Game::PrepareDrawItems describes it, with
+// stand-ins for the API objects; only their identity matters
+// to the commands
+struct BenchmarkMaterial
+{
+	DrawMaterial draw;
+	MaterialBindGroup bindGroup;
+	PerMaterialData constants;
+};
+
+struct BenchmarkEntity
+{
+	Transform transform;
+	unsigned int mesh;
+	unsigned int material;
+};
+
+// Call counts of one run, added up over every measured frame
+struct BenchmarkTotals
+{
+	uint64_t drawCalls = 0;
+	uint64_t shaderChanges = 0;
+	uint64_t meshChanges = 0;
+	uint64_t textureBinds = 0;
+	uint64_t samplerBinds = 0;
+	uint64_t constantBinds = 0;
+	uint64_t renderTargetChanges = 0;
+	uint64_t stateChanges = 0;
+	uint64_t commands = 0;
+	uint64_t uploadBytes = 0;
+};
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	// Same rounding as Graphics::CalcConstantBufferSize()
+	unsigned int CalcConstantBufferSize(unsigned int dataSizeInBytes)
+	{
+		return (dataSizeInBytes + 255) / 256 * 256;
+	}
+
+	// A unique, never dereferenced handle per object
+	const void* FakeHandle()
+	{
+		static uintptr_t next = 0x1000;
+		next += 16;
+		return (const void*)next;
+	}
+
+	// Per-object constants for one range of draws.  Each range
+	// writes its own part of the frame's constants, starting
+	// where the ranges before it could end at most, so no two
+	// draws are ever bound to the same constants.
+	class RangeConstantAllocator : public DrawConstantAllocator
+	{
+	public:
+		unsigned char* ring = 0;
+		unsigned int offset = 0;
+		uint64_t bytes = 0;
+
+		DrawConstants Allocate(unsigned int dataSizeInBytes) override
+		{
+			unsigned int reservationSize = CalcConstantBufferSize(dataSizeInBytes);
+			DrawConstants allocation = { this->ring + this->offset, this->offset / 16, reservationSize / 16 };
+			this->offset += reservationSize;
+			this->bytes += reservationSize;
+			return allocation;
+		}
+	};
+
+	// Fixed seed, so every run builds the same scene
+	uint32_t randomState = 12345;
+	float RandomFloat()
+	{
+		randomState = randomState * 1664525u + 1013904223u;
+		return (randomState >> 8) / 16777216.0f;
+	}
+
+	void PrintUsage()
+	{
+		printf("Usage: Benchmark [--frames N] [--warmup N] [--entities N] [--materials N] [--lights N]\n"
+			"                 [--threads N] [--budget MS] [--deferred] [--perobjectlights]\n"
+			"                 [--nodrawtable] [--depthprepass] [--trace path] [-o path]\n");
+	}
+}
+
+// --------------------------------------------------------
+// The scene: a grid of entities using a handful of meshes
+// and materials, three directional lights, and point lights
+// scattered over the grid the way Game::GenerateScatteredLights
+// lays them out
+// --------------------------------------------------------
+class BenchmarkScene
+{
+public:
+	BenchmarkOptions options;
+	std::vector<DrawMesh> meshes;
+	std::vector<BenchmarkMaterial> materials;
+	std::vector<BenchmarkEntity> entities;
+	std::vector<DrawItem> drawItems;
+	std::vector<Light> lights;
+	float extent = 0.0f;
+
+	// Shaders and states shared by every draw
+	const void* drawTableVS = FakeHandle();
+	const void* vertexShader = FakeHandle();
+	const void* depthPrepassVS = FakeHandle();
+	const void* depthEqualState = FakeHandle();
+	const void* skyVS = FakeHandle();
+	const void* skyPS = FakeHandle();
+	const void* skyDepthState = FakeHandle();
+	const void* skyRasterizerState = FakeHandle();
+	const void* skyTexture = FakeHandle();
+	const void* backBuffer = FakeHandle();
+	const void* depthBuffer = FakeHandle();
+	DeferredPassResources deferredResources = {};
+
+	// Camera, moved along its path every frame
+	Transform camera;
+	XMFLOAT4X4 view = {};
+	XMFLOAT4X4 projection = {};
+	const float nearZ = 0.1f;
+	const float farZ = 100.0f;
+
+	// Per-frame state, as in Game
+	DrawTable drawTable;
+	LightPacking lightPacking;
+	LightClusters lightClusters;
+	ObjectLightLists objectLightLists;
+	LightVolumes lightVolumes;
+	RenderGraph renderGraph;
+	std::vector<CommandBuffer> commandBuffers;
+	std::vector<CommandBuffer> gBufferCommandBuffers;
+	CommandBuffer depthPrepassCommands;
+	CommandBuffer deferredGeometryCommands;	// Kept apart from the lighting pass's,
+	CommandBuffer deferredLightingCommands;	// so both are still there to count
+	CommandBuffer skyCommands;
+	std::vector<unsigned int> depthPrepassOrder;
+	std::vector<float> depthPrepassDepths;
+	std::vector<unsigned char> constantRing;
+	std::vector<RangeConstantAllocator> rangeConstants;
+	NullCommandBackend backend;
+	uint64_t uploadBytes = 0;
+
+	BenchmarkScene(const BenchmarkOptions& options);
+
+	void Update(float deltaTime, float totalTime);
+	void Draw(float totalTime);
+
+private:
+	void RecordSky(CommandBuffer& commands);
+};
+
+BenchmarkScene::BenchmarkScene(const BenchmarkOptions& options)
+{
+	this->options = options;
+
+	// Roughly the sizes of the game's cube, sphere, helix, torus...
+	// with bounds a little off their origins, as modelled ones are
+	const unsigned int indexCounts[] = { 36, 2880, 12672, 3456, 6, 2304 };
+	for (unsigned int indexCount : indexCounts)
+	{
+		DrawMesh mesh = {};
+		mesh.vertexBuffer = FakeHandle();
+		mesh.positionBuffer = FakeHandle();
+		mesh.indexBuffer = FakeHandle();
+		mesh.vertexStride = 48;
+		mesh.indexCount = indexCount;
+		mesh.boundsCenter = XMFLOAT3(0.0f, RandomFloat() - 0.5f, 0.0f);
+		mesh.boundsRadius = 0.5f + RandomFloat();
+		this->meshes.push_back(mesh);
+	}
+
+	// Every other material keeps its textures in the shared arrays,
+	// binding only its sampler, the way Material::RebuildBindGroup
+	// leaves them; the rest bind three textures of their own
+	const void* sampler = FakeHandle();
+	const void* surfaceArray = FakeHandle();
+	const void* normalArray = FakeHandle();
+	for (unsigned int i = 0; i < std::max(options.materials, 1u); i++)
+	{
+		BenchmarkMaterial material = {};
+		material.draw.vertexShader = this->vertexShader;
+		material.draw.pixelShader = FakeHandle();
+		material.draw.drawTablePixelShader = FakeHandle();
+		material.draw.gBufferPixelShader = FakeHandle();
+		material.draw.constantBuffer = FakeHandle();
+		if (i % 2)
+		{
+			material.draw.usesTextureArrays = true;
+			material.draw.textureArrays[0] = surfaceArray;
+			material.draw.textureArrays[1] = normalArray;
+		}
+		else
+		{
+			material.bindGroup.textureCount = 3;
+			for (unsigned int slot = 0; slot < 3; slot++)
+				material.bindGroup.textures[slot] = FakeHandle();
+		}
+		material.bindGroup.samplerCount = 1;
+		material.bindGroup.samplers[0] = sampler;
+		material.constants.colorTint = XMFLOAT4(RandomFloat(), RandomFloat(), RandomFloat(), 1.0f);
+		material.constants.uvScale = XMFLOAT2(1.0f, 1.0f);
+		material.constants.roughness = RandomFloat();
+		this->materials.push_back(material);
+	}
+
+	// Neighbours mostly share a material, like hand-placed scenes do
+	unsigned int gridSize = (unsigned int)ceilf(sqrtf((float)options.entities));
+	this->extent = gridSize * 3.0f;
+	for (unsigned int i = 0; i < options.entities; i++)
+	{
+		BenchmarkEntity entity;
+		entity.mesh = i % this->meshes.size();
+		entity.material = (i / 8) % this->materials.size();
+		entity.transform.SetPosition(
+			-this->extent / 2 + 3.0f * (i % gridSize),
+			RandomFloat() * 2.0f,
+			-this->extent / 2 + 3.0f * (i / gridSize));
+		entity.transform.SetRotation(0, RandomFloat() * XM_2PI, 0);
+		float scale = 0.5f + RandomFloat();
+		entity.transform.SetScale(scale, scale, scale);
+		this->entities.push_back(entity);
+	}
+
+	// Nothing is added after this, so the pointers stay good
+	for (BenchmarkMaterial& material : this->materials)
+		material.draw.bindGroup = &material.bindGroup;
+	for (BenchmarkEntity& entity : this->entities)
+		this->drawItems.push_back({ &this->meshes[entity.mesh], &this->materials[entity.material].draw, &entity.transform });
+
+	const XMFLOAT3 directions[] = {
+		XMFLOAT3(1.0f, -1.0f, 0.0f),
+		XMFLOAT3(-1.0f, -0.5f, 0.5f),
+		XMFLOAT3(0.0f, -1.0f, -1.0f) };
+	for (const XMFLOAT3& direction : directions)
+	{
+		Light light = {};
+		light.type = LIGHT_TYPE_DIRECTIONAL;
+		light.direction = direction;
+		light.color = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		light.intensity = 0.5f;
+		this->lights.push_back(light);
+	}
+
+	const XMFLOAT3 colors[] = {
+		XMFLOAT3(1.0f, 0.3f, 0.3f),
+		XMFLOAT3(0.3f, 1.0f, 0.3f),
+		XMFLOAT3(0.3f, 0.3f, 1.0f),
+		XMFLOAT3(1.0f, 0.9f, 0.4f) };
+	unsigned int lightGridSize = (unsigned int)ceilf(sqrtf((float)options.lights));
+	for (unsigned int i = 0; i < options.lights; i++)
+	{
+		Light light = {};
+		light.type = LIGHT_TYPE_POINT;
+		light.position = XMFLOAT3(
+			-this->extent / 2 + this->extent * (i % lightGridSize) / lightGridSize,
+			1.0f + (i % 3),
+			-this->extent / 2 + this->extent * (i / lightGridSize) / lightGridSize);
+		light.range = 3.0f;
+		light.color = colors[i % 4];
+		light.intensity = 1.0f;
+		this->lights.push_back(light);
+	}
+
+	DeferredPassResources& resources = this->deferredResources;
+	for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++)
+	{
+		resources.gBufferTargets[i] = FakeHandle();
+		resources.gBufferViews[i] = FakeHandle();
+	}
+	resources.backBuffer = this->backBuffer;
+	resources.depthStencil = this->depthBuffer;
+	resources.fullscreenVS = FakeHandle();
+	resources.ambientPS = FakeHandle();
+	resources.volumeVS = FakeHandle();
+	resources.volumePS = FakeHandle();
+	resources.volumeVertexBuffer = FakeHandle();
+	resources.volumeIndexBuffer = FakeHandle();
+	resources.volumeVertexStride = sizeof(XMFLOAT3);
+	resources.volumeIndexCount = 2880;
+	resources.stencilMarkDepthState = FakeHandle();
+	resources.stencilTestDepthState = FakeHandle();
+	resources.insideVolumeDepthState = FakeHandle();
+	resources.noColorBlendState = FakeHandle();
+	resources.additiveBlendState = FakeHandle();
+	resources.cullNoneRasterizerState = FakeHandle();
+	resources.cullFrontRasterizerState = FakeHandle();
+
+	XMStoreFloat4x4(&this->projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, this->nearZ, this->farZ));
+}
+
+// --------------------------------------------------------
+// Spins the entities like Game::Update and flies the camera
+// around the scene, bobbing up and down, always looking at
+// its center
+// --------------------------------------------------------
+void BenchmarkScene::Update(float deltaTime, float totalTime)
+{
+	PROFILE_SCOPE("Update");
+
+	for (BenchmarkEntity& entity : this->entities)
+		entity.transform.Rotate(0, deltaTime * 0.25f, 0);
+
+	float angle = totalTime * 0.2f;
+	float radius = this->extent * 0.6f;
+	XMFLOAT3 position(radius * sinf(angle), 6.0f + 4.0f * sinf(totalTime * 0.3f), -radius * cosf(angle));
+	this->camera.SetPosition(position);
+	this->camera.SetRotation(
+		atan2f(position.y, sqrtf(position.x * position.x + position.z * position.z)),
+		atan2f(-position.x, -position.z),
+		0);
+
+	XMFLOAT3 forward = this->camera.GetForward();
+	XMFLOAT3 up = this->camera.GetUp();
+	XMStoreFloat4x4(&this->view, XMMatrixLookToLH(XMLoadFloat3(&position), XMLoadFloat3(&forward), XMLoadFloat3(&up)));
+}
+
+// --------------------------------------------------------
+// Game::Draw without the GPU: the same preparation and the
+// same passes, with buffer uploads counted instead of made
+// and every command replayed into the null backend
+// --------------------------------------------------------
+void BenchmarkScene::Draw(float totalTime)
+{
+	PROFILE_SCOPE("Draw");
+	this->backend.Reset();
+	this->uploadBytes = 0;
+
+	unsigned int entityCount = (unsigned int)this->entities.size();
+	unsigned int rangeCount = (entityCount + 63) / 64;
+	if (rangeCount > JobSystem::WorkerCount() + 1)
+		rangeCount = JobSystem::WorkerCount() + 1;
+	if (rangeCount == 0)
+		rangeCount = 1;
+	if (this->commandBuffers.size() < rangeCount)
+		this->commandBuffers.resize(rangeCount);
+	if (this->options.deferred && this->gBufferCommandBuffers.size() < rangeCount)
+		this->gBufferCommandBuffers.resize(rangeCount);
+	if (this->rangeConstants.size() < rangeCount)
+		this->rangeConstants.resize(rangeCount);
+
+	this->drawTable.Reset();
+	this->drawTable.ResizeObjects(entityCount);
+	for (BenchmarkMaterial& material : this->materials)
+		material.draw.drawTableMaterial = this->drawTable.AddMaterial(&material, material.constants);
+
+	this->lightPacking.Pack(this->lights);
+	this->lightClusters.Build(
+		this->lightPacking.GetSortedLights(),
+		this->view,
+		this->projection,
+		this->nearZ,
+		this->farZ,
+		!this->options.perObjectLights);
+	this->uploadBytes +=
+		this->lightPacking.GetLightCount() * sizeof(PackedLight) +
+		LIGHT_CLUSTER_COUNT * sizeof(LightClusterRange) +
+		this->lightClusters.GetLightIndexCount() * sizeof(uint32_t);
+	if (this->options.perObjectLights)
+		this->objectLightLists.Resize(entityCount);
+
+	// Per-frame constants, filled in as Game::WritePerFrameData does
+	PerFrameData frameData = {};
+	frameData.view = this->view;
+	frameData.projection = this->projection;
+	XMStoreFloat4x4(&frameData.viewProjection, XMLoadFloat4x4(&this->view) * XMLoadFloat4x4(&this->projection));
+	frameData.cameraPosition = this->camera.GetPosition();
+	frameData.time = totalTime;
+	frameData.directionalLightCount = this->lightClusters.GetDirectionalLightCount();
+	frameData.clusterSliceScale = this->lightClusters.GetSliceScale();
+	frameData.clusterSliceBias = this->lightClusters.GetSliceBias();
+	unsigned int frameBytes = CalcConstantBufferSize(sizeof(PerFrameData));
+	unsigned int bytesPerEntity = CalcConstantBufferSize(sizeof(PerObjectData));
+	this->constantRing.resize(frameBytes + entityCount * bytesPerEntity);
+	memcpy(this->constantRing.data(), &frameData, sizeof(PerFrameData));
+	this->uploadBytes += frameBytes;
+
+	EntityDrawSettings drawSettings = {};
+	drawSettings.drawTableVS = this->drawTableVS;
+	drawSettings.useDrawTable = this->options.drawTable;
+	drawSettings.drawTable = &this->drawTable;
+	drawSettings.objectLightLists = this->options.perObjectLights ? &this->objectLightLists : 0;
+	drawSettings.sortedLights = &this->lightPacking.GetSortedLights();
+
+	JobSystem::ParallelFor(entityCount, rangeCount,
+		[&](unsigned int rangeIndex, unsigned int begin, unsigned int end)
+		{
+			PROFILE_SCOPE("Record draws");
+			CommandBuffer& commands = this->commandBuffers[rangeIndex];
+			commands.Reset();
+			CommandBuffer* gBufferCommands = 0;
+			if (this->options.deferred) {
+				gBufferCommands = &this->gBufferCommandBuffers[rangeIndex];
+				gBufferCommands->Reset();
+			}
+
+			// Past the per-frame constants, each entity has room for
+			// its own, so a range starts after all the ones before it
+			RangeConstantAllocator& constants = this->rangeConstants[rangeIndex];
+			constants.ring = this->constantRing.data();
+			constants.offset = frameBytes + begin * bytesPerEntity;
+			constants.bytes = 0;
+			EntityDrawSettings settings = drawSettings;
+			settings.constants = &constants;
+			EntityDraws::RecordDraws(commands, gBufferCommands, settings, this->drawItems.data(), begin, end);
+		});
+	for (unsigned int i = 0; i < rangeCount; i++)
+		this->uploadBytes += this->rangeConstants[i].bytes;
+
+	this->uploadBytes +=
+		this->drawTable.GetObjectCount() * sizeof(DrawTableObject) +
+		this->drawTable.GetMaterialCount() * sizeof(PerMaterialData);
+	if (this->options.deferred)
+	{
+		this->lightVolumes.Build(this->lightPacking.GetSortedLights(), 1.0f, this->camera.GetPosition(), this->nearZ);
+		this->uploadBytes += this->lightVolumes.GetVolumeCount() * sizeof(LightVolume);
+	}
+	if (this->options.perObjectLights)
+		this->uploadBytes += this->objectLightLists.GetCount() * sizeof(ObjectLightList);
+
+	PROFILE_SCOPE("Render graph");
+	this->renderGraph.Reset();
+	RenderGraphResource backBuffer = this->renderGraph.ImportTexture("Back buffer");
+	RenderGraphResource depthBuffer = this->renderGraph.ImportTexture("Depth buffer");
+
+	if (this->options.depthPrepass)
+	{
+		unsigned int pass = this->renderGraph.AddPass("Depth pre-pass", [&](const RenderGraph&) {
+			EntityDraws::RecordDepthPrepass(
+				this->depthPrepassCommands,
+				this->depthPrepassVS,
+				this->drawItems.data(),
+				(unsigned int)this->drawItems.size(),
+				this->view,
+				this->depthPrepassOrder,
+				this->depthPrepassDepths);
+			this->depthPrepassCommands.SetRenderState(this->depthEqualState, 0, 0);
+			this->depthPrepassCommands.Replay(this->backend);
+		});
+		this->renderGraph.Write(pass, depthBuffer);
+	}
+
+	if (this->options.deferred)
+	{
+		RenderGraphResource gBuffer[GBUFFER_TARGET_COUNT] = {
+			this->renderGraph.CreateTexture("G-buffer albedo", { 1920, 1080, RenderGraphFormat::RGBA8Unorm }),
+			this->renderGraph.CreateTexture("G-buffer normal", { 1920, 1080, RenderGraphFormat::RG16Snorm }),
+			this->renderGraph.CreateTexture("G-buffer depth", { 1920, 1080, RenderGraphFormat::R32Float }) };
+
+		unsigned int geometryPass = this->renderGraph.AddPass("G-buffer", [&](const RenderGraph&) {
+			this->deferredGeometryCommands.Reset();
+			DeferredPasses::RecordGeometryBegin(this->deferredGeometryCommands, this->deferredResources);
+			this->deferredGeometryCommands.Replay(this->backend);
+			for (unsigned int i = 0; i < rangeCount; i++)
+				this->gBufferCommandBuffers[i].Replay(this->backend);
+		});
+		for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++)
+			this->renderGraph.Write(geometryPass, gBuffer[i]);
+		this->renderGraph.Write(geometryPass, depthBuffer);
+
+		unsigned int lightingPass = this->renderGraph.AddPass("Deferred lighting", [&](const RenderGraph&) {
+			this->deferredLightingCommands.Reset();
+			DeferredPasses::RecordLighting(this->deferredLightingCommands, this->deferredResources, this->lightVolumes.GetOutsideCount(), this->lightVolumes.GetInsideCount());
+			if (this->options.depthPrepass)
+				this->deferredLightingCommands.SetRenderState(this->depthEqualState, 0, 0);
+			this->deferredLightingCommands.Replay(this->backend);
+		});
+		for (unsigned int i = 0; i < GBUFFER_TARGET_COUNT; i++)
+			this->renderGraph.Read(lightingPass, gBuffer[i]);
+		this->renderGraph.Read(lightingPass, depthBuffer);
+		this->renderGraph.Write(lightingPass, backBuffer);
+		this->renderGraph.Write(lightingPass, depthBuffer);
+	}
+
+	unsigned int forwardPass = this->renderGraph.AddPass("Forward", [&](const RenderGraph&) {
+		for (unsigned int i = 0; i < rangeCount; i++)
+			this->commandBuffers[i].Replay(this->backend);
+	});
+	this->renderGraph.Write(forwardPass, backBuffer);
+	this->renderGraph.Write(forwardPass, depthBuffer);
+
+	unsigned int skyPass = this->renderGraph.AddPass("Sky", [&](const RenderGraph&) {
+		RecordSky(this->skyCommands);
+		this->skyCommands.Replay(this->backend);
+	});
+	this->renderGraph.Read(skyPass, depthBuffer);
+	this->renderGraph.Write(skyPass, backBuffer);
+
+	if (this->renderGraph.Compile())
+		this->renderGraph.Execute();
+}
+
+// The calls Sky::Draw makes, as commands
+void BenchmarkScene::RecordSky(CommandBuffer& commands)
+{
+	commands.Reset();
+	commands.SetRenderState(this->skyDepthState, 0, this->skyRasterizerState);
+	commands.SetShaders(this->skyVS, this->skyPS);
+	commands.BindTextures(ShaderStage::Pixel, 0, 1, &this->skyTexture);
+	commands.SetMesh(this->meshes[0].vertexBuffer, this->meshes[0].indexBuffer, 48);
+	commands.DrawIndexed(this->meshes[0].indexCount, 0, 0);
+	commands.SetRenderState(0, 0, 0);
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) options.frames = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--warmup" && i + 1 < argc) options.warmup = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--entities" && i + 1 < argc) options.entities = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--materials" && i + 1 < argc) options.materials = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--lights" && i + 1 < argc) options.lights = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--threads" && i + 1 < argc) options.threads = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--budget" && i + 1 < argc) options.budget = (float)atof(argv[++i]);
+		else if (arg == "--deferred") options.deferred = true;
+		else if (arg == "--perobjectlights") options.perObjectLights = true;
+		else if (arg == "--nodrawtable") options.drawTable = false;
+		else if (arg == "--depthprepass") options.depthPrepass = true;
+		else if (arg == "--trace" && i + 1 < argc) options.trace = argv[++i];
+		else if (arg == "-o" && i + 1 < argc) options.output = argv[++i];
+		else if (arg == "-h" || arg == "--help") { PrintUsage(); return 0; }
+		else { fprintf(stderr, "Unknown option %s\n", arg.c_str()); PrintUsage(); return 1; }
+	}
+	if (options.frames == 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// One worker fewer than requested, since the calling thread
+	// records too (a single thread means no workers at all)
+	if (options.threads != 1)
+		JobSystem::Initialize(options.threads > 1 ? options.threads - 1 : 0);
+	Profiler::SetThreadName("Main");
+	Profiler::SetEnabled(!options.trace.empty());
+
+	BenchmarkScene scene(options);
+	// Percentiles over the whole run, not just its last frames
+	FrameStats frameStats(options.budget, options.frames);
+	BenchmarkTotals totals;
+
+	// Fixed timestep, so frame N looks the same on every run
+	const float timestep = 1.0f / 60.0f;
+	for (unsigned int frame = 0; frame < options.warmup + options.frames; frame++)
+	{
+		bool measured = frame >= options.warmup;
+		if (frame == options.warmup && !options.trace.empty())
+			Profiler::StartCapture(options.frames, options.trace);
+
+		int64_t start = Profiler::Now();
+		float totalTime = frame * timestep;
+		scene.Update(timestep, totalTime);
+		scene.Draw(totalTime);
+		int64_t end = Profiler::Now();
+		Profiler::EndFrame();
+		if (!measured)
+			continue;
+
+		frameStats.AddFrame((end - start) / 1000000.0f);
+		const NullCommandBackend& backend = scene.backend;
+		totals.drawCalls += backend.drawCalls;
+		totals.shaderChanges += backend.shaderChanges;
+		totals.meshChanges += backend.meshChanges;
+		totals.textureBinds += backend.textureBinds;
+		totals.samplerBinds += backend.samplerBinds;
+		totals.constantBinds += backend.constantBinds;
+		totals.renderTargetChanges += backend.renderTargetChanges;
+		totals.stateChanges += backend.stateChanges;
+		totals.uploadBytes += scene.uploadBytes;
+		for (const CommandBuffer& commands : scene.commandBuffers)
+			totals.commands += commands.GetCommandCount();
+		for (const CommandBuffer& commands : scene.gBufferCommandBuffers)
+			totals.commands += commands.GetCommandCount();
+		if (options.depthPrepass)
+			totals.commands += scene.depthPrepassCommands.GetCommandCount();
+		if (options.deferred)
+		{
+			totals.commands += scene.deferredGeometryCommands.GetCommandCount();
+			totals.commands += scene.deferredLightingCommands.GetCommandCount();
+		}
+		totals.commands += scene.skyCommands.GetCommandCount();
+	}
+	unsigned int threadCount = JobSystem::WorkerCount() + 1;
+	JobSystem::ShutDown();
+
+	FILE* file = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+		return 1;
+	}
+
+	// Call counts are the same every frame for a given scene, bar
+	// what the camera changes, so they're reported per frame
+	FrameStatsSummary summary = frameStats.Summarize();
+	double frames = options.frames;
+	fprintf(file, "{\n");
+	fprintf(file, "  \"config\": { \"frames\": %u, \"warmup\": %u, \"entities\": %u, \"materials\": %u, \"lights\": %u, \"threads\": %u,\n",
+		options.frames, options.warmup, options.entities, (unsigned int)scene.materials.size(), options.lights, threadCount);
+	fprintf(file, "    \"deferred\": %s, \"perObjectLights\": %s, \"drawTable\": %s, \"depthPrepass\": %s },\n",
+		options.deferred ? "true" : "false",
+		options.perObjectLights ? "true" : "false",
+		options.drawTable ? "true" : "false",
+		options.depthPrepass ? "true" : "false");
+	fprintf(file, "  \"frameMilliseconds\": { \"average\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"p999\": %.4f, \"max\": %.4f,\n",
+		summary.average, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+	fprintf(file, "    \"budget\": %.4f, \"hitches\": %llu, \"window\": %u },\n",
+		summary.budget, (unsigned long long)frameStats.GetTotalHitches(), summary.frameCount);
+	fprintf(file, "  \"perFrame\": { \"drawCalls\": %.2f, \"shaderChanges\": %.2f, \"meshChanges\": %.2f, \"textureBinds\": %.2f,\n",
+		totals.drawCalls / frames, totals.shaderChanges / frames, totals.meshChanges / frames, totals.textureBinds / frames);
+	fprintf(file, "    \"samplerBinds\": %.2f, \"constantBinds\": %.2f, \"renderTargetChanges\": %.2f, \"stateChanges\": %.2f,\n",
+		totals.samplerBinds / frames, totals.constantBinds / frames, totals.renderTargetChanges / frames, totals.stateChanges / frames);
+	fprintf(file, "    \"recordedCommands\": %.2f, \"uploadBytes\": %.2f }\n",
+		totals.commands / frames, totals.uploadBytes / frames);
+	fprintf(file, "}\n");
+
+	if (file != stdout)
+		fclose(file);
+	return 0;
+}
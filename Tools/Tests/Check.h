@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdio>
+
+// --------------------------------------------------------
+// Bare-bones checks for the unit tests.  A failed CHECK
+// prints where it was and carries on; main() returns
+// TEST_RESULT() so ctest sees any failure.
+// --------------------------------------------------------
+namespace Check
+{
+	inline int failures = 0;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			Check::failures++; \
+		} \
+	} while (0)
+
+#define TEST_RESULT() (Check::failures == 0 ? (printf("All checks passed\n"), 0) : (printf("%d check(s) failed\n", Check::failures), 1))
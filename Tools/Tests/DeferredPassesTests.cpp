@@ -0,0 +1,209 @@
+#include "Check.h"
+#include "CommandBuffer.h"
+#include "DeferredPasses.h"
+#include "LightVolumes.h"
+
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Deferred lighting: which lights get volumes, which side of
+// them the camera is on, and the states each volume's draws
+// are recorded with
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	const float nearClip = 0.1f;
+
+	// Handles only need to be told apart
+	int handles[8];
+	const void* const stencilMark = &handles[0];
+	const void* const stencilTest = &handles[1];
+	const void* const insideVolume = &handles[2];
+	const void* const noColor = &handles[3];
+	const void* const additive = &handles[4];
+	const void* const cullNone = &handles[5];
+	const void* const cullFront = &handles[6];
+	const void* const volumePS = &handles[7];
+
+	Light PointLight(XMFLOAT3 position, float range)
+	{
+		Light light = {};
+		light.type = LIGHT_TYPE_POINT;
+		light.position = position;
+		light.range = range;
+		return light;
+	}
+
+	DeferredPassResources Resources()
+	{
+		DeferredPassResources resources = {};
+		resources.stencilMarkDepthState = stencilMark;
+		resources.stencilTestDepthState = stencilTest;
+		resources.insideVolumeDepthState = insideVolume;
+		resources.noColorBlendState = noColor;
+		resources.additiveBlendState = additive;
+		resources.cullNoneRasterizerState = cullNone;
+		resources.cullFrontRasterizerState = cullFront;
+		resources.volumePS = volumePS;
+		resources.volumeIndexCount = 36;
+		return resources;
+	}
+
+	// One volume draw and the state it was recorded with
+	struct VolumeDraw
+	{
+		unsigned int drawID;
+		SetRenderStateCommand state;
+		const void* pixelShader;
+	};
+
+	// Keeps every indexed draw along with the state it ran in
+	class VolumeDrawBackend : public NullCommandBackend
+	{
+	public:
+		std::vector<VolumeDraw> draws;
+		SetRenderStateCommand state = {};
+		const void* pixelShader = 0;
+
+		void SetRenderState(const SetRenderStateCommand& command) override
+		{
+			NullCommandBackend::SetRenderState(command);
+			state = command;
+		}
+
+		void SetShaders(const SetShadersCommand& command) override
+		{
+			NullCommandBackend::SetShaders(command);
+			pixelShader = command.pixelShader;
+		}
+
+		void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override
+		{
+			NullCommandBackend::DrawIndexedInstanced(command);
+			draws.push_back({ command.startInstance, state, pixelShader });
+		}
+	};
+
+	void TestVolumeSelection()
+	{
+		std::vector<Light> lights;
+		lights.push_back(Light{});                                 // Directional: no volume
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 0), 5.0f));     // Around the camera
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 20), 5.0f));    // Well ahead
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 8), 0.0f));     // No range: no volume
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 5.45f), 5.0f)); // Just past the near plane
+		lights.push_back(PointLight(XMFLOAT3(-30, 0, 0), 5.0f));   // Off to the side
+		lights[0].type = LIGHT_TYPE_DIRECTIONAL;
+
+		LightVolumes volumes;
+		volumes.Build(lights, 1.0f, XMFLOAT3(0, 0, 0), nearClip);
+		CHECK(volumes.GetVolumeCount() == 4);
+		CHECK(volumes.GetOutsideCount() == 2);
+		CHECK(volumes.GetInsideCount() == 2);
+
+		// Outside volumes first, each group in light order
+		const LightVolume* list = volumes.GetVolumes();
+		CHECK(list[0].lightIndex == 2);
+		CHECK(list[1].lightIndex == 5);
+		CHECK(list[2].lightIndex == 1);
+		CHECK(list[3].lightIndex == 4);
+
+		// Volumes are scaled up past the light, centered on it
+		CHECK(list[0].world.m[0][0] == 5.0f * LIGHT_VOLUME_MARGIN);
+		CHECK(list[0].world.m[3][2] == 20.0f);
+
+		// Moving the camera into the far light flips both
+		volumes.Build(lights, 1.0f, XMFLOAT3(0, 0, 18), nearClip);
+		CHECK(volumes.GetVolumeCount() == 4);
+		CHECK(volumes.GetInsideCount() == 1);
+		CHECK(volumes.GetVolumes()[3].lightIndex == 2);
+	}
+
+	void TestContainsCamera()
+	{
+		XMFLOAT3 center(0, 0, 10);
+		XMFLOAT3 inside(0, 1, 9);
+		XMFLOAT3 nearSurface(0, 0, 4.9f);
+		XMFLOAT3 outside(0, 0, 0);
+		CHECK(LightVolumes::ContainsCamera(center, 5.0f, inside, nearClip));
+		CHECK(LightVolumes::ContainsCamera(center, 5.0f, nearSurface, nearClip));
+		CHECK(!LightVolumes::ContainsCamera(center, 5.0f, outside, nearClip));
+	}
+
+	void TestStencilStates()
+	{
+		std::vector<Light> lights;
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 20), 5.0f));
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 1), 5.0f));
+		lights.push_back(PointLight(XMFLOAT3(10, 0, 30), 5.0f));
+
+		LightVolumes volumes;
+		volumes.Build(lights, 1.0f, XMFLOAT3(0, 0, 0), nearClip);
+		CHECK(volumes.GetOutsideCount() == 2);
+		CHECK(volumes.GetInsideCount() == 1);
+
+		CommandBuffer commands;
+		DeferredPasses::RecordLighting(commands, Resources(), volumes.GetOutsideCount(), volumes.GetInsideCount());
+		VolumeDrawBackend backend;
+		commands.Replay(backend);
+
+		// Two draws per outside volume, one for the inside one
+		CHECK(backend.draws.size() == 5);
+		if (backend.draws.size() != 5)
+			return;
+
+		// Camera outside: mark with both faces and no color, then
+		// light the marked pixels through the back faces
+		for (unsigned int volume = 0; volume < 2; volume++)
+		{
+			const VolumeDraw& mark = backend.draws[volume * 2];
+			const VolumeDraw& light = backend.draws[volume * 2 + 1];
+			CHECK(mark.drawID == volume && light.drawID == volume);
+			CHECK(mark.state.depthStencilState == stencilMark);
+			CHECK(mark.state.blendState == noColor);
+			CHECK(mark.state.rasterizerState == cullNone);
+			CHECK(mark.pixelShader == 0);
+			CHECK(light.state.depthStencilState == stencilTest);
+			CHECK(light.state.blendState == additive);
+			CHECK(light.state.rasterizerState == cullFront);
+			CHECK(light.pixelShader == volumePS);
+		}
+
+		// Camera inside: one draw of the back faces, no stencil
+		const VolumeDraw& inside = backend.draws[4];
+		CHECK(inside.drawID == 2);
+		CHECK(volumes.GetVolumes()[inside.drawID].lightIndex == 1);
+		CHECK(inside.state.depthStencilState == insideVolume);
+		CHECK(inside.state.blendState == additive);
+		CHECK(inside.state.rasterizerState == cullFront);
+		CHECK(inside.pixelShader == volumePS);
+
+		// Forward drawing continues with default states
+		CHECK(backend.state.depthStencilState == 0);
+	}
+
+	void TestNoVolumes()
+	{
+		CommandBuffer commands;
+		DeferredPasses::RecordLighting(commands, Resources(), 0, 0);
+		VolumeDrawBackend backend;
+		commands.Replay(backend);
+		CHECK(backend.draws.empty());
+		CHECK(backend.meshChanges == 0);
+		CHECK(backend.drawCalls == 1);
+	}
+}
+
+int main()
+{
+	TestVolumeSelection();
+	TestContainsCamera();
+	TestStencilStates();
+	TestNoVolumes();
+	return TEST_RESULT();
+}
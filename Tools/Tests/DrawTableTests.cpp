@@ -0,0 +1,131 @@
+#include "Check.h"
+#include "CommandBuffer.h"
+#include "DrawTable.h"
+
+#include <vector>
+
+// --------------------------------------------------------
+// DrawTable packing: materials are deduplicated by key,
+// objects land in the row of their draw ID, and a draw's
+// start instance (its draw ID on the GPU) finds that row
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	// A world matrix that's easy to tell apart from the others
+	DirectX::XMFLOAT4X4 Translation(float x)
+	{
+		DirectX::XMFLOAT4X4 matrix = {};
+		matrix.m[0][0] = matrix.m[1][1] = matrix.m[2][2] = matrix.m[3][3] = 1.0f;
+		matrix.m[3][0] = x;
+		return matrix;
+	}
+
+	PerMaterialData Material(float roughness)
+	{
+		PerMaterialData data = {};
+		data.roughness = roughness;
+		return data;
+	}
+
+	// Keeps the start instance of every instanced draw
+	class DrawIDBackend : public NullCommandBackend
+	{
+	public:
+		std::vector<unsigned int> drawIDs;
+
+		void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override
+		{
+			NullCommandBackend::DrawIndexedInstanced(command);
+			drawIDs.push_back(command.startInstance);
+		}
+	};
+
+	void TestMaterialDeduplication()
+	{
+		DrawTable table;
+		int keys[3];
+		CHECK(table.AddMaterial(&keys[0], Material(0.1f)) == 0);
+		CHECK(table.AddMaterial(&keys[1], Material(0.2f)) == 1);
+
+		// Adding a key again keeps the original data and index
+		CHECK(table.AddMaterial(&keys[0], Material(0.9f)) == 0);
+		CHECK(table.GetMaterialCount() == 2);
+		CHECK(table.GetMaterials()[0].roughness == 0.1f);
+		CHECK(table.GetMaterials()[1].roughness == 0.2f);
+
+		CHECK(table.FindMaterial(&keys[0]) == 0);
+		CHECK(table.FindMaterial(&keys[1]) == 1);
+		CHECK(table.FindMaterial(&keys[2]) == DRAW_TABLE_INVALID_INDEX);
+
+		// Reset forgets every key
+		table.Reset();
+		CHECK(table.GetMaterialCount() == 0);
+		CHECK(table.FindMaterial(&keys[0]) == DRAW_TABLE_INVALID_INDEX);
+		CHECK(table.AddMaterial(&keys[1], Material(0.3f)) == 0);
+	}
+
+	void TestObjectRows()
+	{
+		DrawTable table;
+		table.ResizeObjects(4);
+		CHECK(table.GetObjectCount() == 4);
+
+		// Filled out of order, as parallel ranges would
+		const unsigned int order[] = { 2, 0, 3, 1 };
+		for (unsigned int drawID : order)
+			table.SetObject(drawID, Translation((float)drawID), Translation(-(float)drawID), drawID % 2);
+
+		for (unsigned int drawID = 0; drawID < 4; drawID++)
+		{
+			const DrawTableObject& object = table.GetObjects()[drawID];
+			CHECK(object.world.m[3][0] == (float)drawID);
+			CHECK(object.worldInvTranspose.m[3][0] == -(float)drawID);
+			CHECK(object.materialIndex == drawID % 2);
+		}
+
+		// Rows must match the shader's 16-byte aligned layout
+		CHECK(sizeof(DrawTableObject) == 144);
+		CHECK(sizeof(PerMaterialData) % 16 == 0);
+	}
+
+	void TestDrawIDToRow()
+	{
+		DrawTable table;
+		int materialKeys[2];
+		table.AddMaterial(&materialKeys[0], Material(0.5f));
+		table.AddMaterial(&materialKeys[1], Material(0.7f));
+		table.ResizeObjects(3);
+
+		// Each draw carries its draw ID as the start instance,
+		// like Mesh::RecordDraw(commands, drawID)
+		CommandBuffer commands;
+		for (unsigned int drawID = 0; drawID < 3; drawID++)
+		{
+			table.SetObject(drawID, Translation(10.0f + drawID), Translation(0.0f), table.FindMaterial(&materialKeys[drawID % 2]));
+			commands.DrawIndexedInstanced(36, 1, 0, 0, drawID);
+		}
+
+		DrawIDBackend backend;
+		commands.Replay(backend);
+		CHECK(backend.drawIDs.size() == 3);
+		for (unsigned int i = 0; i < backend.drawIDs.size(); i++)
+		{
+			unsigned int drawID = backend.drawIDs[i];
+			CHECK(drawID < table.GetObjectCount());
+			const DrawTableObject& object = table.GetObjects()[drawID];
+			CHECK(object.world.m[3][0] == 10.0f + i);
+			CHECK(table.GetMaterials()[object.materialIndex].roughness == (i % 2 ? 0.7f : 0.5f));
+		}
+	}
+}
+
+int main()
+{
+	TestMaterialDeduplication();
+	TestObjectRows();
+	TestDrawIDToRow();
+	return TEST_RESULT();
+}
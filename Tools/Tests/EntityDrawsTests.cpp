@@ -0,0 +1,289 @@
+#include "Check.h"
+#include "BufferStruct.h"
+#include "CommandBuffer.h"
+#include "EntityDraws.h"
+
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Entity draw recording: each draw takes the path its
+// material and the frame allow, bindings shared by a run of
+// draws are recorded once, per-object constants are only
+// allocated for draws that bind them, and the depth pre-pass
+// sorts by bounding sphere rather than by origin
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	// Handles only need to be told apart
+	int handles[16];
+	const void* const drawTableVS = &handles[0];
+	const void* const materialVS = &handles[1];
+	const void* const forwardPS = &handles[2];
+	const void* const tablePS = &handles[3];
+	const void* const gBufferPS = &handles[4];
+	const void* const surfaceArray = &handles[5];
+	const void* const normalArray = &handles[6];
+	const void* const texture = &handles[7];
+	const void* const sampler = &handles[8];
+	const void* const vertexBuffer = &handles[9];
+	const void* const positionBuffer = &handles[10];
+	const void* const indexBuffer = &handles[11];
+
+	// Hands out consecutive slices of its own memory
+	class TestConstantAllocator : public DrawConstantAllocator
+	{
+	public:
+		std::vector<PerObjectData> objects;
+		unsigned int count = 0;
+
+		TestConstantAllocator(unsigned int capacity) : objects(capacity) {}
+
+		DrawConstants Allocate(unsigned int dataSizeInBytes) override
+		{
+			unsigned int numConstants = (dataSizeInBytes + 15) / 16;
+			return { &objects[count], numConstants * count++, numConstants };
+		}
+	};
+
+	// Keeps the draws, the shaders they ran with, constant
+	// bindings, texture binds and the last mesh
+	class DrawRecordingBackend : public NullCommandBackend
+	{
+	public:
+		std::vector<unsigned int> drawIDs;
+		std::vector<unsigned int> firstConstants;
+		std::vector<unsigned int> textureSlots;
+		const void* pixelShader = 0;
+		std::vector<const void*> pixelShaders;
+		SetMeshCommand mesh = {};
+
+		void SetMesh(const SetMeshCommand& command) override
+		{
+			NullCommandBackend::SetMesh(command);
+			mesh = command;
+		}
+
+		void SetShaders(const SetShadersCommand& command) override
+		{
+			NullCommandBackend::SetShaders(command);
+			pixelShader = command.pixelShader;
+		}
+
+		void BindTextures(const BindRangeCommand& command) override
+		{
+			NullCommandBackend::BindTextures(command);
+			textureSlots.push_back(command.startSlot);
+		}
+
+		void BindConstantRange(const BindConstantRangeCommand& command) override
+		{
+			NullCommandBackend::BindConstantRange(command);
+			firstConstants.push_back(command.firstConstant);
+		}
+
+		void DrawIndexed(const DrawIndexedCommand& command) override
+		{
+			NullCommandBackend::DrawIndexed(command);
+			drawIDs.push_back(~0u);
+			pixelShaders.push_back(pixelShader);
+		}
+
+		void DrawIndexedInstanced(const DrawIndexedInstancedCommand& command) override
+		{
+			NullCommandBackend::DrawIndexedInstanced(command);
+			drawIDs.push_back(command.startInstance);
+			pixelShaders.push_back(pixelShader);
+		}
+	};
+
+	DrawMesh Mesh()
+	{
+		DrawMesh mesh = {};
+		mesh.vertexBuffer = vertexBuffer;
+		mesh.positionBuffer = positionBuffer;
+		mesh.indexBuffer = indexBuffer;
+		mesh.vertexStride = 48;
+		mesh.indexCount = 36;
+		mesh.boundsRadius = 1.0f;
+		return mesh;
+	}
+
+	// One texture and one sampler of its own
+	MaterialBindGroup BindGroup()
+	{
+		MaterialBindGroup group = {};
+		group.textureCount = 1;
+		group.textures[0] = texture;
+		group.samplerCount = 1;
+		group.samplers[0] = sampler;
+		return group;
+	}
+
+	DrawMaterial Material(const MaterialBindGroup& group)
+	{
+		DrawMaterial material = {};
+		material.vertexShader = materialVS;
+		material.pixelShader = forwardPS;
+		material.bindGroup = &group;
+		return material;
+	}
+
+	EntityDrawSettings Settings(DrawTable& table, DrawConstantAllocator& constants)
+	{
+		EntityDrawSettings settings = {};
+		settings.drawTableVS = drawTableVS;
+		settings.useDrawTable = true;
+		settings.drawTable = &table;
+		settings.constants = &constants;
+		return settings;
+	}
+
+	void TestPaths()
+	{
+		DrawMesh mesh = Mesh();
+		MaterialBindGroup group = BindGroup();
+
+		// Table and G-buffer capable, forward only, and both
+		// of those but without a G-buffer permutation
+		DrawMaterial everything = Material(group);
+		everything.drawTablePixelShader = tablePS;
+		everything.gBufferPixelShader = gBufferPS;
+		DrawMaterial forwardOnly = Material(group);
+		forwardOnly.drawTableMaterial = 1;
+		DrawMaterial tableOnly = Material(group);
+		tableOnly.drawTablePixelShader = tablePS;
+
+		Transform transforms[3];
+		transforms[1].SetPosition(0, 0, 5);
+		DrawItem items[3] = {
+			{ &mesh, &everything, &transforms[0] },
+			{ &mesh, &forwardOnly, &transforms[1] },
+			{ &mesh, &tableOnly, &transforms[2] } };
+
+		DrawTable table;
+		table.ResizeObjects(3);
+		TestConstantAllocator constants(3);
+		CommandBuffer commands;
+		CommandBuffer gBufferCommands;
+		EntityDraws::RecordDraws(commands, &gBufferCommands, Settings(table, constants), items, 0, 3);
+
+		DrawRecordingBackend forward;
+		commands.Replay(forward);
+		DrawRecordingBackend gBuffer;
+		gBufferCommands.Replay(gBuffer);
+
+		// Only the first can go to the G-buffer
+		CHECK(gBuffer.drawIDs == std::vector<unsigned int>({ 0 }));
+		CHECK(gBuffer.pixelShaders == std::vector<const void*>({ gBufferPS }));
+
+		// The other two are drawn forward, one with its own constants
+		CHECK(forward.drawIDs == std::vector<unsigned int>({ ~0u, 2 }));
+		CHECK(forward.pixelShaders == std::vector<const void*>({ forwardPS, tablePS }));
+		CHECK(constants.count == 1);
+		CHECK(forward.firstConstants == std::vector<unsigned int>({ 0 }));
+		CHECK(constants.objects[0].drawID == 1);
+		CHECK(constants.objects[0].world.m[3][2] == 5.0f);
+
+		// Every object gets a table slot, whichever path draws it
+		CHECK(table.GetObjects()[1].materialIndex == 1);
+		CHECK(table.GetObjects()[1].world.m[3][2] == 5.0f);
+	}
+
+	void TestSharedBindings()
+	{
+		DrawMesh mesh = Mesh();
+
+		// Two groups with the same bindings, then one in the arrays
+		MaterialBindGroup first = BindGroup();
+		MaterialBindGroup second = BindGroup();
+		MaterialBindGroup samplerOnly = {};
+		samplerOnly.samplerCount = 1;
+		samplerOnly.samplers[0] = sampler;
+
+		DrawMaterial a = Material(first);
+		a.drawTablePixelShader = tablePS;
+		DrawMaterial b = Material(second);
+		b.drawTablePixelShader = tablePS;
+		DrawMaterial arrays = Material(samplerOnly);
+		arrays.drawTablePixelShader = tablePS;
+		arrays.usesTextureArrays = true;
+		arrays.textureArrays[0] = surfaceArray;
+		arrays.textureArrays[1] = normalArray;
+
+		Transform transforms[5];
+		DrawItem items[5] = {
+			{ &mesh, &a, &transforms[0] },
+			{ &mesh, &a, &transforms[1] },
+			{ &mesh, &b, &transforms[2] },
+			{ &mesh, &arrays, &transforms[3] },
+			{ &mesh, &arrays, &transforms[4] } };
+
+		DrawTable table;
+		table.ResizeObjects(5);
+		TestConstantAllocator constants(0);
+		CommandBuffer commands;
+		EntityDraws::RecordDraws(commands, 0, Settings(table, constants), items, 0, 5);
+
+		DrawRecordingBackend backend;
+		commands.Replay(backend);
+		CHECK(backend.drawCalls == 5);
+		CHECK(constants.count == 0);
+
+		// The shared texture once, then the arrays once
+		CHECK(backend.textureSlots == std::vector<unsigned int>({ 0, SURFACE_ARRAY_SLOT }));
+		CHECK(backend.samplerBinds == 2);
+	}
+
+	void TestDepthPrepass()
+	{
+		// Two meshes whose bounds are far from their origins, so
+		// sorting by position would draw them the other way round
+		DrawMesh nearMesh = Mesh();
+		nearMesh.boundsCenter = XMFLOAT3(0, 0, -8);
+		DrawMesh farMesh = Mesh();
+		farMesh.boundsCenter = XMFLOAT3(0, 0, 8);
+
+		DrawMesh mesh = Mesh();
+
+		MaterialBindGroup group = BindGroup();
+		DrawMaterial material = Material(group);
+		Transform transforms[3];
+		transforms[0].SetPosition(0, 0, 4);
+		transforms[1].SetPosition(0, 0, 10);
+		transforms[2].SetPosition(0, 0, 6);
+		DrawItem items[3] = {
+			{ &farMesh, &material, &transforms[0] },
+			{ &nearMesh, &material, &transforms[1] },
+			{ &mesh, &material, &transforms[2] } };
+
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixIdentity());
+		std::vector<unsigned int> order;
+		std::vector<float> depths;
+		CommandBuffer commands;
+		EntityDraws::RecordDepthPrepass(commands, drawTableVS, items, 3, view, order, depths);
+		CHECK(order == std::vector<unsigned int>({ 1, 2, 0 }));
+		CHECK(depths[0] == 12.0f && depths[1] == 2.0f && depths[2] == 6.0f);
+
+		// Positions only, drawn by draw ID without a pixel shader
+		DrawRecordingBackend backend;
+		commands.Replay(backend);
+		CHECK(backend.drawIDs == order);
+		CHECK(backend.pixelShaders == std::vector<const void*>(3, 0));
+		CHECK(backend.mesh.vertexBuffer == positionBuffer);
+		CHECK(backend.mesh.vertexStride == sizeof(XMFLOAT3));
+	}
+}
+
+int main()
+{
+	TestPaths();
+	TestSharedBindings();
+	TestDepthPrepass();
+	return TEST_RESULT();
+}
@@ -0,0 +1,198 @@
+#include "Check.h"
+#include "GpuProfiler.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// GPU profiler bookkeeping against the fake timer backend:
+// results come back frames later without stalling, frames
+// with untrustworthy timings are dropped, and nested passes
+// reach the CPU profiler's GPU timeline in order
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	struct FakeGpu
+	{
+		std::shared_ptr<FakeGpuTimerBackend> backend;
+		std::unique_ptr<GpuProfiler> profiler;
+		unsigned int timeline;
+	};
+
+	// Every test gets its own timeline, the latest one added
+	FakeGpu MakeProfiler(unsigned int latency)
+	{
+		FakeGpu gpu;
+		gpu.backend = std::make_shared<FakeGpuTimerBackend>();
+		gpu.backend->latency = latency;
+		gpu.profiler = std::make_unique<GpuProfiler>(gpu.backend);
+		gpu.timeline = (unsigned int)Profiler::GetThreadNames().size() - 1;
+		return gpu;
+	}
+
+	// One frame with a single pass in it
+	void Frame(GpuProfiler& profiler)
+	{
+		profiler.BeginFrame();
+		{
+			PROFILE_GPU_SCOPE(profiler, "GPU pass");
+		}
+		profiler.EndFrame();
+	}
+
+	// The timeline's events since the last call
+	std::vector<ProfileEvent> CollectEvents(unsigned int timeline)
+	{
+		Profiler::EndFrame();
+		std::vector<ProfileEvent> events;
+		for (const ProfileEvent& event : Profiler::GetFrameEvents())
+		{
+			if (event.thread == timeline)
+				events.push_back(event);
+		}
+		return events;
+	}
+
+	void TestDelayedReadback()
+	{
+		FakeGpu gpu = MakeProfiler(2);
+
+		// Results for a frame only come back once two more have ended
+		Frame(*gpu.profiler);
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 0);
+		CHECK(CollectEvents(gpu.timeline).empty());
+
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 1);
+		CHECK(gpu.profiler->GetLatency() == 2);
+		CHECK(gpu.profiler->GetSkippedFrames() == 0);
+
+		std::vector<ProfileEvent> events = CollectEvents(gpu.timeline);
+		CHECK(events.size() == 2);
+
+		// From then on, one frame comes back per frame
+		for (unsigned int i = 0; i < 5; i++)
+			Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 6);
+		CHECK(gpu.profiler->GetSkippedFrames() == 0);
+		CHECK(CollectEvents(gpu.timeline).size() == 10);
+	}
+
+	void TestSlotsFull()
+	{
+		// Slower than the ring of slots can cover: frames are
+		// skipped rather than waited for
+		FakeGpu gpu = MakeProfiler(GPU_PROFILER_FRAMES + 2);
+		for (unsigned int i = 0; i < GPU_PROFILER_FRAMES; i++)
+			Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetSkippedFrames() == 0);
+
+		gpu.profiler->BeginFrame();
+		CHECK(gpu.profiler->BeginScope("GPU pass") == GPU_PROFILER_MAX_SCOPES);
+		gpu.profiler->EndScope(GPU_PROFILER_MAX_SCOPES);
+		gpu.profiler->EndFrame();
+		CHECK(gpu.profiler->GetSkippedFrames() == 1);
+		CHECK(gpu.profiler->GetCompletedFrames() == 0);
+
+		// Once the GPU catches up, every timed frame is read, in order
+		gpu.backend->latency = 0;
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == GPU_PROFILER_FRAMES + 1);
+
+		unsigned int frames = 0;
+		for (const ProfileEvent& event : CollectEvents(gpu.timeline))
+			frames += std::string(event.name) == "GPU frame" ? 1 : 0;
+		CHECK(frames == GPU_PROFILER_FRAMES + 1);
+	}
+
+	void TestDisjointFrames()
+	{
+		FakeGpu gpu = MakeProfiler(0);
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 1);
+		CollectEvents(gpu.timeline);
+
+		// The clock changed mid-frame: nothing is recorded from it
+		gpu.backend->valid = false;
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 1);
+		CHECK(gpu.profiler->GetInvalidFrames() == 1);
+		CHECK(CollectEvents(gpu.timeline).empty());
+
+		// Its slot is still freed, and later frames carry on
+		gpu.backend->valid = true;
+		for (unsigned int i = 0; i < GPU_PROFILER_FRAMES; i++)
+			Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetCompletedFrames() == 1 + GPU_PROFILER_FRAMES);
+		CHECK(gpu.profiler->GetSkippedFrames() == 0);
+		CHECK(CollectEvents(gpu.timeline).size() == GPU_PROFILER_FRAMES * 2);
+
+		// A zero frequency can't be trusted either
+		gpu.backend->frequency = 0;
+		Frame(*gpu.profiler);
+		CHECK(gpu.profiler->GetInvalidFrames() == 2);
+	}
+
+	void TestNestedPasses()
+	{
+		FakeGpu gpu = MakeProfiler(0);
+		gpu.profiler->BeginFrame();
+		{
+			PROFILE_GPU_SCOPE(*gpu.profiler, "GPU opaque");
+			{
+				PROFILE_GPU_SCOPE(*gpu.profiler, "GPU shadows");
+				{
+					PROFILE_GPU_SCOPE(*gpu.profiler, "GPU cascade");
+				}
+			}
+		}
+		{
+			PROFILE_GPU_SCOPE(*gpu.profiler, "GPU post");
+		}
+		gpu.profiler->EndFrame();
+		CHECK(gpu.profiler->GetCompletedFrames() == 1);
+
+		// Ten timestamps a microsecond apart: the frame, then two per pass
+		CHECK(gpu.profiler->GetFrameMilliseconds() == 0.009f);
+
+		// Sorted by start, so parents come before their children
+		std::vector<ProfileEvent> events = CollectEvents(gpu.timeline);
+		const char* names[] = { "GPU frame", "GPU opaque", "GPU shadows", "GPU cascade", "GPU post" };
+		const unsigned int depths[] = { 0, 1, 2, 3, 1 };
+		CHECK(events.size() == 5);
+		if (events.size() != 5)
+			return;
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			CHECK(std::string(events[i].name) == names[i]);
+			CHECK(events[i].depth == depths[i]);
+			CHECK(events[i].start < events[i].end);
+		}
+
+		// Each child inside its parent, and siblings one after another
+		const ProfileEvent& frame = events[0];
+		const ProfileEvent& opaque = events[1];
+		const ProfileEvent& shadows = events[2];
+		const ProfileEvent& cascade = events[3];
+		const ProfileEvent& post = events[4];
+		CHECK(frame.start < opaque.start && post.end < frame.end);
+		CHECK(opaque.start < shadows.start && shadows.end < opaque.end);
+		CHECK(shadows.start < cascade.start && cascade.end < shadows.end);
+		CHECK(opaque.end < post.start);
+		CHECK(cascade.end - cascade.start == 1000);
+	}
+}
+
+int main()
+{
+	TestDelayedReadback();
+	TestSlotsFull();
+	TestDisjointFrames();
+	TestNestedPasses();
+	return TEST_RESULT();
+}
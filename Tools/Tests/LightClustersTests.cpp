@@ -0,0 +1,171 @@
+#include "Check.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Clustered light assignment: lights land in the froxels
+// around them and nowhere else, lights out of view land
+// nowhere, and bounding four lights at a time bins each
+// one just as if it were alone
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	const float nearZ = 0.1f;
+	const float farZ = 100.0f;
+
+	// Camera at the origin looking down +Z
+	void BuildClusters(LightClusters& clusters, const std::vector<Light>& lights)
+	{
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&view, XMMatrixIdentity());
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, nearZ, farZ));
+		clusters.Build(lights, view, projection, nearZ, farZ);
+	}
+
+	Light PointLight(XMFLOAT3 position, float range)
+	{
+		Light light = {};
+		light.type = LIGHT_TYPE_POINT;
+		light.position = position;
+		light.range = range;
+		return light;
+	}
+
+	Light SpotLight(XMFLOAT3 position, XMFLOAT3 direction, float range, float outerAngle)
+	{
+		Light light = PointLight(position, range);
+		light.type = LIGHT_TYPE_SPOT;
+		light.direction = direction;
+		light.spotOuterAngle = outerAngle;
+		return light;
+	}
+
+	// Which clusters list the given light
+	std::vector<bool> ClustersOf(const LightClusters& clusters, uint32_t lightIndex)
+	{
+		std::vector<bool> result(LIGHT_CLUSTER_COUNT);
+		for (unsigned int c = 0; c < LIGHT_CLUSTER_COUNT; c++)
+		{
+			const LightClusterRange& range = clusters.GetRanges()[c];
+			for (uint32_t i = 0; i < range.pointCount + range.spotCount; i++)
+				result[c] = result[c] || clusters.GetLightIndices()[range.offset + i] == lightIndex;
+		}
+		return result;
+	}
+
+	unsigned int Slice(const LightClusters& clusters, float viewDepth)
+	{
+		return (unsigned int)(logf(viewDepth) * clusters.GetSliceScale() + clusters.GetSliceBias());
+	}
+
+	void TestDirectionalListedOnce()
+	{
+		std::vector<Light> lights(2);
+		lights[0].type = LIGHT_TYPE_DIRECTIONAL;
+		lights[1].type = LIGHT_TYPE_DIRECTIONAL;
+
+		LightClusters clusters;
+		BuildClusters(clusters, lights);
+		CHECK(clusters.GetDirectionalLightCount() == 2);
+		CHECK(clusters.GetLightIndexCount() == 2);
+		CHECK(clusters.GetLightIndices()[0] == 0);
+		CHECK(clusters.GetLightIndices()[1] == 1);
+		CHECK(clusters.GetRanges()[0].pointCount == 0);
+	}
+
+	void TestOutOfViewCulled()
+	{
+		std::vector<Light> lights;
+		lights.push_back(PointLight(XMFLOAT3(0, 0, -10), 2.0f));   // Behind the camera
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 150), 2.0f));   // Past the far plane
+		lights.push_back(PointLight(XMFLOAT3(100, 0, 10), 2.0f));  // Off to the right
+		lights.push_back(PointLight(XMFLOAT3(0, -100, 10), 2.0f)); // Below the screen
+		lights.push_back(SpotLight(XMFLOAT3(0, 0, -10), XMFLOAT3(0, 0, -1), 5.0f, 0.3f)); // Pointing away
+
+		LightClusters clusters;
+		BuildClusters(clusters, lights);
+		CHECK(clusters.GetLightIndexCount() == 0);
+	}
+
+	void TestLightAhead()
+	{
+		std::vector<Light> lights;
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 10), 1.0f));
+
+		LightClusters clusters;
+		BuildClusters(clusters, lights);
+		std::vector<bool> listed = ClustersOf(clusters, 0);
+
+		// Dead center of the screen, at the light's own depth
+		unsigned int centerX = LIGHT_CLUSTER_COUNT_X / 2;
+		unsigned int centerY = LIGHT_CLUSTER_COUNT_Y / 2;
+		unsigned int depthSlice = Slice(clusters, 10.0f);
+		CHECK(listed[(depthSlice * LIGHT_CLUSTER_COUNT_Y + centerY) * LIGHT_CLUSTER_COUNT_X + centerX]);
+
+		// Nothing outside the slices the sphere spans, or near the screen's edges
+		unsigned int minSlice = Slice(clusters, 9.0f);
+		unsigned int maxSlice = Slice(clusters, 11.0f);
+		for (unsigned int c = 0; c < LIGHT_CLUSTER_COUNT; c++)
+		{
+			if (!listed[c])
+				continue;
+			unsigned int x = c % LIGHT_CLUSTER_COUNT_X;
+			unsigned int y = (c / LIGHT_CLUSTER_COUNT_X) % LIGHT_CLUSTER_COUNT_Y;
+			unsigned int z = c / (LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y);
+			CHECK(z >= minSlice && z <= maxSlice);
+			CHECK(x > 0 && x < LIGHT_CLUSTER_COUNT_X - 1);
+			CHECK(y > 0 && y < LIGHT_CLUSTER_COUNT_Y - 1);
+		}
+	}
+
+	void TestGroupsOfFour()
+	{
+		// Not a multiple of four, with every type and some out of view
+		std::vector<Light> lights;
+		lights.push_back(PointLight(XMFLOAT3(-6, 2, 12), 3.0f));
+		lights.push_back(SpotLight(XMFLOAT3(4, 1, 5), XMFLOAT3(0, -0.2f, 1), 8.0f, 0.4f));
+		lights.push_back(PointLight(XMFLOAT3(0, 0, -30), 2.0f));
+		lights.push_back(Light{});
+		lights.back().type = LIGHT_TYPE_DIRECTIONAL;
+		lights.push_back(SpotLight(XMFLOAT3(-2, -3, 20), XMFLOAT3(1, 0, 0), 10.0f, 1.2f));
+		lights.push_back(PointLight(XMFLOAT3(9, -4, 40), 6.0f));
+		lights.push_back(PointLight(XMFLOAT3(0, 0, 0.5f), 1.0f));
+		lights.push_back(PointLight(XMFLOAT3(30, 12, 60), 4.0f));
+		lights.push_back(SpotLight(XMFLOAT3(1, 5, 2), XMFLOAT3(0, -1, 1), 6.0f, 0.7f));
+		lights.push_back(PointLight(XMFLOAT3(-1, 1, 95), 10.0f));
+		lights.push_back(PointLight(XMFLOAT3(-40, 0, 25), 5.0f));
+
+		LightClusters together;
+		BuildClusters(together, lights);
+
+		for (uint32_t i = 0; i < lights.size(); i++)
+		{
+			if (lights[i].type == LIGHT_TYPE_DIRECTIONAL)
+				continue;
+
+			LightClusters alone;
+			BuildClusters(alone, std::vector<Light>(1, lights[i]));
+			CHECK(ClustersOf(together, i) == ClustersOf(alone, 0));
+		}
+	}
+}
+
+int main()
+{
+	JobSystem::Initialize();
+	TestDirectionalListedOnce();
+	TestOutOfViewCulled();
+	TestLightAhead();
+	TestGroupsOfFour();
+	JobSystem::ShutDown();
+	return TEST_RESULT();
+}
@@ -0,0 +1,397 @@
+#include "Check.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// CPU profiler: nested scopes nest in time and depth, their
+// durations add up per name, and a captured Chrome trace is
+// valid JSON whose complete events nest on every thread
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	const char* tracePath = "ProfilerTests.json";
+
+	void Wait(int milliseconds)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	}
+
+	const ProfileEvent* FindEvent(const char* name)
+	{
+		for (const ProfileEvent& event : Profiler::GetFrameEvents())
+		{
+			if (std::string(event.name) == name)
+				return &event;
+		}
+		return 0;
+	}
+
+	const ProfileScopeStats* FindStats(const char* name)
+	{
+		for (const ProfileScopeStats& stats : Profiler::GetScopeStats())
+		{
+			if (std::string(stats.name) == name)
+				return &stats;
+		}
+		return 0;
+	}
+
+	// Just enough JSON to check a trace: any value, with
+	// objects and arrays kept for looking into
+	struct JsonValue
+	{
+		enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+		double number = 0;
+		std::string text;
+		std::vector<JsonValue> items;
+		std::map<std::string, JsonValue> members;
+	};
+
+	class JsonParser
+	{
+	private:
+		const std::string& text;
+		size_t at = 0;
+
+		void SkipSpace()
+		{
+			while (at < text.size() && (text[at] == ' ' || text[at] == '\n' || text[at] == '\r' || text[at] == '\t'))
+				at++;
+		}
+
+		bool Take(char c)
+		{
+			SkipSpace();
+			if (at < text.size() && text[at] == c)
+			{
+				at++;
+				return true;
+			}
+			return false;
+		}
+
+		bool ParseString(std::string& result)
+		{
+			if (!Take('"'))
+				return false;
+			for (; at < text.size(); at++)
+			{
+				char c = text[at];
+				if (c == '"')
+				{
+					at++;
+					return true;
+				}
+				if ((unsigned char)c < 0x20)
+					return false;
+				if (c == '\\')
+				{
+					if (++at == text.size() || std::string("\"\\/bfnrtu").find(text[at]) == std::string::npos)
+						return false;
+					if (text[at] == 'u')
+						at += 4;
+					else
+						result += text[at];
+					continue;
+				}
+				result += c;
+			}
+			return false;
+		}
+
+	public:
+		JsonParser(const std::string& text) : text(text) {}
+
+		bool ParseValue(JsonValue& value)
+		{
+			SkipSpace();
+			if (at == text.size())
+				return false;
+
+			char c = text[at];
+			if (c == '{')
+			{
+				at++;
+				value.type = JsonValue::Type::Object;
+				if (Take('}'))
+					return true;
+				do
+				{
+					std::string key;
+					SkipSpace();
+					if (!ParseString(key) || !Take(':') || !ParseValue(value.members[key]))
+						return false;
+				} while (Take(','));
+				return Take('}');
+			}
+			if (c == '[')
+			{
+				at++;
+				value.type = JsonValue::Type::Array;
+				if (Take(']'))
+					return true;
+				do
+				{
+					value.items.emplace_back();
+					if (!ParseValue(value.items.back()))
+						return false;
+				} while (Take(','));
+				return Take(']');
+			}
+			if (c == '"')
+			{
+				value.type = JsonValue::Type::String;
+				return ParseString(value.text);
+			}
+			for (const char* word : { "true", "false", "null" })
+			{
+				if (text.compare(at, strlen(word), word) == 0)
+				{
+					at += strlen(word);
+					value.type = word[0] == 'n' ? JsonValue::Type::Null : JsonValue::Type::Bool;
+					return true;
+				}
+			}
+
+			const char* start = text.c_str() + at;
+			char* end;
+			value.number = strtod(start, &end);
+			if (end == start)
+				return false;
+			value.type = JsonValue::Type::Number;
+			at += end - start;
+			return true;
+		}
+
+		// The whole text is one value
+		bool Parse(JsonValue& value)
+		{
+			if (!ParseValue(value))
+				return false;
+			SkipSpace();
+			return at == text.size();
+		}
+	};
+
+	bool ReadTrace(const std::string& path, JsonValue& trace)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		std::string text = contents.str();
+		return file && JsonParser(text).Parse(trace);
+	}
+
+	// Every event is well formed, and on each thread any two
+	// complete events are either apart or one inside the other.
+	// Returns how many complete events there were.
+	unsigned int CheckTraceEvents(const JsonValue& trace)
+	{
+		CHECK(trace.type == JsonValue::Type::Object);
+		auto found = trace.members.find("traceEvents");
+		CHECK(found != trace.members.end() && found->second.type == JsonValue::Type::Array);
+		if (found == trace.members.end())
+			return 0;
+
+		// Timestamps are written to the nanosecond, and a parent
+		// and child are rounded separately
+		const double slack = 0.0015;
+
+		std::map<double, std::vector<const JsonValue*>> threads;
+		for (const JsonValue& event : found->second.items)
+		{
+			CHECK(event.type == JsonValue::Type::Object);
+			CHECK(event.members.count("name") && event.members.count("ph") && event.members.count("tid"));
+			if (!event.members.count("ph") || !event.members.count("tid"))
+				continue;
+
+			const std::string& phase = event.members.at("ph").text;
+			CHECK(phase == "X" || phase == "M");
+			if (phase == "X")
+			{
+				CHECK(event.members.count("ts") && event.members.count("dur"));
+				CHECK(event.members.at("dur").number >= 0.0);
+				threads[event.members.at("tid").number].push_back(&event);
+			}
+		}
+
+		unsigned int count = 0;
+		for (const auto& thread : threads)
+		{
+			const std::vector<const JsonValue*>& events = thread.second;
+			count += (unsigned int)events.size();
+			for (size_t i = 0; i < events.size(); i++)
+			{
+				for (size_t j = i + 1; j < events.size(); j++)
+				{
+					double startA = events[i]->members.at("ts").number;
+					double endA = startA + events[i]->members.at("dur").number;
+					double startB = events[j]->members.at("ts").number;
+					double endB = startB + events[j]->members.at("dur").number;
+					bool apart = endA <= startB + slack || endB <= startA + slack;
+					bool aHoldsB = startA <= startB + slack && endB <= endA + slack;
+					bool bHoldsA = startB <= startA + slack && endA <= endB + slack;
+					CHECK(apart || aHoldsB || bHoldsA);
+				}
+			}
+		}
+		return count;
+	}
+
+	void TestNestedScopes()
+	{
+		Profiler::SetThreadName("Main");
+		Profiler::EndFrame();
+		{
+			PROFILE_SCOPE("Outer");
+			Wait(2);
+			{
+				PROFILE_SCOPE("Inner");
+				Wait(5);
+			}
+			{
+				PROFILE_SCOPE("Inner");
+				Wait(1);
+			}
+			Wait(2);
+		}
+		Profiler::EndFrame();
+
+		const ProfileEvent* outer = FindEvent("Outer");
+		const ProfileEvent* inner = FindEvent("Inner");
+		CHECK(outer && inner);
+		if (!outer || !inner)
+			return;
+
+		CHECK(outer->depth == 0);
+		CHECK(inner->depth == 1);
+		CHECK(inner->thread == outer->thread);
+		CHECK(outer->start <= inner->start && inner->end <= outer->end);
+		CHECK(inner->end - inner->start >= 5000000);
+
+		// Both calls add up under one name, inside their parent
+		const ProfileScopeStats* outerStats = FindStats("Outer");
+		const ProfileScopeStats* innerStats = FindStats("Inner");
+		CHECK(outerStats && innerStats);
+		if (!outerStats || !innerStats)
+			return;
+		CHECK(outerStats->calls == 1);
+		CHECK(innerStats->calls == 2);
+		CHECK(innerStats->depth == 1);
+		CHECK(innerStats->milliseconds >= 6.0f);
+		CHECK(outerStats->milliseconds >= innerStats->milliseconds + 4.0f);
+		CHECK(outerStats->history[PROFILER_HISTORY - 1] == outerStats->milliseconds);
+
+		// A frame without them zeroes the totals but not the history
+		float outerMilliseconds = outerStats->milliseconds;
+		Profiler::EndFrame();
+		CHECK(FindEvent("Outer") == 0);
+		CHECK(FindStats("Outer")->calls == 0);
+		CHECK(FindStats("Outer")->milliseconds == 0.0f);
+		CHECK(FindStats("Outer")->maxMilliseconds == outerMilliseconds);
+	}
+
+	void TestDisabled()
+	{
+		Profiler::SetEnabled(false);
+		{
+			PROFILE_SCOPE("Disabled");
+		}
+		Profiler::SetEnabled(true);
+		Profiler::EndFrame();
+		CHECK(FindEvent("Disabled") == 0);
+	}
+
+	void TestChromeTrace()
+	{
+		unsigned int gpu = Profiler::AddTimeline("GPU \"queue\"");
+		Profiler::StartCapture(2, tracePath);
+		for (unsigned int frame = 0; frame < 2; frame++)
+		{
+			int64_t frameStart = Profiler::Now();
+			PROFILE_SCOPE("Frame");
+			std::thread worker([]() {
+				Profiler::SetThreadName("Worker");
+				PROFILE_SCOPE("Job");
+				{
+					PROFILE_SCOPE("Step");
+					Wait(1);
+				}
+				PROFILE_SCOPE("Step");
+			});
+			{
+				PROFILE_SCOPE("Draw \"scene\"");
+				Wait(1);
+			}
+			worker.join();
+
+			// The GPU's work, as GpuProfiler would record it
+			int64_t quarter = (Profiler::Now() - frameStart) / 4;
+			Profiler::RecordEvent(gpu, "GPU frame", frameStart, frameStart + quarter * 4, 0);
+			Profiler::RecordEvent(gpu, "GPU pass", frameStart + quarter, frameStart + quarter * 3, 1);
+		}
+		Profiler::EndFrame();
+		CHECK(Profiler::IsCapturing());
+		Profiler::EndFrame();
+		CHECK(!Profiler::IsCapturing());
+		CHECK(Profiler::GetLastCapturePath() == tracePath);
+
+		JsonValue trace;
+		CHECK(ReadTrace(tracePath, trace));
+
+		// Frame, Draw, Job and two Steps, then the GPU's two, per frame
+		CHECK(CheckTraceEvents(trace) == 14);
+
+		// Names survive escaping
+		bool foundDraw = false;
+		bool foundGpu = false;
+		for (const JsonValue& event : trace.members["traceEvents"].items)
+		{
+			foundDraw = foundDraw || event.members.at("name").text == "Draw \"scene\"";
+			if (event.members.at("ph").text == "M")
+				foundGpu = foundGpu || event.members.at("args").members.at("name").text == "GPU \"queue\"";
+		}
+		CHECK(foundDraw);
+		CHECK(foundGpu);
+		std::remove(tracePath);
+	}
+
+	void TestHandWrittenTrace()
+	{
+		// Events that never went through a frame, such as a
+		// timeline made up after the fact
+		std::vector<ProfileEvent> events;
+		events.push_back({ "Parent", 1000000, 5000000, 0, 0 });
+		events.push_back({ "Child", 2000000, 3000000, 1, 0 });
+		events.push_back({ "Sibling", 3000000, 4500000, 1, 0 });
+		CHECK(Profiler::WriteChromeTrace(tracePath, events));
+
+		JsonValue trace;
+		CHECK(ReadTrace(tracePath, trace));
+		CHECK(CheckTraceEvents(trace) == 3);
+		std::remove(tracePath);
+	}
+}
+
+int main()
+{
+	// First, while no thread has been named in traces yet
+	TestHandWrittenTrace();
+
+	TestNestedScopes();
+	TestDisabled();
+	TestChromeTrace();
+	return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+#include "Check.h"
+#include "RenderGraph.h"
+
+#include <vector>
+
+// --------------------------------------------------------
+// Render graph compiling: passes nothing needs are culled,
+// the rest run after the passes they depend on, and
+// transient textures only share memory when their
+// lifetimes don't overlap
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	const RenderGraphTextureDesc fullScreen = { 1920, 1080, RenderGraphFormat::RGBA8Unorm };
+	const RenderGraphTextureDesc halfScreen = { 960, 540, RenderGraphFormat::RGBA8Unorm };
+
+	// Position of a pass in the compiled order
+	unsigned int PositionOf(const RenderGraph& graph, unsigned int pass)
+	{
+		const std::vector<unsigned int>& order = graph.GetPassOrder();
+		for (unsigned int i = 0; i < (unsigned int)order.size(); i++)
+		{
+			if (order[i] == pass)
+				return i;
+		}
+		return RENDER_GRAPH_NO_ALLOCATION;
+	}
+
+	void TestCulling()
+	{
+		RenderGraph graph;
+		RenderGraphResource backBuffer = graph.ImportTexture("Back buffer");
+		RenderGraphResource unused = graph.CreateTexture("Unused", fullScreen);
+		RenderGraphResource scene = graph.CreateTexture("Scene", fullScreen);
+		RenderGraphResource debug = graph.CreateTexture("Debug", fullScreen);
+
+		std::vector<unsigned int> executed;
+		auto record = [&executed](unsigned int pass) { return [&executed, pass](const RenderGraph&) { executed.push_back(pass); }; };
+
+		unsigned int orphan = graph.AddPass("Orphan", record(0));
+		graph.Write(orphan, unused);
+		unsigned int draw = graph.AddPass("Draw", record(1));
+		graph.Write(draw, scene);
+		unsigned int debugView = graph.AddPass("Debug view", record(2));
+		graph.Read(debugView, scene);
+		graph.Write(debugView, debug);
+		unsigned int present = graph.AddPass("Present", record(3));
+		graph.Read(present, scene);
+		graph.Write(present, backBuffer);
+
+		CHECK(graph.Compile());
+		CHECK(!graph.IsPassLive(orphan));
+		CHECK(graph.IsPassLive(draw));
+		CHECK(!graph.IsPassLive(debugView));
+		CHECK(graph.IsPassLive(present));
+		CHECK(graph.GetPassOrder() == std::vector<unsigned int>({ draw, present }));
+
+		// Culled passes don't run, and their textures get no memory
+		graph.Execute();
+		CHECK(executed == std::vector<unsigned int>({ 1, 3 }));
+		CHECK(graph.GetAllocation(unused) == RENDER_GRAPH_NO_ALLOCATION);
+		CHECK(graph.GetAllocation(debug) == RENDER_GRAPH_NO_ALLOCATION);
+		CHECK(graph.GetAllocation(scene) != RENDER_GRAPH_NO_ALLOCATION);
+		CHECK(graph.GetAllocation(backBuffer) == RENDER_GRAPH_NO_ALLOCATION);
+		CHECK(graph.GetAllocationCount() == 1);
+	}
+
+	void TestOrder()
+	{
+		RenderGraph graph;
+		RenderGraphResource backBuffer = graph.ImportTexture("Back buffer");
+		RenderGraphResource shadow = graph.CreateTexture("Shadow", halfScreen);
+		RenderGraphResource scene = graph.CreateTexture("Scene", fullScreen);
+		RenderGraphResource bloom = graph.CreateTexture("Bloom", halfScreen);
+
+		unsigned int drawScene = graph.AddPass("Scene", nullptr);
+		graph.Write(drawScene, scene);
+		unsigned int drawShadow = graph.AddPass("Shadow", nullptr);
+		graph.Write(drawShadow, shadow);
+		unsigned int light = graph.AddPass("Light", nullptr);
+		graph.Read(light, shadow);
+		graph.Write(light, scene);
+		unsigned int blur = graph.AddPass("Bloom", nullptr);
+		graph.Read(blur, scene);
+		graph.Write(blur, bloom);
+		unsigned int composite = graph.AddPass("Composite", nullptr);
+		graph.Read(composite, scene);
+		graph.Read(composite, bloom);
+		graph.Write(composite, backBuffer);
+
+		// Reusing the shadow map after the light pass read it
+		// has to wait for that read
+		unsigned int overlay = graph.AddPass("Overlay", nullptr);
+		graph.Write(overlay, shadow);
+		graph.Write(overlay, backBuffer);
+
+		CHECK(graph.Compile());
+		CHECK(graph.GetPassOrder().size() == 6);
+		CHECK(PositionOf(graph, drawScene) < PositionOf(graph, light));
+		CHECK(PositionOf(graph, drawShadow) < PositionOf(graph, light));
+		CHECK(PositionOf(graph, light) < PositionOf(graph, blur));
+		CHECK(PositionOf(graph, blur) < PositionOf(graph, composite));
+		CHECK(PositionOf(graph, light) < PositionOf(graph, overlay));
+		CHECK(PositionOf(graph, composite) < PositionOf(graph, overlay));
+
+		// Independent passes keep the order they were declared in
+		CHECK(PositionOf(graph, drawScene) < PositionOf(graph, drawShadow));
+	}
+
+	void TestLifetimes()
+	{
+		RenderGraph graph;
+		RenderGraphResource backBuffer = graph.ImportTexture("Back buffer");
+		RenderGraphResource a = graph.CreateTexture("A", fullScreen);
+		RenderGraphResource b = graph.CreateTexture("B", fullScreen);
+
+		unsigned int first = graph.AddPass("First", nullptr);
+		graph.Write(first, a);
+		unsigned int second = graph.AddPass("Second", nullptr);
+		graph.Write(second, b);
+		unsigned int third = graph.AddPass("Third", nullptr);
+		graph.Read(third, a);
+		graph.Write(third, backBuffer);
+		unsigned int fourth = graph.AddPass("Fourth", nullptr);
+		graph.Read(fourth, b);
+		graph.Write(fourth, backBuffer);
+
+		CHECK(graph.Compile());
+		CHECK(graph.GetPassOrder() == std::vector<unsigned int>({ first, second, third, fourth }));
+		CHECK(graph.GetFirstUse(a) == 0 && graph.GetLastUse(a) == 2);
+		CHECK(graph.GetFirstUse(b) == 1 && graph.GetLastUse(b) == 3);
+		CHECK(graph.GetFirstUse(backBuffer) == 2 && graph.GetLastUse(backBuffer) == 3);
+
+		// A and B are alive together for passes 1 and 2
+		CHECK(graph.GetAllocation(a) != graph.GetAllocation(b));
+		CHECK(graph.GetAllocationCount() == 2);
+	}
+
+	void TestAliasing()
+	{
+		// A chain of passes, each reading the last one's output
+		RenderGraph graph;
+		RenderGraphResource backBuffer = graph.ImportTexture("Back buffer");
+		RenderGraphResource t0 = graph.CreateTexture("T0", fullScreen);
+		RenderGraphResource t1 = graph.CreateTexture("T1", fullScreen);
+		RenderGraphResource t2 = graph.CreateTexture("T2", fullScreen);
+		RenderGraphResource t3 = graph.CreateTexture("T3", fullScreen);
+		RenderGraphResource small = graph.CreateTexture("Small", halfScreen);
+
+		unsigned int p0 = graph.AddPass("P0", nullptr);
+		graph.Write(p0, t0);
+		unsigned int p1 = graph.AddPass("P1", nullptr);
+		graph.Read(p1, t0);
+		graph.Write(p1, t1);
+		unsigned int p2 = graph.AddPass("P2", nullptr);
+		graph.Read(p2, t1);
+		graph.Write(p2, t2);
+		graph.Write(p2, small);
+		unsigned int p3 = graph.AddPass("P3", nullptr);
+		graph.Read(p3, t2);
+		graph.Read(p3, small);
+		graph.Write(p3, t3);
+		unsigned int p4 = graph.AddPass("P4", nullptr);
+		graph.Read(p4, t3);
+		graph.Write(p4, backBuffer);
+
+		CHECK(graph.Compile());
+
+		// Each texture is still being read when the next is written,
+		// so neighbours overlap and must not share memory...
+		CHECK(graph.GetLastUse(t0) == graph.GetFirstUse(t1));
+		CHECK(graph.GetAllocation(t0) != graph.GetAllocation(t1));
+		CHECK(graph.GetAllocation(t1) != graph.GetAllocation(t2));
+		CHECK(graph.GetAllocation(t2) != graph.GetAllocation(t3));
+
+		// ...but every other one can
+		CHECK(graph.GetAllocation(t0) == graph.GetAllocation(t2));
+		CHECK(graph.GetAllocation(t1) == graph.GetAllocation(t3));
+
+		// A different size never shares, even though T0 is done
+		// with by the time it's written
+		CHECK(graph.GetAllocation(small) != graph.GetAllocation(t0));
+		CHECK(graph.GetAllocationDesc(graph.GetAllocation(small)) == halfScreen);
+
+		size_t full = RenderGraph::CalcTextureBytes(fullScreen);
+		size_t half = RenderGraph::CalcTextureBytes(halfScreen);
+		CHECK(graph.GetAllocationCount() == 3);
+		CHECK(graph.GetPeakTransientBytes() == full * 2 + half);
+		CHECK(graph.GetUnaliasedTransientBytes() == full * 4 + half);
+	}
+
+	void TestReset()
+	{
+		RenderGraph graph;
+		RenderGraphResource backBuffer = graph.ImportTexture("Back buffer");
+		unsigned int pass = graph.AddPass("Present", nullptr);
+		graph.Write(pass, backBuffer);
+		CHECK(graph.Compile());
+
+		graph.Reset();
+		CHECK(graph.GetPassCount() == 0);
+		CHECK(graph.GetResourceCount() == 0);
+		CHECK(graph.Compile());
+		CHECK(graph.GetPassOrder().empty());
+		CHECK(graph.GetAllocationCount() == 0);
+	}
+}
+
+int main()
+{
+	TestCulling();
+	TestOrder();
+	TestLifetimes();
+	TestAliasing();
+	TestReset();
+	return TEST_RESULT();
+}
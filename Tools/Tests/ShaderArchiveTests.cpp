@@ -0,0 +1,101 @@
+#include "Check.h"
+#include "ShaderArchive.h"
+
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Shader archive packing: shaders are found by name,
+// identical byte code is stored once, every entry can be
+// read back to repack the archive with more shaders, and
+// damaged archives are refused
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	typedef std::vector<std::pair<std::string, std::vector<uint8_t>>> ShaderList;
+
+	void TestFind()
+	{
+		ShaderList shaders = {
+			{ "VertexShader.cso", { 1, 2, 3, 4 } },
+			{ "PixelShader.cso", { 5, 6, 7 } },
+			{ "PixelShader.hlsl|1b|2", { 1, 2, 3, 4 } } };
+		std::vector<uint8_t> bytes = ShaderArchive::Pack(shaders);
+
+		ShaderArchive archive;
+		CHECK(archive.Open(bytes.data(), bytes.size()));
+		CHECK(archive.GetEntryCount() == 3);
+
+		const void* byteCode = 0;
+		size_t byteCodeSize = 0;
+		CHECK(archive.Find("PixelShader.cso", &byteCode, &byteCodeSize));
+		CHECK(byteCodeSize == 3 && static_cast<const uint8_t*>(byteCode)[2] == 7);
+		CHECK(!archive.Find("Missing.cso", &byteCode, &byteCodeSize));
+
+		// The variant has the same byte code as the vertex shader
+		const void* vertexShader = 0;
+		CHECK(archive.Find("VertexShader.cso", &vertexShader, &byteCodeSize));
+		CHECK(archive.Find("PixelShader.hlsl|1b|2", &byteCode, &byteCodeSize));
+		CHECK(byteCode == vertexShader);
+	}
+
+	void TestRepack()
+	{
+		ShaderList shaders = {
+			{ "VertexShader.cso", { 1, 2, 3, 4 } },
+			{ "PixelShader.cso", { 5, 6, 7 } } };
+		std::vector<uint8_t> bytes = ShaderArchive::Pack(shaders);
+		ShaderArchive archive;
+		CHECK(archive.Open(bytes.data(), bytes.size()));
+
+		// Everything read back, plus one more
+		ShaderList repacked;
+		for (unsigned int i = 0; i < archive.GetEntryCount(); i++)
+		{
+			const char* name = 0;
+			const void* byteCode = 0;
+			size_t byteCodeSize = 0;
+			archive.GetEntry(i, &name, &byteCode, &byteCodeSize);
+
+			const uint8_t* code = static_cast<const uint8_t*>(byteCode);
+			repacked.push_back({ name, std::vector<uint8_t>(code, code + byteCodeSize) });
+		}
+		CHECK(repacked == shaders);
+		repacked.push_back({ "PixelShader.hlsl|1|0", { 8 } });
+
+		std::vector<uint8_t> repackedBytes = ShaderArchive::Pack(repacked);
+		ShaderArchive repackedArchive;
+		CHECK(repackedArchive.Open(repackedBytes.data(), repackedBytes.size()));
+		CHECK(repackedArchive.GetEntryCount() == 3);
+
+		const void* byteCode = 0;
+		size_t byteCodeSize = 0;
+		CHECK(repackedArchive.Find("PixelShader.cso", &byteCode, &byteCodeSize) && byteCodeSize == 3);
+		CHECK(repackedArchive.Find("PixelShader.hlsl|1|0", &byteCode, &byteCodeSize) && byteCodeSize == 1);
+	}
+
+	void TestInvalid()
+	{
+		std::vector<uint8_t> bytes = ShaderArchive::Pack({ { "VertexShader.cso", { 1, 2, 3, 4 } } });
+		ShaderArchive archive;
+
+		// Cut off before the end of its byte code
+		CHECK(!archive.Open(bytes.data(), bytes.size() - 1));
+		CHECK(!archive.IsOpen());
+
+		bytes[0] = 0;
+		CHECK(!archive.Open(bytes.data(), bytes.size()));
+		CHECK(!archive.Open(0, 0));
+	}
+}
+
+int main()
+{
+	TestFind();
+	TestRepack();
+	TestInvalid();
+	return TEST_RESULT();
+}
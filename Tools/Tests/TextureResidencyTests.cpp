@@ -0,0 +1,238 @@
+#include "Check.h"
+#include "TextureResidency.h"
+
+#include <vector>
+
+// --------------------------------------------------------
+// Texture streaming policy: loads stay inside the budget,
+// the least recently used textures give up their unwanted
+// mips first, and textures move up and down the mip chain
+// as requests and the budget change
+// --------------------------------------------------------
+
+// Annonymous namespace to hold variables
+// only accessible in this file
+namespace
+{
+	// A 1024x1024 RGBA8 texture, whose tail starts at the 64x64 mip
+	StreamingTextureInfo Info()
+	{
+		StreamingTextureInfo info = {};
+		info.width = 1024;
+		info.height = 1024;
+		info.mipCount = 11;
+		for (unsigned int i = 0; i < info.mipCount; i++)
+			info.mipBytes[i] = (uint64_t)(1024 >> i) * (1024 >> i) * 4;
+		info.tailMip = TextureResidency::CalcTailMip(info.width, info.height, info.mipCount, 4);
+		return info;
+	}
+
+	// Bytes of everything from the given mip down
+	uint64_t BytesFrom(unsigned int mip)
+	{
+		StreamingTextureInfo info = Info();
+		uint64_t bytes = 0;
+		for (unsigned int i = mip; i < info.mipCount; i++)
+			bytes += info.mipBytes[i];
+		return bytes;
+	}
+
+	const unsigned int tail = 4;
+
+	bool IsAction(const StreamingAction& action, StreamingActionType type, unsigned int texture, unsigned int mip)
+	{
+		return action.type == type && action.texture == texture && action.mip == mip;
+	}
+
+	// Starts a frame, makes the given requests and runs Update
+	std::vector<StreamingAction> Frame(TextureResidency& residency, const std::vector<std::pair<unsigned int, unsigned int>>& requests)
+	{
+		std::vector<StreamingAction> actions;
+		residency.BeginFrame();
+		for (const std::pair<unsigned int, unsigned int>& request : requests)
+			residency.Request(request.first, request.second);
+		residency.Update(actions);
+		return actions;
+	}
+
+	void TestTail()
+	{
+		CHECK(Info().tailMip == tail);
+		CHECK(TextureResidency::CalcTailMip(1024, 256, 11, 4) == 4);
+		CHECK(TextureResidency::CalcTailMip(32, 32, 6, 4) == 0);
+
+		// Block compressed textures can't go below 4x4
+		CHECK(TextureResidency::CalcTailMip(1024, 8, 11, 4) == 1);
+
+		TextureResidency residency(0);
+		unsigned int texture = residency.AddTexture(Info());
+		CHECK(residency.GetResidentMip(texture) == tail);
+		CHECK(residency.GetResidentBytes() == BytesFrom(tail));
+
+		// The tail is never given up, even over budget
+		std::vector<StreamingAction> actions = Frame(residency, {});
+		CHECK(actions.empty());
+		CHECK(residency.GetResidentMip(texture) == tail);
+	}
+
+	void TestPromotion()
+	{
+		TextureResidency residency(BytesFrom(0) * 2);
+		unsigned int texture = residency.AddTexture(Info());
+
+		std::vector<StreamingAction> actions = Frame(residency, { { texture, 0 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Load, texture, 0));
+		CHECK(residency.IsLoading(texture));
+
+		// Counted against the budget as soon as it starts
+		CHECK(residency.GetResidentMip(texture) == 0);
+		CHECK(residency.GetResidentBytes() == BytesFrom(0));
+
+		// Not asked to load again while it's in flight
+		actions = Frame(residency, { { texture, 0 } });
+		CHECK(actions.empty());
+		residency.CompleteLoad(texture);
+		CHECK(!residency.IsLoading(texture));
+		CHECK(residency.GetResidentMip(texture) == 0);
+	}
+
+	void TestFailedLoad()
+	{
+		TextureResidency residency(BytesFrom(0));
+		unsigned int texture = residency.AddTexture(Info());
+		Frame(residency, { { texture, 1 } });
+		residency.CompleteLoad(texture, false);
+		CHECK(residency.GetResidentMip(texture) == tail);
+		CHECK(residency.GetResidentBytes() == BytesFrom(tail));
+
+		// And it's free to try again
+		std::vector<StreamingAction> actions = Frame(residency, { { texture, 1 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Load, texture, 1));
+	}
+
+	void TestBudget()
+	{
+		// Room for everything but the most detailed mip
+		TextureResidency residency(BytesFrom(1) + 1000);
+		unsigned int texture = residency.AddTexture(Info());
+
+		std::vector<StreamingAction> actions = Frame(residency, { { texture, 0 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Load, texture, 1));
+		CHECK(residency.GetResidentBytes() <= residency.GetBudget());
+		residency.CompleteLoad(texture);
+
+		// Once there's room, it gets the rest
+		residency.SetBudget(BytesFrom(0));
+		actions = Frame(residency, { { texture, 0 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Load, texture, 0));
+		CHECK(residency.GetResidentBytes() == residency.GetBudget());
+	}
+
+	void TestLoadLimit()
+	{
+		TextureResidency residency(BytesFrom(0) * 8);
+		for (unsigned int i = 0; i < 6; i++)
+			residency.AddTexture(Info());
+
+		// Most starved first, ties by index, STREAMING_MAX_LOADS at most
+		std::vector<StreamingAction> actions = Frame(residency, { { 0, 3 }, { 1, 3 }, { 2, 0 }, { 3, 0 }, { 4, 1 }, { 5, 0 } });
+		CHECK(actions.size() == STREAMING_MAX_LOADS);
+		const unsigned int expected[] = { 2, 3, 5, 4 };
+		for (unsigned int i = 0; i < actions.size() && i < 4; i++)
+			CHECK(actions[i].texture == expected[i]);
+	}
+
+	void TestLRUEviction()
+	{
+		// Two full textures and a tail
+		TextureResidency residency(BytesFrom(0) * 2 + BytesFrom(tail));
+		unsigned int a = residency.AddTexture(Info());
+		unsigned int b = residency.AddTexture(Info());
+		unsigned int c = residency.AddTexture(Info());
+
+		Frame(residency, { { a, 0 }, { c, 0 } });
+		residency.CompleteLoad(a);
+		residency.CompleteLoad(c);
+		CHECK(residency.GetResidentBytes() == residency.GetBudget());
+
+		// C is used a frame after A
+		Frame(residency, { { c, 0 } });
+
+		// B needs room: A, the least recently used, gives up only
+		// the mip that makes it, and C keeps everything
+		std::vector<StreamingAction> actions = Frame(residency, { { b, 1 } });
+		CHECK(actions.size() == 2);
+		if (actions.size() == 2)
+		{
+			CHECK(IsAction(actions[0], StreamingActionType::Evict, a, 1));
+			CHECK(IsAction(actions[1], StreamingActionType::Load, b, 1));
+		}
+		CHECK(residency.GetResidentMip(a) == 1);
+		CHECK(residency.GetResidentMip(c) == 0);
+		CHECK(residency.GetResidentBytes() <= residency.GetBudget());
+		residency.CompleteLoad(b);
+
+		// Mips requested this frame are never evicted: with B and C
+		// both in use, A can't get its top mip back
+		actions = Frame(residency, { { a, 0 }, { b, 1 }, { c, 0 } });
+		CHECK(actions.empty());
+		CHECK(residency.GetResidentMip(a) == 1);
+	}
+
+	void TestDemotion()
+	{
+		TextureResidency residency(BytesFrom(0));
+		unsigned int texture = residency.AddTexture(Info());
+		Frame(residency, { { texture, 0 } });
+		residency.CompleteLoad(texture);
+
+		// A lower budget takes away unrequested mips right away...
+		residency.SetBudget(BytesFrom(2));
+		std::vector<StreamingAction> actions = Frame(residency, { { texture, 2 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Evict, texture, 2));
+		CHECK(residency.GetResidentMip(texture) == 2);
+		CHECK(residency.GetResidentBytes() == BytesFrom(2));
+
+		// ...but not the ones still being asked for
+		residency.SetBudget(BytesFrom(tail));
+		actions = Frame(residency, { { texture, 2 } });
+		CHECK(actions.empty());
+		CHECK(residency.GetResidentMip(texture) == 2);
+
+		// Once they aren't, down to the tail
+		actions = Frame(residency, {});
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Evict, texture, tail));
+		CHECK(residency.GetResidentBytes() == BytesFrom(tail));
+
+		// And back up when there's room again
+		residency.SetBudget(BytesFrom(0));
+		actions = Frame(residency, { { texture, 0 } });
+		CHECK(actions.size() == 1 && IsAction(actions[0], StreamingActionType::Load, texture, 0));
+	}
+
+	void TestRequiredMip()
+	{
+		// One texel per pixel at a depth of 1, then half as many
+		// pixels each time the distance doubles
+		CHECK(TextureResidency::CalcRequiredMip(1024, 1024, 11, 1.0f, 1.0f, 1.0f, 1.0f, 1024.0f) == 0);
+		CHECK(TextureResidency::CalcRequiredMip(1024, 1024, 11, 1.0f, 1.0f, 1.0f, 2.0f, 1024.0f) == 1);
+		CHECK(TextureResidency::CalcRequiredMip(1024, 1024, 11, 1.0f, 1.0f, 1.0f, 8.0f, 1024.0f) == 3);
+		CHECK(TextureResidency::CalcRequiredMip(1024, 1024, 11, 1.0f, 1.0f, 1.0f, 1e6f, 1024.0f) == 10);
+
+		// Unknown density assumes the worst
+		CHECK(TextureResidency::CalcRequiredMip(1024, 1024, 11, 0.0f, 1.0f, 1.0f, 8.0f, 1024.0f) == 0);
+	}
+}
+
+int main()
+{
+	TestTail();
+	TestPromotion();
+	TestFailedLoad();
+	TestBudget();
+	TestLoadLimit();
+	TestLRUEviction();
+	TestDemotion();
+	TestRequiredMip();
+	return TEST_RESULT();
+}
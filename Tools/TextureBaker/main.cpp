@@ -0,0 +1,323 @@
+#include "TextureBaker.h"
+#include "JobSystem.h"
+
+#include <png.h>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Offline texture baker: turns PNG/JPEG source images into
+// BC7 (color) or BC5 (normal map) DDS files with full mip
+// chains.  The game picks up a .dds sitting next to a source
+// image in place of the original.
+//
+// Usage: TextureBaker [options] image...
+//   --normal / --albedo   Force the texture type (otherwise any
+//                         file with "normal" in its name is a
+//                         normal map)
+//   --srgb / --linear     Force the color space (otherwise read
+//                         from the PNG's sRGB/gAMA chunks)
+//   --threads N           Worker threads (default: all cores)
+//   -o path               Output file (single input only)
+// --------------------------------------------------------
+
+struct SourceImage
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	bool sRGB = false;
+	std::vector<uint8_t> rgba;
+};
+
+// Annonymous namespace for the image readers
+namespace
+{
+	struct PNGError
+	{
+		jmp_buf jump;
+	};
+
+	void OnPNGError(png_structp png, png_const_charp message)
+	{
+		fprintf(stderr, "  libpng: %s\n", message);
+		longjmp(((PNGError*)png_get_error_ptr(png))->jump, 1);
+	}
+
+	void OnPNGWarning(png_structp, png_const_charp) {}
+
+	bool LoadPNG(FILE* file, SourceImage& image)
+	{
+		PNGError error;
+		png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &error, OnPNGError, OnPNGWarning);
+		png_infop info = png_create_info_struct(png);
+		if (setjmp(error.jump))
+		{
+			png_destroy_read_struct(&png, &info, 0);
+			return false;
+		}
+
+		png_init_io(png, file);
+		png_read_info(png, info);
+
+		// Same rule as the WIC path in TextureLoader: an sRGB chunk,
+		// or a gamma of roughly 1/2.2, means the colors are sRGB
+		double gamma = 0.0;
+		image.sRGB = png_get_valid(png, info, PNG_INFO_sRGB) ||
+			(png_get_gAMA(png, info, &gamma) && fabs(gamma - 0.45455) < 0.0001);
+
+		// Expand everything to 8-bit RGBA
+		png_set_expand(png);
+		png_set_strip_16(png);
+		png_set_gray_to_rgb(png);
+		png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+		png_read_update_info(png, info);
+
+		image.width = png_get_image_width(png, info);
+		image.height = png_get_image_height(png, info);
+		image.rgba.resize((size_t)image.width * image.height * 4);
+
+		std::vector<png_bytep> rows(image.height);
+		for (unsigned int y = 0; y < image.height; y++)
+			rows[y] = &image.rgba[(size_t)y * image.width * 4];
+		png_read_image(png, rows.data());
+		png_read_end(png, 0);
+
+		png_destroy_read_struct(&png, &info, 0);
+		return true;
+	}
+
+	struct JPEGError
+	{
+		jpeg_error_mgr manager;
+		jmp_buf jump;
+	};
+
+	void OnJPEGError(j_common_ptr info)
+	{
+		char message[JMSG_LENGTH_MAX];
+		info->err->format_message(info, message);
+		fprintf(stderr, "  libjpeg: %s\n", message);
+		longjmp(((JPEGError*)info->err)->jump, 1);
+	}
+
+	bool LoadJPEG(FILE* file, SourceImage& image)
+	{
+		jpeg_decompress_struct info;
+		JPEGError error;
+		info.err = jpeg_std_error(&error.manager);
+		error.manager.error_exit = OnJPEGError;
+		if (setjmp(error.jump))
+		{
+			jpeg_destroy_decompress(&info);
+			return false;
+		}
+
+		jpeg_create_decompress(&info);
+		jpeg_stdio_src(&info, file);
+		jpeg_read_header(&info, TRUE);
+		info.out_color_space = JCS_RGB;
+		jpeg_start_decompress(&info);
+
+		image.width = info.output_width;
+		image.height = info.output_height;
+		image.sRGB = false;
+		image.rgba.resize((size_t)image.width * image.height * 4);
+
+		std::vector<uint8_t> row((size_t)image.width * 3);
+		while (info.output_scanline < info.output_height)
+		{
+			unsigned int y = info.output_scanline;
+			JSAMPROW rowPointer = row.data();
+			jpeg_read_scanlines(&info, &rowPointer, 1);
+			for (unsigned int x = 0; x < image.width; x++)
+			{
+				uint8_t* pixel = &image.rgba[((size_t)y * image.width + x) * 4];
+				memcpy(pixel, &row[x * 3], 3);
+				pixel[3] = 255;
+			}
+		}
+
+		jpeg_finish_decompress(&info);
+		jpeg_destroy_decompress(&info);
+		return true;
+	}
+
+	bool LoadImage(const std::string& path, SourceImage& image)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+
+		uint8_t signature[8] = {};
+		size_t read = fread(signature, 1, sizeof(signature), file);
+		rewind(file);
+
+		bool loaded = false;
+		if (read == 8 && png_sig_cmp(signature, 0, 8) == 0)
+			loaded = LoadPNG(file, image);
+		else if (read >= 2 && signature[0] == 0xFF && signature[1] == 0xD8)
+			loaded = LoadJPEG(file, image);
+		else
+			fprintf(stderr, "  not a PNG or JPEG file\n");
+
+		fclose(file);
+		return loaded;
+	}
+
+	std::string ReplaceExtension(const std::string& path, const std::string& extension)
+	{
+		size_t slash = path.find_last_of("/\\");
+		size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return path + extension;
+		return path.substr(0, dot) + extension;
+	}
+
+	bool LooksLikeNormalMap(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+		std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+		return name.find("normal") != std::string::npos;
+	}
+
+	// Peak signal to noise ratio of the top level after a round
+	// trip through the encoder, over the channels that are kept
+	double MeasurePSNR(const SourceImage& image, const uint8_t* blocks, BakeKind kind)
+	{
+		unsigned int blocksWide = (image.width + 3) / 4;
+		unsigned int channels = kind == BakeKind::Normal ? 2 : 4;
+		double squaredError = 0.0;
+
+		for (unsigned int y = 0; y < image.height; y++)
+		{
+			for (unsigned int x = 0; x < image.width; x++)
+			{
+				const uint8_t* block = blocks + ((size_t)(y / 4) * blocksWide + x / 4) * 16;
+				unsigned int index = (y % 4) * 4 + (x % 4);
+
+				uint8_t decoded[16][4] = {};
+				if (kind == BakeKind::Normal)
+				{
+					uint8_t rg[16][2];
+					TextureBaker::DecodeBC5Block(block, rg);
+					decoded[index][0] = rg[index][0];
+					decoded[index][1] = rg[index][1];
+				}
+				else
+				{
+					TextureBaker::DecodeBC7Block(block, decoded);
+				}
+
+				const uint8_t* source = &image.rgba[((size_t)y * image.width + x) * 4];
+				for (unsigned int c = 0; c < channels; c++)
+				{
+					double d = (double)decoded[index][c] - source[c];
+					squaredError += d * d;
+				}
+			}
+		}
+
+		double meanError = squaredError / ((double)image.width * image.height * channels);
+		return meanError == 0.0 ? INFINITY : 10.0 * log10(255.0 * 255.0 / meanError);
+	}
+
+	void PrintUsage()
+	{
+		printf("Usage: TextureBaker [--normal|--albedo] [--srgb|--linear] [--threads N] [-o out.dds] image...\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int forcedKind = -1;	// -1 = by name, otherwise a BakeKind
+	int forcedSRGB = -1;	// -1 = from the file
+	unsigned int threads = 0;
+	std::string output;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--normal") forcedKind = (int)BakeKind::Normal;
+		else if (arg == "--albedo") forcedKind = (int)BakeKind::Albedo;
+		else if (arg == "--srgb") forcedSRGB = 1;
+		else if (arg == "--linear") forcedSRGB = 0;
+		else if (arg == "--threads" && i + 1 < argc) threads = (unsigned int)atoi(argv[++i]);
+		else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+		else if (arg == "-h" || arg == "--help") { PrintUsage(); return 0; }
+		else if (!arg.empty() && arg[0] == '-') { fprintf(stderr, "Unknown option %s\n", arg.c_str()); PrintUsage(); return 1; }
+		else inputs.push_back(arg);
+	}
+
+	if (inputs.empty() || (!output.empty() && inputs.size() > 1))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// One worker fewer than requested, since the calling thread helps
+	// too (a single thread means no workers at all)
+	if (threads != 1)
+		JobSystem::Initialize(threads > 1 ? threads - 1 : 0);
+	printf("Baking with %u thread(s)\n", JobSystem::WorkerCount() + 1);
+
+	int failures = 0;
+	for (const std::string& input : inputs)
+	{
+		printf("%s\n", input.c_str());
+
+		SourceImage image;
+		if (!LoadImage(input, image))
+		{
+			fprintf(stderr, "  failed to load\n");
+			failures++;
+			continue;
+		}
+
+		BakeKind kind = forcedKind >= 0 ? (BakeKind)forcedKind : (LooksLikeNormalMap(input) ? BakeKind::Normal : BakeKind::Albedo);
+		bool sRGB = kind == BakeKind::Albedo && (forcedSRGB >= 0 ? forcedSRGB == 1 : image.sRGB);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<uint8_t> dds = TextureBaker::Bake(image.rgba.data(), image.width, image.height, kind, sRGB);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::string path = output.empty() ? ReplaceExtension(input, ".dds") : output;
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file || fwrite(dds.data(), 1, dds.size(), file) != dds.size())
+		{
+			fprintf(stderr, "  failed to write %s\n", path.c_str());
+			if (file) fclose(file);
+			failures++;
+			continue;
+		}
+		fclose(file);
+
+		// The top level starts right after the magic and both headers
+		const size_t headerSize = 4 + 124 + 20;
+		double psnr = MeasurePSNR(image, dds.data() + headerSize, kind);
+
+		unsigned int mipCount = 1 + (unsigned int)floor(log2((double)std::max(image.width, image.height)));
+		printf("  %ux%u %s%s, %u mips, %.1f ms, %.2f dB -> %s (%zu bytes)\n",
+			image.width, image.height,
+			kind == BakeKind::Normal ? "BC5" : "BC7",
+			sRGB ? " sRGB" : "",
+			mipCount,
+			std::chrono::duration<double, std::milli>(end - start).count(),
+			psnr,
+			path.c_str(),
+			dds.size());
+	}
+
+	JobSystem::ShutDown();
+	return failures == 0 ? 0 : 1;
+}
@@ -2,9 +2,6 @@
 
 #include <DirectXMath.h>
 
-#include <d3d11.h>
-#include <wrl/client.h>
-
 class Transform
 {
 private:
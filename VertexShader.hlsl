@@ -1,13 +1,34 @@
 #include "ShaderInclude.hlsli"
 
 
-cbuffer ExternalData : register(b0)
+// Only the start of the per-frame buffer is needed here
+cbuffer PerFrame : register(b0)
 {
-    matrix world;
     matrix view;
     matrix projection;
+    matrix viewProjection;
+}
+
+#ifdef USE_DRAW_TABLE
+// Per-object data for the whole frame, indexed by draw ID
+// - Must match DrawTableObject in DrawTable.h
+struct DrawTableObject
+{
+    matrix world;
     matrix worldInvTranspose;
+    uint materialIndex;
+    uint3 padding;
+};
+
+StructuredBuffer<DrawTableObject> ObjectTable : register(t0);
+#else
+cbuffer PerObject : register(b2)
+{
+    matrix world;
+    matrix worldInvTranspose;
+    uint drawID;
 }
+#endif
 
 
 // --------------------------------------------------------
@@ -17,8 +38,16 @@ cbuffer ExternalData : register(b0)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
 // --------------------------------------------------------
+#ifdef USE_DRAW_TABLE
+VertexToPixel main( VertexShaderInput input, uint drawID : DRAWID )
+{
+    DrawTableObject object = ObjectTable[drawID];
+    matrix world = object.world;
+    matrix worldInvTranspose = object.worldInvTranspose;
+#else
 VertexToPixel main( VertexShaderInput input )
 {
+#endif
 	// Set up output struct
 	VertexToPixel output;
 
@@ -31,9 +60,11 @@ VertexToPixel main( VertexShaderInput input )
 	//   which we're leaving at 1.0 for now (this is more useful when dealing with 
 	//   a perspective projection matrix, which we'll get to in the future).
 	
-	// Multiply the three matrices together first
-    matrix wvp = mul(projection, mul(view, world));
-    output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+	// View and projection are already combined once per frame
+	// - precise keeps this bit-identical to DepthPrepassVS.hlsl
+    precise float4 worldPosition = mul(world, float4(input.localPosition, 1.0f));
+    precise float4 screenPosition = mul(viewProjection, worldPosition);
+    output.screenPosition = screenPosition;
 
 	
 	output.uv = input.uv;
@@ -42,7 +73,14 @@ VertexToPixel main( VertexShaderInput input )
     output.normal = mul((float3x3) worldInvTranspose, input.normal); // Perfect!
     output.tangent = mul((float3x3) world, input.tangent);
 
-    output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
+    output.worldPosition = worldPosition.xyz;
+
+#ifdef USE_DRAW_TABLE
+    output.materialIndex = object.materialIndex;
+#else
+    output.materialIndex = 0;
+#endif
+    output.drawID = drawID;
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)